@@ -418,23 +418,17 @@ void vtDemoAppPlanets::onFrameRender(const int64_t /* currentTimeMs */, const do
 	}
 	pageResolver->endPageIdPass(); // Generate the page requests
 
-	// Get the current queue of new pages to be uploaded:
+	// Upload the new pages. Each texture only takes its own pages from
+	// the provider and is only updated if any new pages were loaded for it.
+	for (size_t p = 0; p < vt::arrayLength(planets); ++p)
 	{
-		vt::FulfilledPageRequestQueue readyQueue;
-		if (pageProvider->getReadyQueue(readyQueue) != 0)
-		{
-			// Only update the textures if any new pages were loaded.
-			for (size_t p = 0; p < vt::arrayLength(planets); ++p)
-			{
-				planets[p].virtualTex->frameUpdate(readyQueue);
-			}
-
-			#if PLANETS_DEMO_WITH_BACKGROUND_PLANE
-			backgroundPlaneTex->frameUpdate(readyQueue);
-			#endif // PLANETS_DEMO_WITH_BACKGROUND_PLANE
-		}
+		planets[p].virtualTex->frameUpdate();
 	}
 
+	#if PLANETS_DEMO_WITH_BACKGROUND_PLANE
+	backgroundPlaneTex->frameUpdate();
+	#endif // PLANETS_DEMO_WITH_BACKGROUND_PLANE
+
 	// ** TEXTURED RENDER PASS **
 	//
 	#if PLANETS_DEMO_WITH_BACKGROUND_PLANE
@@ -76,6 +76,7 @@ private:
 	void setShowPageInfo();
 	void setForceSync();
 	void purgeCaches();
+	void runSamplerBenchmark();
 
 private:
 
@@ -92,6 +93,9 @@ private:
 	Obj3d              * sphereModel  = nullptr;
 	Obj3d              * cubeModel    = nullptr;
 
+	// CPU-side sampler, created by the first benchmark run.
+	vt::PageSampler * pageSampler = nullptr;
+
 	// We use these pointers to be able to hot-swap
 	// between the "real" page file and the DebugPageFile.
 	vt::PageFilePtr vtTexSphereOldPageFile;
@@ -115,7 +119,7 @@ private:
 	vt::ui::Button           * texStatsButton     = nullptr;
 	vt::ui::Button           * debugOverlayButton = nullptr;
 	vt::ui::SwitchButton     * switchButtons      = nullptr;
-	static constexpr int       numSwitchButtons   = 6;
+	static constexpr int       numSwitchButtons   = 7;
 
 	// Misc flags:
 	bool showUserInterface   = true;
@@ -178,6 +182,7 @@ vtDemoAppSimple::vtDemoAppSimple()
 
 vtDemoAppSimple::~vtDemoAppSimple()
 {
+	delete pageSampler; // Before the textures it reads from.
 	delete[] switchButtons;
 	delete debugOverlayButton;
 	delete texStatsButton;
@@ -263,6 +268,7 @@ void vtDemoAppSimple::initDemoUI()
 		auto cb3 = [this](vt::ui::SwitchButton &, bool) { setShowPageInfo();  };
 		auto cb4 = [this](vt::ui::SwitchButton &, bool) { purgeCaches();      };
 		auto cb5 = [this](vt::ui::SwitchButton &, bool) { setForceSync();     };
+		auto cb6 = [this](vt::ui::SwitchButton &, bool) { runSamplerBenchmark(); };
 
 		struct {
 			const char * labelText;
@@ -274,7 +280,8 @@ void vtDemoAppSimple::initDemoUI()
 			{ "use debug page file" , cb2, useDebugPageFile         }, // toggle use of a DebugPageFile
 			{ "add debug to pages"  , cb3, addDebugInfoToPages      }, // add debug info the every loaded page
 			{ "purge vt caches"     , cb4, false                    }, // purge the VT cache once for each texture
-			{ "force sync operation", cb5, !pageProvider->isAsync() }  // use synchronous PageProvider and glFinish every frame
+			{ "force sync operation", cb5, !pageProvider->isAsync() }, // use synchronous PageProvider and glFinish every frame
+			{ "bench cpu sampler"   , cb6, false                    }  // run the PageSampler benchmark once, results go to the log
 		};
 
 		switchButtons = new vt::ui::SwitchButton[numSwitchButtons];
@@ -303,8 +310,13 @@ void vtDemoAppSimple::onFrameRender(const int64_t /* currentTimeMs */, const dou
 
 	// ** PAGE ID FEEDBACK PASS **
 	//
+	// The scene is static, so the camera alone tells if the visible pages can change.
+	// The pass is skipped while the camera is still and all visible pages are resident.
+	pageResolver->setViewSignature(vt::PageResolver::hashViewMatrix(toFloatPtr(viewProj)));
+
 	vt::renderBindPageIdPassShader();
 	pageResolver->beginPageIdPass(); // Set proper render states
+	if (!pageResolver->isPageIdPassSkipped())
 	{
 		// Render all geometry using vtTexCube:
 		vt::renderBindTextureForPageIdPass(*vtTexCube);
@@ -326,16 +338,10 @@ void vtDemoAppSimple::onFrameRender(const int64_t /* currentTimeMs */, const dou
 	}
 	pageResolver->endPageIdPass(); // Generate the page requests
 
-	// Get the current queue of new pages to be uploaded:
-	{
-		vt::FulfilledPageRequestQueue readyQueue;
-		if (pageProvider->getReadyQueue(readyQueue) != 0)
-		{
-			// Only update the textures if any new pages were loaded.
-			vtTexCube->frameUpdate(readyQueue);
-			vtTexSphere->frameUpdate(readyQueue);
-		}
-	}
+	// Upload the new pages. Each texture only takes its own pages from
+	// the provider and is only updated if any new pages were loaded for it.
+	vtTexCube->frameUpdate();
+	vtTexSphere->frameUpdate();
 
 	// ** TEXTURED RENDER PASS **
 	//
@@ -467,6 +473,44 @@ void vtDemoAppSimple::purgeCaches()
 	vtTexCube->purgeCache();
 }
 
+void vtDemoAppSimple::runSamplerBenchmark()
+{
+	// Random lookups on the sphere texture, in batches, as a gameplay
+	// system would do. The first pass starts with a cold CPU page cache
+	// and blocks for the loads, the second one is served from the cache.
+	if (pageSampler == nullptr)
+	{
+		pageSampler = new vt::PageSampler();
+	}
+	pageSampler->purgeCache();
+
+	constexpr int numSamples = 1 << 18;
+	constexpr int batchSize  = 256;
+	const int level = std::max(vtTexSphere->getNumLevels() - 3, 0);
+
+	std::vector<float> uvs(numSamples * 2);
+	std::vector<float> rgba(numSamples * 4);
+	for (float & uv : uvs)
+	{
+		uv = static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX);
+	}
+
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		pageSampler->resetStats();
+		for (int s = 0; s < numSamples; s += batchSize)
+		{
+			pageSampler->sample(*vtTexSphere, &uvs[s * 2], batchSize, level, &rgba[s * 4],
+					nullptr, 0, vt::PageSampler::MissPolicy::Block, 1000);
+		}
+
+		const vt::PageSampler::Stats stats = pageSampler->getStats();
+		vtLogComment("PageSampler benchmark (" << (pass == 0 ? "cold" : "warm") << " cache, level " << level << "): "
+				<< static_cast<uint64_t>(stats.samplesPerSecond) << " samples/s, " << stats.pageLoads << " page loads, "
+				<< stats.fallbackSamples << " fallback samples, " << stats.blockTimeouts << " timeouts.");
+	}
+}
+
 void vtDemoAppSimple::onAppEvent(const SDL_Event & event)
 {
 	switch (event.type)
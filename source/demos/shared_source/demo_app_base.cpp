@@ -208,6 +208,9 @@ void vtDemoAppBase::appFrame(const int64_t currentTimeMs, const double deltaTime
 
 	SDL_RenderPresent(instance->renderer);
 
+	// The SDL renderer might touch the GL state behind the VT library's back.
+	vt::gl::invalidateStateCache();
+
 	#if VT_EXTRA_GL_ERROR_CHECKING
 	vt::gl::checkGLErrors(__FILE__, __LINE__);
 	#endif // VT_EXTRA_GL_ERROR_CHECKING
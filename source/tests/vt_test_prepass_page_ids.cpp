@@ -0,0 +1,340 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: vt_test_prepass_page_ids.cpp
+// Author: Guilherme R. Lampert
+// Created on: 18/10/26
+// Brief: Headless software-GL test of the fused depth prepass page-id path.
+//
+// License:
+//  This source code is released under the MIT License.
+//  Copyright (c) 2014 Guilherme R. Lampert.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+// ================================================================================================
+
+//
+// Checks that page ids written by an application prepass and handed to
+// PageResolver::resolveExternalPageIds() (downsampled by the page_id_downsample
+// shader) produce the same page requests as the library's own page-id pass.
+//
+// Runs on Mesa's software rasterizer through a pbuffer EGL context, so no
+// window or GPU is needed. Linux only. Build from the 'source' directory with:
+//
+//   g++ -std=c++11 -O2 -Ivt_lib/include -Ivt_tools/include \
+//       tests/vt_test_prepass_page_ids.cpp vt_lib/source/*.cpp \
+//       $(ls vt_tools/source/*.cpp | grep -v vt_make.cpp) \
+//       -o vt_test_prepass_page_ids -lEGL -lGLESv2 -ldispatch -lpthread -lz
+//
+// libdispatch (GCD) is needed to link the library, but the PageProvider is run
+// synchronously. TargetConditionals.h is Apple only; an empty one on the include
+// path will do. Run with the shader directory as the argument, or from inside it:
+//
+//   EGL_PLATFORM=surfaceless ./vt_test_prepass_page_ids vt_lib/glsl
+//
+// Exits with zero on success.
+//
+
+#include "vt.hpp"
+#include "vt_tool_platform_utils.hpp"
+
+#include <EGL/egl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// ======================================================
+// Platform utils:
+// ======================================================
+
+// The tools' platform layer is Objective-C++. These are the bits the library
+// calls on the code paths exercised here.
+namespace vt
+{
+namespace tool
+{
+
+std::string getUserHomePath()
+{
+	const char * home = std::getenv("HOME");
+	return (home != nullptr) ? home : ".";
+}
+
+bool createDirectory(const char * /* basePath */, const char * /* directoryName */)
+{
+	return false;
+}
+
+int64_t getClockMillisec()
+{
+	using namespace std::chrono;
+	return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+unsigned int getFramesPerSecondCount()
+{
+	return 0;
+}
+
+void getScreenDimensionsInPixels(int & screenWidth, int & screenHeight)
+{
+	screenWidth  = 0;
+	screenHeight = 0;
+}
+
+} // namespace tool {}
+} // namespace vt {}
+
+namespace
+{
+
+// ======================================================
+// Test helpers:
+// ======================================================
+
+struct TestLogCallbacks final
+	: public vt::LogCallbacks
+{
+	void logComment(const std::string &) override { }
+	void logWarning(const std::string & message) override { std::printf("WARNING: %s\n", message.c_str()); }
+	void logError(const std::string & message)   override { std::printf("ERROR: %s\n",   message.c_str()); }
+};
+
+// 8x8 pages at level 0, down to a single page.
+const int vtNumLevels = 4;
+const int vtPagesX[vt::MaxVTMipLevels] = { 8, 4, 2, 1 };
+const int vtPagesY[vt::MaxVTMipLevels] = { 8, 4, 2, 1 };
+
+// Resolver feedback framebuffer size.
+const int feedbackSize = 64;
+
+// Log2 mip scale factor used by the library's own page-id pass.
+const float baseMipScaleFactor = 3.0f;
+
+// A full screen quad, mapping the whole texture:
+const float quadPositions[] = { -1.0f, -1.0f, 0.0f,  1.0f, -1.0f, 0.0f,  -1.0f, 1.0f, 0.0f,  1.0f, 1.0f, 0.0f };
+const float quadTexCoords[] = {  0.0f,  0.0f,        1.0f,  0.0f,         0.0f, 1.0f,         1.0f, 1.0f       };
+
+const char appPrepassVS[] =
+	"attribute vec3 a_position;\n"
+	"attribute vec2 a_tex_coords;\n"
+	"varying vec2 v_uv;\n"
+	"void main() { v_uv = a_tex_coords; gl_Position = vec4(a_position, 1.0); }\n";
+
+const char appPrepassFSMain[] =
+	"varying vec2 v_uv;\n"
+	"void main() { gl_FragColor = vtPageIdColor(v_uv); }\n";
+
+void drawQuad()
+{
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, quadPositions);
+	glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, 0, quadTexCoords);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(4);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	glDisableVertexAttribArray(0);
+	glDisableVertexAttribArray(4);
+}
+
+bool initHeadlessContext()
+{
+	EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+	{
+		std::printf("Failed to initialize EGL!\n");
+		return false;
+	}
+
+	const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE,    EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+		EGL_DEPTH_SIZE, 16,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0)
+	{
+		std::printf("No suitable EGL config!\n");
+		return false;
+	}
+
+	const EGLint surfaceAttribs[] = { EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE };
+	const EGLint contextAttribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+
+	eglBindAPI(EGL_OPENGL_ES_API);
+	EGLSurface surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+	if (surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT || !eglMakeCurrent(display, surface, surface, context))
+	{
+		std::printf("Failed to create the EGL context!\n");
+		return false;
+	}
+
+	std::printf("GL_RENDERER: %s\n", reinterpret_cast<const char *>(glGetString(GL_RENDERER)));
+	return true;
+}
+
+// Page ids requested by one frame of feedback. 'targetScale' is the size of
+// the application's page-id target relative to the feedback framebuffer.
+// Zero runs the library's page-id pass instead.
+std::vector<vt::PageId> collectPageRequests(const int targetScale, int & visiblePages)
+{
+	vt::PageProvider provider(/* async = */ false);
+	vt::PageResolver resolver(provider, feedbackSize, feedbackSize);
+	vt::VirtualTexture vtTex(vtPagesX, vtPagesY, vtNumLevels, vt::PageFilePtr(new vt::DebugPageFile(false)), nullptr);
+
+	resolver.registerVirtualTexture(&vtTex);
+	provider.registerVirtualTexture(&vtTex);
+
+	if (targetScale == 0)
+	{
+		vt::renderBindPageIdPassShader();
+		vt::renderBindTextureForPageIdPass(vtTex);
+		vt::renderSetLog2MipScaleFactor(baseMipScaleFactor);
+
+		const float identity[16] = { 1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1 };
+		vt::renderSetMvpMatrix(identity);
+
+		resolver.beginPageIdPass();
+		drawQuad();
+		resolver.endPageIdPass();
+	}
+	else
+	{
+		// Application prepass with its own RGBA8 page-id target, cleared to white.
+		const int targetSize = feedbackSize * targetScale;
+		GLuint targetTex = 0, targetFbo = 0;
+		glGenTextures(1, &targetTex);
+		glBindTexture(GL_TEXTURE_2D, targetTex);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, targetSize, targetSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glGenFramebuffers(1, &targetFbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, targetFbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, targetTex, 0);
+
+		const vt::gl::VertexAttrib attr0 = { "a_position"   , 0 };
+		const vt::gl::VertexAttrib attr1 = { "a_tex_coords" , 4 };
+		const vt::gl::VertexAttrib * vtxAttribs[] = { &attr0, &attr1, nullptr };
+		const std::string fs = vt::getPageIdGlslFuncs() + appPrepassFSMain;
+		GLuint programId = vt::gl::createShaderProgram(appPrepassVS, fs.c_str(), vtxAttribs);
+
+		// A target N times bigger has derivatives N times smaller,
+		// which the mip scale factor has to compensate for.
+		vt::gl::useShaderProgram(programId);
+		vt::renderBindTextureForPageIdOutput(vt::renderGetPageIdShaderUniforms(programId),
+				vtTex, baseMipScaleFactor - std::log2(static_cast<float>(targetScale)));
+
+		glViewport(0, 0, targetSize, targetSize);
+		glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+		drawQuad();
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		vt::gl::invalidateStateCache(); // Bindings changed behind the library's back.
+		resolver.resolveExternalPageIds(targetTex);
+
+		vt::gl::deleteShaderProgram(programId);
+		glDeleteFramebuffers(1, &targetFbo);
+		glDeleteTextures(1, &targetTex);
+	}
+
+	vt::gl::checkGLErrors(__FILE__, __LINE__);
+	visiblePages = resolver.getNumVisiblePages();
+
+	// The serial provider has already loaded every request.
+	vt::FulfilledPageRequestQueue readyQueue;
+	provider.getReadyQueue(vtTex.getTextureIndex(), readyQueue);
+
+	std::vector<vt::PageId> requests;
+	for (const vt::PageRequestDataPacket & packet : readyQueue)
+	{
+		requests.push_back(packet.pageId);
+	}
+	std::sort(requests.begin(), requests.end());
+
+	provider.unregisterVirtualTexture(&vtTex);
+	resolver.unregisterVirtualTexture(&vtTex);
+	return requests;
+}
+
+} // namespace {}
+
+// ======================================================
+// main():
+// ======================================================
+
+int main(int argc, char * argv[])
+{
+	// Shaders are loaded from the current directory.
+	if (argc > 1 && chdir(argv[1]) != 0)
+	{
+		std::printf("Can't change to shader directory \"%s\"!\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	if (!initHeadlessContext())
+	{
+		return EXIT_FAILURE;
+	}
+
+	TestLogCallbacks logCallbacks;
+	int failures = 0;
+
+	try
+	{
+		vt::libraryInit(vt::IndirectionTableFormat::Rgba8888, &logCallbacks);
+
+		int expectedVisible = 0;
+		const std::vector<vt::PageId> expected = collectPageRequests(0, expectedVisible);
+		std::printf("Page-id pass: %d visible pages, %d requests.\n", expectedVisible, static_cast<int>(expected.size()));
+
+		if (expected.empty())
+		{
+			std::printf("FAIL: the page-id pass requested no pages.\n");
+			++failures;
+		}
+
+		// Same size target (1:1 copy) and a 4x bigger target (point sampled decimation).
+		for (const int targetScale : { 1, 4 })
+		{
+			int visible = 0;
+			const std::vector<vt::PageId> requests = collectPageRequests(targetScale, visible);
+			const bool match = (requests == expected) && (visible == expectedVisible);
+
+			std::printf("%s: external %dx target: %d visible pages, %d requests.\n",
+					(match ? "PASS" : "FAIL"), targetScale, visible, static_cast<int>(requests.size()));
+			failures += match ? 0 : 1;
+		}
+
+		vt::libraryShutdown();
+	}
+	catch (const vt::Exception & e)
+	{
+		std::printf("FAIL: %s\n", e.what());
+		++failures;
+	}
+
+	return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,363 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: vt_test_reduced_layer.cpp
+// Author: Guilherme R. Lampert
+// Created on: 18/10/26
+// Brief: Checks the page mapping and read sharing of ReducedLayerPageFile.
+//
+// License:
+//  This source code is released under the MIT License.
+//  Copyright (c) 2014 Guilherme R. Lampert.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+// ================================================================================================
+
+//
+// Wraps a stub PageFile that counts its loads in a ReducedLayerPageFile and checks that:
+//
+// - getReducedPageId() maps base pages to the reduced page covering the same area,
+//   for mip offsets 1 to 4, including the base levels past 'baseLevels - mipOffset',
+//   which all fall on the coarsest reduced level.
+// - Sibling base pages requested together from several threads cause exactly one
+//   read of their reduced page, and all get its pixels.
+// - When that read fails, the siblings waiting on it read the page again instead
+//   of copying the failed one.
+//
+// Build from the 'source' directory with:
+//
+//   g++ -std=c++11 -O2 -Ivt_lib/include -Ivt_tools/include
+//       tests/vt_test_reduced_layer.cpp vt_lib/source/*.cpp
+//       $(ls vt_tools/source/*.cpp | grep -v vt_make.cpp)
+//       -o vt_test_reduced_layer -lGLESv2 -ldispatch -lpthread -lz
+//
+// libdispatch (GCD) and GLES are only needed to link the library; no GL context
+// is created. TargetConditionals.h is Apple only; an empty one on the include
+// path will do.
+//
+// Exits with zero on success.
+//
+
+#include "vt.hpp"
+#include "vt_tool_platform_utils.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// ======================================================
+// Platform utils:
+// ======================================================
+
+// The tools' platform layer is Objective-C++. Only needed to link the library.
+namespace vt
+{
+namespace tool
+{
+
+bool createDirectory(const char * /* basePath */, const char * /* directoryName */)
+{
+	return false;
+}
+
+int64_t getClockMillisec()
+{
+	using namespace std::chrono;
+	return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+unsigned int getFramesPerSecondCount()
+{
+	return 0;
+}
+
+} // namespace tool {}
+} // namespace vt {}
+
+namespace
+{
+
+using vt::PageId;
+using vt::PageFile;
+using vt::PageRequestDataPacket;
+using vt::ReducedLayerPageFile;
+
+// ======================================================
+// Test helpers:
+// ======================================================
+
+int numFailures = 0;
+
+void fail(const char * testName, const char * what)
+{
+	std::printf("FAIL: %s: %s\n", testName, what);
+	++numFailures;
+}
+
+// Every pixel of a stub page holds its page id.
+vt::Pixel4b pagePixel(const PageId pageId)
+{
+	vt::Pixel4b pixel;
+	pixel.r = static_cast<uint8_t>(pageId);
+	pixel.g = static_cast<uint8_t>(pageId >> 8);
+	pixel.b = static_cast<uint8_t>(pageId >> 16);
+	pixel.a = static_cast<uint8_t>(pageId >> 24);
+	return pixel;
+}
+
+bool hasPagePixels(const PageRequestDataPacket & request, const PageId pageId)
+{
+	const vt::Pixel4b expected = pagePixel(pageId);
+	for (int p = 0; p < PageRequestDataPacket::TotalPagePixels; ++p)
+	{
+		if (std::memcmp(&request.pageData[p], &expected, sizeof(expected)) != 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Stands in for the reduced file. Reads take 'readTime' and the first 'failReads' fail.
+class CountingPageFile final
+	: public PageFile
+{
+public:
+
+	std::atomic<int> numLoads{ 0 };
+	std::atomic<int> failReads{ 0 };
+	std::chrono::milliseconds readTime{ 0 };
+
+	bool loadPage(const PageId pageId, PageRequestDataPacket & pageRequest) override
+	{
+		++numLoads;
+		std::this_thread::sleep_for(readTime);
+
+		if (failReads.fetch_sub(1) > 0)
+		{
+			std::memset(pageRequest.pageData, 0, sizeof(pageRequest.pageData));
+			return false;
+		}
+
+		const vt::Pixel4b pixel = pagePixel(pageId);
+		for (int p = 0; p < PageRequestDataPacket::TotalPagePixels; ++p)
+		{
+			pageRequest.pageData[p] = pixel;
+		}
+		return true;
+	}
+
+	void setAddDebugInfoToPages(bool) override { }
+	bool isAddingDebugInfoToPages() const override { return false; }
+};
+
+struct SiblingResults
+{
+	int numFailedLoads = 0;
+	int numBadPages    = 0;
+};
+
+// Loads all base pages of level 0 that share reduced page (0, 0), one per thread, started together.
+SiblingResults loadSiblingsConcurrently(ReducedLayerPageFile & file, const PageId expectedReducedId)
+{
+	const int pagesPerAxis = 1 << file.getMipOffset();
+	const int numThreads   = pagesPerAxis * pagesPerAxis;
+
+	std::atomic<int> numStarted{ 0 };
+	std::atomic<int> numFailedLoads{ 0 };
+	std::atomic<int> numBadPages{ 0 };
+	std::vector<std::thread> threads;
+
+	for (int t = 0; t < numThreads; ++t)
+	{
+		threads.emplace_back([&, t]
+		{
+			std::unique_ptr<PageRequestDataPacket> request(new PageRequestDataPacket);
+			const PageId pageId = vt::makePageId(t % pagesPerAxis, t / pagesPerAxis, 0, 1);
+			request->pageId = pageId;
+			request->fileId = 1;
+
+			++numStarted;
+			while (numStarted.load() < numThreads)
+			{
+				std::this_thread::yield();
+			}
+
+			if (!file.loadPage(pageId, *request))
+			{
+				++numFailedLoads;
+			}
+			else if (!hasPagePixels(*request, expectedReducedId))
+			{
+				++numBadPages;
+			}
+		});
+	}
+	for (auto & thread : threads)
+	{
+		thread.join();
+	}
+
+	SiblingResults results;
+	results.numFailedLoads = numFailedLoads.load();
+	results.numBadPages    = numBadPages.load();
+	return results;
+}
+
+// ======================================================
+// Tests:
+// ======================================================
+
+void testReducedPageIds()
+{
+	const char * testName = "reduced page ids";
+	int numBadIds = 0;
+
+	// Includes base files with fewer levels than the offset, reduced to a single page.
+	for (const int baseLevels : { 2, 3, 6, 9 })
+	{
+		for (int offset = 1; offset <= ReducedLayerPageFile::MaxMipOffset; ++offset)
+		{
+			const ReducedLayerPageFile file(vt::PageFilePtr(new CountingPageFile), offset, baseLevels);
+			const int reducedLevels = std::max(baseLevels - offset, 1);
+
+			for (int level = 0; level < baseLevels; ++level)
+			{
+				const int basePages = 1 << (baseLevels - 1 - level);
+				for (int y = 0; y < basePages; ++y)
+				{
+					for (int x = 0; x < basePages; ++x)
+					{
+						// The reduced page with the same base level 0 position. A page of reduced
+						// level 'r' spans 2^(r + offset) level 0 base pages per axis.
+						const int r = std::min(level, reducedLevels - 1);
+						const int reducedPages = std::max((1 << (baseLevels - 1)) >> (r + offset), 1);
+						const int rx = (x << level) >> (r + offset);
+						const int ry = (y << level) >> (r + offset);
+
+						const PageId reducedId = file.getReducedPageId(vt::makePageId(x, y, level, 7));
+						if (reducedId != vt::makePageId(rx, ry, r, 7) || rx >= reducedPages || ry >= reducedPages)
+						{
+							if (numBadIds++ == 0)
+							{
+								std::printf("Base levels %d, offset %d: page (%d, %d, %d) mapped to (%d, %d, %d).\n",
+								            baseLevels, offset, x, y, level, vt::pageIdExtractPageX(reducedId),
+								            vt::pageIdExtractPageY(reducedId), vt::pageIdExtractMipLevel(reducedId));
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	if (numBadIds != 0)
+	{
+		fail(testName, "base pages mapped to the wrong reduced page");
+	}
+}
+
+void testSiblingsShareOneRead()
+{
+	const char * testName = "siblings share one read";
+
+	for (int offset = 1; offset <= ReducedLayerPageFile::MaxMipOffset; ++offset)
+	{
+		CountingPageFile * stub = new CountingPageFile;
+		stub->readTime = std::chrono::milliseconds(50);
+		ReducedLayerPageFile file(vt::PageFilePtr(stub), offset, 9);
+
+		const PageId reducedId = vt::makePageId(0, 0, 0, 1);
+		const SiblingResults results = loadSiblingsConcurrently(file, reducedId);
+
+		if (stub->numLoads != 1)
+		{
+			std::printf("Offset %d: %d reads of the reduced page.\n", offset, stub->numLoads.load());
+			fail(testName, "expected exactly one reduced read");
+		}
+		if (results.numFailedLoads != 0 || results.numBadPages != 0)
+		{
+			fail(testName, "a sibling didn't get the reduced page");
+		}
+
+		// Cached now. A page from the next reduced page over is another read.
+		std::unique_ptr<PageRequestDataPacket> request(new PageRequestDataPacket);
+		const int pagesPerAxis = 1 << offset;
+		if (!file.loadPage(vt::makePageId(pagesPerAxis - 1, 0, 0, 1), *request) || stub->numLoads != 1 ||
+		    !file.loadPage(vt::makePageId(pagesPerAxis, 0, 0, 1), *request) || stub->numLoads != 2 ||
+		    !hasPagePixels(*request, vt::makePageId(1, 0, 0, 1)))
+		{
+			fail(testName, "cached or neighbouring reduced page not served right");
+		}
+	}
+}
+
+void testFailedReadIsRetried()
+{
+	const char * testName = "failed read retried";
+
+	CountingPageFile * stub = new CountingPageFile;
+	stub->readTime  = std::chrono::milliseconds(50);
+	stub->failReads = 1;
+	ReducedLayerPageFile file(vt::PageFilePtr(stub), 2, 9);
+
+	// The thread that made the failed read reports it. One of the waiting
+	// siblings reads the page again and the rest get its pixels.
+	const SiblingResults results = loadSiblingsConcurrently(file, vt::makePageId(0, 0, 0, 1));
+
+	if (results.numFailedLoads != 1)
+	{
+		fail(testName, "expected a single failed load");
+	}
+	if (results.numBadPages != 0)
+	{
+		fail(testName, "a sibling copied the failed page");
+	}
+	if (stub->numLoads != 2)
+	{
+		std::printf("%d reads of the reduced page.\n", stub->numLoads.load());
+		fail(testName, "expected the failed read and one retry");
+	}
+}
+
+} // namespace {}
+
+int main()
+{
+	try
+	{
+		testReducedPageIds();
+		testSiblingsShareOneRead();
+		testFailedReadIsRetried();
+	}
+	catch (const std::exception & e)
+	{
+		std::printf("FAIL: %s\n", e.what());
+		++numFailures;
+	}
+
+	std::printf("%d failures.\n", numFailures);
+	return (numFailures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
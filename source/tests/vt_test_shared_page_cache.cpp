@@ -0,0 +1,473 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: vt_test_shared_page_cache.cpp
+// Author: Guilherme R. Lampert
+// Created on: 18/10/26
+// Brief: Runs several processes against one SharedPageCache segment.
+//
+// License:
+//  This source code is released under the MIT License.
+//  Copyright (c) 2014 Guilherme R. Lampert.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+// ================================================================================================
+
+//
+// Forks worker processes that attach to a private SharedPageCache segment by
+// name and look up the same pages, as separate applications on a host would.
+// Pages are filled with a pattern derived from their key, so a worker can tell
+// a torn or misplaced page from the one it asked for. Checks that:
+//
+// - Without eviction pressure, each page is published once per host and all
+//   the other lookups are hits, whatever the texture slot index in the page id.
+// - With far more pages than slots, every hit still returns intact bytes.
+// - A cancel() after a failed load lets a process waiting on that page
+//   reserve it and load it itself, instead of waiting for the timeout.
+//
+// POSIX only. Build from the 'source' directory with:
+//
+//   g++ -std=c++11 -O2 -Ivt_lib/include -Ivt_tools/include
+//       tests/vt_test_shared_page_cache.cpp vt_lib/source/vt_shared_page_cache.cpp
+//       -o vt_test_shared_page_cache -lpthread -lrt
+//
+// TargetConditionals.h is Apple only; an empty one on the include path will do.
+// The segment is removed at the end, and also before each test in case a failed
+// run left one behind.
+//
+// Exits with zero on success.
+//
+
+#include "vt.hpp"
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ======================================================
+// Library stubs:
+// ======================================================
+
+// The logging and GL error check used by vtFatalError() live with the
+// renderer in vt_common.cpp and vt_opengl.cpp. The cache needs neither.
+namespace vt
+{
+
+struct TestLogCallbacks final
+	: public LogCallbacks
+{
+	void logComment(const std::string & message) override { std::printf("%s\n", message.c_str()); }
+	void logWarning(const std::string & message) override { std::printf("%s\n", message.c_str()); }
+	void logError(const std::string & message)   override { std::fprintf(stderr, "%s\n", message.c_str()); }
+};
+
+LogCallbacks & getLogCallbacks() noexcept
+{
+	static TestLogCallbacks callbacks;
+	return callbacks;
+}
+
+namespace gl
+{
+void checkGLErrors(const char *, int) { }
+} // namespace gl {}
+
+} // namespace vt {}
+
+namespace
+{
+
+using vt::Pixel4b;
+using vt::PageId;
+using vt::SharedPageCache;
+
+// ======================================================
+// Test helpers:
+// ======================================================
+
+constexpr int NumWorkers = 4;
+constexpr int PagePixels = vt::PageRequestDataPacket::TotalPagePixels;
+
+int numFailures = 0;
+
+void fail(const char * testName, const char * what)
+{
+	std::printf("FAIL: %s: %s\n", testName, what);
+	++numFailures;
+}
+
+// Per process, so concurrent runs of the test don't share a segment.
+std::string makeSegmentName()
+{
+	return "/vt_test_spc_" + std::to_string(static_cast<long>(getpid()));
+}
+
+// Page contents derived from the cache key. The texture slot index is not part of it.
+void fillPage(const uint64_t fileKey, const PageId pageId, Pixel4b * pixels)
+{
+	uint32_t state = static_cast<uint32_t>(fileKey ^ (fileKey >> 32)) * 2654435761u;
+	state ^= static_cast<uint32_t>(vt::makePageId(vt::pageIdExtractPageX(pageId), vt::pageIdExtractPageY(pageId),
+	                                              vt::pageIdExtractMipLevel(pageId), 0));
+	for (int p = 0; p < PagePixels; ++p)
+	{
+		state = state * 1664525u + 1013904223u;
+		pixels[p].r = static_cast<uint8_t>(state >> 24);
+		pixels[p].g = static_cast<uint8_t>(state >> 16);
+		pixels[p].b = static_cast<uint8_t>(state >> 8);
+		pixels[p].a = static_cast<uint8_t>(state);
+	}
+}
+
+bool checkPage(const uint64_t fileKey, const PageId pageId, const Pixel4b * pixels)
+{
+	std::vector<Pixel4b> expected(PagePixels);
+	fillPage(fileKey, pageId, expected.data());
+	return std::memcmp(expected.data(), pixels, PagePixels * sizeof(Pixel4b)) == 0;
+}
+
+// Runs 'work' in NumWorkers child processes and waits for them.
+// True if all of them returned true.
+bool runWorkers(const std::function<bool(int)> & work)
+{
+	std::fflush(stdout); // Or the children print it again.
+
+	std::vector<pid_t> children;
+	for (int w = 0; w < NumWorkers; ++w)
+	{
+		const pid_t pid = fork();
+		if (pid == 0)
+		{
+			bool ok = false;
+			try
+			{
+				ok = work(w);
+			}
+			catch (const std::exception & e)
+			{
+				std::printf("Worker %d: %s\n", w, e.what());
+			}
+			std::fflush(stdout);
+			_exit(ok ? EXIT_SUCCESS : EXIT_FAILURE); // No atexit handlers or parent destructors.
+		}
+		if (pid < 0)
+		{
+			std::perror("fork");
+			break;
+		}
+		children.push_back(pid);
+	}
+
+	bool allOk = (children.size() == NumWorkers);
+	for (const pid_t pid : children)
+	{
+		int status = 0;
+		allOk &= (waitpid(pid, &status, 0) == pid) && WIFEXITED(status) && (WEXITSTATUS(status) == EXIT_SUCCESS);
+	}
+	return allOk;
+}
+
+// One lookup as the PageProvider does it: a miss loads and publishes the page.
+// False if a hit returned the wrong bytes.
+bool lookupPage(SharedPageCache & cache, const uint64_t fileKey, const PageId pageId, Pixel4b * pixels)
+{
+	SharedPageCache::Reservation reservation;
+	switch (cache.lookupOrReserve(fileKey, pageId, pixels, reservation))
+	{
+	case SharedPageCache::LookupResult::Hit :
+		return checkPage(fileKey, pageId, pixels);
+
+	case SharedPageCache::LookupResult::Reserved :
+		fillPage(fileKey, pageId, pixels);
+		std::this_thread::sleep_for(std::chrono::microseconds(100)); // "Read" time, so others get to wait.
+		cache.publish(reservation, pixels);
+		return true;
+
+	default : // Uncached
+		fillPage(fileKey, pageId, pixels);
+		return true;
+	}
+}
+
+// ======================================================
+// Tests:
+// ======================================================
+
+const uint64_t fileKeys[] = { 0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full };
+
+void testPublishedOnce(const std::string & segmentName)
+{
+	const char * testName = "publish once";
+
+	// 64 pages in 128 sets of 8 ways: no set overflows, so nothing is evicted.
+	const int pagesPerAxis = 4;
+	const int numPages     = 2 * pagesPerAxis * pagesPerAxis * 2;
+	const int numPasses    = 3;
+
+	SharedPageCache::removeSegment(segmentName);
+	SharedPageCache cache(segmentName, /* numSlots = */ 1024, /* loadWaitMs = */ 2000);
+
+	const bool workersOk = runWorkers([&](const int worker) -> bool
+	{
+		SharedPageCache workerCache(segmentName);
+		std::vector<Pixel4b> pixels(PagePixels);
+
+		std::vector<PageId> pages;
+		for (const uint64_t key : fileKeys)
+		{
+			(void)key;
+			for (int level = 0; level < 2; ++level)
+			{
+				for (int y = 0; y < pagesPerAxis; ++y)
+				{
+					for (int x = 0; x < pagesPerAxis; ++x)
+					{
+						// Each process uses its own texture slot index for the same pages.
+						pages.push_back(vt::makePageId(x, y, level, worker + 1));
+					}
+				}
+			}
+		}
+
+		std::mt19937 randomGen(worker);
+		bool ok = true;
+		for (int pass = 0; pass < numPasses; ++pass)
+		{
+			std::vector<int> order(pages.size());
+			for (size_t i = 0; i < order.size(); ++i)
+			{
+				order[i] = static_cast<int>(i);
+			}
+			std::shuffle(order.begin(), order.end(), randomGen);
+
+			for (const int i : order)
+			{
+				const uint64_t fileKey = fileKeys[i / (pages.size() / 2)];
+				ok &= lookupPage(workerCache, fileKey, pages[i], pixels.data());
+			}
+		}
+		return ok;
+	});
+
+	if (!workersOk)
+	{
+		fail(testName, "a worker got a bad page or failed");
+	}
+
+	const SharedPageCache::Stats stats = cache.getStats();
+	if (stats.publishes != static_cast<uint64_t>(numPages) || stats.readySlots != numPages)
+	{
+		fail(testName, "pages were not published exactly once");
+	}
+	if (stats.evictions != 0 || stats.waitTimeouts != 0 || stats.staleReclaims != 0)
+	{
+		fail(testName, "unexpected evictions, timeouts or reclaims");
+	}
+	if (stats.hits + stats.misses != static_cast<uint64_t>(NumWorkers * numPasses * numPages) ||
+	    stats.misses != static_cast<uint64_t>(numPages))
+	{
+		fail(testName, "lookups other than the first for each page were not hits");
+	}
+
+	// The creator sees the pages the workers published, under yet another slot index.
+	std::vector<Pixel4b> pixels(PagePixels);
+	SharedPageCache::Reservation reservation;
+	if (cache.lookupOrReserve(fileKeys[1], vt::makePageId(3, 2, 1, 0), pixels.data(), reservation) != SharedPageCache::LookupResult::Hit ||
+	    !checkPage(fileKeys[1], vt::makePageId(3, 2, 1, 0), pixels.data()))
+	{
+		fail(testName, "published page not visible to the creator");
+	}
+
+	std::printf("%s: %llu hits, %llu misses, %llu waits, %llu publishes.\n", testName,
+	            static_cast<unsigned long long>(stats.hits), static_cast<unsigned long long>(stats.misses),
+	            static_cast<unsigned long long>(stats.loadWaits), static_cast<unsigned long long>(stats.publishes));
+}
+
+void testEvictionPressure(const std::string & segmentName)
+{
+	const char * testName = "eviction pressure";
+
+	// 512 pages over 64 slots, so slots are recycled while other processes read them.
+	const int pagesPerAxis = 16;
+	const int numLookups   = 3000;
+
+	SharedPageCache::removeSegment(segmentName);
+	SharedPageCache cache(segmentName, /* numSlots = */ 64, /* loadWaitMs = */ 2000);
+
+	const bool workersOk = runWorkers([&](const int worker) -> bool
+	{
+		SharedPageCache workerCache(segmentName);
+		std::vector<Pixel4b> pixels(PagePixels);
+
+		// Skewed towards a few hot pages, so there are hits as well as evictions.
+		std::mt19937 randomGen(100 + worker);
+		std::geometric_distribution<int> pageDist(0.01);
+		std::uniform_int_distribution<int> keyDist(0, 1);
+
+		bool ok = true;
+		for (int i = 0; i < numLookups; ++i)
+		{
+			const int page = pageDist(randomGen) % (pagesPerAxis * pagesPerAxis);
+			const PageId pageId = vt::makePageId(page % pagesPerAxis, page / pagesPerAxis, 0, worker);
+			ok &= lookupPage(workerCache, fileKeys[keyDist(randomGen)], pageId, pixels.data());
+		}
+		return ok;
+	});
+
+	if (!workersOk)
+	{
+		fail(testName, "a worker got a bad page or failed");
+	}
+
+	const SharedPageCache::Stats stats = cache.getStats();
+	if (stats.evictions == 0 || stats.hits == 0)
+	{
+		fail(testName, "expected both hits and evictions");
+	}
+	if (stats.readySlots > stats.numSlots || stats.hits + stats.misses != static_cast<uint64_t>(NumWorkers * numLookups))
+	{
+		fail(testName, "inconsistent stats");
+	}
+
+	std::printf("%s: %llu hits, %llu misses, %llu evictions.\n", testName,
+	            static_cast<unsigned long long>(stats.hits), static_cast<unsigned long long>(stats.misses),
+	            static_cast<unsigned long long>(stats.evictions));
+}
+
+void testCancelAfterFailedLoad(const std::string & segmentName)
+{
+	const char * testName = "cancel";
+
+	const int loadWaitMs = 3000;
+	const uint64_t fileKey = fileKeys[0];
+	const PageId pageId = vt::makePageId(5, 7, 0, 0);
+
+	SharedPageCache::removeSegment(segmentName);
+	SharedPageCache cache(segmentName, /* numSlots = */ 64, loadWaitMs);
+
+	// This process starts loading the page...
+	std::vector<Pixel4b> pixels(PagePixels);
+	SharedPageCache::Reservation reservation;
+	if (cache.lookupOrReserve(fileKey, pageId, pixels.data(), reservation) != SharedPageCache::LookupResult::Reserved)
+	{
+		fail(testName, "first lookup didn't reserve the page");
+		return;
+	}
+
+	// ...while another one waits for it.
+	std::fflush(stdout);
+	const pid_t pid = fork();
+	if (pid == 0)
+	{
+		bool ok = false;
+		try
+		{
+			SharedPageCache workerCache(segmentName);
+			std::vector<Pixel4b> workerPixels(PagePixels);
+			SharedPageCache::Reservation workerReservation;
+
+			const auto start = std::chrono::steady_clock::now();
+			const SharedPageCache::LookupResult result =
+				workerCache.lookupOrReserve(fileKey, pageId, workerPixels.data(), workerReservation);
+			const auto waitMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+			// Reserved well before the timeout, which would have returned Uncached.
+			ok = (result == SharedPageCache::LookupResult::Reserved) && (waitMs < loadWaitMs / 2);
+			if (ok)
+			{
+				fillPage(fileKey, pageId, workerPixels.data());
+				workerCache.publish(workerReservation, workerPixels.data());
+			}
+		}
+		catch (const std::exception & e)
+		{
+			std::printf("Worker: %s\n", e.what());
+		}
+		std::fflush(stdout);
+		_exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	if (pid < 0)
+	{
+		std::perror("fork");
+		cache.cancel(reservation);
+		fail(testName, "fork failed");
+		return;
+	}
+
+	// The load fails once the other process is waiting.
+	for (int i = 0; i < 1000 && cache.getStats().loadWaits == 0; ++i)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	cache.cancel(reservation);
+
+	int status = 0;
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+	{
+		fail(testName, "the waiting process didn't get to reserve the page");
+	}
+
+	// The page it loaded is the one in the cache now.
+	if (cache.lookupOrReserve(fileKey, pageId, pixels.data(), reservation) != SharedPageCache::LookupResult::Hit ||
+	    !checkPage(fileKey, pageId, pixels.data()))
+	{
+		fail(testName, "page not published after the retry");
+	}
+
+	const SharedPageCache::Stats stats = cache.getStats();
+	if (stats.loadWaits != 1 || stats.waitTimeouts != 0 || stats.staleReclaims != 0 || stats.publishes != 1)
+	{
+		fail(testName, "unexpected stats");
+	}
+}
+
+} // namespace {}
+
+int main()
+{
+	const std::string segmentName = makeSegmentName();
+
+	try
+	{
+		testPublishedOnce(segmentName);
+		testEvictionPressure(segmentName);
+		testCancelAfterFailedLoad(segmentName);
+	}
+	catch (const std::exception & e)
+	{
+		std::printf("FAIL: %s\n", e.what());
+		++numFailures;
+	}
+
+	SharedPageCache::removeSegment(segmentName);
+
+	std::printf("%d failures.\n", numFailures);
+	return (numFailures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -3,9 +3,11 @@
 
 precision mediump float;
 
-// xy = vertex position, zx = texture coordinates.
-attribute vec4 a_vertex_position_tex_coord;
+// Packed vertex: float position, normalized 16bit
+// tex coords and normalized 8bit color.
+attribute vec2 a_vertex_position;
 attribute vec4 a_vertex_color;
+attribute vec2 a_vertex_tex_coords;
 
 // Output tex coordinates and color:
 varying vec2 v_tex_coords;
@@ -20,7 +22,7 @@ uniform mat4 u_mvp_matrix;
 
 void main()
 {
-	gl_Position  = u_mvp_matrix * vec4(a_vertex_position_tex_coord.xy, 0.0, 1.0);
-	v_tex_coords = a_vertex_position_tex_coord.zw;
+	gl_Position  = u_mvp_matrix * vec4(a_vertex_position, 0.0, 1.0);
+	v_tex_coords = a_vertex_tex_coords;
 	v_color      = a_vertex_color;
 }
@@ -12,10 +12,13 @@
 // - VT_HAS_DERIVATIVES is defined if GL_OES_standard_derivatives is available.
 
 // ======================================================
-// virtualToPhysicalTranslation():
+// virtualPageLookup():
 // ======================================================
 
-vec3 virtualToPhysicalTranslation(in sampler2D indirection_table_samp, in vec2 virt_coords, in float mip_sample_bias)
+// Returns the physical page mapped at 'virt_coords': xy is the origin of its content
+// area in the page table texture and z the number of pages across its mip level.
+// z is zero if nothing is mapped there.
+vec4 virtualPageLookup(in sampler2D indirection_table_samp, in vec2 virt_coords, in float mip_sample_bias)
 {
 	//
 	// RGB-5:6:5 page indirection table lookup.
@@ -30,34 +33,68 @@ vec3 virtualToPhysicalTranslation(in sampler2D indirection_table_samp, in vec2 v
 	const float c_float_to_mip        = 255.0 / 256.0 * 64.0;
 
 	// Derived constants:
-	const float c_page_frac_scale = (c_page_width - 2.0 * c_page_border) / c_page_width / c_phys_pages_wide;
-	const float c_border_offset   = (c_page_border / c_page_width / c_phys_pages_wide);
-	const vec4  c_tex_scale       = vec4(c_float_to_pages_wide, c_float_to_mip, c_float_to_pages_wide, 0.0);
+	const float c_border_offset = (c_page_border / c_page_width / c_phys_pages_wide);
+	const vec4  c_tex_scale     = vec4(c_float_to_pages_wide, c_float_to_mip, c_float_to_pages_wide, 0.0);
 
 	// Small value added to the exponent so we can floor the inaccurate exp2() result.
 	const vec4 c_tex_bias = vec4(0.0, (1.0 / 4096.0), 0.0, 0.0);
 
 	// Address lookup and translation:
 	vec4 phys_page = texture2D(indirection_table_samp, virt_coords, mip_sample_bias) * c_tex_scale + c_tex_bias;
-	phys_page.y = exp2(phys_page.y);
+
+	// Empty entries have an out-of-range mip field. Clamp it so exp2() stays finite.
+	bool empty_entry = (phys_page.y > 32.0);
+	phys_page.y = exp2(min(phys_page.y, 16.0));
 	phys_page   = floor(phys_page); // Account for inaccurate exp2() and strip replicated bits.
 
-	vec2 pag_frac = fract(virt_coords * phys_page.y);
+	return vec4(phys_page.xz / c_phys_pages_wide + c_border_offset, (empty_entry ? 0.0 : phys_page.y), 0.0);
+}
+
+// ======================================================
+// virtualPageTranslation():
+// ======================================================
+
+// Physical page coordinates (xy) and derivative scale (z) of 'virt_coords' inside the page
+// returned by virtualPageLookup(). 'layer_scale' is 1/2^offset for a layer stored at a mip
+// offset. Such a layer's page holds the coarser page that contains this one, so it spans
+// fewer pages across, but never fewer than one.
+vec3 virtualPageTranslation(in vec4 phys_page, in vec2 virt_coords, in float layer_scale)
+{
+	const float c_page_frac_scale = (c_page_width - 2.0 * c_page_border) / c_page_width / c_phys_pages_wide;
+
+	float page_scale = max(phys_page.z * layer_scale, 1.0);
+	vec2  page_frac  = fract(virt_coords * page_scale);
 
 	vec3 result;
-	result.xy = pag_frac * c_page_frac_scale + phys_page.xz / c_phys_pages_wide + c_border_offset;
+	result.xy = page_frac * c_page_frac_scale + phys_page.xy;
 
 	// The derivative scale is set to zero if
 	// we can't use it on texture2DGradEXT().
 #if defined(VT_HAS_TEX_GRAD) && defined(VT_HAS_DERIVATIVES)
-	result.z = c_page_frac_scale * phys_page.y;
+	result.z = c_page_frac_scale * page_scale;
 #else // !VT_HAS_TEX_GRAD && !VT_HAS_DERIVATIVES
 	result.z = 0.0;
 #endif // VT_HAS_TEX_GRAD && VT_HAS_DERIVATIVES
 
+	// Empty entries have a zero scale. Flag them for the mip tail fallback.
+	if (phys_page.z < 0.5)
+	{
+		result.z = -1.0;
+	}
+
 	return result;
 }
 
+// ======================================================
+// virtualToPhysicalTranslation():
+// ======================================================
+
+vec3 virtualToPhysicalTranslation(in sampler2D indirection_table_samp, in vec2 virt_coords, in float mip_sample_bias)
+{
+	vec4 phys_page = virtualPageLookup(indirection_table_samp, virt_coords, mip_sample_bias);
+	return virtualPageTranslation(phys_page, virt_coords, 1.0);
+}
+
 // ======================================================
 // virtualTexture2D():
 // ======================================================
@@ -72,3 +109,17 @@ vec4 virtualTexture2D(in sampler2D page_table_samp, in vec2 virt_coords, in vec3
 	return texture2D(page_table_samp, phys_coords.xy);
 #endif // VT_HAS_TEX_GRAD && VT_HAS_DERIVATIVES
 }
+
+// ======================================================
+// virtualTexture2D() with mip tail fallback:
+// ======================================================
+
+// Same as above, but falls back to the always-resident mip tail texture where the
+// indirection table has no page mapped (phys_coords.z is negative in that case).
+// Both are sampled and then selected, so no derivatives are taken inside a branch.
+vec4 virtualTexture2D(in sampler2D page_table_samp, in sampler2D mip_tail_samp, in vec2 virt_coords, in vec3 phys_coords)
+{
+	vec4 page_sample = virtualTexture2D(page_table_samp, virt_coords, phys_coords);
+	vec4 tail_sample = texture2D(mip_tail_samp, virt_coords);
+	return (phys_coords.z < 0.0) ? tail_sample : page_sample;
+}
@@ -12,10 +12,13 @@
 // - VT_HAS_DERIVATIVES is defined if GL_OES_standard_derivatives is available.
 
 // ======================================================
-// virtualToPhysicalTranslation():
+// virtualPageLookup():
 // ======================================================
 
-vec3 virtualToPhysicalTranslation(in sampler2D indirection_table_samp, in vec2 virt_coords, in float mip_sample_bias)
+// Returns the physical page mapped at 'virt_coords': xy is the origin of its content
+// area in the page table texture and z the number of pages across its mip level.
+// z is zero if nothing is mapped there.
+vec4 virtualPageLookup(in sampler2D indirection_table_samp, in vec2 virt_coords, in float mip_sample_bias)
 {
 	//
 	// RGBA-8:8:8:8 page indirection table lookup.
@@ -24,9 +27,8 @@ vec3 virtualToPhysicalTranslation(in sampler2D indirection_table_samp, in vec2 v
 	// J.M.P. van Waveren in his 2012 paper "Software Virtual Textures"
 	//
 
-	const float c_float_to_byte   = 255.0;
-	const float c_page_frac_scale = (c_page_width - 2.0 * c_page_border) / c_page_width / c_phys_pages_wide;
-	const float c_border_offset   = (c_page_border / c_page_width / c_phys_pages_wide);
+	const float c_float_to_byte = 255.0;
+	const float c_border_offset = (c_page_border / c_page_width / c_phys_pages_wide);
 
 	const vec4 c_tex_bias  = vec4(c_border_offset, c_border_offset, 0.0, 0.0);
 	const vec4 c_tex_scale = vec4(
@@ -36,7 +38,23 @@ vec3 virtualToPhysicalTranslation(in sampler2D indirection_table_samp, in vec2 v
 		(c_float_to_byte * 256.0 / 16.0));
 
 	vec4 phys_page = texture2D(indirection_table_samp, virt_coords, mip_sample_bias) * c_tex_scale + c_tex_bias;
-	vec2 page_frac = fract(virt_coords * (phys_page.z + phys_page.w));
+	return vec4(phys_page.xy, phys_page.z + phys_page.w, 0.0);
+}
+
+// ======================================================
+// virtualPageTranslation():
+// ======================================================
+
+// Physical page coordinates (xy) and derivative scale (z) of 'virt_coords' inside the page
+// returned by virtualPageLookup(). 'layer_scale' is 1/2^offset for a layer stored at a mip
+// offset. Such a layer's page holds the coarser page that contains this one, so it spans
+// fewer pages across, but never fewer than one.
+vec3 virtualPageTranslation(in vec4 phys_page, in vec2 virt_coords, in float layer_scale)
+{
+	const float c_page_frac_scale = (c_page_width - 2.0 * c_page_border) / c_page_width / c_phys_pages_wide;
+
+	float page_scale = max(phys_page.z * layer_scale, 1.0);
+	vec2  page_frac  = fract(virt_coords * page_scale);
 
 	vec3 result;
 	result.xy = page_frac * c_page_frac_scale + phys_page.xy;
@@ -44,14 +62,30 @@ vec3 virtualToPhysicalTranslation(in sampler2D indirection_table_samp, in vec2 v
 	// The derivative scale is set to zero if
 	// we can't use it on texture2DGradEXT().
 #if defined(VT_HAS_TEX_GRAD) && defined(VT_HAS_DERIVATIVES)
-	result.z = c_page_frac_scale * (phys_page.z + phys_page.w);
+	result.z = c_page_frac_scale * page_scale;
 #else // !VT_HAS_TEX_GRAD && !VT_HAS_DERIVATIVES
 	result.z = 0.0;
 #endif // VT_HAS_TEX_GRAD && VT_HAS_DERIVATIVES
 
+	// Empty entries have a zero scale. Flag them for the mip tail fallback.
+	if (phys_page.z < 0.5)
+	{
+		result.z = -1.0;
+	}
+
 	return result;
 }
 
+// ======================================================
+// virtualToPhysicalTranslation():
+// ======================================================
+
+vec3 virtualToPhysicalTranslation(in sampler2D indirection_table_samp, in vec2 virt_coords, in float mip_sample_bias)
+{
+	vec4 phys_page = virtualPageLookup(indirection_table_samp, virt_coords, mip_sample_bias);
+	return virtualPageTranslation(phys_page, virt_coords, 1.0);
+}
+
 // ======================================================
 // virtualTexture2D():
 // ======================================================
@@ -66,3 +100,17 @@ vec4 virtualTexture2D(in sampler2D page_table_samp, in vec2 virt_coords, in vec3
 	return texture2D(page_table_samp, phys_coords.xy);
 #endif // VT_HAS_TEX_GRAD && VT_HAS_DERIVATIVES
 }
+
+// ======================================================
+// virtualTexture2D() with mip tail fallback:
+// ======================================================
+
+// Same as above, but falls back to the always-resident mip tail texture where the
+// indirection table has no page mapped (phys_coords.z is negative in that case).
+// Both are sampled and then selected, so no derivatives are taken inside a branch.
+vec4 virtualTexture2D(in sampler2D page_table_samp, in sampler2D mip_tail_samp, in vec2 virt_coords, in vec3 phys_coords)
+{
+	vec4 page_sample = virtualTexture2D(page_table_samp, virt_coords, phys_coords);
+	vec4 tail_sample = texture2D(mip_tail_samp, virt_coords);
+	return (phys_coords.z < 0.0) ? tail_sample : page_sample;
+}
@@ -0,0 +1,19 @@
+
+// ======================================================
+
+precision mediump float;
+
+uniform sampler2D u_texture_samp; // tmu:0
+
+varying vec2 v_tex_coords;
+
+// ======================================================
+// main():
+// ======================================================
+
+void main()
+{
+	// Page ids can't be filtered, so this is a point sampled
+	// decimation of the application's full resolution page-id target.
+	gl_FragColor = texture2D(u_texture_samp, v_tex_coords);
+}
@@ -0,0 +1,20 @@
+
+// ======================================================
+
+precision mediump float;
+
+attribute vec2 a_vertex_position_ndc;
+
+varying vec2 v_tex_coords;
+
+// ======================================================
+// main():
+// ======================================================
+
+void main()
+{
+	// Full screen quadrilateral.
+	const vec2 scale = vec2(0.5, 0.5);
+	v_tex_coords = a_vertex_position_ndc * scale + scale; // scale vertex attribute to [0,1] range
+	gl_Position  = vec4(a_vertex_position_ndc, 0.0, 1.0);
+}
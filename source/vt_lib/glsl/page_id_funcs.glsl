@@ -0,0 +1,139 @@
+
+// ======================================================
+
+// **** Page id output ****
+
+// Shared by the library's page-id pass and by application shaders
+// that write page ids as an extra render target of their own prepass.
+// Retrieve with vt::getPageIdGlslFuncs(), which prepends the required
+// extension directives and the default precision.
+//
+// Output vtPageIdColor(uv) to the page-id target. The target must be
+// RGBA8 and cleared to white (1,1,1,1), which is an invalid page id.
+// Uniforms are set with vt::renderBindTextureForPageIdOutput().
+//
+// NOTE: Currently GL_OES_standard_derivatives is mandatory!
+
+// Compact 16-bit page numbers need highp. The PageResolver
+// only enables compact feedback if highp is supported.
+#ifdef GL_FRAGMENT_PRECISION_HIGH
+	#define VT_PAGE_NUMBER_PRECISION highp
+#else
+	#define VT_PAGE_NUMBER_PRECISION mediump
+#endif
+
+// Virtual Texture params:
+uniform float u_log2_mip_scale_factor;
+
+#ifdef VT_BATCHED_PAGE_IDS
+	// Per-instance params, passed down by page_id_gen_pass_batched.vert.
+	// Constant over an instance, but interpolation might still add some error, so round them.
+	varying VT_PAGE_NUMBER_PRECISION vec4 v_vt_params0; // max mip level, VT index, page base, unused
+	varying VT_PAGE_NUMBER_PRECISION vec4 v_vt_params1; // size in pixels (xy), size in pages (zw)
+	#define VT_PAGE_BASE      floor(v_vt_params0.z  + 0.5)
+	#define VT_MAX_MIP_LEVEL  floor(v_vt_params0.x  + 0.5)
+	#define VT_INDEX          floor(v_vt_params0.y  + 0.5)
+	#define VT_SIZE_PIXELS    floor(v_vt_params1.xy + 0.5)
+	#define VT_SIZE_PAGES     floor(v_vt_params1.zw + 0.5)
+	#define VT_UV_SCALE       vec2(1.0) // Already applied by the vertex shader.
+#else // !VT_BATCHED_PAGE_IDS
+	uniform VT_PAGE_NUMBER_PRECISION float u_vt_page_base; // Compact feedback if >= 0.
+	uniform float u_vt_max_mip_level;
+	uniform float u_vt_index;
+	uniform vec2  u_vt_size_pixels;
+	uniform vec2  u_vt_size_pages;
+	uniform vec2  u_vt_uv_scale; // Less than one if the image only partially fills the last pages.
+	#define VT_PAGE_BASE      u_vt_page_base
+	#define VT_MAX_MIP_LEVEL  u_vt_max_mip_level
+	#define VT_INDEX          u_vt_index
+	#define VT_SIZE_PIXELS    u_vt_size_pixels
+	#define VT_SIZE_PAGES     u_vt_size_pages
+	#define VT_UV_SCALE       u_vt_uv_scale
+#endif // VT_BATCHED_PAGE_IDS
+
+// ======================================================
+// computeMipLevel():
+// ======================================================
+
+float computeMipLevel(in vec2 uv)
+{
+	vec2 coord_pixels = uv * VT_SIZE_PIXELS;
+
+	vec2 x_deriv = dFdx(coord_pixels);
+	vec2 y_deriv = dFdy(coord_pixels);
+
+	float d = max(dot(x_deriv, x_deriv), dot(y_deriv, y_deriv));
+	float m = max((0.5 * log2(d)) - u_log2_mip_scale_factor, 0.0);
+
+	return floor(min(m, VT_MAX_MIP_LEVEL));
+}
+
+// ======================================================
+// compactPageIdColor():
+// ======================================================
+
+vec4 compactPageIdColor(in float mip_level, in vec2 page_coords)
+{
+	// Linear page number: this texture's base in the resolver's page
+	// number space, plus all pages of the finer levels, plus the page
+	// index within its level. Must match PageResolver's decoding.
+	VT_PAGE_NUMBER_PRECISION float page_number = VT_PAGE_BASE;
+	VT_PAGE_NUMBER_PRECISION vec2  level_pages;
+
+	for (int l = 0; l < 16; ++l)
+	{
+		if (float(l) >= mip_level)
+		{
+			break;
+		}
+		level_pages  = max(floor(VT_SIZE_PAGES / exp2(float(l))), 1.0);
+		page_number += level_pages.x * level_pages.y;
+	}
+
+	// Out of range coords (e.g. repeating UVs) would alias other pages, so clamp them:
+	level_pages  = max(floor(VT_SIZE_PAGES / exp2(mip_level)), 1.0);
+	VT_PAGE_NUMBER_PRECISION vec2 coords = clamp(page_coords, vec2(0.0), level_pages - 1.0);
+	page_number += coords.y * level_pages.x + coords.x;
+
+	// Low byte in R, high byte in G:
+	VT_PAGE_NUMBER_PRECISION float hi = floor(page_number / 256.0);
+	VT_PAGE_NUMBER_PRECISION float lo = page_number - (hi * 256.0);
+	return vec4(lo, hi, 0.0, 0.0) / 255.0;
+}
+
+// ======================================================
+// vtAtlasRemap():
+// ======================================================
+
+// Maps the [0,1] UVs of one texture of an atlas built by 'vtmake --atlas'
+// to UVs of the virtual texture. 'scale_bias' is the texture's entry of the
+// VTAT table, from vt::AtlasRemapTable::getScaleBias(). Apply it to the UVs
+// passed to vtPageIdColor() and to the ones used to sample the texture.
+vec2 vtAtlasRemap(in vec2 uv, in vec4 scale_bias)
+{
+	return uv * scale_bias.xy + scale_bias.zw;
+}
+
+// ======================================================
+// vtPageIdColor():
+// ======================================================
+
+vec4 vtPageIdColor(in vec2 tex_coords)
+{
+	// Map the image into the pages it covers. The edges of the image
+	// are repeated into the rest of partially filled pages.
+	vec2 uv = tex_coords * VT_UV_SCALE;
+
+	// Compute mip-level and virtual page coords:
+	float mip_level   = computeMipLevel(uv);
+	vec2  page_coords = floor(uv * VT_SIZE_PAGES / exp2(mip_level));
+
+	if (VT_PAGE_BASE >= 0.0)
+	{
+		return compactPageIdColor(mip_level, page_coords);
+	}
+
+	// Convert to [0,255] RGBA color:
+	vec4 page_id = vec4(page_coords, mip_level, VT_INDEX);
+	return page_id / 255.0;
+}
@@ -0,0 +1,35 @@
+
+// ======================================================
+
+precision mediump float;
+
+// Max instances per batch. Must match vt::MaxRenderBatchInstances.
+#define MAX_INSTANCES 16
+
+attribute mediump vec3 a_position;
+attribute mediump vec2 a_tex_coords;
+attribute mediump float a_instance_index;
+
+// Per-instance params. Three vectors per instance in u_vt_params:
+// [max mip level, VT index, page base, unused], [size in pixels (xy), size in pages (zw)],
+// [UV scale (xy), unused, unused]. The UV scale is applied here, to the texture coordinates.
+uniform mediump mat4 u_mvp_matrices[MAX_INSTANCES];
+uniform highp   vec4 u_vt_params[MAX_INSTANCES * 3];
+
+varying mediump vec2 v_tex_coords;
+varying highp   vec4 v_vt_params0;
+varying highp   vec4 v_vt_params1;
+
+// ======================================================
+// main():
+// ======================================================
+
+void main()
+{
+	int instance = int(a_instance_index);
+
+	gl_Position  = u_mvp_matrices[instance] * vec4(a_position, 1.0);
+	v_tex_coords = a_tex_coords * u_vt_params[instance * 3 + 2].xy;
+	v_vt_params0 = u_vt_params[instance * 3];
+	v_vt_params1 = u_vt_params[instance * 3 + 1];
+}
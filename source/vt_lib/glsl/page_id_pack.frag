@@ -0,0 +1,29 @@
+
+// ======================================================
+
+#ifdef GL_FRAGMENT_PRECISION_HIGH
+	precision highp float;
+#else
+	precision mediump float;
+#endif
+
+uniform sampler2D u_texture_samp; // tmu:0
+uniform vec2 u_src_size;          // Size in pixels of the compact feedback target.
+
+// ======================================================
+// main():
+// ======================================================
+
+void main()
+{
+	// Compact feedback only uses the RG bytes of each pixel, so two
+	// horizontally adjacent pixels are packed into a single RGBA output,
+	// halving the size of the feedback read-back.
+	float src_x = floor(gl_FragCoord.x) * 2.0 + 0.5;
+	float src_v = gl_FragCoord.y / u_src_size.y;
+
+	vec2 a = texture2D(u_texture_samp, vec2(src_x / u_src_size.x, src_v)).rg;
+	vec2 b = texture2D(u_texture_samp, vec2((src_x + 1.0) / u_src_size.x, src_v)).rg;
+
+	gl_FragColor = vec4(a, b);
+}
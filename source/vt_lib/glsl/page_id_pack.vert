@@ -0,0 +1,16 @@
+
+// ======================================================
+
+precision mediump float;
+
+attribute vec2 a_vertex_position_ndc;
+
+// ======================================================
+// main():
+// ======================================================
+
+void main()
+{
+	// Full screen quadrilateral. The fragment shader only uses gl_FragCoord.
+	gl_Position = vec4(a_vertex_position_ndc, 0.0, 1.0);
+}
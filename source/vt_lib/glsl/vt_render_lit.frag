@@ -7,6 +7,10 @@ uniform sampler2D u_indirection_table_samp; // tmu:0
 uniform sampler2D u_diffuse_samp;           // tmu:1
 uniform sampler2D u_normal_samp;            // tmu:2
 uniform sampler2D u_specular_samp;          // tmu:3
+uniform sampler2D u_diffuse_tail_samp;      // tmu:4
+uniform sampler2D u_normal_tail_samp;       // tmu:5
+uniform sampler2D u_specular_tail_samp;     // tmu:6
+uniform vec3      u_vt_layer_scale;         // 1/2^offset of each reduced layer.
 
 // Inputs from previous stage:
 varying vec3 v_view_dir_tangent_space;  // Tangent-space view direction.
@@ -63,12 +67,17 @@ void main()
 {
 	// Lookup the indirection texture and convert a virtual texture address
 	// to an address suitable for sampling a physical page table/cache texture.
-	vec3 phys_coords = virtualToPhysicalTranslation(u_indirection_table_samp, v_tex_coords, u_mip_sample_bias);
+	// All layers share the physical page. Layers stored at a mip offset address it with their own scale.
+	vec4 phys_page = virtualPageLookup(u_indirection_table_samp, v_tex_coords, u_mip_sample_bias);
+	vec3 diffuse_coords  = virtualPageTranslation(phys_page, v_tex_coords, u_vt_layer_scale.x);
+	vec3 normal_coords   = virtualPageTranslation(phys_page, v_tex_coords, u_vt_layer_scale.y);
+	vec3 specular_coords = virtualPageTranslation(phys_page, v_tex_coords, u_vt_layer_scale.z);
 
 	// Now we can use the physical coordinates to sample as many textures as we need.
-	vec4 diffuseMap  = virtualTexture2D(u_diffuse_samp,  v_tex_coords, phys_coords);
-	vec4 normalMap   = virtualTexture2D(u_normal_samp,   v_tex_coords, phys_coords);
-	vec4 specularMap = virtualTexture2D(u_specular_samp, v_tex_coords, phys_coords);
+	// The mip tails fill in where no page is resident yet.
+	vec4 diffuseMap  = virtualTexture2D(u_diffuse_samp,  u_diffuse_tail_samp,  v_tex_coords, diffuse_coords);
+	vec4 normalMap   = virtualTexture2D(u_normal_samp,   u_normal_tail_samp,   v_tex_coords, normal_coords);
+	vec4 specularMap = virtualTexture2D(u_specular_samp, u_specular_tail_samp, v_tex_coords, specular_coords);
 
 	// Point light attenuation and contribution:
 	float d = length(v_position_object_space - v_light_pos_object_space);
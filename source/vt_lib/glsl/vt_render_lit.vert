@@ -14,6 +14,7 @@ attribute vec2 a_tex_coords;
 uniform vec4 u_light_pos_object_space;
 uniform vec4 u_view_pos_object_space;
 uniform mat4 u_mvp_matrix;
+uniform vec2 u_vt_uv_scale; // Maps the image into the pages, see VirtualTexture::getUVScale().
 
 // Stage outputs:
 varying vec3 v_view_dir_tangent_space;  // Tangent-space view direction.
@@ -47,7 +48,7 @@ void main()
 	// Pass vertex-position & light-position in object space (as is):
 	v_position_object_space  = a_position;
 	v_light_pos_object_space = u_light_pos_object_space.xyz;
-	v_tex_coords             = a_tex_coords;
+	v_tex_coords             = a_tex_coords * u_vt_uv_scale;
 
 	// Transform position to clip-space for GL:
 	gl_Position = vec4(u_mvp_matrix * vec4(a_position, 1.0));
@@ -10,6 +10,7 @@
 uniform float     u_mip_sample_bias;
 uniform sampler2D u_page_table_samp;        // tmu:0
 uniform sampler2D u_indirection_table_samp; // tmu:1
+uniform sampler2D u_mip_tail_samp;          // tmu:2
 
 // Vertex Shader outputs:
 varying mediump vec2 v_tex_coords;
@@ -28,5 +29,6 @@ void main()
 	// as long as they all have the same dimensions. In this demo, we only
 	// sample a diffuse texture. In a more complex scenario, phys_coords would
 	// index the diffuse, normal, specular, whatnot maps, translating the virtual coords only once.
-	gl_FragColor = virtualTexture2D(u_page_table_samp, v_tex_coords, phys_coords);
+	// Where no page is resident yet, the mip tail is sampled instead.
+	gl_FragColor = virtualTexture2D(u_page_table_samp, u_mip_tail_samp, v_tex_coords, phys_coords);
 }
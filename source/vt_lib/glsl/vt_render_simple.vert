@@ -7,6 +7,7 @@ attribute mediump vec3 a_position;
 attribute mediump vec2 a_tex_coords;
 
 uniform mediump mat4 u_mvp_matrix;
+uniform mediump vec2 u_vt_uv_scale; // Maps the image into the pages, see VirtualTexture::getUVScale().
 varying mediump vec2 v_tex_coords;
 
 // ======================================================
@@ -16,5 +17,5 @@ varying mediump vec2 v_tex_coords;
 void main()
 {
 	gl_Position  = u_mvp_matrix * vec4(a_position, 1.0);
-	v_tex_coords = a_tex_coords;
+	v_tex_coords = a_tex_coords * u_vt_uv_scale;
 }
@@ -0,0 +1,25 @@
+
+// ======================================================
+
+precision mediump float;
+
+// Max instances per batch. Must match vt::MaxRenderBatchInstances.
+#define MAX_INSTANCES 16
+
+attribute mediump vec3 a_position;
+attribute mediump vec2 a_tex_coords;
+attribute mediump float a_instance_index;
+
+uniform mediump mat4 u_mvp_matrices[MAX_INSTANCES];
+uniform mediump vec2 u_vt_uv_scale; // Same for all instances, since they share the texture.
+varying mediump vec2 v_tex_coords;
+
+// ======================================================
+// main():
+// ======================================================
+
+void main()
+{
+	gl_Position  = u_mvp_matrices[int(a_instance_index)] * vec4(a_position, 1.0);
+	v_tex_coords = a_tex_coords * u_vt_uv_scale;
+}
@@ -44,11 +44,14 @@
 // Other auxiliary components:
 #include "vt_page_file.hpp"
 #include "vt_page_provider.hpp"
+#include "vt_shared_page_cache.hpp"
+#include "vt_page_overlay.hpp"
 #include "vt_page_resolver.hpp"
 #include "vt_page_cache_mgr.hpp"
 
 // The texture interface:
 #include "vt_virtual_texture.hpp"
+#include "vt_page_sampler.hpp"
 
 namespace vt
 {
@@ -84,6 +87,51 @@ enum class IndirectionTableFormat
 	Rgba8888
 };
 
+// ======================================================
+// Memory footprint accounting:
+// ======================================================
+
+// Bytes used by the library, per subsystem.
+// System memory sizes are taken from the allocated storage of each component.
+// GPU sizes are estimates derived from texture dimensions and formats,
+// since GL doesn't report the actual storage used by the driver.
+struct MemoryStats
+{
+	// System memory:
+	size_t cachePageTrees;       // PageCacheMgr entry arrays + CachePageTree pointer pools.
+	size_t pageFileIndexes;      // VTFFPageTree page info pools.
+	size_t indirectionTables;    // CPU copies of the indirection tables (tableEntryPool).
+	size_t feedbackBuffers;      // PageResolver read-back buffer, page map and sort vector.
+	size_t readyQueues;          // Fulfilled page requests waiting in the PageProvider.
+
+	// Estimated GPU memory:
+	size_t indirectionTablesGpu; // Indirection textures, all levels.
+	size_t pageTablesGpu;        // Page table textures, all layers.
+	size_t mipTailsGpu;          // Always-resident mip tail textures.
+	size_t feedbackFboGpu;       // Page-id pass framebuffer.
+
+	size_t getTotalSystemBytes() const
+	{
+		return cachePageTrees + pageFileIndexes + indirectionTables + feedbackBuffers + readyQueues;
+	}
+
+	size_t getTotalGpuBytes() const
+	{
+		return indirectionTablesGpu + pageTablesGpu + mipTailsGpu + feedbackFboGpu;
+	}
+};
+
+// Gathers the memory used by the provider, the resolver and every texture registered with
+// the provider. Indirection tables shared by more than one texture are only counted once.
+// Each call also updates the high-water marks returned by getPeakMemoryStats().
+MemoryStats getMemoryStats(const PageProvider & provider, const PageResolver & resolver);
+
+// Largest value seen for each field of MemoryStats. The ready queue and feedback buffer
+// peaks are sampled by the provider/resolver themselves, so they capture transient spikes
+// that happen between calls to getMemoryStats().
+const MemoryStats & getPeakMemoryStats() noexcept;
+void resetPeakMemoryStats(PageProvider & provider, PageResolver & resolver);
+
 // ======================================================
 // Global library initialization and shutdown:
 // ======================================================
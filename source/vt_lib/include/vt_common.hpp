@@ -193,6 +193,20 @@ struct GlobalShaders
 		GLint  unifMvpMatrix;            // mat4
 	} drawText2D;
 
+	// Used by PageResolver::resolveExternalPageIds() to downsample an
+	// application page-id render target into the feedback framebuffer.
+	struct {
+		GLuint programId;
+		GLint  unifTextureSamp;          // sampler2D
+	} pageIdDownsample;
+
+	// Used by the PageResolver to pack compact feedback two pixels per texel before the read-back.
+	struct {
+		GLuint programId;
+		GLint  unifTextureSamp;          // sampler2D
+		GLint  unifSrcSize;              // vec2
+	} pageIdPack;
+
 	// Used to render the page-id pre-pass.
 	struct {
 		GLuint programId;
@@ -203,37 +217,72 @@ struct GlobalShaders
 		GLuint unifVTIndex;              // float
 		GLuint unifVTSizePixels;         // vec2
 		GLuint unifVTSizePages;          // vec2
+		GLuint unifVTPageBase;           // float
+		GLuint unifVTUVScale;            // vec2
 	} pageIdGenPass;
 
+	// Batched page-id pass. Per-instance MVPs and VT params in uniform arrays.
+	struct {
+		GLuint programId;
+		GLint  unifMvpMatrices;          // mat4[MaxRenderBatchInstances]
+		GLint  unifVTParams;             // vec4[MaxRenderBatchInstances * 3]
+		GLint  unifLog2MipScaleFactor;   // float
+	} pageIdGenPassBatched;
+
 	// Used to render the final textured scene using the Virtual Texture.
 	// This is a simple test shader that renders diffuse colors only; unlit.
 	struct {
 		GLuint programId;
 		GLint  unifMvpMatrix;            // mat4
+		GLint  unifVTUVScale;            // vec2
 		// Fragment Shader params:
 		GLint  unifMipSampleBias;        // float
 		GLint  unifPageTableSamp;        // sampler2D
 		GLint  unifIndirectionTableSamp; // sampler2D
+		GLint  unifMipTailSamp;          // sampler2D
 	} vtRenderSimple;
 
+	// Batched version of vtRenderSimple. Per-instance MVPs in a uniform array.
+	struct {
+		GLuint programId;
+		GLint  unifMvpMatrices;          // mat4[MaxRenderBatchInstances]
+		GLint  unifVTUVScale;            // vec2
+		// Fragment Shader params:
+		GLint  unifMipSampleBias;        // float
+		GLint  unifPageTableSamp;        // sampler2D
+		GLint  unifIndirectionTableSamp; // sampler2D
+		GLint  unifMipTailSamp;          // sampler2D
+	} vtRenderSimpleBatched;
+
 	struct {
 		GLuint programId;
 		// Vertex Shader params:
 		GLint  unifMvpMatrix;            // mat4
 		GLint  unifLightPosObjectSpace;  // vec4
 		GLint  unifViewPosObjectSpace;   // vec4
+		GLint  unifVTUVScale;            // vec2
 		// Fragment Shader params:
 		GLint  unifMipSampleBias;        // float
+		GLint  unifVTLayerScale;         // vec3
 		GLint  unifDiffuseSamp;          // sampler2D
 		GLint  unifNormalSamp;           // sampler2D
 		GLint  unifSpecularSamp;         // sampler2D
 		GLint  unifIndirectionTableSamp; // sampler2D
+		GLint  unifDiffuseTailSamp;      // sampler2D
+		GLint  unifNormalTailSamp;       // sampler2D
+		GLint  unifSpecularTailSamp;     // sampler2D
 	} vtRenderLit;
 };
 
 // Get a reference to the set of shader programs used by the VT library.
 const GlobalShaders & getGlobalShaders() noexcept;
 
+// GLSL source of the page id functions and uniforms (page_id_funcs.glsl), with the required
+// extension directives and the default precision prepended. Must be placed at the start of a
+// fragment shader that outputs page ids, such as an application depth prepass writing page ids
+// to an extra render target. 'withDrawBuffers' also enables GL_EXT_draw_buffers (gl_FragData[1+]).
+std::string getPageIdGlslFuncs(bool withDrawBuffers = false);
+
 // ======================================================
 // NonCopyable:
 // ======================================================
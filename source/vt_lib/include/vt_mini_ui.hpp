@@ -217,6 +217,7 @@ private:
 
 // Draw a sprite quadrilateral to the screen with texture applied.
 // This will actually only add the sprite to the batch. The real drawing happens at flush2dSpriteBatches().
+// Tex coords are clamped to [0,1]. Sprites of a layer sharing a texture are drawn together.
 void draw2dSprite(const Rect & rect, const float color[4], const float uvs[][2], GLuint textureId, Layer layer);
 
 // Draws a developer overlay at the top-left corner of the window for VT stats printing.
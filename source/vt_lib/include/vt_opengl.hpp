@@ -40,9 +40,16 @@
 #elif defined(__IPHONEOS__) || TARGET_OS_IPHONE || TARGET_IPHONE_SIMULATOR
 	#include <OpenGLES/ES2/gl.h>
 	#include <OpenGLES/ES2/glext.h>
+	// iOS exports the instanced arrays entry points directly.
+	#ifdef GL_EXT_instanced_arrays
+		#define VT_GL_INSTANCED_ARRAYS 1
+	#endif
 #else
 	#include <GLES2/gl2.h>
 	#include <GLES2/gl2ext.h>
+	#if defined(GL_EXT_instanced_arrays) && defined(GL_GLEXT_PROTOTYPES)
+		#define VT_GL_INSTANCED_ARRAYS 1
+	#endif
 #endif
 
 #include <string>
@@ -65,6 +72,47 @@ void checkGLErrors(const char * file, int line);
 // Draws an NDC quadrilateral to the screen. This will affect the current VBO binding.
 void drawNdcQuadrilateral();
 
+// Test the GL_EXTENSIONS string for an extension name.
+bool isExtensionSupported(const char * extName);
+
+// ======================================================
+// GL state cache:
+// ======================================================
+
+//
+// The helpers below keep a shadow copy of the state they set (texture bound to each unit,
+// active unit, program, framebuffer, uniform values of each program and the common enable
+// flags) and drop the calls that wouldn't change anything. Application code that changes any
+// of this state directly through GL must call invalidateStateCache() before the library
+// renders again. The state starts unknown, so the first call of each kind always goes through.
+//
+void invalidateStateCache();
+void setStateCacheEnabled(bool enable); // Enabled by default. Also invalidates.
+bool isStateCacheEnabled();
+
+// Calls that never reached the driver since the last reset.
+unsigned int getNumElidedStateCalls();
+void resetNumElidedStateCalls();
+
+// glEnable()/glDisable() and glIsEnabled() through the cache.
+// GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_SCISSOR_TEST and GL_STENCIL_TEST are cached.
+void setEnabled(GLenum cap, bool enable);
+bool isEnabled(GLenum cap);
+
+// ======================================================
+// Instanced drawing:
+// ======================================================
+
+// True if GL_EXT_instanced_arrays is available, both in the headers and at runtime.
+// The other instancing helpers must only be called if this returns true.
+bool hasInstancedArrays();
+
+// Same as glVertexAttribDivisor(). Zero is per-vertex, one is per-instance.
+void setVertexAttribDivisor(GLuint attribIndex, GLuint divisor);
+
+// Same as glDrawElementsInstanced().
+void drawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void * indices, GLsizei instanceCount);
+
 // ======================================================
 // GL Shader Programs:
 // ======================================================
@@ -105,6 +153,9 @@ bool setShaderProgramUniform(GLint uniformLoc, float val);
 // 16 = mat4
 bool setShaderProgramUniform(GLint uniformLoc, const float * val, int count);
 
+// Set an array of vec4 (count = 4) or mat4 (count = 16) uniforms with a single call.
+bool setShaderProgramUniformArray(GLint uniformLoc, const float * val, int count, int arrayLength);
+
 // ======================================================
 // Physical OpenGL Textures:
 // ======================================================
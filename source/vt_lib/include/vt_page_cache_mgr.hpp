@@ -71,6 +71,9 @@ struct CacheEntry
 
 	// Position the above page currently occupies in the cache texture.
 	CachePageCoord cacheCoord;
+
+	// Page was modified (writable VTs) and not yet handed to the write-back.
+	bool dirty;
 };
 
 // ======================================================
@@ -105,6 +108,9 @@ public:
 	int getNumPagesX(int level) const { return numPagesX[level]; }
 	int getNumPagesY(int level) const { return numPagesY[level]; }
 
+	// Bytes of system memory used by the entry pointer pool.
+	size_t getMemoryBytes() const { return cacheEntryPtrPool.capacity() * sizeof(CacheEntry *); }
+
 private:
 
 	// Num mip-levels in the Virtual Texture:
@@ -177,6 +183,20 @@ public:
 	// Lookup a page, incrementing its use count if it is already in cache.
 	CachePageStatus lookupPage(PageId id);
 
+	// Status of a page, plus its cache position if cached. Unlike lookupPage(),
+	// doesn't touch the usage lists or the stats, nor requests the page.
+	CachePageStatus queryPage(PageId id, CachePageCoord * coordOut = nullptr) const;
+
+	// Dirty page tracking of writable VTs. A page marked dirty was modified in
+	// the cache and its write-back wasn't started yet. Marking a page that is not
+	// in the cache does nothing and returns false.
+	bool markPageDirty(PageId id);
+	void clearDirtyPages();
+	int getNumDirtyPages() const { return numDirtyPages; }
+
+	// Dirty pages evicted or purged since the last call. Resets the count.
+	int takeNumEvictedDirtyPages();
+
 	// Verify that a previously requested page is still wanted by the cache.
 	bool stillWantPage(PageId id) const;
 
@@ -202,6 +222,9 @@ public:
 	// This should be called at the end of a frame, after the cache is updated.
 	void clearCacheStats() { clearPodObject(stats); }
 
+	// Bytes of system memory used by this cache manager, including its page tree.
+	size_t getMemoryBytes() const { return sizeof(PageCacheMgr) + cachePageTree.getMemoryBytes(); }
+
 private:
 
 	// Allocate a slot in the cache, possibly evicting an older page.
@@ -220,6 +243,10 @@ private:
 	// Runtime stats counters for the cache manager:
 	RuntimeStats stats;
 
+	// Dirty pages currently in the cache, and the ones that left it dirty.
+	int numDirtyPages;
+	int numEvictedDirtyPages;
+
 	// List heads:
 	CacheEntry * mru; // MRU list
 	CacheEntry * lru; // LRU list
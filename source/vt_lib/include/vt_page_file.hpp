@@ -34,7 +34,10 @@
 #define VTLIB_VT_PAGE_FILE_HPP
 
 #include "vt_file_format.hpp"
+#include <atomic>
+#include <condition_variable>
 #include <mutex>
+#include <unordered_map>
 
 namespace vt
 {
@@ -45,20 +48,59 @@ struct PageRequestDataPacket;
 // PageFile:
 // ======================================================
 
+// The always-resident mip tail of a page file (see VTFF::MipTailInfo).
+struct MipTailData
+{
+	int width     = 0; // First level size. Level 'l' is max(width >> l, 1) x max(height >> l, 1).
+	int height    = 0;
+	int numLevels = 0;
+	std::vector<Pixel4b> pixels; // All levels, largest first.
+};
+
 class PageFile
 {
 public:
 
 	// Load the page pointed by 'pageId' into 'pageRequest'.
 	// 'pageId' should be a valid page in the underlaying virtual texture.
-	virtual void loadPage(PageId pageId, PageRequestDataPacket & pageRequest) = 0;
+	// Returns false if the page couldn't be read, in which case the page data is zeroed.
+	virtual bool loadPage(PageId pageId, PageRequestDataPacket & pageRequest) = 0;
 
 	// Enable/disable addition of debug info to each loaded page.
 	virtual void setAddDebugInfoToPages(bool debug) = 0;
 	virtual bool isAddingDebugInfoToPages() const = 0;
 
+	// Bytes of system memory used by the page index/lookup structures of this file.
+	// Page data is not counted, since it is streamed. Zero for files without an index.
+	virtual size_t getMemoryBytes() const { return 0; }
+
+	// Loads the mip tail, if the file has one. Called once when the texture is registered.
+	virtual bool loadMipTail(MipTailData & /* tail */) { return false; }
+
+	// Fraction of the level 0 pages covered by the image, for each axis. Less than one if the
+	// right/bottom pages are only partially filled (see VTFF::MipLevelInfo::validWidth).
+	// Texture coordinates are multiplied by it before addressing the pages.
+	virtual void getUVScale(float scale[2]) { scale[0] = 1.0f; scale[1] = 1.0f; }
+
+	// Identity of the page contents, for the SharedPageCache. Files with the same key produce
+	// the same pages in any process. Zero (the default) keeps the file out of the shared cache.
+	virtual uint64_t getSharedCacheKey() const { return 0; }
+
+	// Bytes read from storage to load page 'pageId', as charged by the PageProvider I/O rate
+	// limiter. Must not do any I/O itself. Defaults to one full uncompressed page.
+	virtual size_t getPageReadBytes(PageId pageId) const;
+
+	// Backing device of this file, used to pick the PageProvider I/O rate limiter bucket.
+	// Files on the same disk should share an id. Zero (the default bucket) if never set.
+	void setIoDeviceId(int id) { ioDeviceId = id; }
+	int getIoDeviceId() const { return ioDeviceId; }
+
 	// Default virtual for proper inheritance usage.
 	virtual ~PageFile() = default;
+
+private:
+
+	int ioDeviceId = 0;
 };
 
 using PageFilePtr = std::unique_ptr<PageFile>;
@@ -77,7 +119,7 @@ public:
 
 	// Load a page from a loose image on disk.
 	// This can be used with pages generated by the PageFileBuilder with the 'dumpPageImages' flag.
-	void loadPage(PageId pageId, PageRequestDataPacket & pageRequest) override;
+	bool loadPage(PageId pageId, PageRequestDataPacket & pageRequest) override;
 
 	void setAddDebugInfoToPages(bool debug) override { addDebugInfo = debug; }
 	bool isAddingDebugInfoToPages() const   override { return addDebugInfo;  }
@@ -106,11 +148,14 @@ public:
 
 	// Fills each page request with a solid color and prints page
 	// number and level on top of it. No file IO performed.
-	void loadPage(PageId pageId, PageRequestDataPacket & pageRequest) override;
+	bool loadPage(PageId pageId, PageRequestDataPacket & pageRequest) override;
 
 	void setAddDebugInfoToPages(bool debug) override { addDebugInfo = debug; }
 	bool isAddingDebugInfoToPages() const   override { return addDebugInfo;  }
 
+	// Pages are generated, not read.
+	size_t getPageReadBytes(PageId /* pageId */) const override { return 0; }
+
 private:
 
 	bool addDebugInfo;
@@ -120,41 +165,178 @@ private:
 // VTFFPageFile:
 // ======================================================
 
+//
+// VTFF files are opened lazily:
+//
+// - The file header (texture dimensions) is read on the first
+//   call to a dimension getter or on the first page request.
+//
+// - The full page index (VTFFPageTree) is only loaded by the
+//   first page request and may be evicted again when it goes cold.
+//
+// - File handles are kept in a bounded LRU shared by all VTFF files,
+//   so thousands of files can exist with only a few of them open.
+//
+// Both LRUs are library-wide. Their limits can be changed with
+// setMaxOpenFiles() and setMaxResidentPageIndexes().
+//
 class VTFFPageFile final
 	: public PageFile, public NonCopyable
 {
 public:
 
-	// Initialize by attempting to open a file.
-	// Throws a vt::Exception if the file cannot be opened.
+	// Default limits for the shared LRUs:
+	static constexpr int DefaultMaxOpenFiles           = 32;
+	static constexpr int DefaultMaxResidentPageIndexes = 128;
+
+	// Initialize with the name of a file to be opened on demand.
+	// No file IO happens here. Errors are reported when the header is first loaded.
 	explicit VTFFPageFile(std::string filename, bool debug = false);
 
 	// Initialize from an open file.
-	// Assumes the stream is pointing to the beginning of the file.
-	// Takes ownership of the file stream and closes it in the destructor.
+	// Takes ownership of the file stream. It is placed in the open handles LRU
+	// and might get closed when evicted, so 'filename' must be re-openable.
 	VTFFPageFile(FILE * fileStream, std::string filename, bool debug = false);
 
-	// Closes the underlaying file stream.
+	// Closes the underlaying file stream, if still open.
 	~VTFFPageFile();
 
 	// Load a page from a Virtual Texture File Format (VTFF) file.
-	void loadPage(PageId pageId, PageRequestDataPacket & pageRequest) override;
+	// Opens the file and loads its page index if they are not resident.
+	bool loadPage(PageId pageId, PageRequestDataPacket & pageRequest) override;
 
 	// Getters/setters:
 	void setAddDebugInfoToPages(bool debug) override { addDebugInfo = debug; }
 	bool isAddingDebugInfoToPages() const   override { return addDebugInfo;  }
 
-	const VTFFPageTree & getPageTree() const { return *pageTree; }
-	VTFFPageTree & getPageTree() { return *pageTree; }
+	// Texture dimensions. The first call loads and validates the file header.
+	// Throws a vt::Exception if the file cannot be opened or is invalid.
+	int getNumLevels();
+	const int * getNumPagesX();
+	const int * getNumPagesY();
+
+	// Keeps the page index (and file handle) of a VTFFPageFile resident while alive,
+	// so it can't be evicted by requests for other files. Must not outlive the file.
+	class PinnedPageTree final
+	{
+	public:
+
+		PinnedPageTree(PinnedPageTree && other)
+			: file(other.file), tree(other.tree)
+		{
+			other.file = nullptr;
+			other.tree = nullptr;
+		}
+
+		~PinnedPageTree()
+		{
+			if (file != nullptr)
+			{
+				file->releaseFileHandle();
+			}
+		}
+
+		// No copy or assignment.
+		PinnedPageTree(const PinnedPageTree &) = delete;
+		PinnedPageTree & operator = (const PinnedPageTree &) = delete;
+		PinnedPageTree & operator = (PinnedPageTree &&) = delete;
+
+		const VTFFPageTree & operator * () const { return *tree; }
+		const VTFFPageTree * operator -> () const { return tree; }
+
+	private:
+
+		friend class VTFFPageFile;
+		PinnedPageTree(VTFFPageFile * owner, const VTFFPageTree * pinnedTree)
+			: file(owner), tree(pinnedTree) { }
+
+		VTFFPageFile * file;
+		const VTFFPageTree * tree;
+	};
+
+	// Full page index. Loaded if not resident. Stays pinned until the returned handle is destroyed.
+	PinnedPageTree getPageTree();
+
+	// Closes the file handle and drops the page index now, if not in use.
+	void evictResidentData();
+
+	// Memory used by the page index, if resident.
+	size_t getMemoryBytes() const override;
+
+	// Reads the mip tail of a version 5+ file. False if the file has none.
+	bool loadMipTail(MipTailData & tail) override;
+
+	// From the valid extents of level 0. One for files older than version 7.
+	void getUVScale(float scale[2]) override;
+
+	// From the device, inode, size and modification time of the file. Zero if it can't be stat'ed.
+	uint64_t getSharedCacheKey() const override;
+
+	// Stored size of the page if the index is resident, which accounts for reduced pages.
+	// A full page otherwise, since finding out would mean reading the index.
+	size_t getPageReadBytes(PageId pageId) const override;
+
+	// Limits of the shared LRUs. Lowering a limit takes effect on the next file access.
+	static void setMaxOpenFiles(int count);
+	static void setMaxResidentPageIndexes(int count);
+	static int  getNumOpenFiles();
+	static int  getNumResidentPageIndexes();
 
 private:
 
+	// Intrusive links for the LRUs:
+	struct LruLinks
+	{
+		VTFFPageFile * prev;
+		VTFFPageFile * next;
+	};
+
+	// A LRU list. Head is the most recently used.
+	struct LruList
+	{
+		VTFFPageFile * head;
+		VTFFPageFile * tail;
+		LruLinks VTFFPageFile::* links;
+		int count;
+		int limit;
+	};
+
 	static bool isPowerOfTwo(uint32_t size);
-	static FILE * tryOpenFile(const std::string & filename);
+	static void lruTouch(LruList & list, VTFFPageFile * file);
+	static void lruUnlink(LruList & list, VTFFPageFile * file);
+	static void trimResidentSets();
+
+	// File handle pinning. While pinned, neither the handle nor the page index get evicted.
+	// acquireFileHandle() opens the file if needed and returns null on failure, but the
+	// file is pinned regardless, so releaseFileHandle() must always follow.
+	FILE * acquireFileHandle();
+	void releaseFileHandle();
+
+	// Loaders. Expect the file to be pinned (and fileLock held, if enabled).
+	bool loadHeader(FILE * fileStream, std::string & errorMessage);
+	bool loadPageIndex(FILE * fileStream, std::string & errorMessage);
+	bool readPage(FILE * fileStream, PageId pageId, PageRequestDataPacket & pageRequest);
+	bool loadHeaderOnce(FILE * fileStream, std::string & errorMessage);
+	void ensureHeaderLoaded();
 
-	// File handle owned by this class.
+private:
+
+	// Shared LRUs and the lock guarding them, plus the
+	// handle, index and links of every VTFFPageFile instance.
+	static std::mutex residencyLock;
+	static LruList    openFiles;
+	static LruList    residentIndexes;
+
+	// File handle. Null when closed/evicted.
 	FILE * pageFile;
 
+	// Number of requests currently using the file.
+	int pinCount;
+
+	// Links into 'openFiles' and 'residentIndexes'.
+	LruLinks handleLinks;
+	LruLinks indexLinks;
+
 	// In some implementations (including iOS, it seems),
 	// FILEs are not thread safe. If we are concurrently accessing
 	// pageFile, which is the case with an async PageProvider, this mutex is needed.
@@ -162,15 +344,308 @@ private:
 	std::mutex fileLock;
 	#endif // VT_THREAD_SAFE_VTFF_PAGE_FILE
 
-	// Set of all pages, as loaded from the input file.
+	// Texture dimensions, from the file header. Never evicted.
+	// Loaded once, under 'headerLock'. The flag is set last.
+	std::mutex headerLock;
+	std::atomic<bool> headerLoaded;
+	int  numLevels;
+	uint32_t fileVersion;
+	std::array<int, MaxVTMipLevels> numPagesX;
+	std::array<int, MaxVTMipLevels> numPagesY;
+	float uvScale[2];
+	VTFF::MipTailInfo mipTailInfo;
+	VTFF::PageStorageInfo pageStorageInfo;
+
+	// Set of all pages, as loaded from the input file. Null when not resident.
 	std::unique_ptr<VTFFPageTree> pageTree;
 
+	// Hash of the file stats, taken on the first getSharedCacheKey(). Zero until then.
+	mutable std::atomic<uint64_t> fileIdentity;
+
 	const std::string inputFileName;
 	bool addDebugInfo;
 };
 
 using VTFFPageFilePtr = std::unique_ptr<VTFFPageFile>;
 
+// ======================================================
+// VTFFArchive:
+// ======================================================
+
+class VTFFArchivePageFile;
+
+//
+// A VTFA archive (see vt_file_format.hpp) holding many VTFF textures.
+//
+// The archive file is memory mapped once and stays mapped for the lifetime
+// of this object. Opening it only validates the header and directory, so the
+// cost doesn't scale with the number of pages. Each texture's page tree is a
+// view into the mapped index and every page read is a copy from the mapping.
+//
+class VTFFArchive final
+	: public NonCopyable
+{
+public:
+
+	// Maps and validates the archive. Throws a vt::Exception on failure.
+	explicit VTFFArchive(std::string filename);
+
+	// Unmaps the file. Page files created from this archive must be gone by now.
+	~VTFFArchive();
+
+	// Archive directory:
+	int getNumTextures() const { return static_cast<int>(entries.size()); }
+	const char * getTextureName(int textureIndex) const;
+
+	// Index of the texture with the given name, or -1 if not found.
+	int findTexture(const std::string & name) const;
+
+	// Texture dimensions and page tree view of the given texture.
+	int getNumLevels(int textureIndex) const;
+	const int * getNumPagesX(int textureIndex) const;
+	const int * getNumPagesY(int textureIndex) const;
+	const float * getUVScale(int textureIndex) const;
+	const VTFFPageTree & getPageTree(int textureIndex) const;
+
+	// Creates a page file that streams the given texture from this archive.
+	// The archive must outlive the returned object.
+	std::unique_ptr<VTFFArchivePageFile> createPageFile(int textureIndex, bool debug = false) const;
+
+	// Copies the page data at the given offset to 'dest'. False if out of bounds.
+	bool readPageData(uint64_t fileOffset, uint32_t sizeInBytes, void * dest) const;
+
+	// Pointer to the page data at the given offset, in the mapping. Null if out of bounds.
+	const uint8_t * getPageDataPtr(uint64_t fileOffset, uint32_t sizeInBytes) const;
+
+	// Filter used to upsample the pages stored at reduced resolution (a tool::FilterType).
+	uint32_t getPageUpsampleFilter(int textureIndex) const;
+
+	// Mip tail of the texture, with an archive offset. Zero levels if it has none.
+	const VTFF::MipTailInfo & getMipTailInfo(int textureIndex) const;
+
+	// Hash of the device, inode, size and modification time of the archive file.
+	uint64_t getFileIdentity() const { return fileIdentity; }
+
+	// Size of the mapped file and the name it was opened with.
+	size_t getMappedSizeBytes() const { return mappedSize; }
+	const std::string & getFileName() const { return archiveFileName; }
+
+private:
+
+	struct TextureEntry
+	{
+		VTFA::TextureEntry info; // Converted to the current layout.
+		std::array<int, MaxVTMipLevels> numPagesX;
+		std::array<int, MaxVTMipLevels> numPagesY;
+		float uvScale[2];
+		std::unique_ptr<VTFFPageTree> pageTree; // View into the mapped index.
+	};
+
+	void unmap();
+
+	// The memory mapped archive file.
+	const uint8_t * mappedData;
+	size_t mappedSize;
+	uint64_t fileIdentity;
+
+	std::vector<TextureEntry> entries;
+	const std::string archiveFileName;
+};
+
+using VTFFArchivePtr = std::unique_ptr<VTFFArchive>;
+
+// ======================================================
+// VTFFArchivePageFile:
+// ======================================================
+
+// Page file for one texture of a VTFFArchive. Owns no data and never touches
+// the file system, so it is cheap to create and safe to use from the provider threads.
+class VTFFArchivePageFile final
+	: public PageFile, public NonCopyable
+{
+public:
+
+	VTFFArchivePageFile(const VTFFArchive & arch, int texIndex, bool debug = false)
+		: archive(arch), textureIndex(texIndex), addDebugInfo(debug) { }
+
+	// Load a page from the mapped archive.
+	bool loadPage(PageId pageId, PageRequestDataPacket & pageRequest) override;
+
+	void setAddDebugInfoToPages(bool debug) override { addDebugInfo = debug; }
+	bool isAddingDebugInfoToPages() const   override { return addDebugInfo;  }
+
+	// Texture dimensions, from the archive directory.
+	int getNumLevels() const        { return archive.getNumLevels(textureIndex); }
+	const int * getNumPagesX() const { return archive.getNumPagesX(textureIndex); }
+	const int * getNumPagesY() const { return archive.getNumPagesY(textureIndex); }
+
+	void getUVScale(float scale[2]) override
+	{
+		scale[0] = archive.getUVScale(textureIndex)[0];
+		scale[1] = archive.getUVScale(textureIndex)[1];
+	}
+
+	// The archive identity plus the texture index.
+	uint64_t getSharedCacheKey() const override;
+
+	// Stored size of the page, from the mapped page index.
+	size_t getPageReadBytes(PageId pageId) const override;
+
+	// Copied from the mapping. Archives older than version 4 have no tails.
+	bool loadMipTail(MipTailData & tail) override;
+
+	const VTFFArchive & getArchive() const { return archive; }
+	int getTextureIndex() const { return textureIndex; }
+
+private:
+
+	const VTFFArchive & archive;
+	const int textureIndex;
+	bool addDebugInfo;
+};
+
+using VTFFArchivePageFilePtr = std::unique_ptr<VTFFArchivePageFile>;
+
+// ======================================================
+// AtlasRemapTable:
+// ======================================================
+
+//
+// The VTAT remap table (see vt_file_format.hpp) written next to a VTFF
+// built by 'vtmake --atlas'. Gives the UV scale and bias that map each
+// packed texture into the virtual texture. Load the VTFF as usual and
+// apply the remap in the shaders with vtAtlasRemap() (page_id_funcs.glsl).
+//
+class AtlasRemapTable final
+	: public NonCopyable
+{
+public:
+
+	// Reads and validates the table. Throws a vt::Exception on failure.
+	explicit AtlasRemapTable(std::string filename);
+
+	// Textures in the order of the vtmake inputs.
+	int getNumTextures() const { return static_cast<int>(entries.size()); }
+	const char * getTextureName(int textureIndex) const;
+
+	// Index of the texture with the given name, or -1 if not found.
+	int findTexture(const std::string & name) const;
+
+	// (scaleU, scaleV, biasU, biasV) of the texture. Fits a vec4 uniform for vtAtlasRemap().
+	const float * getScaleBias(int textureIndex) const;
+
+	// Level 0 size of the atlas, in pixels.
+	int getAtlasWidth()  const { return atlasWidth;  }
+	int getAtlasHeight() const { return atlasHeight; }
+
+	const std::string & getFileName() const { return tableFileName; }
+
+private:
+
+	struct Entry
+	{
+		std::string name;
+		float scaleBias[4];
+	};
+
+	std::vector<Entry> entries;
+	int atlasWidth;
+	int atlasHeight;
+	const std::string tableFileName;
+};
+
+using AtlasRemapTablePtr = std::unique_ptr<AtlasRemapTable>;
+
+// ======================================================
+// ReducedLayerPageFile:
+// ======================================================
+
+//
+// Page file for a layer of a multi-file VirtualTexture that is stored at a lower
+// resolution than the base layer (file 0), by a fixed mip offset. Each level of the
+// reduced file has the page grid of the base level 'mipOffset' steps coarser. Requests
+// are made in the base layer's page geometry: base page (x, y, level) is served
+// from reduced page (x >> mipOffset, y >> mipOffset, level). That page covers the
+// same area at a lower texel density. The shaders scale the in-page coordinates
+// to match (see VirtualTexture::getLayerMipOffset).
+//
+// Past the last level of the reduced file, its coarsest level is used.
+//
+// One reduced page serves up to 4^mipOffset base pages, which are usually requested
+// together. It is read once and kept in a small LRU, so its siblings are copied
+// from memory. Requests for a page that is still being read wait for that read.
+//
+class ReducedLayerPageFile final
+	: public PageFile, public NonCopyable
+{
+public:
+
+	// Reduced pages kept in memory. 32 pages of 128x128 RGBA is 2MB.
+	static constexpr int DefaultMaxCachedPages = 32;
+
+	// Largest offset supported. A reduced page is shared by 4^offset base pages.
+	static constexpr int MaxMipOffset = 4;
+
+	// 'baseNumLevels' is the level count of the base layer. The reduced file must
+	// have max(baseNumLevels - mipOffset, 1) levels.
+	ReducedLayerPageFile(PageFilePtr reduced, int offset, int baseNumLevels,
+	                     int cacheSizeInPages = DefaultMaxCachedPages);
+
+	// Load base layer page 'pageId' from its reduced page.
+	bool loadPage(PageId pageId, PageRequestDataPacket & pageRequest) override;
+
+	// Changing the debug flag drops the cached pages, which have the old debug text.
+	void setAddDebugInfoToPages(bool debug) override;
+	bool isAddingDebugInfoToPages() const override { return reducedFile->isAddingDebugInfoToPages(); }
+
+	// The reduced file's index plus the cached pages.
+	size_t getMemoryBytes() const override;
+
+	bool loadMipTail(MipTailData & tail) override { return reducedFile->loadMipTail(tail); }
+	void getUVScale(float scale[2]) override { reducedFile->getUVScale(scale); }
+
+	// Keyed apart from the reduced file, since it serves other pages under the same page ids.
+	uint64_t getSharedCacheKey() const override;
+
+	// Zero if the reduced page is cached or being read, else what the reduced file reads for it.
+	size_t getPageReadBytes(PageId pageId) const override;
+
+	// Reduced file page that holds base layer page 'pageId'. Keeps the texture index.
+	PageId getReducedPageId(PageId pageId) const;
+
+	// Swaps the wrapped file with 'other' and drops the cached pages. No requests may be in flight.
+	void swapReducedFile(PageFilePtr & other);
+
+	// Drops all cached pages. Must not be called while requests are in flight.
+	void purgeCache();
+
+	// Accessors:
+	int getMipOffset() const { return mipOffset; }
+	const PageFile * getReducedFile() const { return reducedFile.get(); }
+	PageFile * getReducedFile() { return reducedFile.get(); }
+
+private:
+
+	struct CachedPage
+	{
+		std::shared_ptr<const std::vector<Pixel4b>> pixels; // Null while being read.
+		uint64_t lastUsed;
+	};
+
+	PageFilePtr reducedFile;
+	const int mipOffset;
+	const int baseLevels;
+	const int maxCachedPages;
+
+	// Guards the cache. Readers of a page in flight wait on the condition.
+	mutable std::mutex cacheMutex;
+	std::condition_variable pageLoadedCond;
+	std::unordered_map<PageId, CachedPage> cachedPages;
+	uint64_t useCounter;
+};
+
+using ReducedLayerPageFilePtr = std::unique_ptr<ReducedLayerPageFile>;
+
 } // namespace vt {}
 
 #endif // VTLIB_VT_PAGE_FILE_HPP
@@ -60,12 +60,17 @@ public:
 
 	// Update the indirection table texture. This is called whenever the page cache changes.
 	// Array size must be 'PageTable::TotalTablePages'. Must bind first with PageIndirectionTable::bind().
+	// Areas not covered by any resident page are left empty, so the shaders sample the mip tail instead.
 	virtual void updateIndirectionTexture(const struct CacheEntry * const pages) = 0;
 
 	// Write every mip-level of the indirection table to image files.
 	// The file name/path should not include an extension. Each level will be named ( pathname + "_level_number" ).
 	virtual bool writeIndirectionTextureToFile(const std::string & pathname, bool recolor) const = 0;
 
+	// Bytes used by the CPU copy of the table and estimated size of the GL texture (all levels).
+	virtual size_t getSystemMemoryBytes() const = 0;
+	virtual size_t getGpuMemoryBytes() const = 0;
+
 protected:
 
 	// OpenGL texture handle:
@@ -94,6 +99,9 @@ public:
 	void updateIndirectionTexture(const struct CacheEntry * const pages) override;
 	bool writeIndirectionTextureToFile(const std::string & pathname, bool recolor) const override;
 
+	size_t getSystemMemoryBytes() const override { return totalTableEntries * sizeof(TableEntry); }
+	size_t getGpuMemoryBytes() const override { return totalTableEntries * sizeof(TableEntry); }
+
 private:
 
 	void initTexture();
@@ -108,6 +116,9 @@ private:
 	};
 	static_assert(sizeof(TableEntry) == 4, "Expected 4 bytes size!");
 
+	// No page mapped. A zero scale is never produced by a valid entry.
+	static constexpr uint32_t EmptyEntry = 0;
+
 private:
 
 	int totalTableEntries;
@@ -135,6 +146,9 @@ public:
 	void updateIndirectionTexture(const struct CacheEntry * const pages) override;
 	bool writeIndirectionTextureToFile(const std::string & pathname, bool recolor) const override;
 
+	size_t getSystemMemoryBytes() const override { return totalTableEntries * sizeof(TableEntry); }
+	size_t getGpuMemoryBytes() const override { return totalTableEntries * sizeof(TableEntry); }
+
 private:
 
 	void initTexture();
@@ -143,6 +157,9 @@ private:
 	using TableEntry = uint16_t;
 	static_assert(sizeof(TableEntry) == 2, "Expected 2 bytes size!");
 
+	// No page mapped. Flagged by an out-of-range mip field (valid entries are <= 8).
+	static constexpr TableEntry EmptyEntry = (63 << 5);
+
 private:
 
 	int log2VirtPagesWide;
@@ -0,0 +1,241 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: vt_page_overlay.hpp
+// Author: Guilherme R. Lampert
+// Created on: 18/10/26
+// Brief: Sparse overlay file and write-back of the pages of writable virtual textures.
+//
+// License:
+//  This source code is released under the MIT License.
+//  Copyright (c) 2014 Guilherme R. Lampert.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+// ================================================================================================
+
+#ifndef VTLIB_VT_PAGE_OVERLAY_HPP
+#define VTLIB_VT_PAGE_OVERLAY_HPP
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+
+namespace vt
+{
+
+// ======================================================
+// PageOverlay:
+// ======================================================
+
+//
+// Sparse overlay file with the pages modified at runtime in a writable
+// VirtualTexture (see VirtualTexture::enablePageWriting()). File layout
+// is described by VTPO in vt_file_format.hpp.
+//
+// - Written pages are kept in memory until the background write-back
+//   puts them on disk. Loads look there first, then in the file.
+//
+// - Write-back runs in batches, one at a time, on a low priority serial
+//   queue. A batch is started by flush() once enough pages are pending or
+//   the oldest one waited long enough. Slots that are adjacent in the file
+//   are merged into a single write.
+//
+// - A page written again before reaching the disk replaces the pending copy,
+//   so it is only written once.
+//
+class PageOverlay final
+	: public NonCopyable
+{
+public:
+
+	// Default write-back thresholds. See setFlushThresholds().
+	static constexpr int DefaultFlushIntervalMs = 1000;
+	static constexpr int DefaultFlushBatchPages = 64;
+
+	// Max slots merged into a single write call.
+	static constexpr int MaxSlotsPerWrite = 16;
+
+	// Number of RGBA pixels in a page:
+	static constexpr int TotalPagePixels = (PageTable::PageSizeInPixels * PageTable::PageSizeInPixels);
+
+	struct Stats
+	{
+		unsigned pendingPages;    // Written pages not on disk yet.
+		unsigned storedPages;     // Pages with a slot in the overlay file.
+		uint64_t pagesWritten;    // Pages that reached the disk.
+		uint64_t coalescedWrites; // Writes replaced by a newer one before reaching the disk.
+		uint64_t batchesWritten;  // Write-back batches completed.
+		uint64_t writeCalls;      // File writes issued, after merging adjacent slots.
+		uint64_t overlayLoads;    // Page loads served by the overlay.
+	};
+
+	// Opens the overlay file, creating it if it doesn't exist.
+	// Throws a vt::Exception if the file can't be opened or is not an overlay.
+	explicit PageOverlay(std::string filename);
+
+	// Writes all pending pages back and waits for it.
+	~PageOverlay();
+
+	// Replaces the contents of a page. The texture index of 'pageId' is ignored,
+	// so the overlay can be reused with the texture in any slot. 'fileId' is
+	// the page file of the VirtualTexture. The data is copied.
+	void storePage(PageId pageId, uint32_t fileId, const Pixel4b * pageData);
+
+	// Copies the latest contents of a page to 'dest'. False if it was never written.
+	// Safe to call from the PageProvider threads.
+	bool loadPage(PageId pageId, uint32_t fileId, Pixel4b * dest);
+
+	// True if the page was ever written.
+	bool hasPage(PageId pageId, uint32_t fileId) const;
+
+	// Starts a write-back of every pending page if the thresholds were reached,
+	// or regardless of them if 'force' is set. Nothing happens while the previous
+	// batch is still being written. Returns true if a batch was started.
+	bool flush(bool force = false);
+
+	// Writes all pending pages back and blocks until they are on disk.
+	void flushAndWait();
+
+	// A batch is started when 'batchPages' pages are pending or when the
+	// oldest pending page was written more than 'intervalMs' ago.
+	void setFlushThresholds(int intervalMs, int batchPages);
+
+	// Accessors:
+	Stats getStats() const;
+	size_t getPendingMemoryBytes() const;
+	const std::string & getFileName() const { return overlayFileName; }
+
+private:
+
+	// Immutable snapshot of a page. New writes replace the pointer, so a
+	// batch can keep writing the old snapshot without holding the lock.
+	using PageData    = std::array<Pixel4b, TotalPagePixels>;
+	using PageDataPtr = std::shared_ptr<const PageData>;
+
+	struct PendingPage
+	{
+		PageDataPtr data;
+		uint64_t    generation; // Bumped by every write, to tell if the page changed while in a batch.
+	};
+
+	struct BatchPage
+	{
+		uint64_t    key;
+		uint64_t    slotOffset;
+		uint64_t    generation;
+		PageDataPtr data;
+	};
+
+	struct WriteBatch
+	{
+		PageOverlay * overlay;
+		std::vector<BatchPage> pages;
+	};
+
+	static uint64_t makeKey(PageId pageId, uint32_t fileId);
+	static void writeBatchTask(void * param);
+
+	void openFile();
+	void startBatch();
+	bool writeSlots(const BatchPage * pages, size_t count, std::vector<uint8_t> & buffer);
+
+private:
+
+	// Guards everything below, except the counters that say otherwise.
+	mutable std::mutex overlayLock;
+
+	// Pages not on disk yet.
+	std::unordered_map<uint64_t, PendingPage> pendingPages;
+
+	// File offset of the slot of every page in the file.
+	std::unordered_map<uint64_t, uint64_t> slotOffsets;
+	uint64_t nextSlotOffset;
+
+	uint64_t nextGeneration;
+	int64_t  oldestPendingMs; // -1 if nothing is pending.
+	int      flushIntervalMs;
+	int      flushBatchPages;
+	Stats    stats;
+
+	// Set while a batch is being written. Only cleared by the write-back task.
+	std::atomic<bool> batchInFlight;
+
+	// Page loads served from the overlay. Updated without the lock.
+	std::atomic<uint64_t> overlayLoads;
+
+	// File descriptor, used with pread/pwrite from any thread.
+	int fileDesc;
+
+	// Serial write-back queue, below the priority of the page loads.
+	void * writeQueue;
+
+	const std::string overlayFileName;
+};
+
+using PageOverlayPtr = std::shared_ptr<PageOverlay>;
+
+// ======================================================
+// OverlayPageFile:
+// ======================================================
+
+// Page file of a writable VirtualTexture. Wraps the original page file and
+// serves the pages found in the overlay from it, everything else from the original.
+class OverlayPageFile final
+	: public PageFile, public NonCopyable
+{
+public:
+
+	OverlayPageFile(PageFilePtr base, PageOverlayPtr pageOverlay, uint32_t fileIndex);
+
+	// Load a page from the overlay, or from the original file if it was never written.
+	bool loadPage(PageId pageId, PageRequestDataPacket & pageRequest) override;
+
+	void setAddDebugInfoToPages(bool debug) override { baseFile->setAddDebugInfoToPages(debug); }
+	bool isAddingDebugInfoToPages() const   override { return baseFile->isAddingDebugInfoToPages(); }
+
+	size_t getMemoryBytes() const override { return baseFile->getMemoryBytes(); }
+	bool loadMipTail(MipTailData & tail) override { return baseFile->loadMipTail(tail); }
+	void getUVScale(float scale[2]) override { baseFile->getUVScale(scale); }
+
+	// What the original file reads. Overlay pages are charged the same, which is close enough.
+	size_t getPageReadBytes(PageId pageId) const override { return baseFile->getPageReadBytes(pageId); }
+
+	// Written pages only exist in this process, so overlays stay out of the shared cache.
+	uint64_t getSharedCacheKey() const override { return 0; }
+
+	// Swaps the wrapped file with 'other'. No requests may be in flight.
+	void swapBaseFile(PageFilePtr & other);
+
+	// Accessors:
+	const PageFile * getBaseFile() const { return baseFile.get(); }
+	PageFile * getBaseFile() { return baseFile.get(); }
+	const PageOverlayPtr & getOverlay() const { return overlay; }
+
+private:
+
+	PageFilePtr    baseFile;
+	PageOverlayPtr overlay;
+	const uint32_t fileId;
+};
+
+} // namespace vt {}
+
+#endif // VTLIB_VT_PAGE_OVERLAY_HPP
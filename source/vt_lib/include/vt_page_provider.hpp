@@ -42,6 +42,8 @@ namespace vt
 {
 
 class VirtualTexture;
+class SharedPageCache;
+class PageFile;
 
 struct PageRequestDataPacket
 {
@@ -70,25 +72,102 @@ class PageProvider final
 {
 public:
 
-	// Max requests waiting in the provider queue, per frame. Arbitrary.
-	static constexpr int MaxOutstandingPageRequests = 256;
+	// Max requests waiting in the provider queue. Each page file read of a request counts as one.
+	// This is the fixed limit. With adaptive queue depth, the limit moves between the Min/Upper bounds.
+	static constexpr int MaxOutstandingPageRequests   = 256;
+	static constexpr int MinOutstandingPageRequests   = 8;
+	static constexpr int UpperOutstandingPageRequests = 2048;
+
+	// Default request latency goal of the adaptive queue depth, in milliseconds.
+	static constexpr double DefaultTargetLatencyMs = 50.0;
+
+	// Bytes of a full page. Requests are charged what the page file reads for them
+	// (PageFile::getPageReadBytes), which is less for reduced pages.
+	static constexpr size_t PageRequestIoBytes = sizeof(Pixel4b) * PageRequestDataPacket::TotalPagePixels;
+
+	// Requests for the N coarsest levels of a texture may take the I/O budget into
+	// debt (up to one burst), so the low-resolution fallback is never starved.
+	static constexpr int IoPriorityCoarseLevels = 2;
+
+	// I/O throttling counters of one rate limiter bucket.
+	struct IoThrottleStats
+	{
+		double   throttledSeconds;  // Time spent with requests being refused for lack of budget.
+		unsigned throttledRequests; // Requests refused by the limiter.
+		uint64_t admittedBytes;     // Bytes of page data let through.
+		double   availableBytes;    // Current budget. Negative when in debt.
+	};
+
+	// Measurements and current output of the adaptive queue depth controller.
+	// Latency is from addPageRequest() to the page reaching the ready queue;
+	// service time is the page file read alone. Both are smoothed averages.
+	struct QueueDepthStats
+	{
+		double latencyMs;
+		double serviceTimeMs;
+		double completionsPerSec;
+		double targetLatencyMs;
+		int    outstandingLimit;  // Current max outstanding requests.
+		int    frameRequestLimit; // Recommended PageResolver per-frame request cap.
+		bool   adaptive;
+	};
 
 	// Construction:
 	PageProvider(bool async = true);
 
 	// Attempt to add a new request to the page request queue.
-	// The request might be refused if MaxOutstandingPageRequests limit
-	// was already reached for the current frame.
+	// The request might be refused if the outstanding requests limit
+	// was already reached for the current frame or if the I/O rate limiter
+	// has no budget left for it. Refused requests are retried by the resolver
+	// on the next frame, coarse pages first, so the budget goes to them first.
 	bool addPageRequest(PageId requestId);
 
-	// Steal the current ready queue.
-	// This way the background threads can continue their work while one
-	// queue is being consumed, at the cost of some extra memory allocations.
-	// This method returns the current size of the ready queue.
+	// I/O rate limiting. A token bucket refilled at 'bytesPerSecond' that holds at most
+	// 'burstBytes'. Pages found in the shared page cache are not read, so their charge is
+	// given back once the request completes. Device 0 is the default bucket, shared by every page file whose device
+	// (PageFile::getIoDeviceId) has no bucket of its own. 'bytesPerSecond' <= 0 removes the limit.
+	void setIoRateLimit(double bytesPerSecond, double burstBytes, int ioDeviceId = 0);
+	double getIoRateLimit(int ioDeviceId = 0) const;
+	IoThrottleStats getIoThrottleStats(int ioDeviceId = 0) const;
+	void resetIoThrottleStats();
+
+	// Adaptive queue depth. When enabled, the outstanding requests limit is derived from
+	// Little's law (depth = completion rate * latency goal) using the measured request
+	// latency and completion rate, and a per-frame request cap is recommended to the
+	// PageResolver. When disabled, MaxOutstandingPageRequests is used. Off by default.
+	void setAdaptiveQueueDepth(bool enable, double targetLatencyMs = DefaultTargetLatencyMs);
+	bool isAdaptiveQueueDepthEnabled() const { return queueDepth.enabled; }
+	QueueDepthStats getQueueDepthStats() const;
+
+	// Called once per frame by the PageResolver, before it issues the frame's requests.
+	// Also on frames where the page-id pass was skipped, to keep the frame count right.
+	// Folds in the measurements since the last update and adjusts the limits.
+	void updateQueueDepth();
+
+	// Recommended PageResolver per-frame request cap. Only meaningful in adaptive mode.
+	int getFrameRequestLimit() const { return queueDepth.frameRequestLimit; }
+
+	// Host-wide page cache shared with other processes. When set, pages of files that have a
+	// shared cache key (PageFile::getSharedCacheKey) are looked up in it before being read,
+	// and published to it after being read. Null (the default) disables it. Not owned: the
+	// cache must outlive the provider. Only change it while no requests are in flight.
+	void setSharedPageCache(SharedPageCache * cache) { sharedPageCache = cache; }
+	SharedPageCache * getSharedPageCache() const { return sharedPageCache; }
+
+	// Steal the current ready queue of a texture slot.
+	// Fulfilled requests are routed to a queue per texture as they complete,
+	// so each texture only touches its own pages. The background threads can
+	// continue their work while one queue is being consumed, at the cost of
+	// some extra memory allocations. Returns the number of pages stolen.
+	size_t getReadyQueue(int textureIndex, FulfilledPageRequestQueue & readyQueueOut);
+
+	// Steal the ready queues of all textures, merged into one in texture slot order.
+	// Costs a copy of every page but the first texture's. Prefer the per-texture version.
 	size_t getReadyQueue(FulfilledPageRequestQueue & readyQueueOut);
 
-	// Register/unregister textures that use this resolver.
+	// Register/unregister textures that use this provider.
 	// The provider will NOT copy the texture object. It only keeps a weak reference.
+	// Textures are stored by their stable slot index, so both operations are O(1).
 	void registerVirtualTexture(VirtualTexture * vtTex);
 	void unregisterVirtualTexture(VirtualTexture * vtTex);
 	void unregisterAllVirtualTextures();
@@ -97,32 +176,125 @@ public:
 	bool isAsync() const { return !forceSynchronous; }
 	void setAsync(bool async) { forceSynchronous = !async; }
 	int getNumOutstandingRequests() const { return static_cast<int>(outstandingRequests); }
+	int getMaxOutstandingRequests() const { return maxOutstandingRequests; }
+
+	// Registered textures, indexed by texture slot. Unused slots are null.
+	unsigned int getNumRegisteredTextures() const { return static_cast<unsigned int>(registeredTextures.size()); }
+	const VirtualTexture * getRegisteredTexture(unsigned int index) const { return registeredTextures[index]; }
+
+	// Bytes of system memory used by the fulfilled requests still waiting in the ready queue.
+	// The high-water mark is the largest size the queue reached since construction or the last reset.
+	size_t getReadyQueueMemoryBytes() const;
+	size_t getPeakReadyQueueMemoryBytes() const;
+	void resetPeakReadyQueueMemoryBytes();
 
 private:
 
 	// Internal helpers:
 	bool runAsyncRequest(PageId requestId);
 	bool runImmediateRequest(PageId requestId);
-	void pushReadyRequest(const PageRequestDataPacket & readyRequest);
+	VirtualTexture * getTextureForRequest(PageId requestId) const;
+	void pushReadyRequest(const PageRequestDataPacket & readyRequest, uint32_t slotGeneration);
+	uint32_t getSlotGeneration(PageId requestId) const;
+	bool loadPageData(PageFile * pageFile, PageId requestId, PageRequestDataPacket & pageRequest);
+	void recordCompletion(int64_t submitTimeUs, int64_t loadStartUs);
+	static int64_t getClockMicrosec();
+	bool admitIoRequest(PageId requestId);
+	int findIoBucket(int ioDeviceId) const;
+	void refundIoCharge(int bucketIndex, double bytes);
+	void applyIoRefunds();
+
+	struct IoRateBucket
+	{
+		double   bytesPerSecond;    // <= 0 if unlimited.
+		double   burstBytes;        // Bucket capacity.
+		double   tokens;            // Available bytes. Negative when in debt.
+		double   pendingCost;       // Scratch: cost of the request being admitted.
+		int64_t  lastRefillMs;      // Clock at the last refill.
+		int64_t  throttleStartMs;   // Clock at the first refusal. -1 if not throttled.
+		int64_t  throttledMs;       // Accumulated throttled time.
+		unsigned throttledRequests;
+		uint64_t admittedBytes;
+
+		bool isLimited() const { return bytesPerSecond > 0.0; }
+		void refill(int64_t nowMs);
+	};
+
+	// What one page file read of an admitted request was charged.
+	struct IoCharge
+	{
+		int    bucketIndex; // -1 if not limited.
+		double bytes;
+	};
+
+	// Adaptive queue depth state. Main thread only.
+	struct QueueDepthController
+	{
+		bool     enabled;
+		double   targetLatencyMs;
+		int64_t  windowStartUs;       // Start of the current measurement window.
+		uint64_t windowCompleted;     // Completion totals at the window start.
+		uint64_t windowLatencyUs;
+		uint64_t windowServiceUs;
+		unsigned windowFrames;        // updateQueueDepth() calls in the window.
+		unsigned windowLimitRefusals; // Requests refused by the outstanding limit in the window.
+		double   latencyMs;           // Smoothed measurements:
+		double   serviceTimeMs;
+		double   completionsPerSec;
+		double   completionsPerFrame;
+		int      frameRequestLimit;
+	};
 
 private:
 
-	// Keep track of the number of pending requests.
+	// Keep track of the number of pending requests and the current limit.
 	std::atomic<int> outstandingRequests;
+	int maxOutstandingRequests;
+
+	// Completion totals, updated by the worker threads and sampled by updateQueueDepth().
+	std::atomic<uint64_t> completedRequests;
+	std::atomic<uint64_t> totalLatencyUs;
+	std::atomic<uint64_t> totalServiceUs;
+	QueueDepthController  queueDepth;
 
-	// The queue with fulfilled page requests.
+	// The queues with fulfilled page requests, indexed by texture slot.
 	// The font-end thread that consumes the finished requests
-	// can "steal" this queue every frame via getReadyQueue() to consume
-	// the requests, while the background threads continue work on a new queue.
+	// can "steal" these queues every frame via getReadyQueue() to consume
+	// the requests, while the background threads continue work on new queues.
 	// Currently, we use a simple mutex for synchronization.
 	// This could be optimized to use lock-free data structure in the future.
-	std::mutex readyQueueMutex;
-	FulfilledPageRequestQueue readyQueue;
+	mutable std::mutex readyQueueMutex;
+	std::vector<FulfilledPageRequestQueue> readyQueues;
 
-	// Virtual textures using this provider.
+	// Bumped every time a texture slot is released. Requests remember the generation
+	// of their slot when issued, and are dropped if it changed by the time they
+	// complete, so loads still in flight for an unregistered texture can't reach the
+	// next owner of the slot. Written by the main thread under readyQueueMutex.
+	std::vector<uint32_t> slotGenerations;
+
+	// Packets currently in all ready queues and the largest number seen. Guarded by readyQueueMutex.
+	size_t readyQueueSize;
+	size_t readyQueuePeakSize;
+
+	// Virtual textures using this provider, indexed by texture slot (null if free).
 	// Just weak references. Textures must outlive the provider.
 	std::vector<VirtualTexture *> registeredTextures;
 
+	// Optional cross-process page cache. Just a weak reference.
+	SharedPageCache * sharedPageCache;
+
+	// I/O rate limiter buckets, indexed by device id. Empty if no limit was ever set.
+	// Only touched by addPageRequest and the accessors, so no locking is needed.
+	std::vector<IoRateBucket> ioBuckets;
+
+	// Charges of the request last admitted, one per page file. Handed to its reads.
+	std::vector<IoCharge> admittedIoCharges;
+
+	// Bytes to give back to each bucket, posted by the worker threads when a
+	// read is skipped. Applied on the next admission. Guarded by ioRefundMutex.
+	std::mutex ioRefundMutex;
+	std::vector<double> ioRefunds;
+
 	// Debug flag. False by default.
 	// Force all requests to be fulfilled serially form the caller thread.
 	volatile bool forceSynchronous;
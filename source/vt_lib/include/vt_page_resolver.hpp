@@ -63,6 +63,17 @@ public:
 	// enqueue per frame. Page requests are generated by endPageIdPass().
 	static constexpr int DefaultMaxPageRequestsPerFrame = 128;
 
+	// When the feedback has converged, the page-id pass is still
+	// refreshed once every this many frames, to catch anything missed.
+	static constexpr int DefaultConvergedRefreshInterval = 60;
+
+	// Compact feedback page numbers are 16 bits. The all-ones
+	// value is the white clear color, marking an invalid page.
+	static constexpr unsigned int InvalidCompactPageNumber = 0xFFFF;
+
+	// Side in pixels of the feedback blocks compared between frames by the incremental analysis.
+	static constexpr int FeedbackBlockSize = 16;
+
 	// Default constructor initializes the framebuffer with its default size.
 	// Might throw and exception if initialization fails.
 	explicit PageResolver(PageProvider & provider);
@@ -73,6 +84,28 @@ public:
 	// Frees the underlaying OpenGL framebuffer.
 	~PageResolver();
 
+	// Convergence detection. Optional; call once per frame before beginPageIdPass() with a
+	// signature of the view (e.g. hashViewMatrix() of the view-projection) and whether anything
+	// else that affects visible pages changed (objects moved, textures swapped, etc).
+	// While the signature is unchanged and the last analysis had nothing left to request,
+	// the page-id pass is skipped: begin/endPageIdPass() and resolveExternalPageIds() do nothing
+	// and the application can skip drawing the pass geometry (see isPageIdPassSkipped()).
+	void setViewSignature(uint64_t signature, bool sceneDirty = false);
+	bool isPageIdPassSkipped() const { return skipPageIdPass; }
+
+	// Forces the next page-id pass to run. Called on texture registration changes.
+	void invalidateFeedback();
+
+	// Frames between forced refreshes while converged. Zero never forces a refresh.
+	int  getConvergedRefreshInterval() const { return convergedRefreshInterval; }
+	void setConvergedRefreshInterval(int frames) { convergedRefreshInterval = frames; }
+
+	// Number of page-id passes skipped since construction.
+	unsigned int getNumSkippedPageIdPasses() const { return numSkippedPasses; }
+
+	// FNV-1a hash of a matrix (or any float array), usable as a view signature.
+	static uint64_t hashViewMatrix(const float * matrix, int numFloats = 16);
+
 	// Begin the page id generation pass.
 	// The appropriate shader program (pageIdGenPass) must be already bound!
 	void beginPageIdPass();
@@ -81,32 +114,98 @@ public:
 	// and generates the page requests for a given frame.
 	void endPageIdPass();
 
+	// Alternative to begin/endPageIdPass() for renderers that already have a depth prepass:
+	// the application writes page ids as an extra render target of its own prepass (see
+	// getPageIdGlslFuncs()) and hands the target texture to this method, which downsamples it
+	// to the feedback framebuffer resolution, then performs the feedback analysis just like
+	// endPageIdPass(). The texture must be RGBA8 and cleared to white. Its filtering is set to
+	// GL_NEAREST, since page ids can't be interpolated.
+	void resolveExternalPageIds(GLuint pageIdTexture);
+
 	// Visualize the page id generation pass as a screen overlay.
 	// This should always be called after endPageIdPass()
 	// for the output to make any sense. This is intended for debugging.
 	void visualizePageIds(const float overlayScale[2]) const;
 
+	// Compact feedback: while the page count of all registered textures fits in 16 bits, the
+	// page-id pass outputs a linear page number per pixel (each texture has a base offset in
+	// that number space) and the feedback is packed two pixels per texel before the read-back,
+	// halving the read-back size and the histogram keys. Falls back to the wide RGBA page ids
+	// automatically. Enabled by default. Requires highp floats in fragment shaders.
+	void setCompactFeedbackEnabled(bool enable);
+	bool isCompactFeedbackEnabled() const { return compactFeedbackEnabled; }
+	bool isCompactFeedbackActive()  const { return compactFeedbackActive;  }
+
+	// Base of a texture in the compact page number space. -1 if compact feedback is not active.
+	int getCompactPageBase(int textureIndex) const;
+
+	// Incremental feedback analysis: the feedback is split into square blocks, each compared
+	// with the previous read-back. Only blocks that changed are counted again, and the page
+	// histogram is patched by removing the block's old counts and adding the new ones, so the
+	// cost follows the amount of on-screen change rather than the feedback resolution. Keeps a
+	// second read-back buffer plus a small histogram per block. Same results as a full count.
+	// Enabled by default.
+	void setIncrementalFeedbackEnabled(bool enable);
+	bool isIncrementalFeedbackEnabled() const { return incrementalFeedbackEnabled; }
+
+	// Blocks counted again by the last analysis, out of getNumFeedbackBlocks().
+	int getNumChangedFeedbackBlocks() const { return frameChangedBlocks; }
+	int getNumFeedbackBlocks() const { return feedbackBlocksX * feedbackBlocksY; }
+
 	// Number of unique visible pages for the last page generation pass.
 	int getNumVisiblePages() const { return visiblePages; }
 
 	// Get/set max per-frame request limit.
+	// Overwritten every frame if the PageProvider has adaptive queue depth enabled.
 	int  getMaxPageRequestsPerFrame() const { return maxPageRequestsPerFrame; }
 	void setMaxPageRequestsPerFrame(int amount) { maxPageRequestsPerFrame = amount; }
 
+	// Request downgrading. When more pages are missing than the frame can request (per-frame
+	// limit or free provider capacity), groups of sibling pages are replaced by their parent
+	// page, one request covering them all, instead of leaving the excess out. The groups that
+	// cover the fewest screen pixels per request go first. Enabled by default.
+	void setRequestDowngradeEnabled(bool enable) { requestDowngradeEnabled = enable; }
+	bool isRequestDowngradeEnabled() const { return requestDowngradeEnabled; }
+
+	// Pages replaced by a parent in the last analysis.
+	int getNumDowngradedPages() const { return frameDowngradedPages; }
+
 	// Register/unregister textures that use this resolver.
-	// The provider will NOT copy the texture object. It only keeps a weak reference.
+	// The resolver will NOT copy the texture object. It only keeps a weak reference.
+	// Textures are stored by their stable slot index, so both operations are O(1).
 	void registerVirtualTexture(VirtualTexture * vtTex);
 	void unregisterVirtualTexture(VirtualTexture * vtTex);
 	void unregisterAllVirtualTextures();
 
 	void addDefaultRequests();
 
+	// Bytes of system memory used by the feedback read-back buffers and the analysis
+	// structures (page map, sort vector and incremental histograms). Map sizes are estimates,
+	// since the hash tables don't expose their node size. The peak is sampled during the
+	// analysis, before the per-frame structures are cleared.
+	size_t getSystemMemoryBytes() const;
+	size_t getPeakSystemMemoryBytes() const { return peakSystemMemoryBytes; }
+	void resetPeakSystemMemoryBytes() { peakSystemMemoryBytes = getSystemMemoryBytes(); }
+
+	// Estimated size of the page-id framebuffer (RGBA color + 16bits depth).
+	size_t getGpuMemoryBytes() const;
+
 private:
 
 	// Internal helpers:
 	void feedbackBufferAnalysis();
 	int  processPageRequest(PageId requestId, PageCacheMgr & pageCache);
+	int  getFrameRequestBudget() const;
+	void downgradeMissingPages(size_t budget);
 	void initFrameBuffer(int w, int h);
+	void initPackFrameBuffer();
+	void runFullScreenPass(GLuint fbo, int w, int h, GLuint programId, GLuint srcTexture) const;
+	void countWidePageIds();
+	void countCompactPageNumbers();
+	void countChangedFeedbackBlocks();
+	void resetFeedbackHistory();
+	void updateCompactFeedbackLayout();
+	PageId decodeCompactPageNumber(unsigned int pageNumber) const;
 
 private:
 
@@ -137,6 +236,35 @@ private:
 	// Doesn't have to be re-allocated if the framebuffer size never changes.
 	std::unique_ptr<Pixel4b[]> feedbackBuffer;
 
+	// Compact feedback state. 'compactPageBases' is indexed by texture slot, -1 if free.
+	// The pack target is half the width of the feedback FBO and is what gets read back.
+	bool compactFeedbackEnabled;
+	bool compactFeedbackSupported;
+	bool compactFeedbackActive;
+	std::vector<int> compactPageBases;
+	GLuint packFbo;
+	GLuint packColorTex;
+	int packFboWidth;
+
+	// Frequencies of the 16-bit page numbers when in compact mode.
+	// Only the unique numbers are decoded back into page ids.
+	std::unordered_map<uint16_t, unsigned int> compactPageMap;
+
+	// Incremental analysis state. The previous read-back is kept in 'prevFeedbackBuffer'
+	// (the two are swapped after each analysis). Histograms are keyed by the raw feedback
+	// value: the page id in wide mode, the page number in compact mode. 'feedbackHistogram'
+	// is the sum of all the block histograms. Not valid until the first incremental analysis.
+	using FeedbackCount = std::pair<uint32_t, unsigned int>;
+	std::unique_ptr<Pixel4b[]> prevFeedbackBuffer;
+	std::vector<std::vector<FeedbackCount>> blockHistograms;
+	std::unordered_map<uint32_t, unsigned int> feedbackHistogram;
+	int  feedbackBlocksX;
+	int  feedbackBlocksY;
+	int  frameChangedBlocks;
+	bool incrementalFeedbackEnabled;
+	bool feedbackHistoryValid;
+	bool feedbackHistoryCompact;
+
 	// Map of unique pages and their frequencies for the current frame:
 	// <pageId, frequency>
 	std::unordered_map<PageId, unsigned int> pageMap;
@@ -145,12 +273,42 @@ private:
 	// Sorted by mip-level (higher first).
 	std::vector<PageId> sortedPages;
 
-	// Virtual textures using this resolver.
+	// Visible pages neither resident nor in-flight, plus their pixel counts.
+	// Same order as 'sortedPages'. These are the ones that cost a request.
+	struct MissingPage
+	{
+		PageId pageId;
+		unsigned int pixels;
+	};
+	std::vector<MissingPage> missingPages;
+
+	// Virtual textures using this resolver, indexed by texture slot (null if free).
 	// Just weak references. Textures must outlive the resolver.
 	std::vector<VirtualTexture *> registeredTextures;
 
 	// Counter used for debugging.
 	int visiblePages;
+
+	// Convergence detection state. The feedback is converged when the last analysis
+	// found every visible page already cached or in-flight, with nothing left out.
+	uint64_t lastViewSignature;
+	bool hasViewSignature;
+	bool feedbackConverged;
+	bool skipPageIdPass;
+	int  framesSinceLastPass;
+	int  convergedRefreshInterval;
+	unsigned int numSkippedPasses;
+
+	// New provider requests and dropped requests in the current analysis.
+	int frameNewRequests;
+	int frameDroppedRequests;
+
+	// Request downgrading switch and pages downgraded in the current analysis.
+	bool requestDowngradeEnabled;
+	int  frameDowngradedPages;
+
+	// High-water mark for getSystemMemoryBytes().
+	size_t peakSystemMemoryBytes;
 };
 
 } // namespace vt {}
@@ -0,0 +1,224 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: vt_page_sampler.hpp
+// Author: Guilherme R. Lampert
+// Created on: 18/10/26
+// Brief: CPU-side sampling of virtual textures, for non-rendering consumers.
+//
+// License:
+//  This source code is released under the MIT License.
+//  Copyright (c) 2014 Guilherme R. Lampert.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+// ================================================================================================
+
+#ifndef VTLIB_VT_PAGE_SAMPLER_HPP
+#define VTLIB_VT_PAGE_SAMPLER_HPP
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace vt
+{
+
+// ======================================================
+// PageSampler:
+// ======================================================
+
+//
+// Reads texels of a VirtualTexture on the CPU, for systems that need the
+// texture data but don't render it (material masks for footstep sounds,
+// height and splat lookups, collision materials on a server, etc).
+//
+// - Pages are loaded from the texture's own PageFiles, including the overlay
+//   of writable textures, into a CPU page cache private to the sampler.
+//   Nothing goes through the GPU page cache, so the texture doesn't have to
+//   be linked to a PageProvider or PageResolver to be sampled.
+//
+// - Missing pages are loaded in the background. Until they arrive, samples
+//   are served from the finest resident parent page or from the mip tail of
+//   the page file, unless the caller asks to block for them with a timeout.
+//
+// - Samples are batched: UVs are translated to page and texel addresses four
+//   at a time with SSE2/NEON, then filtered bilinearly using the page borders.
+//
+// Methods are thread safe. Loads run on the default priority GCD queue.
+//
+class PageSampler final
+	: public NonCopyable
+{
+public:
+
+	// Default page cache size. 256 pages of 128x128 RGBA is 16MB.
+	static constexpr int DefaultMaxCachedPages = 256;
+
+	// Served level reported for samples taken from the mip tail, or
+	// constant grey if the page file has no tail.
+	static constexpr int MipTailLevel = -1;
+
+	// What to do with pages that are not in the CPU cache.
+	enum class MissPolicy
+	{
+		// Start loading them and sample the best resident
+		// level right away. Never waits for the disk.
+		BestResident,
+
+		// Load them and wait, up to the timeout. Pages still
+		// missing then fall back to the best resident level.
+		Block
+	};
+
+	struct Stats
+	{
+		uint64_t samples;          // Total UVs sampled.
+		uint64_t fallbackSamples;  // Samples served from a coarser level than requested.
+		uint64_t pageLoads;        // Pages loaded into the cache.
+		uint64_t pageEvictions;    // Pages evicted to make room for others.
+		uint64_t blockTimeouts;    // Blocking batches that hit the timeout.
+		double   sampleSeconds;    // Time spent inside sample(), including blocking.
+		double   samplesPerSecond; // samples / sampleSeconds.
+		int      cachedPages;      // Pages currently in the cache.
+		int      pendingLoads;     // Loads currently in flight.
+	};
+
+	explicit PageSampler(int cacheSizeInPages = DefaultMaxCachedPages);
+
+	// Waits for the loads in flight.
+	~PageSampler();
+
+	// Samples mip level 'mipLevel' of page file 'fileIndex' of 'vtTex' at 'count' positions.
+	// 'uvs' has interleaved [u,v] pairs, clamped to [0,1]. 'rgbaOut' receives 4 floats
+	// in the [0,1] range per position. If 'servedLevels' is not null, it receives the
+	// level each sample actually came from. 'timeoutMs' is only used by MissPolicy::Block.
+	// Returns the number of samples served from the requested level.
+	int sample(VirtualTexture & vtTex, const float * uvs, int count, int mipLevel,
+	           float * rgbaOut, int * servedLevels = nullptr, unsigned int fileIndex = 0,
+	           MissPolicy missPolicy = MissPolicy::BestResident, int timeoutMs = 100);
+
+	// Loads the pages covering the UVs at 'mipLevel' in the background, without sampling.
+	void prefetch(VirtualTexture & vtTex, const float * uvs, int count, int mipLevel, unsigned int fileIndex = 0);
+
+	// Drops every cached page and mip tail. Loads in flight are still inserted when done.
+	void purgeCache();
+
+	// Must be called before a page file of a sampled texture is destroyed or
+	// replaced, so its cached pages are dropped. Waits for its loads in flight.
+	void forgetPageFile(const PageFile * pageFile);
+
+	// Accessors:
+	Stats getStats() const;
+	void resetStats();
+	int getMaxCachedPages() const { return maxCachedPages; }
+	size_t getMemoryBytes() const;
+
+private:
+
+	// Translated address of a sample at a given level.
+	struct SampleAddress
+	{
+		int   pageX;
+		int   pageY;
+		float texelX; // Texel position within the page, borders included,
+		float texelY; // already offset by -0.5 for the bilinear filter.
+	};
+
+	// Cached pages are keyed by page file and page id.
+	struct PageKey
+	{
+		const PageFile * pageFile;
+		PageId pageId;
+
+		bool operator == (const PageKey & other) const
+		{
+			return (pageFile == other.pageFile) && (pageId == other.pageId);
+		}
+	};
+
+	struct PageKeyHash
+	{
+		size_t operator()(const PageKey & key) const
+		{
+			return std::hash<const void *>()(key.pageFile) ^ (static_cast<size_t>(key.pageId) * 0x9E3779B1u);
+		}
+	};
+
+	struct CachedPage
+	{
+		std::unique_ptr<PageRequestDataPacket> data;
+		uint64_t lastUsed;
+	};
+
+	struct LoadContext
+	{
+		PageSampler * sampler;
+		PageFile    * pageFile;
+		PageKey       key;
+		uint32_t      fileId;
+	};
+
+	// Translates 'count' UVs at a level with 'pagesX' by 'pagesY' pages.
+	// UVs are clamped to [0,1], then scaled by the texture's 'uvScale'.
+	static void translateAddresses(const float * uvs, int count, int pagesX, int pagesY,
+	                               const float * uvScale, SampleAddress * addresses);
+
+	// Bilinear fetch from a page or from the mip tail.
+	static void samplePage(const Pixel4b * pageData, const SampleAddress & addr, float * rgbaOut);
+	static void sampleMipTail(const MipTailData & tail, const float * uv, const float * uvScale, float * rgbaOut);
+
+	// These expect 'cacheMutex' to be held. The ones taking the lock release
+	// it while reading a mip tail from the file, and hold it again on return.
+	const Pixel4b * findPage(const PageKey & key);
+	void requestPageLoad(PageFile * pageFile, const PageKey & key, unsigned int fileIndex);
+	void sampleBestResident(const VirtualTexture & vtTex, PageFile * pageFile, int mipOffset,
+	                        const float * uv, int firstLevel, float * rgbaOut, int & servedLevel,
+	                        std::unique_lock<std::mutex> & lock);
+	static PageKey makePageKey(const VirtualTexture & vtTex, const PageFile * pageFile,
+	                           const SampleAddress & addr, int level, int mipOffset);
+	const MipTailData * findMipTail(PageFile * pageFile, std::unique_lock<std::mutex> & lock);
+
+	// Adds the result of a background load. Takes the lock.
+	void insertLoadedPage(const PageKey & key, std::unique_ptr<PageRequestDataPacket> data);
+	static void pageLoadTask(void * param);
+
+	// Pages in one axis of a mip level. Same as the PageResolver for full resolution
+	// files. Reduced layers have the page count of the level 'mipOffset' levels down.
+	static int levelPages(const VirtualTexture & vtTex, int level, int axis, int mipOffset);
+
+	mutable std::mutex cacheMutex;
+	std::condition_variable pageLoadedCond;
+
+	std::unordered_map<PageKey, CachedPage, PageKeyHash> cachedPages;
+	std::unordered_set<PageKey, PageKeyHash> pendingPages;
+	std::unordered_map<const PageFile *, std::unique_ptr<MipTailData>> mipTails;
+
+	const int maxCachedPages;
+	uint64_t useCounter;
+	Stats stats;
+};
+
+using PageSamplerPtr = std::unique_ptr<PageSampler>;
+
+} // namespace vt {}
+
+#endif // VTLIB_VT_PAGE_SAMPLER_HPP
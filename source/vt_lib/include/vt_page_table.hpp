@@ -96,6 +96,9 @@ public:
 	// easy to identify. This is useful when debugging the VT system.
 	void fillTextureWithDebugData();
 
+	// Estimated size of the GL texture. Two RGBA levels are allocated (full and half size).
+	static constexpr size_t getGpuMemoryBytes() { return (TotalTablePixels + TotalTablePixels / 4) * sizeof(Pixel4b); }
+
 private:
 
 	void initTexture();
@@ -0,0 +1,203 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: vt_shared_page_cache.hpp
+// Author: Guilherme R. Lampert
+// Created on: 18/10/26
+// Brief: Host-wide page cache in POSIX shared memory, shared by renderer processes.
+//
+// License:
+//  This source code is released under the MIT License.
+//  Copyright (c) 2014 Guilherme R. Lampert.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+// ================================================================================================
+
+#ifndef VTLIB_VT_SHARED_PAGE_CACHE_HPP
+#define VTLIB_VT_SHARED_PAGE_CACHE_HPP
+
+#include <string>
+
+namespace vt
+{
+
+// ======================================================
+// SharedPageCache:
+// ======================================================
+
+//
+// A page cache shared by all the processes of a host that stream the same
+// virtual textures, so that each page is read and decoded once per host,
+// not once per process. Attach a cache to a PageProvider with
+// PageProvider::setSharedPageCache(). The provider looks pages up in it
+// before reading the page file and publishes the pages it reads.
+//
+// - The cache is a POSIX shared memory segment. It has a fixed number of
+//   page slots and is created by the first process that opens the name.
+//   The other processes attach to it. It outlives its processes until
+//   removeSegment() is called or the host reboots.
+//
+// - Pages are keyed by (PageFile::getSharedCacheKey(), page x/y/level).
+//   The texture slot index is not part of the key, since it is local to
+//   each process.
+//
+// - The index is set-associative. A key hashes to a set of WaysPerSet
+//   slots, so a lookup only probes that set. There are no locks. Each
+//   slot has one atomic control word, holding its state, a generation
+//   and a reader count. Readers pin a slot while they copy its page out.
+//   A slot is only recycled once it has no readers. The generation
+//   increments on each reuse, so a stale pin attempt always fails.
+//
+// - A miss reserves a slot in the Loading state before the page is read.
+//   Processes that miss the same page meanwhile wait for that load, up to
+//   the load wait timeout, instead of reading the page again. Each set has
+//   a reservation counter. A reservation only stands if the counter hasn't
+//   moved since the set was scanned, so two processes can't both reserve
+//   the same page.
+//
+// Methods are thread and process safe. If a process crashes while it holds
+// a Loading reservation, that slot is reclaimed after StaleReservationMs.
+// If it crashes while publishing or reading a page, the slot stays lost
+// until the segment is removed.
+//
+class SharedPageCache final
+	: public NonCopyable
+{
+public:
+
+	// macOS limits shared memory names to 31 characters, including the leading slash.
+	static constexpr const char * DefaultSegmentName = "/vt_shared_page_cache";
+
+	// Default segment size. 2048 pages of 128x128 RGBA is 128MB.
+	static constexpr int DefaultNumSlots = 2048;
+
+	// Slots probed per lookup. The slot count is rounded up to a multiple of it.
+	static constexpr int WaysPerSet = 8;
+
+	// Longest wait for a page that another process is loading. After that, the page is read again.
+	static constexpr int DefaultLoadWaitMs = 200;
+
+	// A Loading reservation older than this belongs to a dead or stuck process and can be reclaimed.
+	static constexpr int StaleReservationMs = 5000;
+
+	// Result of lookupOrReserve().
+	enum class LookupResult
+	{
+		Hit,      // The page was copied out of the cache.
+		Reserved, // Miss. Load the page, then hand it to publish() or release it with cancel().
+		Uncached  // Miss. No slot was free (or the wait timed out), so load without publishing.
+	};
+
+	// A Loading slot owned by the caller.
+	struct Reservation
+	{
+		uint32_t slot;
+		uint32_t generation;
+	};
+
+	// Host-wide counters, summed over all the processes attached to the segment.
+	struct Stats
+	{
+		uint64_t hits;          // Lookups served from the cache, including those that waited.
+		uint64_t misses;        // Lookups that had to read the page file.
+		uint64_t loadWaits;     // Lookups that waited for another process to load the page.
+		uint64_t waitTimeouts;  // Waits that gave up and read the page file.
+		uint64_t publishes;     // Pages added to the cache.
+		uint64_t evictions;     // Pages dropped to make room for others.
+		uint64_t staleReclaims; // Loading reservations of dead processes reclaimed.
+		int      numSlots;      // Size of the segment, in pages.
+		int      readySlots;    // Slots currently holding a page.
+	};
+
+	// Creates the named segment with 'numSlots' page slots, or attaches to it if it already exists.
+	// When attaching, the existing segment's size is used. Throws a vt::Exception on failure.
+	explicit SharedPageCache(const std::string & segmentName = DefaultSegmentName,
+	                         int numSlots = DefaultNumSlots, int loadWaitMs = DefaultLoadWaitMs);
+
+	// Detaches from the segment. The segment itself is left for the other processes.
+	~SharedPageCache();
+
+	// Looks up a page. On a hit, copies it to 'pageData'. On a miss, tries to
+	// reserve a slot for it. 'pageId' may carry any texture slot index.
+	LookupResult lookupOrReserve(uint64_t fileKey, PageId pageId, Pixel4b * pageData, Reservation & reservation);
+
+	// Fills a reserved slot with the loaded page and makes it visible to all processes.
+	// The page is dropped if the reservation was reclaimed as stale in the meantime.
+	void publish(const Reservation & reservation, const Pixel4b * pageData);
+
+	// Releases a reservation without publishing, e.g. if the load failed.
+	void cancel(const Reservation & reservation);
+
+	// Host-wide statistics. Counts the ready slots, so this touches the whole slot table.
+	Stats getStats() const;
+
+	// Accessors:
+	int getNumSlots() const { return static_cast<int>(numSlots); }
+	size_t getSegmentBytes() const { return segmentSize; }
+	bool isSegmentCreator() const { return segmentCreator; }
+	const std::string & getSegmentName() const { return segmentName; }
+
+	// Unlinks the named segment. Processes already attached keep their mapping.
+	// The next cache created with this name starts empty. Returns false if there was no such segment.
+	static bool removeSegment(const std::string & name = DefaultSegmentName);
+
+private:
+
+	struct SegmentHeader;
+	struct SetInfo;
+	struct SlotInfo;
+
+	// What scanSet() found for a key.
+	enum class ScanResult
+	{
+		NotFound,
+		Hit,
+		Loading
+	};
+
+	ScanResult scanSet(uint32_t setIndex, uint64_t fileKey, uint32_t pageKey, Pixel4b * pageData);
+	bool reserveSlot(uint32_t setIndex, uint64_t fileKey, uint32_t pageKey, Reservation & reservation);
+	uint32_t getSetIndex(uint64_t fileKey, uint32_t pageKey) const;
+	uint8_t * getSlotData(uint32_t slot) const;
+	void unmap();
+
+	// Layout of a segment with the given number of slots.
+	static size_t getSlotTableOffset(uint32_t slotCount);
+	static size_t getDataOffset(uint32_t slotCount);
+
+	// The mapped segment.
+	uint8_t       * mappedData;
+	size_t          segmentSize;
+	SegmentHeader * header;
+	SetInfo       * sets;
+	SlotInfo      * slots;
+
+	uint32_t numSlots;
+	uint32_t numSets;
+	int loadWaitMs;
+	bool segmentCreator;
+	const std::string segmentName;
+};
+
+using SharedPageCachePtr = std::unique_ptr<SharedPageCache>;
+
+} // namespace vt {}
+
+#endif // VTLIB_VT_SHARED_PAGE_CACHE_HPP
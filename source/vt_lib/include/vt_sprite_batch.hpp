@@ -0,0 +1,150 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: vt_sprite_batch.hpp
+// Author: Guilherme R. Lampert
+// Created on: 18/10/26
+// Brief: Streaming batcher for the 2D quads of the debug text and UI.
+//
+// License:
+//  This source code is released under the MIT License.
+//  Copyright (c) 2014 Guilherme R. Lampert.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+// ================================================================================================
+
+#ifndef VTLIB_VT_SPRITE_BATCH_HPP
+#define VTLIB_VT_SPRITE_BATCH_HPP
+
+namespace vt
+{
+
+// ======================================================
+// SpriteBatch:
+// ======================================================
+
+//
+// Screen quads for the built-in text and the mini UI.
+//
+// - Quads are stored in fixed size arrays allocated on first use, so
+//   adding and flushing never touches the heap after that.
+//
+// - At flush time the quads are grouped by layer, then by texture, and
+//   each group is a single draw call. Groups of the same layer are drawn in
+//   the order their textures first appeared; lower layers are drawn first.
+//
+// - Vertexes are 16 bytes: float position, normalized 16bit tex coords and
+//   a RGBA8 color. Tex coords are therefore clamped to the [0,1] range.
+//
+// - Vertexes are streamed to a ring buffer VBO, which is only orphaned
+//   when it wraps around. The index buffer is static and shared by all
+//   batches, since every quad uses the same index pattern.
+//
+class SpriteBatch final
+	: public NonCopyable
+{
+public:
+
+	// Quads per flush. Further quads are dropped with a warning.
+	// 4 vertexes per quad must be addressable with 16bit indexes.
+	static constexpr int MaxQuads = 4096;
+
+	// Distinct layer+texture pairs per flush.
+	static constexpr int MaxDrawGroups = 64;
+
+	// Layers are in the [0, MaxLayers) range.
+	static constexpr int MaxLayers = 8;
+
+	// The ring buffer holds this many full flushes before being orphaned.
+	static constexpr int RingBufferFlushes = 4;
+
+	// 'debugName' is only used for the log. Must be a string literal.
+	explicit SpriteBatch(const char * debugName);
+
+	// Adds a quad with corners (x,y) and (x+w,y+h). 'uvs' are the tex coords of each of the 4 corners,
+	// in clockwise order starting at (x,y). A zero 'textureId' draws with whatever texture is bound
+	// to unit 0 at flush time.
+	void addQuad(float x, float y, float w, float h, const float color[4],
+	             const float uvs[][2], GLuint textureId, int layer = 0);
+
+	// Draws all the quads added since the last flush with the 2D text shader,
+	// with alpha blending and no depth test. Does nothing if the batch is empty.
+	void flush(const float * mvpMatrix);
+
+	// Frees the GL buffers and the quad storage. The batch is still usable afterwards.
+	void shutdown();
+
+	// Accessors:
+	int getNumQuads()     const { return numQuads;      }
+	int getNumDrawCalls() const { return lastDrawCalls; }
+
+private:
+
+	struct Vertex
+	{
+		float    x, y;
+		uint16_t u, v;
+		uint8_t  r, g, b, a;
+	};
+
+	struct Quad
+	{
+		Vertex verts[4];
+	};
+
+	struct DrawGroup
+	{
+		GLuint textureId;
+		int    layer;
+		int    numQuads;
+		int    firstQuad; // Into the sorted quads. Set by flush().
+	};
+
+	void ensureBuffersCreated();
+	int  findDrawGroup(GLuint textureId, int layer);
+	int  sortQuadsByDrawGroup();
+
+	// Quads in submission order and the draw group of each one.
+	// Sorted by draw group into 'sortedQuads' before being uploaded.
+	std::unique_ptr<Quad[]>    quads;
+	std::unique_ptr<Quad[]>    sortedQuads;
+	std::unique_ptr<uint8_t[]> quadGroups;
+	int numQuads;
+
+	DrawGroup drawGroups[MaxDrawGroups];
+	int numDrawGroups;
+	int lastDrawGroup; // Consecutive quads usually share the group.
+
+	// Ring buffer position, in quads.
+	GLuint vbo;
+	int ringOffset;
+
+	int  lastDrawCalls;
+	bool overflowWarned;
+	const char * name;
+
+	// Index buffer with the two triangles of MaxQuads quads.
+	static GLuint sharedQuadIbo;
+	static int sharedQuadIboRefs;
+};
+
+} // namespace vt {}
+
+#endif // VTLIB_VT_SPRITE_BATCH_HPP
@@ -45,12 +45,20 @@ class VirtualTexture final
 {
 public:
 
+	// Texture slots are limited by the 8 bits texture index of a PageId.
+	static constexpr int MaxTextureSlots = 256;
+
 	// Construct from a VTFF page file. If 'pageIndirection' is null a new table is created.
 	VirtualTexture(VTFFPageFilePtr vtffFile, PageIndirectionTablePtr pageIndirection = nullptr);
 
+	// Construct from a texture stored in a VTFFArchive. Dimensions come from the archive directory.
+	// The archive must outlive the VirtualTexture.
+	VirtualTexture(VTFFArchivePageFilePtr archiveFile, PageIndirectionTablePtr pageIndirection = nullptr);
+
 	// Construct with a set of page files. This is a common case for objects that render using a
 	// diffuse + normal + specular texture set. For each page file, a unique page table texture is created.
-	// All page files share the same indirection table and cache manager.
+	// All page files share the same indirection table and cache manager. Files after the first may
+	// be reduced resolution layers (e.g. a half-size specular map), 2^k times smaller with k fewer levels.
 	VirtualTexture(VTFFPageFilePtr * vtffFiles, size_t numFiles, PageIndirectionTablePtr pageIndirection = nullptr);
 
 	// Construct from an exiting page file with user provided texture dimensions.
@@ -58,8 +66,16 @@ public:
 	VirtualTexture(const int * vtPagesX, const int * vtPagesY, int vtNumLevels,
 	               PageFilePtr pageFile, PageIndirectionTablePtr pageIndirection);
 
+	// Frees the mip tail textures.
+	~VirtualTexture();
+
 	// Per frame update of the virtual texture.
 	// Must be called every rendering frame of the game loop to upload new texture pages to the GPU.
+	// This overload takes this texture's own ready queue from the linked PageProvider.
+	void frameUpdate(bool updateIndirectionTable = true);
+
+	// Same as above, but with a queue provided by the caller.
+	// Entries belonging to other textures are skipped.
 	void frameUpdate(const FulfilledPageRequestQueue & pageRequestUploads, bool updateIndirectionTable = true);
 
 	// Draws a developer stats panel for this texture and its cache. Uses the built-in VT GUI.
@@ -74,13 +90,49 @@ public:
 
 	// Replaces the current page file with the new one and sets the new one
 	// to point to the old page file that this texture had at the given index.
+	// Reloads the mip tail of that index if the tails were already loaded.
+	// With page writing enabled, the overlay stays on top of the new file.
+	// For a reduced layer, the new file must have the same reduced dimensions.
 	void replacePageFile(PageFilePtr & newPageFile, unsigned int index = 0);
 
+	// Makes the texture writable. Every page file gets wrapped by an OverlayPageFile,
+	// so pages written with writePage() take precedence over the original data from
+	// then on. Each writable texture needs an overlay of its own. Call it before linking
+	// the texture to a PageProvider, with no requests in flight.
+	void enablePageWriting(PageOverlayPtr overlay);
+	bool isPageWritingEnabled() const { return pageOverlay != nullptr; }
+
+	// Replaces the contents of a page of page file 'fileIndex'. The texture index of
+	// 'pageId' is ignored. If the page is in the cache, it is updated right away and
+	// marked dirty. The data is copied and written back to the overlay file by the
+	// background write-back. Coarser levels are not updated, that's up to the caller.
+	// Main thread only. Returns false if page writing is not enabled or 'fileIndex' is a reduced layer.
+	bool writePage(PageId pageId, const Pixel4b * pageData, unsigned int fileIndex = 0);
+
+	// Get the PageOverlay. Null if page writing is not enabled.
+	const PageOverlay * getPageOverlay() const { return pageOverlay.get(); }
+	PageOverlay * getPageOverlay() { return pageOverlay.get(); }
+
+	// Uploads the mip tail of every page file to a small never evicted texture that the shaders
+	// sample where no page is resident. Files without a tail get a 1x1 grey texture.
+	// Called by the PageResolver on registration. Does nothing if already loaded.
+	void loadMipTails();
+
+	// Mip tail texture of a page file. Zero until loadMipTails() is called.
+	GLuint getMipTailTexture(unsigned int index = 0) const
+	{
+		return (index < mipTailTextures.size()) ? mipTailTextures[index] : 0;
+	}
+
 	// Global index of this VT, necessary when rendering with multiple VTs.
 	int getTextureIndex() const { return textureIndex; }
 
-	// This is called internally by the PageProvider when the texture is linked to it.
-	void setTextureIndex(unsigned int index) { textureIndex = index; }
+	// These are called internally by the PageProvider and PageResolver when the texture is linked/unlinked.
+	// The texture index is a stable slot shared by both. It is acquired by whichever links the texture first
+	// and only returned to the free list once the texture is unlinked from both, so the index of a live
+	// texture never changes. Release must be called after clearing the provider/resolver pointer.
+	void acquireTextureSlot();
+	void releaseTextureSlot();
 
 	// This is called internally by PageProvider when the texture is linked to it.
 	// You cannot render with a VirtualTexture until it is linked to a PageProvider.
@@ -120,14 +172,38 @@ public:
 	const float * getLevel0SizeInPixels() const { return level0SizePixels; }
 	const float * getLevel0SizeInPages()  const { return level0SizePages;  }
 
+	// Scale applied to the texture coordinates before addressing the pages. Less than
+	// one in an axis where the image only partially fills the right/bottom pages.
+	// The render and page-id shaders take it in the u_vt_uv_scale uniform.
+	const float * getUVScale() const { return uvScale; }
+
+	// How many levels smaller than the first file the given page file is. Zero for a full
+	// resolution file. Reduced layers are detected by the multi-file constructor and
+	// magnified by the lit shader, which takes 1/2^offset in the u_vt_layer_scale uniform.
+	int getLayerMipOffset(unsigned int index = 0) const { return layerMipOffsets[index]; }
+
 	// Number of mipmap levels for this VT. A value between 1 and MaxVTMipLevels - 1.
 	int getNumLevels() const { return numLevels; }
 
+	// Adds the memory used by this texture to 'stats'. Fields are accumulated, not overwritten.
+	// The indirection table is counted in full, even if shared with other textures.
+	void getMemoryStats(struct MemoryStats & stats) const;
+
 private:
 
 	using PageTablePtr = std::unique_ptr<PageTable>;
 	using PageCachePtr = std::unique_ptr<PageCacheMgr>;
 
+	// Creates the mip tail texture for a page file. Returns its size in bytes.
+	size_t createMipTailTexture(unsigned int index);
+
+	// Starts the write-back of the pages written so far, if it is due.
+	void updatePageWriteBack();
+
+	// Data to upload for a ready request. Pages written while their load was
+	// in flight are taken from the overlay, the loaded copy is stale.
+	const Pixel4b * getPageDataForUpload(const PageRequestDataPacket & request);
+
 	// The texture data sources we stream from.
 	// Need at least one, but can have many.
 	std::vector<PageFilePtr>  pageFiles;
@@ -140,6 +216,10 @@ private:
 	// Each texture requires an exclusive page cache manager for the page table(s).
 	PageCachePtr pageCacheMgr;
 
+	// One always-resident mip tail texture per page file, plus their sizes in bytes.
+	std::vector<GLuint> mipTailTextures;
+	std::vector<size_t> mipTailBytes;
+
 	// Weak references to the page provider and resolver that service this texture.
 	// These pointers are only set when the texture is linked to them.
 	PageProvider * pageProvider;
@@ -148,10 +228,25 @@ private:
 	// VT texture index in the provider & resolver list.
 	int textureIndex;
 
+	// Pages taken from the provider by frameUpdate(). Swapped with the provider's
+	// queue each frame, so the two buffers are reused instead of reallocated.
+	FulfilledPageRequestQueue readyPages;
+
+	// Writable VT state. Overlay is null if page writing is not enabled.
+	// 'writtenInFlightPages' are pages written while a load for them was pending.
+	PageOverlayPtr pageOverlay;
+	std::vector<PageId> writtenInFlightPages;
+	std::vector<Pixel4b> overlayPageScratch;
+	bool writeBackRequested;
+
 	// These are required by the PageResolver. Cached for easy access.
 	int   numLevels;
 	float level0SizePixels[2];
 	float level0SizePages[2];
+	float uvScale[2];
+
+	// Mip offset of each page file. Non-zero for reduced resolution layers.
+	std::vector<int> layerMipOffsets;
 
 	// Debug counters:
 	unsigned int numPageUploads;
@@ -166,10 +261,60 @@ private:
 void renderBindPageIdPassShader();
 void renderBindTextureForPageIdPass(const VirtualTexture & vtTex);
 
-// Final/textured render pass:
+// Page id output from an application shader that includes getPageIdGlslFuncs(),
+// e.g. as an extra render target of the application's depth prepass.
+// The target is later consumed by PageResolver::resolveExternalPageIds().
+struct PageIdShaderUniforms
+{
+	GLint log2MipScaleFactor; // float
+	GLint vtMaxMipLevel;      // float
+	GLint vtIndex;            // float
+	GLint vtSizePixels;       // vec2
+	GLint vtSizePages;        // vec2
+	GLint vtPageBase;         // float
+	GLint vtUVScale;          // vec2
+};
+PageIdShaderUniforms renderGetPageIdShaderUniforms(GLuint programId);
+void renderBindTextureForPageIdOutput(const PageIdShaderUniforms & uniforms, const VirtualTexture & vtTex,
+                                      float log2MipScaleFactor = 3.0f); // Application program must be bound.
+
+// Final/textured render pass. Binding a texture also sets its UV
+// scale in the shader bound by the last renderBind*TexturedPassShader().
 void renderBindTexturedPassShader(bool simpleRender);
 void renderBindTextureForTexturedPass(const VirtualTexture & vtTex);
 
+// Batched rendering, for many objects sharing a mesh. Instead of binding the VT params and setting
+// the MVP per object, the per-instance MVPs (and page id params, for the page-id pass) are uploaded
+// to uniform arrays once per batch of up to MaxRenderBatchInstances. The shaders index them with an
+// instance index attribute (RenderInstanceIndexAttrib). With GL_EXT_instanced_arrays each batch is
+// a single instanced draw. Without it, every instance is still one draw, but with no uniform uploads
+// in between. The page-id pass can mix textures in a batch. The textured pass binds each texture once,
+// drawing all of its instances together. Only single page file textures and the simple (unlit)
+// textured shader are supported. The application binds the mesh's vertex arrays (position at index 0,
+// tex coords at 4) and index buffer before drawing. The log2 mip scale factor and mip debug bias
+// are set with the usual renderSet*() functions, after binding the batched shader.
+constexpr int    MaxRenderBatchInstances   = 16; // Must match the batched vertex shaders.
+constexpr GLuint RenderInstanceIndexAttrib = 5;
+
+struct RenderInstance
+{
+	const float *          mvpMatrix; // 4x4 matrix, 16 floats.
+	const VirtualTexture * vtTex;
+};
+
+// glDrawElements() params of the mesh shared by the instances.
+struct RenderDrawElements
+{
+	GLenum       mode;
+	GLsizei      indexCount;
+	GLenum       indexType;
+	const void * indices; // Offset into the bound index buffer.
+};
+
+void renderBindBatchedPageIdPassShader();
+void renderBindBatchedTexturedPassShader();
+void renderDrawInstances(const RenderInstance * instances, int numInstances, const RenderDrawElements & draw);
+
 // Render params (require the proper shader to be bound):
 void renderSetMvpMatrix(const float * mvpMatrix);
 void renderSetMipDebugBias(float mipDebugBias);
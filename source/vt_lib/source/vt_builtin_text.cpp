@@ -32,8 +32,10 @@
 
 #include "vt.hpp"
 #include "vt_builtin_text.hpp"
+#include "vt_sprite_batch.hpp"
 
 #include <cctype>
+#include <cstdarg>
 #include <cstdio>
 
 namespace vt
@@ -249,20 +251,8 @@ extern void bindTextAtlasTexture();
 
 namespace {
 
-struct SpriteVertex
-{
-	float x, y, u, v;
-	float r, g, b, a;
-};
-
-// Batched geometry:
-static std::vector<SpriteVertex> vertexBatch;
-static std::vector<uint16_t>     indexBatch;
-
-// GL buffers for text drawing:
-static GLuint textVbo;
-static GLuint textIbo;
-static bool textBuffersInitialized;
+// Glyph quadrilaterals. All use the atlas texture.
+static SpriteBatch textBatch("debug text");
 
 // Null/empty glyph. Used as a safe return value for getBuiltInFontGlyph().
 static const BuiltInFontGlyph nullGlyph = { 0.0f, 0.0f, 0.0f, 0.0f, 0, 0, nullptr };
@@ -282,56 +272,13 @@ static int getWhiteSpaceWidth(const BuiltInFontId fontId)
 	return builtInFonts[fontId].glyphs[0].w;
 }
 
-static void ensureTextVboAndIboCreated()
-{
-	// One time initialization.
-	if (textBuffersInitialized)
-	{
-		return;
-	}
-
-	glGenBuffers(1, &textVbo);
-	glGenBuffers(1, &textIbo);
-	textBuffersInitialized = true;
-
-	vtLogComment("Created VBO/IBO for debug text drawing...");
-}
-
 static void addGlyphQuadrilateral(const float x, const float y, const float w, const float h, const float color[4], const float uvs[][2])
 {
 	assert(w > 0.0f);
 	assert(h > 0.0f);
 
-	const uint16_t indexes[] = { 0, 1, 2, 2, 3, 0 };
-	SpriteVertex verts[4];
-
-	// Store scaled position:
-	verts[0].x = x;     verts[0].y = y;
-	verts[1].x = x + w; verts[1].y = y;
-	verts[2].x = x + w; verts[2].y = y + h;
-	verts[3].x = x;     verts[3].y = y + h;
-
-	// And texture coords:
-	verts[0].u = uvs[0][0]; verts[0].v = uvs[0][1];
-	verts[1].u = uvs[1][0]; verts[1].v = uvs[1][1];
-	verts[2].u = uvs[2][0]; verts[2].v = uvs[2][1];
-	verts[3].u = uvs[3][0]; verts[3].v = uvs[3][1];
-
-	// Store vertex color:
-	verts[0].r = color[0]; verts[0].g = color[1]; verts[0].b = color[2]; verts[0].a = color[3];
-	verts[1].r = color[0]; verts[1].g = color[1]; verts[1].b = color[2]; verts[1].a = color[3];
-	verts[2].r = color[0]; verts[2].g = color[1]; verts[2].b = color[2]; verts[2].a = color[3];
-	verts[3].r = color[0]; verts[3].g = color[1]; verts[3].b = color[2]; verts[3].a = color[3];
-
-	// Add indexes offseting the base vertex:
-	const uint16_t baseVertex = static_cast<uint16_t>(vertexBatch.size());
-	for (size_t i = 0; i < arrayLength(indexes); ++i)
-	{
-		indexBatch.push_back(indexes[i] + baseVertex);
-	}
-
-	// Add vertexes to triangle batch:
-	vertexBatch.insert(vertexBatch.end(), verts, verts + arrayLength(verts));
+	// Zero texture: the atlas is bound by flushTextBatches().
+	textBatch.addQuad(x, y, w, h, color, uvs, 0);
 }
 
 } // namespace {}
@@ -353,7 +300,6 @@ bool loadBuiltInFont(const BuiltInFontId fontId)
 	// for the text rendering are also initialized.
 	// These functions are no-ops if the resources are already available.
 	ensureTextAtlasCreated();
-	ensureTextVboAndIboCreated();
 
 	// Load & decompress the glyphs then copy bitmaps to the atlas:
 	builtInFonts[fontId].load(compressedBuiltInFonts[fontId]);
@@ -409,19 +355,7 @@ void unloadAllBuiltInFonts()
 		unloadBuiltInFont(static_cast<BuiltInFontId>(i));
 	}
 
-	vertexBatch.clear();
-	vertexBatch.shrink_to_fit();
-
-	indexBatch.clear();
-	indexBatch.shrink_to_fit();
-
-	glDeleteBuffers(1, &textVbo);
-	textVbo = 0;
-
-	glDeleteBuffers(1, &textIbo);
-	textIbo = 0;
-
-	textBuffersInitialized = false;
+	textBatch.shutdown();
 }
 
 // ======================================================
@@ -658,56 +592,14 @@ void flushTextBatches(const float * mvpMatrix)
 {
 	assert(mvpMatrix != nullptr);
 
-	if (vertexBatch.empty() || indexBatch.empty())
+	if (textBatch.getNumQuads() == 0)
 	{
 		return;
 	}
 
-	assert(textBuffersInitialized);
-	assert(textVbo != 0);
-	assert(textIbo != 0);
-
-	// Update the buffers:
-
-	glBindBuffer(GL_ARRAY_BUFFER, textVbo);
-	glBufferData(GL_ARRAY_BUFFER, vertexBatch.size() * sizeof(SpriteVertex), vertexBatch.data(), GL_STREAM_DRAW);
-
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, textIbo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBatch.size() * sizeof(uint16_t), indexBatch.data(), GL_STREAM_DRAW);
-
-	// Draw call:
-
-	// First vec4 are position + tex coords:
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteVertex), nullptr);
-
-	// Second vec4 is the vertex color:
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteVertex), reinterpret_cast<GLvoid *>(sizeof(float) * 4));
-
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glEnable(GL_BLEND);
-	glDisable(GL_DEPTH_TEST);
-	glDisable(GL_CULL_FACE);
-
+	// Whole batch is a single draw with the atlas texture.
 	bindTextAtlasTexture();
-
-	const GlobalShaders & shaders = getGlobalShaders();
-	gl::useShaderProgram(shaders.drawText2D.programId);
-	gl::setShaderProgramUniform(shaders.drawText2D.unifMvpMatrix, mvpMatrix, 16);
-
-	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indexBatch.size()), GL_UNSIGNED_SHORT, nullptr);
-
-	glEnable(GL_CULL_FACE);
-	glEnable(GL_DEPTH_TEST);
-	glDisable(GL_BLEND);
-
-	// Cleanup:
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	vertexBatch.clear();
-	indexBatch.clear();
+	textBatch.flush(mvpMatrix);
 }
 
 // ======================================================
@@ -37,6 +37,8 @@
 #include <fstream>
 #include <streambuf>
 #include <iostream>
+#include <algorithm>
+#include <vector>
 #include <cmath>
 
 namespace vt
@@ -74,6 +76,7 @@ static GlobalShaders          globShaders;
 static DefaultLogCallbacks    defaultLogCallbacks;
 static LogCallbacks *         currentLogCallbacks;
 static IndirectionTableFormat indirectionTableFmt;
+static MemoryStats            peakMemoryStats;
 
 // ======================================================
 // readTextFile():
@@ -140,12 +143,40 @@ static std::string getIndirectionTableGlslFuncs(const IndirectionTableFormat pag
 	return definesStr + constsStr + src;
 }
 
+// ======================================================
+// readPageIdGlslFuncs():
+// ======================================================
+
+static std::string readPageIdGlslFuncs(const bool withDrawBuffers, const bool batched = false)
+{
+	const std::string src = readTextFile("page_id_funcs.glsl");
+	if (src.empty())
+	{
+		vtFatalError("Failed to load fragment shader file \'page_id_funcs.glsl\'!");
+	}
+
+	// Extension directives must come before anything else in the shader.
+	std::string definesStr("#extension GL_OES_standard_derivatives : require\n");
+	if (withDrawBuffers)
+	{
+		definesStr += "#extension GL_EXT_draw_buffers : require\n";
+	}
+	if (batched)
+	{
+		definesStr += "#define VT_BATCHED_PAGE_IDS 1\n";
+	}
+	definesStr += "\nprecision mediump float;\n"; // NOTE: Default precision set to medium
+
+	return definesStr + src;
+}
+
 // ======================================================
 // createGLProg():
 // ======================================================
 
 static GLuint createGLProg(const std::string & progName, const gl::VertexAttrib * const * vtxAttribs,
-                           const char * vsBuiltIn = nullptr, const char * fsBuiltIn = nullptr)
+                           const char * vsBuiltIn = nullptr, const char * fsBuiltIn = nullptr,
+                           const char * fsProgName = nullptr) // Fragment shader of another program, if not null.
 {
 	std::string vs;
 	if (vsBuiltIn != nullptr)
@@ -163,10 +194,11 @@ static GLuint createGLProg(const std::string & progName, const gl::VertexAttrib
 	{
 		fs += fsBuiltIn;
 	}
-	fs += readTextFile(progName + ".frag");
+	const std::string fsName = (fsProgName != nullptr) ? fsProgName : progName;
+	fs += readTextFile(fsName + ".frag");
 	if (fs.empty())
 	{
-		vtFatalError("Failed to load fragment shader file \'" << progName << ".frag\'!");
+		vtFatalError("Failed to load fragment shader file \'" << fsName << ".frag\'!");
 	}
 
 	const GLuint programId = gl::createShaderProgram(vs.c_str(), fs.c_str(), vtxAttribs);
@@ -198,6 +230,9 @@ static void initGlobalShaders(const IndirectionTableFormat pageTblFormat)
 		globShaders.vtRenderSimple.unifMvpMatrix =
 			gl::getShaderProgramUniformLocation(globShaders.vtRenderSimple.programId, "u_mvp_matrix");
 
+		globShaders.vtRenderSimple.unifVTUVScale =
+			gl::getShaderProgramUniformLocation(globShaders.vtRenderSimple.programId, "u_vt_uv_scale");
+
 		globShaders.vtRenderSimple.unifMipSampleBias =
 			gl::getShaderProgramUniformLocation(globShaders.vtRenderSimple.programId, "u_mip_sample_bias");
 
@@ -207,16 +242,65 @@ static void initGlobalShaders(const IndirectionTableFormat pageTblFormat)
 		globShaders.vtRenderSimple.unifIndirectionTableSamp =
 			gl::getShaderProgramUniformLocation(globShaders.vtRenderSimple.programId, "u_indirection_table_samp");
 
+		globShaders.vtRenderSimple.unifMipTailSamp =
+			gl::getShaderProgramUniformLocation(globShaders.vtRenderSimple.programId, "u_mip_tail_samp");
+
 		// - Page cache will be at tex unit 0
 		// - Page indirection table at tex unit 1
+		// - Mip tail at tex unit 2
 		gl::setShaderProgramUniform(globShaders.vtRenderSimple.unifPageTableSamp,        int(0)); // tmu:0
 		gl::setShaderProgramUniform(globShaders.vtRenderSimple.unifIndirectionTableSamp, int(1)); // tmu:1
+		gl::setShaderProgramUniform(globShaders.vtRenderSimple.unifMipTailSamp,          int(2)); // tmu:2
 
 		// Mip sample bias:
 		const float pageSizeLog2 = std::log2(PageTable::PageSizeInPixels);
 		/* const float mipDebugBias = 0.1f; -> optional */
 		const float mipSampleBias = pageSizeLog2 - 0.5f /* + mipDebugBias */;
 		gl::setShaderProgramUniform(globShaders.vtRenderSimple.unifMipSampleBias, mipSampleBias);
+
+		const float one[] = { 1.0f, 1.0f };
+		gl::setShaderProgramUniform(globShaders.vtRenderSimple.unifVTUVScale, one, 2);
+	}
+
+	// vtRenderSimpleBatched:
+	{
+		const gl::VertexAttrib attr0 = { "a_position"       , 0 };
+		const gl::VertexAttrib attr1 = { "a_tex_coords"     , 4 };
+		const gl::VertexAttrib attr2 = { "a_instance_index" , RenderInstanceIndexAttrib };
+		const gl::VertexAttrib * vtxAttribs[] = { &attr0, &attr1, &attr2, nullptr };
+
+		// Same fragment shader as vtRenderSimple:
+		globShaders.vtRenderSimpleBatched.programId = createGLProg("vt_render_simple_batched",
+				vtxAttribs, nullptr, getIndirectionTableGlslFuncs(pageTblFormat).c_str(), "vt_render_simple");
+
+		globShaders.vtRenderSimpleBatched.unifMvpMatrices =
+			gl::getShaderProgramUniformLocation(globShaders.vtRenderSimpleBatched.programId, "u_mvp_matrices");
+
+		globShaders.vtRenderSimpleBatched.unifVTUVScale =
+			gl::getShaderProgramUniformLocation(globShaders.vtRenderSimpleBatched.programId, "u_vt_uv_scale");
+
+		globShaders.vtRenderSimpleBatched.unifMipSampleBias =
+			gl::getShaderProgramUniformLocation(globShaders.vtRenderSimpleBatched.programId, "u_mip_sample_bias");
+
+		globShaders.vtRenderSimpleBatched.unifPageTableSamp =
+			gl::getShaderProgramUniformLocation(globShaders.vtRenderSimpleBatched.programId, "u_page_table_samp");
+
+		globShaders.vtRenderSimpleBatched.unifIndirectionTableSamp =
+			gl::getShaderProgramUniformLocation(globShaders.vtRenderSimpleBatched.programId, "u_indirection_table_samp");
+
+		globShaders.vtRenderSimpleBatched.unifMipTailSamp =
+			gl::getShaderProgramUniformLocation(globShaders.vtRenderSimpleBatched.programId, "u_mip_tail_samp");
+
+		// Same texture units as vtRenderSimple:
+		gl::setShaderProgramUniform(globShaders.vtRenderSimpleBatched.unifPageTableSamp,        int(0)); // tmu:0
+		gl::setShaderProgramUniform(globShaders.vtRenderSimpleBatched.unifIndirectionTableSamp, int(1)); // tmu:1
+		gl::setShaderProgramUniform(globShaders.vtRenderSimpleBatched.unifMipTailSamp,          int(2)); // tmu:2
+
+		const float mipSampleBias = std::log2(PageTable::PageSizeInPixels) - 0.5f;
+		gl::setShaderProgramUniform(globShaders.vtRenderSimpleBatched.unifMipSampleBias, mipSampleBias);
+
+		const float one[] = { 1.0f, 1.0f };
+		gl::setShaderProgramUniform(globShaders.vtRenderSimpleBatched.unifVTUVScale, one, 2);
 	}
 
 	// vtRenderLit:
@@ -241,10 +325,16 @@ static void initGlobalShaders(const IndirectionTableFormat pageTblFormat)
 		globShaders.vtRenderLit.unifViewPosObjectSpace =
 			gl::getShaderProgramUniformLocation(globShaders.vtRenderLit.programId, "u_view_pos_object_space");
 
+		globShaders.vtRenderLit.unifVTUVScale =
+			gl::getShaderProgramUniformLocation(globShaders.vtRenderLit.programId, "u_vt_uv_scale");
+
 		// Fragment Shader params:
 		globShaders.vtRenderLit.unifMipSampleBias =
 			gl::getShaderProgramUniformLocation(globShaders.vtRenderLit.programId, "u_mip_sample_bias");
 
+		globShaders.vtRenderLit.unifVTLayerScale =
+			gl::getShaderProgramUniformLocation(globShaders.vtRenderLit.programId, "u_vt_layer_scale");
+
 		globShaders.vtRenderLit.unifDiffuseSamp =
 			gl::getShaderProgramUniformLocation(globShaders.vtRenderLit.programId, "u_diffuse_samp");
 
@@ -257,18 +347,37 @@ static void initGlobalShaders(const IndirectionTableFormat pageTblFormat)
 		globShaders.vtRenderLit.unifIndirectionTableSamp =
 			gl::getShaderProgramUniformLocation(globShaders.vtRenderLit.programId, "u_indirection_table_samp");
 
+		globShaders.vtRenderLit.unifDiffuseTailSamp =
+			gl::getShaderProgramUniformLocation(globShaders.vtRenderLit.programId, "u_diffuse_tail_samp");
+
+		globShaders.vtRenderLit.unifNormalTailSamp =
+			gl::getShaderProgramUniformLocation(globShaders.vtRenderLit.programId, "u_normal_tail_samp");
+
+		globShaders.vtRenderLit.unifSpecularTailSamp =
+			gl::getShaderProgramUniformLocation(globShaders.vtRenderLit.programId, "u_specular_tail_samp");
+
 		// - Page indirection table at tex unit 0
 		// - Page table textures starting from 1
+		// - Mip tails following the page tables
 		gl::setShaderProgramUniform(globShaders.vtRenderLit.unifIndirectionTableSamp, int(0)); // tmu:0
 		gl::setShaderProgramUniform(globShaders.vtRenderLit.unifDiffuseSamp,          int(1)); // tmu:1
 		gl::setShaderProgramUniform(globShaders.vtRenderLit.unifNormalSamp,           int(2)); // tmu:2
 		gl::setShaderProgramUniform(globShaders.vtRenderLit.unifSpecularSamp,         int(3)); // tmu:3
+		gl::setShaderProgramUniform(globShaders.vtRenderLit.unifDiffuseTailSamp,      int(4)); // tmu:4
+		gl::setShaderProgramUniform(globShaders.vtRenderLit.unifNormalTailSamp,       int(5)); // tmu:5
+		gl::setShaderProgramUniform(globShaders.vtRenderLit.unifSpecularTailSamp,     int(6)); // tmu:6
 
 		// Set to safe defaults.
 		const float zero[] = { 0.0f, 0.0f, 0.0f, 0.0f };
 		gl::setShaderProgramUniform(globShaders.vtRenderLit.unifLightPosObjectSpace, zero, 4);
 		gl::setShaderProgramUniform(globShaders.vtRenderLit.unifViewPosObjectSpace,  zero, 4);
 
+		const float one[] = { 1.0f, 1.0f };
+		gl::setShaderProgramUniform(globShaders.vtRenderLit.unifVTUVScale, one, 2);
+
+		const float fullResLayers[] = { 1.0f, 1.0f, 1.0f };
+		gl::setShaderProgramUniform(globShaders.vtRenderLit.unifVTLayerScale, fullResLayers, 3);
+
 		// Mip sample bias:
 		const float pageSizeLog2 = std::log2(PageTable::PageSizeInPixels);
 		/* const float mipDebugBias = 0.1f; -> optional */
@@ -282,7 +391,8 @@ static void initGlobalShaders(const IndirectionTableFormat pageTblFormat)
 		const gl::VertexAttrib attr2 = { "a_tex_coords" , 4 };
 		const gl::VertexAttrib * vtxAttribs[] = { &attr0, &attr2, nullptr };
 
-		globShaders.pageIdGenPass.programId = createGLProg("page_id_gen_pass", vtxAttribs);
+		globShaders.pageIdGenPass.programId = createGLProg("page_id_gen_pass",
+				vtxAttribs, nullptr, readPageIdGlslFuncs(false).c_str());
 
 		globShaders.pageIdGenPass.unifMvpMatrix = gl::getShaderProgramUniformLocation(
 				globShaders.pageIdGenPass.programId, "u_mvp_matrix");
@@ -302,12 +412,75 @@ static void initGlobalShaders(const IndirectionTableFormat pageTblFormat)
 		globShaders.pageIdGenPass.unifVTSizePages = gl::getShaderProgramUniformLocation(
 				globShaders.pageIdGenPass.programId, "u_vt_size_pages");
 
+		globShaders.pageIdGenPass.unifVTPageBase = gl::getShaderProgramUniformLocation(
+				globShaders.pageIdGenPass.programId, "u_vt_page_base");
+
+		globShaders.pageIdGenPass.unifVTUVScale = gl::getShaderProgramUniformLocation(
+				globShaders.pageIdGenPass.programId, "u_vt_uv_scale");
+
 		const float zero[] = { 0.0f, 0.0f };
+		const float one[]  = { 1.0f, 1.0f };
 		gl::setShaderProgramUniform(globShaders.pageIdGenPass.unifLog2MipScaleFactor, 3.0f);
 		gl::setShaderProgramUniform(globShaders.pageIdGenPass.unifVTMaxMipLevel,      0.0f);
 		gl::setShaderProgramUniform(globShaders.pageIdGenPass.unifVTIndex,            0.0f);
 		gl::setShaderProgramUniform(globShaders.pageIdGenPass.unifVTSizePixels, zero, 2);
 		gl::setShaderProgramUniform(globShaders.pageIdGenPass.unifVTSizePages,  zero, 2);
+		gl::setShaderProgramUniform(globShaders.pageIdGenPass.unifVTPageBase,  -1.0f);
+		gl::setShaderProgramUniform(globShaders.pageIdGenPass.unifVTUVScale,   one,  2);
+	}
+
+	// pageIdGenPassBatched:
+	{
+		const gl::VertexAttrib attr0 = { "a_position"       , 0 };
+		const gl::VertexAttrib attr1 = { "a_tex_coords"     , 4 };
+		const gl::VertexAttrib attr2 = { "a_instance_index" , RenderInstanceIndexAttrib };
+		const gl::VertexAttrib * vtxAttribs[] = { &attr0, &attr1, &attr2, nullptr };
+
+		// Same fragment shader as pageIdGenPass, with the VT params coming from the vertex shader:
+		globShaders.pageIdGenPassBatched.programId = createGLProg("page_id_gen_pass_batched",
+				vtxAttribs, nullptr, readPageIdGlslFuncs(false, true).c_str(), "page_id_gen_pass");
+
+		globShaders.pageIdGenPassBatched.unifMvpMatrices = gl::getShaderProgramUniformLocation(
+				globShaders.pageIdGenPassBatched.programId, "u_mvp_matrices");
+
+		globShaders.pageIdGenPassBatched.unifVTParams = gl::getShaderProgramUniformLocation(
+				globShaders.pageIdGenPassBatched.programId, "u_vt_params");
+
+		globShaders.pageIdGenPassBatched.unifLog2MipScaleFactor = gl::getShaderProgramUniformLocation(
+				globShaders.pageIdGenPassBatched.programId, "u_log2_mip_scale_factor");
+
+		gl::setShaderProgramUniform(globShaders.pageIdGenPassBatched.unifLog2MipScaleFactor, 3.0f);
+	}
+
+	// pageIdDownsample:
+	{
+		const gl::VertexAttrib attr0 = { "a_vertex_position_ndc", 0 };
+		const gl::VertexAttrib * vtxAttribs[] = { &attr0, nullptr };
+
+		globShaders.pageIdDownsample.programId = createGLProg("page_id_downsample", vtxAttribs);
+
+		globShaders.pageIdDownsample.unifTextureSamp = gl::getShaderProgramUniformLocation(
+				globShaders.pageIdDownsample.programId, "u_texture_samp");
+
+		gl::setShaderProgramUniform(globShaders.pageIdDownsample.unifTextureSamp, int(0)); // tmu:0
+	}
+
+	// pageIdPack:
+	{
+		const gl::VertexAttrib attr0 = { "a_vertex_position_ndc", 0 };
+		const gl::VertexAttrib * vtxAttribs[] = { &attr0, nullptr };
+
+		globShaders.pageIdPack.programId = createGLProg("page_id_pack", vtxAttribs);
+
+		globShaders.pageIdPack.unifTextureSamp = gl::getShaderProgramUniformLocation(
+				globShaders.pageIdPack.programId, "u_texture_samp");
+
+		globShaders.pageIdPack.unifSrcSize = gl::getShaderProgramUniformLocation(
+				globShaders.pageIdPack.programId, "u_src_size");
+
+		const float one[] = { 1.0f, 1.0f };
+		gl::setShaderProgramUniform(globShaders.pageIdPack.unifSrcSize,     one, 2);
+		gl::setShaderProgramUniform(globShaders.pageIdPack.unifTextureSamp, int(0)); // tmu:0
 	}
 
 	// drawIndirectionTable:
@@ -348,9 +521,10 @@ static void initGlobalShaders(const IndirectionTableFormat pageTblFormat)
 
 	// drawText2D:
 	{
-		const gl::VertexAttrib attr0 = { "a_vertex_position_tex_coord", 0 };
-		const gl::VertexAttrib attr1 = { "a_vertex_color",              1 };
-		const gl::VertexAttrib * vtxAttribs[] = { &attr0, &attr1, nullptr };
+		const gl::VertexAttrib attr0 = { "a_vertex_position",   0 };
+		const gl::VertexAttrib attr1 = { "a_vertex_color",      1 };
+		const gl::VertexAttrib attr2 = { "a_vertex_tex_coords", 2 };
+		const gl::VertexAttrib * vtxAttribs[] = { &attr0, &attr1, &attr2, nullptr };
 
 		globShaders.drawText2D.programId = createGLProg("draw_text_2d", vtxAttribs);
 
@@ -379,6 +553,15 @@ const GlobalShaders & getGlobalShaders() noexcept
 	return globShaders;
 }
 
+// ======================================================
+// getPageIdGlslFuncs():
+// ======================================================
+
+std::string getPageIdGlslFuncs(const bool withDrawBuffers)
+{
+	return readPageIdGlslFuncs(withDrawBuffers);
+}
+
 // ======================================================
 // getIndirectionTableFormat():
 // ======================================================
@@ -418,6 +601,88 @@ std::string getLibraryVersionString()
 	return "1.0.0";
 }
 
+// ======================================================
+// getMemoryStats():
+// ======================================================
+
+MemoryStats getMemoryStats(const PageProvider & provider, const PageResolver & resolver)
+{
+	MemoryStats stats;
+	clearPodObject(stats);
+
+	std::vector<const PageIndirectionTable *> countedTables;
+	const unsigned int numTextures = provider.getNumRegisteredTextures();
+
+	for (unsigned int t = 0; t < numTextures; ++t)
+	{
+		const VirtualTexture * vtTex = provider.getRegisteredTexture(t);
+		if (vtTex == nullptr)
+		{
+			continue;
+		}
+
+		MemoryStats texStats;
+		clearPodObject(texStats);
+		vtTex->getMemoryStats(texStats);
+
+		// Shared indirection tables are only accounted for by the first texture using it:
+		const PageIndirectionTable * table = vtTex->getPageIndirectionTable().get();
+		if (std::find(countedTables.begin(), countedTables.end(), table) != countedTables.end())
+		{
+			texStats.indirectionTables    = 0;
+			texStats.indirectionTablesGpu = 0;
+		}
+		else
+		{
+			countedTables.push_back(table);
+		}
+
+		stats.cachePageTrees       += texStats.cachePageTrees;
+		stats.pageFileIndexes      += texStats.pageFileIndexes;
+		stats.indirectionTables    += texStats.indirectionTables;
+		stats.indirectionTablesGpu += texStats.indirectionTablesGpu;
+		stats.pageTablesGpu        += texStats.pageTablesGpu;
+		stats.mipTailsGpu          += texStats.mipTailsGpu;
+	}
+
+	stats.feedbackBuffers = resolver.getSystemMemoryBytes();
+	stats.feedbackFboGpu  = resolver.getGpuMemoryBytes();
+	stats.readyQueues     = provider.getReadyQueueMemoryBytes();
+
+	// Update the high-water marks:
+	peakMemoryStats.cachePageTrees       = std::max(peakMemoryStats.cachePageTrees,       stats.cachePageTrees);
+	peakMemoryStats.pageFileIndexes      = std::max(peakMemoryStats.pageFileIndexes,      stats.pageFileIndexes);
+	peakMemoryStats.indirectionTables    = std::max(peakMemoryStats.indirectionTables,    stats.indirectionTables);
+	peakMemoryStats.feedbackBuffers      = std::max(peakMemoryStats.feedbackBuffers,      resolver.getPeakSystemMemoryBytes());
+	peakMemoryStats.readyQueues          = std::max(peakMemoryStats.readyQueues,          provider.getPeakReadyQueueMemoryBytes());
+	peakMemoryStats.indirectionTablesGpu = std::max(peakMemoryStats.indirectionTablesGpu, stats.indirectionTablesGpu);
+	peakMemoryStats.pageTablesGpu        = std::max(peakMemoryStats.pageTablesGpu,        stats.pageTablesGpu);
+	peakMemoryStats.mipTailsGpu          = std::max(peakMemoryStats.mipTailsGpu,          stats.mipTailsGpu);
+	peakMemoryStats.feedbackFboGpu       = std::max(peakMemoryStats.feedbackFboGpu,       stats.feedbackFboGpu);
+
+	return stats;
+}
+
+// ======================================================
+// getPeakMemoryStats():
+// ======================================================
+
+const MemoryStats & getPeakMemoryStats() noexcept
+{
+	return peakMemoryStats;
+}
+
+// ======================================================
+// resetPeakMemoryStats():
+// ======================================================
+
+void resetPeakMemoryStats(PageProvider & provider, PageResolver & resolver)
+{
+	clearPodObject(peakMemoryStats);
+	provider.resetPeakReadyQueueMemoryBytes();
+	resolver.resetPeakSystemMemoryBytes();
+}
+
 // ======================================================
 // libraryInit():
 // ======================================================
@@ -432,6 +697,9 @@ void libraryInit(const IndirectionTableFormat format, LogCallbacks * logCallback
 	// to avoid spurious warnings from errors we didn't cause.
 	gl::clearGLErrors();
 
+	// Nothing is known about the GL state yet.
+	gl::invalidateStateCache();
+
 	// Since we are dealing exclusively with RGBA,
 	// the ideal pixel alignment is 4.
 	gl::setPixelStoreAlignment(4);
@@ -461,7 +729,11 @@ void libraryShutdown()
 	gl::deleteShaderProgram(globShaders.drawPageTable.programId);
 	gl::deleteShaderProgram(globShaders.drawIndirectionTable.programId);
 	gl::deleteShaderProgram(globShaders.pageIdGenPass.programId);
+	gl::deleteShaderProgram(globShaders.pageIdGenPassBatched.programId);
+	gl::deleteShaderProgram(globShaders.pageIdDownsample.programId);
+	gl::deleteShaderProgram(globShaders.pageIdPack.programId);
 	gl::deleteShaderProgram(globShaders.vtRenderSimple.programId);
+	gl::deleteShaderProgram(globShaders.vtRenderSimpleBatched.programId);
 	clearPodObject(globShaders);
 }
 
@@ -32,6 +32,7 @@
 
 #include "vt.hpp"
 #include "vt_mini_ui.hpp"
+#include "vt_sprite_batch.hpp"
 #include "vt_tool_image.hpp"
 #include "vt_tool_platform_utils.hpp"
 
@@ -349,30 +350,9 @@ GLuint MovementControls::createArrowTexture(const int arrow)
 
 namespace {
 
-struct Sprite2d
-{
-	GLuint   textureId;
-	uint32_t firstIndex;
-};
-
-struct SpriteVertex
-{
-	float x, y, u, v;
-	float r, g, b, a;
-};
-
-// Batches ordered by layer or, one batch per layer:
-static constexpr int NumBatches = int(Layer::Count);
-static std::vector<Sprite2d> spriteBatch[NumBatches];
-
-// Geometry for the batched sprites:
-static std::vector<SpriteVertex> spriteVerts;
-static std::vector<uint16_t>     spriteIndexes;
-
-// GL buffers for 2d/sprite drawing:
-static GLuint spriteVbo;
-static GLuint spriteIbo;
-static bool spriteBuffersInitialized;
+// Sprites of all layers. One draw call per layer and texture.
+static constexpr int NumLayers = int(Layer::Count);
+static SpriteBatch spriteBatch("2D/UI");
 
 // Will scale width and height of draw2dSprite().
 static float globalUIscale = 1.0f;
@@ -380,23 +360,6 @@ static float globalUIscale = 1.0f;
 // Default color used for debug text rendering.
 static float defaultUItexColor[] = { 0.25f, 0.25f, 0.25f, 1.0f };
 
-// ======================================================
-
-static void ensure2dVboAndIboCreated()
-{
-	// One time initialization.
-	if (spriteBuffersInitialized)
-	{
-		return;
-	}
-
-	glGenBuffers(1, &spriteVbo);
-	glGenBuffers(1, &spriteIbo);
-	spriteBuffersInitialized = true;
-
-	vtLogComment("Created VBO/IBO for 2D/UI drawing...");
-}
-
 } // namespace {}
 
 // ======================================================
@@ -405,46 +368,16 @@ static void ensure2dVboAndIboCreated()
 
 void draw2dSprite(const Rect & rect, const float color[4], const float uvs[][2], const GLuint textureId, const Layer layer)
 {
-	ensure2dVboAndIboCreated();
+	static_assert(NumLayers <= SpriteBatch::MaxLayers, "Too many UI layers for the SpriteBatch!");
 
-	assert(static_cast<int>(layer) < NumBatches);
+	assert(static_cast<int>(layer) < NumLayers);
 	assert(rect.width  > 0.0f);
 	assert(rect.height > 0.0f);
 
-	const uint16_t indexes[] = { 0, 1, 2, 2, 3, 0 };
-	SpriteVertex verts[4];
-
 	// Store position with scaling:
 	const float sw = rect.width  * globalUIscale;
 	const float sh = rect.height * globalUIscale;
-	verts[0].x = rect.x;      verts[0].y = rect.y;
-	verts[1].x = rect.x + sw; verts[1].y = rect.y;
-	verts[2].x = rect.x + sw; verts[2].y = rect.y + sh;
-	verts[3].x = rect.x;      verts[3].y = rect.y + sh;
-
-	// And texture coords:
-	verts[0].u = uvs[0][0]; verts[0].v = uvs[0][1];
-	verts[1].u = uvs[1][0]; verts[1].v = uvs[1][1];
-	verts[2].u = uvs[2][0]; verts[2].v = uvs[2][1];
-	verts[3].u = uvs[3][0]; verts[3].v = uvs[3][1];
-
-	// Store vertex color:
-	verts[0].r = color[0]; verts[0].g = color[1]; verts[0].b = color[2]; verts[0].a = color[3];
-	verts[1].r = color[0]; verts[1].g = color[1]; verts[1].b = color[2]; verts[1].a = color[3];
-	verts[2].r = color[0]; verts[2].g = color[1]; verts[2].b = color[2]; verts[2].a = color[3];
-	verts[3].r = color[0]; verts[3].g = color[1]; verts[3].b = color[2]; verts[3].a = color[3];
-
-	spriteBatch[static_cast<int>(layer)].push_back({ textureId, static_cast<uint32_t>(spriteIndexes.size()) });
-
-	// Add indexes offseting the base vertex:
-	const uint16_t baseVertex = static_cast<uint16_t>(spriteVerts.size());
-	for (size_t i = 0; i < arrayLength(indexes); ++i)
-	{
-		spriteIndexes.push_back(indexes[i] + baseVertex);
-	}
-
-	// Add vertexes to triangle batch:
-	spriteVerts.insert(spriteVerts.end(), verts, verts + arrayLength(verts));
+	spriteBatch.addQuad(rect.x, rect.y, sw, sh, color, uvs, textureId, static_cast<int>(layer));
 }
 
 // ======================================================
@@ -472,8 +405,12 @@ void drawVTStatsPanel(const char * title, const PageCacheMgr & cacheMgr, const P
 
 	// Global/Provider stats:
 	font::drawTextF(textPos, textColor, font::Consolas36, "\n--- global ---\n");
-	font::drawTextF(textPos, textColor, font::Consolas36, "pending......: %d\n", provider.getNumOutstandingRequests());
+	const PageProvider::QueueDepthStats queueStats = provider.getQueueDepthStats();
+	font::drawTextF(textPos, textColor, font::Consolas36, "pending......: %d / %d%s\n", provider.getNumOutstandingRequests(),
+			queueStats.outstandingLimit, (queueStats.adaptive ? " (adaptive)" : ""));
 	font::drawTextF(textPos, textColor, font::Consolas36, "max requests.: %d\n", resolver.getMaxPageRequestsPerFrame());
+	font::drawTextF(textPos, textColor, font::Consolas36, "io latency...: %.1fms (goal %.0fms)\n", queueStats.latencyMs, queueStats.targetLatencyMs);
+	font::drawTextF(textPos, textColor, font::Consolas36, "io service...: %.2fms, %.0f/s\n", queueStats.serviceTimeMs, queueStats.completionsPerSec);
 	font::drawTextF(textPos, textColor, font::Consolas36, "vis pages....: %d\n", resolver.getNumVisiblePages());
 	font::drawTextF(textPos, textColor, font::Consolas36, "indr updates.: %u (%.1f/s)\n", numIndirectionTableUpdates, indrTblUpdatesPerSec);
 	font::drawTextF(textPos, textColor, font::Consolas36, "page uploads.: %u (%.1f/s)\n", numPageUploads, pageUploadsPerSec);
@@ -499,77 +436,7 @@ void drawFpsCounter(const int viewportWidth)
 void flush2dSpriteBatches(const float * mvpMatrix)
 {
 	assert(mvpMatrix != nullptr);
-
-	if (spriteVerts.empty() || spriteIndexes.empty())
-	{
-		return;
-	}
-
-	// Check for internal consistency:
-	assert(spriteBuffersInitialized);
-	assert(spriteVbo != 0);
-	assert(spriteIbo != 0);
-
-	// Update the buffers:
-
-	glBindBuffer(GL_ARRAY_BUFFER, spriteVbo);
-	glBufferData(GL_ARRAY_BUFFER, spriteVerts.size() * sizeof(SpriteVertex), spriteVerts.data(), GL_STREAM_DRAW);
-
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, spriteIbo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, spriteIndexes.size() * sizeof(uint16_t), spriteIndexes.data(), GL_STREAM_DRAW);
-
-	// Vertex format / render states:
-
-	// First vec4 are position + tex coords:
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteVertex), nullptr);
-
-	// Second vec4 is the vertex color:
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteVertex), reinterpret_cast<GLvoid *>(sizeof(float) * 4));
-
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glEnable(GL_BLEND);
-	glDisable(GL_DEPTH_TEST);
-	glDisable(GL_CULL_FACE);
-
-	const GlobalShaders & shaders = getGlobalShaders();
-	gl::useShaderProgram(shaders.drawText2D.programId);
-	gl::setShaderProgramUniform(shaders.drawText2D.unifMvpMatrix, mvpMatrix, 16);
-
-	// Try to avoid texture changes with a simple caching:
-	GLuint currentTextId = 0;
-
-	// Draw each layer separately.
-	// Currently, each sprite is also a single draw call.
-	for (int i = 0; i < NumBatches; ++i)
-	{
-		for (const auto & sprite : spriteBatch[i])
-		{
-			if (currentTextId != sprite.textureId)
-			{
-				gl::use2DTexture(sprite.textureId);
-				currentTextId = sprite.textureId;
-			}
-
-			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT,
-				reinterpret_cast<GLvoid *>(sprite.firstIndex * sizeof(uint16_t)));
-		}
-
-		spriteBatch[i].clear();
-	}
-
-	glEnable(GL_CULL_FACE);
-	glEnable(GL_DEPTH_TEST);
-	glDisable(GL_BLEND);
-
-	// Cleanup:
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	// Also free all the geometry batches:
-	spriteVerts.clear();
-	spriteIndexes.clear();
+	spriteBatch.flush(mvpMatrix);
 }
 
 // ======================================================
@@ -578,28 +445,10 @@ void flush2dSpriteBatches(const float * mvpMatrix)
 
 void shutdownUI()
 {
-	for (int i = 0; i < NumBatches; ++i)
-	{
-		spriteBatch[i].clear();
-		spriteBatch[i].shrink_to_fit();
-	}
-
-	spriteVerts.clear();
-	spriteVerts.shrink_to_fit();
-
-	spriteIndexes.clear();
-	spriteIndexes.shrink_to_fit();
-
-	glDeleteBuffers(1, &spriteVbo);
-	spriteVbo = 0;
-
-	glDeleteBuffers(1, &spriteIbo);
-	spriteIbo = 0;
+	spriteBatch.shutdown();
 
 	gl::delete2DTexture(switchBtnTexOff);
 	gl::delete2DTexture(switchBtnTexOn);
-
-	spriteBuffersInitialized = false;
 }
 
 // ======================================================
@@ -31,12 +31,129 @@
 // ================================================================================================
 
 #include "vt.hpp"
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
 
 namespace vt
 {
 namespace gl
 {
 
+// ======================================================
+// GL state cache data:
+// ======================================================
+
+namespace
+{
+
+// Value of a binding or flag not known to the cache.
+constexpr GLuint UnknownBinding = ~0u;
+constexpr int    UnknownFlag    = -1;
+
+// Texture units tracked. Binds to higher units are always forwarded.
+constexpr int MaxCachedTexUnits = 16;
+
+// Uniform locations above this are not cached.
+constexpr GLint MaxCachedUniformLocation = 1024;
+
+// Last value set for a uniform location. Bitwise copy of the
+// ints or floats. 'count' is negative for ints and zero if unknown.
+struct UniformValue
+{
+	uint32_t bits[16];
+	int count;
+};
+
+// Enable flags tracked. Any other cap is always forwarded.
+constexpr GLenum cachedCaps[] = { GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_SCISSOR_TEST, GL_STENCIL_TEST };
+
+struct StateCache
+{
+	bool   enabled = true;
+	int    activeTexUnit = UnknownFlag;
+	GLuint boundTextures[MaxCachedTexUnits];
+	GLuint currentProgram = UnknownBinding;
+	GLuint currentFrameBuffer = UnknownBinding;
+	int    capFlags[arrayLength(cachedCaps)];
+
+	// Uniforms of each program, indexed by location.
+	std::unordered_map<GLuint, std::vector<UniformValue>> programUniforms;
+
+	// Calls that didn't reach the driver.
+	unsigned int numElidedCalls = 0;
+
+	StateCache()
+	{
+		std::fill(std::begin(boundTextures), std::end(boundTextures), UnknownBinding);
+		std::fill(std::begin(capFlags), std::end(capFlags), UnknownFlag);
+	}
+};
+
+StateCache stateCache;
+
+int findCapIndex(const GLenum cap)
+{
+	for (int c = 0; c < static_cast<int>(arrayLength(cachedCaps)); ++c)
+	{
+		if (cachedCaps[c] == cap)
+		{
+			return c;
+		}
+	}
+	return -1;
+}
+
+// Cache slot of a uniform of the current program, or null if it can't be cached.
+UniformValue * findUniformValue(const GLint uniformLoc)
+{
+	if (!stateCache.enabled || stateCache.currentProgram == UnknownBinding ||
+		stateCache.currentProgram == 0 || uniformLoc > MaxCachedUniformLocation)
+	{
+		return nullptr;
+	}
+
+	std::vector<UniformValue> & uniforms = stateCache.programUniforms[stateCache.currentProgram];
+	if (static_cast<size_t>(uniformLoc) >= uniforms.size())
+	{
+		UniformValue unknown;
+		clearPodObject(unknown);
+		uniforms.resize(uniformLoc + 1, unknown);
+	}
+	return &uniforms[uniformLoc];
+}
+
+// True if the uniform already holds the value. Otherwise records it, to be sent to GL by the caller.
+bool uniformValueMatches(const GLint uniformLoc, const void * val, const int count)
+{
+	UniformValue * cached = findUniformValue(uniformLoc);
+	if (cached == nullptr)
+	{
+		return false;
+	}
+
+	const size_t numBytes = std::abs(count) * sizeof(uint32_t);
+	if (cached->count == count && std::memcmp(cached->bits, val, numBytes) == 0)
+	{
+		++stateCache.numElidedCalls;
+		return true;
+	}
+
+	std::memcpy(cached->bits, val, numBytes);
+	cached->count = count;
+	return false;
+}
+
+void forgetUniformValue(const GLint uniformLoc)
+{
+	if (UniformValue * cached = findUniformValue(uniformLoc))
+	{
+		cached->count = 0;
+	}
+}
+
+} // namespace {}
+
 // ======================================================
 // errorToString():
 // ======================================================
@@ -171,7 +288,7 @@ void drawNdcQuadrilateral()
 		vtLogComment("Created VBO for a fullscreen quadrilateral...");
 	}
 
-	glDisable(GL_DEPTH_TEST);
+	setEnabled(GL_DEPTH_TEST, false);
 	glBindBuffer(GL_ARRAY_BUFFER, screenQuadVBO);
 
 	// Set vertex format:
@@ -182,7 +299,167 @@ void drawNdcQuadrilateral()
 	glDrawArrays(GL_TRIANGLES, 0, 6);
 
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glEnable(GL_DEPTH_TEST);
+	setEnabled(GL_DEPTH_TEST, true);
+}
+
+// ======================================================
+// GL state cache:
+// ======================================================
+
+void invalidateStateCache()
+{
+	stateCache.activeTexUnit      = UnknownFlag;
+	stateCache.currentProgram     = UnknownBinding;
+	stateCache.currentFrameBuffer = UnknownBinding;
+
+	std::fill(std::begin(stateCache.boundTextures), std::end(stateCache.boundTextures), UnknownBinding);
+	std::fill(std::begin(stateCache.capFlags), std::end(stateCache.capFlags), UnknownFlag);
+
+	stateCache.programUniforms.clear();
+}
+
+void setStateCacheEnabled(const bool enable)
+{
+	invalidateStateCache();
+	stateCache.enabled = enable;
+}
+
+bool isStateCacheEnabled()
+{
+	return stateCache.enabled;
+}
+
+unsigned int getNumElidedStateCalls()
+{
+	return stateCache.numElidedCalls;
+}
+
+void resetNumElidedStateCalls()
+{
+	stateCache.numElidedCalls = 0;
+}
+
+// ======================================================
+// setEnabled() / isEnabled():
+// ======================================================
+
+void setEnabled(const GLenum cap, const bool enable)
+{
+	const int c = findCapIndex(cap);
+	if (stateCache.enabled && c >= 0)
+	{
+		if (stateCache.capFlags[c] == int(enable))
+		{
+			++stateCache.numElidedCalls;
+			return;
+		}
+		stateCache.capFlags[c] = int(enable);
+	}
+
+	if (enable)
+	{
+		glEnable(cap);
+	}
+	else
+	{
+		glDisable(cap);
+	}
+}
+
+bool isEnabled(const GLenum cap)
+{
+	const int c = findCapIndex(cap);
+	if (stateCache.enabled && c >= 0)
+	{
+		if (stateCache.capFlags[c] == UnknownFlag)
+		{
+			stateCache.capFlags[c] = int(glIsEnabled(cap) == GL_TRUE);
+		}
+		else
+		{
+			++stateCache.numElidedCalls;
+		}
+		return stateCache.capFlags[c] != 0;
+	}
+	return glIsEnabled(cap) == GL_TRUE;
+}
+
+// ======================================================
+// isExtensionSupported():
+// ======================================================
+
+bool isExtensionSupported(const char * extName)
+{
+	assert(extName != nullptr);
+
+	const char * extensions = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+	if (extensions == nullptr)
+	{
+		return false;
+	}
+
+	// Must match a whole entry of the space separated list, not just a prefix:
+	const size_t nameLen = std::strlen(extName);
+	for (const char * match = std::strstr(extensions, extName); match != nullptr; match = std::strstr(match + nameLen, extName))
+	{
+		const bool startsEntry = (match == extensions) || (match[-1] == ' ');
+		const bool endsEntry   = (match[nameLen] == ' ') || (match[nameLen] == '\0');
+		if (startsEntry && endsEntry)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// ======================================================
+// hasInstancedArrays():
+// ======================================================
+
+bool hasInstancedArrays()
+{
+	#ifdef VT_GL_INSTANCED_ARRAYS
+	// Only queried once. Assumes a single GL context.
+	static const bool supported = isExtensionSupported("GL_EXT_instanced_arrays");
+	return supported;
+	#else // !VT_GL_INSTANCED_ARRAYS
+	return false;
+	#endif // VT_GL_INSTANCED_ARRAYS
+}
+
+// ======================================================
+// setVertexAttribDivisor():
+// ======================================================
+
+void setVertexAttribDivisor(const GLuint attribIndex, const GLuint divisor)
+{
+	assert(hasInstancedArrays());
+
+	#ifdef VT_GL_INSTANCED_ARRAYS
+	glVertexAttribDivisorEXT(attribIndex, divisor);
+	#else // !VT_GL_INSTANCED_ARRAYS
+	(void)attribIndex;
+	(void)divisor;
+	#endif // VT_GL_INSTANCED_ARRAYS
+}
+
+// ======================================================
+// drawElementsInstanced():
+// ======================================================
+
+void drawElementsInstanced(const GLenum mode, const GLsizei count, const GLenum type, const void * indices, const GLsizei instanceCount)
+{
+	assert(hasInstancedArrays());
+
+	#ifdef VT_GL_INSTANCED_ARRAYS
+	glDrawElementsInstancedEXT(mode, count, type, indices, instanceCount);
+	#else // !VT_GL_INSTANCED_ARRAYS
+	(void)mode;
+	(void)count;
+	(void)type;
+	(void)indices;
+	(void)instanceCount;
+	#endif // VT_GL_INSTANCED_ARRAYS
 }
 
 // ======================================================
@@ -237,6 +514,9 @@ GLuint createShaderProgram(const char * vsSrc, const char * fsSrc, const VertexA
 	glDeleteShader(vsId);
 	glDeleteShader(fsId);
 
+	// The id might be a reused one. Drop any uniform values recorded for it.
+	stateCache.programUniforms.erase(progId);
+
 	checkGLErrors(__FILE__, __LINE__);
 	vtLogComment("New GL shader program #" << progId << " created...");
 
@@ -250,6 +530,13 @@ GLuint createShaderProgram(const char * vsSrc, const char * fsSrc, const VertexA
 void deleteShaderProgram(GLuint & shaderProgId)
 {
 	glDeleteProgram(shaderProgId);
+
+	stateCache.programUniforms.erase(shaderProgId);
+	if (stateCache.currentProgram == shaderProgId)
+	{
+		stateCache.currentProgram = UnknownBinding;
+	}
+
 	shaderProgId = 0;
 }
 
@@ -259,6 +546,15 @@ void deleteShaderProgram(GLuint & shaderProgId)
 
 void useShaderProgram(const GLuint shaderProgId)
 {
+	if (stateCache.enabled)
+	{
+		if (stateCache.currentProgram == shaderProgId)
+		{
+			++stateCache.numElidedCalls;
+			return;
+		}
+		stateCache.currentProgram = shaderProgId;
+	}
 	glUseProgram(shaderProgId);
 }
 
@@ -285,7 +581,10 @@ bool setShaderProgramUniform(const GLint uniformLoc, const int val)
 {
 	if (uniformLoc >= 0)
 	{
-		glUniform1i(uniformLoc, val);
+		if (!uniformValueMatches(uniformLoc, &val, -1))
+		{
+			glUniform1i(uniformLoc, val);
+		}
 		return true;
 	}
 	return false;
@@ -299,7 +598,10 @@ bool setShaderProgramUniform(const GLint uniformLoc, const float val)
 {
 	if (uniformLoc >= 0)
 	{
-		glUniform1f(uniformLoc, val);
+		if (!uniformValueMatches(uniformLoc, &val, 1))
+		{
+			glUniform1f(uniformLoc, val);
+		}
 		return true;
 	}
 	return false;
@@ -319,6 +621,14 @@ bool setShaderProgramUniform(const GLint uniformLoc, const float * val, const in
 		return false;
 	}
 
+	if ((count >= 1 && count <= 4) || count == 16)
+	{
+		if (uniformValueMatches(uniformLoc, val, count))
+		{
+			return true;
+		}
+	}
+
 	switch (count)
 	{
 	case 1 : // float
@@ -347,6 +657,39 @@ bool setShaderProgramUniform(const GLint uniformLoc, const float * val, const in
 	} // switch (fv.length)
 }
 
+// ======================================================
+// setShaderProgramUniformArray():
+// ======================================================
+
+bool setShaderProgramUniformArray(const GLint uniformLoc, const float * val, const int count, const int arrayLength)
+{
+	assert(val != nullptr);
+	assert(arrayLength > 0);
+
+	if (uniformLoc < 0)
+	{
+		return false;
+	}
+
+	// Arrays are not cached, but the first element shares the location of the whole array.
+	forgetUniformValue(uniformLoc);
+
+	switch (count)
+	{
+	case 4 : // vec4[]
+		glUniform4fv(uniformLoc, arrayLength, val);
+		return true;
+
+	case 16 : // mat4[]
+		glUniformMatrix4fv(uniformLoc, arrayLength, GL_FALSE, val);
+		return true;
+
+	default :
+		vtLogError("setShaderProgramUniformArray() => element length is invalid!");
+		return false;
+	} // switch (count)
+}
+
 // ======================================================
 // create2DTexture():
 // ======================================================
@@ -404,6 +747,16 @@ GLuint create2DTexture(const int w, const int h, const GLenum pixFormat, const G
 void delete2DTexture(GLuint & texId)
 {
 	glDeleteTextures(1, &texId);
+
+	// GL reverts the units the texture was bound to back to zero:
+	for (GLuint & boundTexId : stateCache.boundTextures)
+	{
+		if (boundTexId == texId)
+		{
+			boundTexId = 0;
+		}
+	}
+
 	texId = 0;
 }
 
@@ -414,8 +767,36 @@ void delete2DTexture(GLuint & texId)
 void use2DTexture(const GLuint texId, const int texUnit)
 {
 	assert(texUnit >= 0);
-	glActiveTexture(GL_TEXTURE0 + texUnit);
-	glBindTexture(GL_TEXTURE_2D, texId);
+
+	if (!stateCache.enabled || texUnit >= MaxCachedTexUnits)
+	{
+		stateCache.activeTexUnit = UnknownFlag;
+		glActiveTexture(GL_TEXTURE0 + texUnit);
+		glBindTexture(GL_TEXTURE_2D, texId);
+		return;
+	}
+
+	// Even if the texture is already bound, the unit must be made active,
+	// since callers expect texture parameter/upload calls to hit that unit.
+	if (stateCache.activeTexUnit != texUnit)
+	{
+		glActiveTexture(GL_TEXTURE0 + texUnit);
+		stateCache.activeTexUnit = texUnit;
+	}
+	else
+	{
+		++stateCache.numElidedCalls;
+	}
+
+	if (stateCache.boundTextures[texUnit] != texId)
+	{
+		glBindTexture(GL_TEXTURE_2D, texId);
+		stateCache.boundTextures[texUnit] = texId;
+	}
+	else
+	{
+		++stateCache.numElidedCalls;
+	}
 }
 
 // ======================================================
@@ -424,6 +805,13 @@ void use2DTexture(const GLuint texId, const int texUnit)
 
 GLuint getCurrent2DTexture()
 {
+	if (stateCache.enabled && stateCache.activeTexUnit != UnknownFlag &&
+		stateCache.boundTextures[stateCache.activeTexUnit] != UnknownBinding)
+	{
+		++stateCache.numElidedCalls;
+		return stateCache.boundTextures[stateCache.activeTexUnit];
+	}
+
 	GLint texId = 0;
 	glGetIntegerv(GL_TEXTURE_BINDING_2D, &texId);
 	return texId;
@@ -504,7 +892,7 @@ GLuint createFrameBuffer(const int w, const int h, const bool defaultDepthBuffer
 		return 0;
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+	useFrameBuffer(fboId);
 
 	if (defaultDepthBuffer)
 	{
@@ -518,7 +906,7 @@ GLuint createFrameBuffer(const int w, const int h, const bool defaultDepthBuffer
 		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, stencilRBO);
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	useFrameBuffer(0);
 
 	checkGLErrors(__FILE__, __LINE__);
 	vtLogComment("New GL framebuffer #" << fboId << " created...");
@@ -533,6 +921,13 @@ GLuint createFrameBuffer(const int w, const int h, const bool defaultDepthBuffer
 void deleteFrameBuffer(GLuint & fboId)
 {
 	glDeleteFramebuffers(1, &fboId);
+
+	// Deleting the bound FBO reverts to the default framebuffer:
+	if (stateCache.currentFrameBuffer == fboId)
+	{
+		stateCache.currentFrameBuffer = 0;
+	}
+
 	fboId = 0;
 }
 
@@ -542,6 +937,15 @@ void deleteFrameBuffer(GLuint & fboId)
 
 void useFrameBuffer(const GLuint fboId)
 {
+	if (stateCache.enabled)
+	{
+		if (stateCache.currentFrameBuffer == fboId)
+		{
+			++stateCache.numElidedCalls;
+			return;
+		}
+		stateCache.currentFrameBuffer = fboId;
+	}
 	glBindFramebuffer(GL_FRAMEBUFFER, fboId);
 }
 
@@ -560,7 +964,7 @@ bool validateFrameBuffer(const GLuint fboId, std::string * errorString)
 		return false;
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+	useFrameBuffer(fboId);
 	const GLuint status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
 
 	if (status == GL_FRAMEBUFFER_COMPLETE)
@@ -569,7 +973,7 @@ bool validateFrameBuffer(const GLuint fboId, std::string * errorString)
 		{
 			errorString->clear();
 		}
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		useFrameBuffer(0);
 		return true;
 	}
 	else
@@ -578,7 +982,7 @@ bool validateFrameBuffer(const GLuint fboId, std::string * errorString)
 		{
 			(*errorString) = fboStatusToString(status);
 		}
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		useFrameBuffer(0);
 		return false;
 	}
 }
@@ -597,12 +1001,12 @@ void attachTextureToFrameBuffer(const GLuint fboId, const GLuint texId, const in
 	// level must be 0 for GL ES v2.0.
 	assert(texLevel == 0);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+	useFrameBuffer(fboId);
 	{
 		glFramebufferTexture2D(GL_FRAMEBUFFER, attachmentPoint, texTarget, texId, texLevel);
 		checkGLErrors(__FILE__, __LINE__);
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	useFrameBuffer(0);
 }
 
 // ======================================================
@@ -614,12 +1018,12 @@ void attachRenderBufferToFrameBuffer(const GLuint fboId, const GLuint rboId, con
 	assert(fboId != 0);
 	assert(rboId != 0);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+	useFrameBuffer(fboId);
 	{
 		glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachmentPoint, GL_RENDERBUFFER, rboId);
 		checkGLErrors(__FILE__, __LINE__);
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	useFrameBuffer(0);
 }
 
 // ======================================================
@@ -633,12 +1037,12 @@ void readFrameBuffer(const GLuint fboId, const int xOffs, const int yOffs, const
 	assert(fboId != 0);
 	assert(destBuffer != nullptr);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+	useFrameBuffer(fboId);
 	{
 		glReadPixels(xOffs, yOffs, w, h, pixFormat, dataType, destBuffer);
 		checkGLErrors(__FILE__, __LINE__);
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	useFrameBuffer(0);
 }
 
 } // namespace gl {}
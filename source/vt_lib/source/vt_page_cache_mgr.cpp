@@ -144,7 +144,9 @@ void CachePageTree::set(const int level, const int x, const int y, CacheEntry *
 // ======================================================
 
 PageCacheMgr::PageCacheMgr(const int * vtPagesX, const int * vtPagesY, const int vtNumLevels)
-	: mru(nullptr)
+	: numDirtyPages(0)
+	, numEvictedDirtyPages(0)
+	, mru(nullptr)
 	, lru(nullptr)
 	, cachePageTree(vtPagesX, vtPagesY, vtNumLevels)
 {
@@ -228,6 +230,72 @@ CachePageStatus PageCacheMgr::lookupPage(const PageId id)
 	return CachePageStatus::Cached;
 }
 
+CachePageStatus PageCacheMgr::queryPage(const PageId id, CachePageCoord * coordOut) const
+{
+	const int level = pageIdExtractMipLevel(id);
+	const int pageX = pageIdExtractPageX(id);
+	const int pageY = pageIdExtractPageY(id);
+	assert(validPageRequest(level, pageX, pageY));
+
+	const CacheEntry * entry = cachePageTree.get(level, pageX, pageY);
+	if (entry == nullptr)
+	{
+		return CachePageStatus::Unavailable;
+	}
+	if (entry == getRequestedPageDummy())
+	{
+		return CachePageStatus::InFlight;
+	}
+
+	if (coordOut != nullptr)
+	{
+		*coordOut = entry->cacheCoord;
+	}
+	return CachePageStatus::Cached;
+}
+
+bool PageCacheMgr::markPageDirty(const PageId id)
+{
+	const int level = pageIdExtractMipLevel(id);
+	const int pageX = pageIdExtractPageX(id);
+	const int pageY = pageIdExtractPageY(id);
+	assert(validPageRequest(level, pageX, pageY));
+
+	CacheEntry * entry = cachePageTree.get(level, pageX, pageY);
+	if (entry == nullptr || entry == getRequestedPageDummy())
+	{
+		return false;
+	}
+
+	if (!entry->dirty)
+	{
+		entry->dirty = true;
+		numDirtyPages++;
+	}
+	return true;
+}
+
+void PageCacheMgr::clearDirtyPages()
+{
+	if (numDirtyPages == 0)
+	{
+		return;
+	}
+
+	for (CacheEntry & entry : cacheEntryPool)
+	{
+		entry.dirty = false;
+	}
+	numDirtyPages = 0;
+}
+
+int PageCacheMgr::takeNumEvictedDirtyPages()
+{
+	const int count = numEvictedDirtyPages;
+	numEvictedDirtyPages = 0;
+	return count;
+}
+
 bool PageCacheMgr::stillWantPage(const PageId id) const
 {
 	const int level = pageIdExtractMipLevel(id);
@@ -265,6 +333,14 @@ CacheEntry * PageCacheMgr::allocPageEntry()
 		cachePageTree.set(lru->pageId, nullptr);
 	}
 
+	// Evicting a modified page. The owner should write it back soon.
+	if (lru->dirty)
+	{
+		lru->dirty = false;
+		numDirtyPages--;
+		numEvictedDirtyPages++;
+	}
+
 	// Get the LRU and reuse it:
 	CacheEntry * entry = lru;
 	entry->prev->next = nullptr;
@@ -309,8 +385,13 @@ void PageCacheMgr::purgeCache()
 		page->prev = (i > 0) ? &entries[i - 1] : nullptr;
 		page->next = (i < (TotalCachePages - 1)) ? &entries[i + 1] : nullptr;
 		page->pageId = InvalidPageId;
+		page->dirty  = false;
 	}
 
+	// Dirty pages are dropped along with the rest.
+	numEvictedDirtyPages += numDirtyPages;
+	numDirtyPages = 0;
+
 	mru = &entries[0];
 	lru = &entries[TotalCachePages - 1];
 }
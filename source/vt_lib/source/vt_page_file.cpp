@@ -32,20 +32,79 @@
 
 #include "vt.hpp"
 #include "vt_tool_image.hpp"
+#include "vt_tool_page_scaling.hpp"
 #include "vt_file_format.hpp"
 
 #include <cerrno>
 #include <cstdio>
 #include <cstring>
+#include <vector>
+
+// POSIX memory mapping, for VTFFArchive:
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 namespace vt
 {
 
+// ======================================================
+// Shared page cache keys:
+// ======================================================
+
+namespace {
+
+inline uint64_t fnv1aAppend(uint64_t hash, const uint64_t value)
+{
+	for (int b = 0; b < 8; ++b)
+	{
+		hash ^= (value >> (b * 8)) & 0xFF;
+		hash *= 1099511628211ull; // FNV-1a prime
+	}
+	return hash;
+}
+
+// Device and inode identify the file regardless of the path it was opened with.
+// Size and modification time change when it is rebuilt in place.
+uint64_t hashFileIdentity(const struct stat & fileStats)
+{
+	uint64_t hash = 14695981039346656037ull; // FNV-1a offset basis
+	hash = fnv1aAppend(hash, static_cast<uint64_t>(fileStats.st_dev));
+	hash = fnv1aAppend(hash, static_cast<uint64_t>(fileStats.st_ino));
+	hash = fnv1aAppend(hash, static_cast<uint64_t>(fileStats.st_size));
+	hash = fnv1aAppend(hash, static_cast<uint64_t>(fileStats.st_mtime));
+	return (hash != 0) ? hash : 1;
+}
+
+// The debug text is drawn into the pages, so it is part of the key.
+uint64_t makeSharedCacheKey(const uint64_t fileIdentity, const uint32_t textureIndex, const bool debug)
+{
+	if (fileIdentity == 0)
+	{
+		return 0;
+	}
+	uint64_t hash = fnv1aAppend(fileIdentity, textureIndex);
+	hash = fnv1aAppend(hash, debug ? 1 : 0);
+	return (hash != 0) ? hash : 1;
+}
+
+} // namespace {}
+
+// ======================================================
+// PageFile:
+// ======================================================
+
+size_t PageFile::getPageReadBytes(PageId /* pageId */) const
+{
+	return sizeof(Pixel4b) * PageRequestDataPacket::TotalPagePixels;
+}
+
 // ======================================================
 // UnpackedImagesPageFile:
 // ======================================================
 
-void UnpackedImagesPageFile::loadPage(const PageId pageId, PageRequestDataPacket & pageRequest)
+bool UnpackedImagesPageFile::loadPage(const PageId pageId, PageRequestDataPacket & pageRequest)
 {
 	char path[512];
 	const int x = pageIdExtractPageX(pageId);
@@ -59,7 +118,7 @@ void UnpackedImagesPageFile::loadPage(const PageId pageId, PageRequestDataPacket
 	{
 		vtLogError("UnpackedImagesPageFile: Failed to load a page! " << imageLoadError);
 		std::memset(pageRequest.pageData, 0, sizeof(pageRequest.pageData));
-		return;
+		return false;
 	}
 
 	size_t pageBytes = sizeof(pageRequest.pageData);
@@ -84,13 +143,14 @@ void UnpackedImagesPageFile::loadPage(const PageId pageId, PageRequestDataPacket
 			PageTable::PageSizeInPixels,
 			PageTable::PageBorderSizeInPixels);
 	}
+	return true;
 }
 
 // ======================================================
 // DebugPageFile:
 // ======================================================
 
-void DebugPageFile::loadPage(const PageId pageId, PageRequestDataPacket & pageRequest)
+bool DebugPageFile::loadPage(const PageId pageId, PageRequestDataPacket & pageRequest)
 {
 	// This PageFile implementation is used for basic testing and debugging.
 	// It does not perform any file IO, just writes the pageId to every
@@ -123,36 +183,208 @@ void DebugPageFile::loadPage(const PageId pageId, PageRequestDataPacket & pageRe
 			PageTable::PageSizeInPixels,
 			PageTable::PageBorderSizeInPixels);
 	}
+	return true;
 }
 
 // ======================================================
 // VTFFPageFile:
 // ======================================================
 
+std::mutex VTFFPageFile::residencyLock;
+VTFFPageFile::LruList VTFFPageFile::openFiles       = { nullptr, nullptr, &VTFFPageFile::handleLinks, 0, DefaultMaxOpenFiles };
+VTFFPageFile::LruList VTFFPageFile::residentIndexes = { nullptr, nullptr, &VTFFPageFile::indexLinks,  0, DefaultMaxResidentPageIndexes };
+
 VTFFPageFile::VTFFPageFile(std::string filename, const bool debug)
-	: VTFFPageFile(tryOpenFile(filename), std::move(filename), debug)
+	: pageFile(nullptr)
+	, pinCount(0)
+	, headerLoaded(false)
+	, numLevels(0)
+	, fileVersion(0)
+	, fileIdentity(0)
+	, inputFileName(std::move(filename))
+	, addDebugInfo(debug)
 {
-	// tryOpenFile() may throw if fopen() fails.
+	handleLinks = { nullptr, nullptr };
+	indexLinks  = { nullptr, nullptr };
+	clearArray(numPagesX);
+	clearArray(numPagesY);
+	uvScale[0] = 1.0f;
+	uvScale[1] = 1.0f;
+	clearPodObject(mipTailInfo);
+	clearPodObject(pageStorageInfo);
 }
 
 VTFFPageFile::VTFFPageFile(FILE * fileStream, std::string filename, const bool debug)
-	: pageFile(fileStream)
-	, inputFileName(std::move(filename))
-	, addDebugInfo(debug)
+	: VTFFPageFile(std::move(filename), debug)
+{
+	assert(fileStream != nullptr);
+	assert(!std::ferror(fileStream));
+
+	std::lock_guard<std::mutex> lock(residencyLock);
+	pageFile = fileStream;
+	lruTouch(openFiles, this);
+	trimResidentSets();
+}
+
+VTFFPageFile::~VTFFPageFile()
+{
+	std::lock_guard<std::mutex> lock(residencyLock);
+	assert(pinCount == 0 && "VTFFPageFile destroyed while a request is still using it!");
+
+	if (pageFile != nullptr)
+	{
+		std::fclose(pageFile);
+		lruUnlink(openFiles, this);
+	}
+	if (pageTree != nullptr)
+	{
+		lruUnlink(residentIndexes, this);
+	}
+}
+
+bool VTFFPageFile::isPowerOfTwo(const uint32_t size)
+{
+	return (size & (size - 1)) == 0;
+}
+
+void VTFFPageFile::lruTouch(LruList & list, VTFFPageFile * file)
+{
+	LruLinks & links = file->*list.links;
+	if (list.head == file)
+	{
+		return;
+	}
+
+	// Unlink if already in the list, else it is a new entry:
+	if (links.prev != nullptr || list.tail == file)
+	{
+		lruUnlink(list, file);
+	}
+
+	// Link at front:
+	links.prev = nullptr;
+	links.next = list.head;
+	if (list.head != nullptr)
+	{
+		(list.head->*list.links).prev = file;
+	}
+	list.head = file;
+	if (list.tail == nullptr)
+	{
+		list.tail = file;
+	}
+	list.count++;
+}
+
+void VTFFPageFile::lruUnlink(LruList & list, VTFFPageFile * file)
+{
+	LruLinks & links = file->*list.links;
+
+	if (links.prev != nullptr)
+	{
+		(links.prev->*list.links).next = links.next;
+	}
+	else
+	{
+		assert(list.head == file);
+		list.head = links.next;
+	}
+
+	if (links.next != nullptr)
+	{
+		(links.next->*list.links).prev = links.prev;
+	}
+	else
+	{
+		assert(list.tail == file);
+		list.tail = links.prev;
+	}
+
+	links.prev = nullptr;
+	links.next = nullptr;
+	list.count--;
+}
+
+void VTFFPageFile::trimResidentSets()
+{
+	// residencyLock must be held by the caller.
+	// Pinned files are skipped, so the limits might be temporarily exceeded.
+
+	for (VTFFPageFile * file = openFiles.tail; (file != nullptr) && (openFiles.count > openFiles.limit);)
+	{
+		VTFFPageFile * prev = file->handleLinks.prev;
+		if (file->pinCount == 0)
+		{
+			std::fclose(file->pageFile);
+			file->pageFile = nullptr;
+			lruUnlink(openFiles, file);
+		}
+		file = prev;
+	}
+
+	for (VTFFPageFile * file = residentIndexes.tail; (file != nullptr) && (residentIndexes.count > residentIndexes.limit);)
+	{
+		VTFFPageFile * prev = file->indexLinks.prev;
+		if (file->pinCount == 0)
+		{
+			file->pageTree.reset();
+			lruUnlink(residentIndexes, file);
+		}
+		file = prev;
+	}
+}
+
+FILE * VTFFPageFile::acquireFileHandle()
+{
+	std::lock_guard<std::mutex> lock(residencyLock);
+	++pinCount;
+
+	if (pageFile == nullptr)
+	{
+		errno = 0;
+		pageFile = std::fopen(inputFileName.c_str(), "rb");
+		if (pageFile == nullptr)
+		{
+			vtLogError("Failed to open VTFF page file \"" << inputFileName << "\"! Sys err: " << std::strerror(errno));
+			return nullptr;
+		}
+	}
+
+	lruTouch(openFiles, this);
+	trimResidentSets();
+	return pageFile;
+}
+
+void VTFFPageFile::releaseFileHandle()
+{
+	std::lock_guard<std::mutex> lock(residencyLock);
+	assert(pinCount > 0);
+	--pinCount;
+}
+
+bool VTFFPageFile::loadHeader(FILE * fileStream, std::string & errorMessage)
 {
-	assert(pageFile != nullptr);
-	assert(!std::ferror(pageFile));
+	std::ostringstream errStr;
+	errStr << "VTFF \"" << inputFileName << "\": ";
+
+	if (std::fseek(fileStream, 0, SEEK_SET) != 0)
+	{
+		errorMessage = errStr.str() + "fseek() failed!";
+		return false;
+	}
 
 	// Read file header and validate it:
 	VTFF::Header header;
-	if (std::fread(&header, sizeof(header), 1, pageFile) != 1)
+	if (std::fread(&header, sizeof(header), 1, fileStream) != 1)
 	{
-		vtFatalError("VTFF \"" << inputFileName << "\": Unable to read file header!");
+		errorMessage = errStr.str() + "Unable to read file header!";
+		return false;
 	}
 
-	if ((header.magic != VTFF::Magic) || (header.version != VTFF::Version))
+	if ((header.magic != VTFF::Magic) || (header.version < VTFF::MinVersion) || (header.version > VTFF::Version))
 	{
-		vtFatalError("VTFF \"" << inputFileName <<  "\": Wrong file type / bad file version!");
+		errorMessage = errStr.str() + "Wrong file type / bad file version!";
+		return false;
 	}
 
 	if ((header.numMipMapLevels == 0) ||
@@ -161,170 +393,414 @@ VTFFPageFile::VTFFPageFile(FILE * fileStream, std::string filename, const bool d
 		(header.borderSize != PageTable::PageBorderSizeInPixels) ||
 		(header.pageContentSize != PageTable::PageSizeInPixels - (PageTable::PageBorderSizeInPixels * 2)))
 	{
-		vtFatalError("VTFF \"" << inputFileName << "\": Bad file format! Data layout is incompatible.");
+		errorMessage = errStr.str() + "Bad file format! Data layout is incompatible.";
+		return false;
 	}
 
 	if (header.pixelFormat != tool::PixelFormat::RgbaU8)
 	{
-		vtFatalError("VTFF \"" << inputFileName << "\": Currently, we only support 8bits RGBA page files!");
+		errorMessage = errStr.str() + "Currently, we only support 8bits RGBA page files!";
+		return false;
 	}
 
-	vtLogComment("VTFF file \"" << inputFileName << "\" has " << header.numMipMapLevels << " mipmap levels.");
-
-	int vtPagesX[MaxVTMipLevels] = {0};
-	int vtPagesY[MaxVTMipLevels] = {0};
-	const unsigned int numLevels = header.numMipMapLevels;
-
-	fpos_t oldFilePos;
-	if (std::fgetpos(pageFile, &oldFilePos) != 0)
-	{
-		vtFatalError("fgetpos() failed!");
-	}
+	// Now read mip-map levels and validate the headers.
+	// The page infos are skipped. They are only loaded by loadPageIndex().
+	const uint32_t levelInfoSize = VTFF::getMipLevelInfoSize(header.version);
+	uint8_t levelRecord[sizeof(VTFF::MipLevelInfo)];
 
-	// Now read mip-map levels and validate the headers:
-    for (unsigned int level = 0; level < numLevels; ++level)
+	for (unsigned int level = 0; level < header.numMipMapLevels; ++level)
 	{
 		VTFF::MipLevelInfo levelInfo;
-		if (std::fread(&levelInfo, sizeof(levelInfo), 1, pageFile) != 1)
+		if (std::fread(levelRecord, levelInfoSize, 1, fileStream) != 1)
 		{
-			vtFatalError("VTFF \"" << inputFileName << "\": Unable to read mipmap information for level " << level);
+			errStr << "Unable to read mipmap information for level " << level;
+			errorMessage = errStr.str();
+			return false;
 		}
+		VTFF::unpackMipLevelInfo(levelRecord, header.version, header.pageContentSize, levelInfo);
 
 		// We expect a power-of-two number of pages in both axes!
-		if (!isPowerOfTwo(levelInfo.numPagesX))
-		{
-			vtFatalError("VTFF \"" << inputFileName << "\": Mipmap level " << level
-					<< ": numPagesX (" << levelInfo.numPagesX << ") is not a power-of-2!");
-		}
-		if (!isPowerOfTwo(levelInfo.numPagesY))
+		if (!isPowerOfTwo(levelInfo.numPagesX) || !isPowerOfTwo(levelInfo.numPagesY))
 		{
-			vtFatalError("VTFF \"" << inputFileName << "\": Mipmap level " << level
-					<< ": numPagesY (" << levelInfo.numPagesY << ") is not a power-of-2!");
+			errStr << "Mipmap level " << level << ": numPagesX/Y (" << levelInfo.numPagesX
+			       << ", " << levelInfo.numPagesY << ") is not a power-of-2!";
+			errorMessage = errStr.str();
+			return false;
 		}
 
 		// Width/height must also be evenly divisible by the page size!
 		if ((levelInfo.width % header.pageSize) != 0 || (levelInfo.height % header.pageSize) != 0)
 		{
-			vtFatalError("VTFF \"" << inputFileName << "\": Bad mipmap level layout for level " << level);
+			errStr << "Bad mipmap level layout for level " << level;
+			errorMessage = errStr.str();
+			return false;
 		}
 
-		// Read information for all pages belonging this level and validate 'em:
-		for (uint16_t y = 0; y < levelInfo.numPagesY; ++y)
+		// The image data can only leave part of the last page in each axis unfilled.
+		if ((levelInfo.validWidth  == 0) || (levelInfo.validWidth  > levelInfo.numPagesX * header.pageContentSize) ||
+		    (levelInfo.validHeight == 0) || (levelInfo.validHeight > levelInfo.numPagesY * header.pageContentSize))
 		{
-			for (uint16_t x = 0; x < levelInfo.numPagesX; ++x)
-			{
-				VTFF::PageInfo pageInfo;
-				if (std::fread(&pageInfo, sizeof(pageInfo), 1, pageFile) != 1)
-				{
-					vtFatalError("VTFF \"" << inputFileName << "\": Unable to read page("
-							<< x << ", " << y << ") info for mipmap level " << level);
-				}
+			errStr << "Bad valid extents for mipmap level " << level;
+			errorMessage = errStr.str();
+			return false;
+		}
+		if (level == 0)
+		{
+			uvScale[0] = static_cast<float>(levelInfo.validWidth)  / (levelInfo.numPagesX * header.pageContentSize);
+			uvScale[1] = static_cast<float>(levelInfo.validHeight) / (levelInfo.numPagesY * header.pageContentSize);
+		}
 
-				if (pageInfo.sizeInBytes != (PageTable::PageSizeInPixels * PageTable::PageSizeInPixels * 4))
-				{
-					vtFatalError("VTFF \"" << inputFileName << "\": Bad page size in bytes! We currently only support RgbaU8 format!");
-				}
+		const long pageInfoBytes = static_cast<long>(levelInfo.numPagesX) * levelInfo.numPagesY * VTFF::getPageInfoSize(header.version);
+		if (std::fseek(fileStream, pageInfoBytes, SEEK_CUR) != 0)
+		{
+			errStr << "Unable to skip page infos for mipmap level " << level;
+			errorMessage = errStr.str();
+			return false;
+		}
 
-				// Don't save this PageInfo now. There will be a second pass to
-				// collect these after we finish gathering the mipmap level sizes.
-			}
+		numPagesX[level] = levelInfo.numPagesX;
+		numPagesY[level] = levelInfo.numPagesY;
+	}
+
+	// The mip tail info follows the page infos. Older files have none.
+	clearPodObject(mipTailInfo);
+	if (header.version >= VTFF::FirstVersionWithMipTail)
+	{
+		if (std::fread(&mipTailInfo, sizeof(mipTailInfo), 1, fileStream) != 1)
+		{
+			errorMessage = errStr.str() + "Unable to read mip tail information!";
+			return false;
+		}
+
+		uint32_t expectedBytes = 0;
+		for (uint32_t l = 0; l < mipTailInfo.numLevels; ++l)
+		{
+			expectedBytes += std::max(mipTailInfo.width >> l, 1u) * std::max(mipTailInfo.height >> l, 1u) * 4;
+		}
+		if (mipTailInfo.numLevels != 0 && mipTailInfo.sizeInBytes != expectedBytes)
+		{
+			vtLogWarning("VTFF file \"" << inputFileName << "\" has a bad mip tail. Ignoring it...");
+			clearPodObject(mipTailInfo);
+		}
+	}
+
+	// Then how the reduced resolution pages are restored, since version 6.
+	clearPodObject(pageStorageInfo);
+	if (header.version >= VTFF::FirstVersionWithPageStorage)
+	{
+		if (std::fread(&pageStorageInfo, sizeof(pageStorageInfo), 1, fileStream) != 1)
+		{
+			errorMessage = errStr.str() + "Unable to read page storage information!";
+			return false;
 		}
+		if (pageStorageInfo.upsampleFilter > static_cast<uint32_t>(tool::FilterType::Kaiser))
+		{
+			errorMessage = errStr.str() + "Unknown page upsampling filter!";
+			return false;
+		}
+	}
+
+	numLevels    = static_cast<int>(header.numMipMapLevels);
+	fileVersion  = header.version;
+	headerLoaded = true;
 
-		vtPagesX[level] = levelInfo.numPagesX;
-		vtPagesY[level] = levelInfo.numPagesY;
-    }
+	vtLogComment("VTFF file \"" << inputFileName << "\" has " << numLevels << " mipmap levels.");
+	return true;
+}
+
+bool VTFFPageFile::loadPageIndex(FILE * fileStream, std::string & errorMessage)
+{
+	assert(headerLoaded);
+
+	std::ostringstream errStr;
+	errStr << "VTFF \"" << inputFileName << "\": ";
 
-	// Restore the file position to just before the main file header:
-	if (std::fsetpos(pageFile, &oldFilePos) != 0)
+	// Skip the main header, which was already validated by loadHeader():
+	if (std::fseek(fileStream, sizeof(VTFF::Header), SEEK_SET) != 0)
 	{
-		vtFatalError("fsetpos() failed!");
+		errorMessage = errStr.str() + "fseek() failed!";
+		return false;
 	}
 
-	// Allocate the page quad-tree:
-	pageTree.reset(new VTFFPageTree(vtPagesX, vtPagesY, numLevels));
+	std::unique_ptr<VTFFPageTree> newTree(new VTFFPageTree(numPagesX.data(), numPagesY.data(), numLevels));
+	std::vector<VTFF::PageInfo> levelPages;
+	std::vector<uint8_t> pageInfoRecords;
+	const uint32_t levelInfoSize = VTFF::getMipLevelInfoSize(fileVersion);
+	const uint32_t pageInfoSize  = VTFF::getPageInfoSize(fileVersion);
+	uint8_t levelRecord[sizeof(VTFF::MipLevelInfo)];
 
-	// Now we are going to read the MipLevelInfo and PageInfo
-	// headers again to construct the VTFFPageTree.
-	for (uint32_t level = 0; level < numLevels; ++level)
+	for (int level = 0; level < numLevels; ++level)
 	{
+		// Only the page counts are needed here. Valid extents were checked by loadHeader().
 		VTFF::MipLevelInfo levelInfo;
-		if (std::fread(&levelInfo, sizeof(levelInfo), 1, pageFile) != 1)
+		if (std::fread(levelRecord, levelInfoSize, 1, fileStream) != 1)
+		{
+			errStr << "Unable to read mipmap information for level " << level;
+			errorMessage = errStr.str();
+			return false;
+		}
+		VTFF::unpackMipLevelInfo(levelRecord, fileVersion, PageTable::PageSizeInPixels - (PageTable::PageBorderSizeInPixels * 2), levelInfo);
+		if (levelInfo.numPagesX != numPagesX[level] || levelInfo.numPagesY != numPagesY[level])
+		{
+			errStr << "Unable to read mipmap information for level " << level;
+			errorMessage = errStr.str();
+			return false;
+		}
+
+		// Read all page infos of the level with a single call:
+		levelPages.resize(levelInfo.numPagesX * levelInfo.numPagesY);
+		pageInfoRecords.resize(levelPages.size() * pageInfoSize);
+		if (std::fread(pageInfoRecords.data(), pageInfoSize, levelPages.size(), fileStream) != levelPages.size())
 		{
-			vtFatalError("VTFF \"" << inputFileName << "\": Unable to read mipmap information for level " << level);
+			errStr << "Unable to read page infos for mipmap level " << level;
+			errorMessage = errStr.str();
+			return false;
 		}
+		VTFF::unpackPageInfos(pageInfoRecords.data(), fileVersion, levelPages.data(), levelPages.size());
 
-		for (uint16_t y = 0; y < levelInfo.numPagesY; ++y)
+		for (int y = 0; y < levelInfo.numPagesY; ++y)
 		{
-			for (uint16_t x = 0; x < levelInfo.numPagesX; ++x)
+			for (int x = 0; x < levelInfo.numPagesX; ++x)
 			{
-				VTFF::PageInfo pageInfo;
-				if (std::fread(&pageInfo, sizeof(pageInfo), 1, pageFile) != 1)
+				const VTFF::PageInfo & pageInfo = levelPages[x + y * levelInfo.numPagesX];
+				if ((pageInfo.storageShift > tool::MaxPageStorageShift) ||
+				    (pageInfo.sizeInBytes != tool::reducedPageSizeBytes(PageTable::PageSizeInPixels, pageInfo.storageShift)))
 				{
-					vtFatalError("VTFF \"" << inputFileName << "\": Unable to read page("
-							<< x << ", " << y << ") info for mipmap level " << level);
+					errorMessage = errStr.str() + "Bad page size in bytes! We currently only support RgbaU8 format!";
+					return false;
 				}
 
-				pageTree->set(x, y, level, pageInfo.fileOffset, pageInfo.sizeInBytes);
+				newTree->set(x, y, level, pageInfo.fileOffset, pageInfo.sizeInBytes, pageInfo.storageShift);
 			}
 		}
 	}
+
+	std::lock_guard<std::mutex> lock(residencyLock);
+	pageTree = std::move(newTree);
+	lruTouch(residentIndexes, this);
+	trimResidentSets();
+
+	vtLogComment("Loaded page index of VTFF file \"" << inputFileName << "\"...");
+	return true;
 }
 
-VTFFPageFile::~VTFFPageFile()
+bool VTFFPageFile::loadHeaderOnce(FILE * fileStream, std::string & errorMessage)
 {
-	if (pageFile != nullptr)
+	// Threads racing here must not both parse the header into the same members.
+	std::lock_guard<std::mutex> lock(headerLock);
+	return headerLoaded || loadHeader(fileStream, errorMessage);
+}
+
+void VTFFPageFile::ensureHeaderLoaded()
+{
+	if (headerLoaded)
 	{
-		std::fclose(pageFile);
+		return;
+	}
+
+	#if VT_THREAD_SAFE_VTFF_PAGE_FILE
+	std::lock_guard<std::mutex> lock(fileLock);
+	#endif // VT_THREAD_SAFE_VTFF_PAGE_FILE
+
+	std::string errorMessage;
+	FILE * fileStream = acquireFileHandle();
+	const bool success = (fileStream != nullptr) && loadHeaderOnce(fileStream, errorMessage);
+	releaseFileHandle();
+
+	if (!success)
+	{
+		vtFatalError("Failed to load VTFF page file \"" << inputFileName << "\"! " << errorMessage);
 	}
 }
 
-bool VTFFPageFile::isPowerOfTwo(const uint32_t size)
+int VTFFPageFile::getNumLevels()
 {
-	return (size & (size - 1)) == 0;
+	ensureHeaderLoaded();
+	return numLevels;
 }
 
-FILE * VTFFPageFile::tryOpenFile(const std::string & filename)
+const int * VTFFPageFile::getNumPagesX()
 {
-	errno = 0;
-	FILE * pageFile = std::fopen(filename.c_str(), "rb");
-	if (pageFile == nullptr)
+	ensureHeaderLoaded();
+	return numPagesX.data();
+}
+
+const int * VTFFPageFile::getNumPagesY()
+{
+	ensureHeaderLoaded();
+	return numPagesY.data();
+}
+
+void VTFFPageFile::getUVScale(float scale[2])
+{
+	ensureHeaderLoaded();
+	scale[0] = uvScale[0];
+	scale[1] = uvScale[1];
+}
+
+uint64_t VTFFPageFile::getSharedCacheKey() const
+{
+	// Racing threads compute the same value, so no lock is needed.
+	uint64_t identity = fileIdentity.load(std::memory_order_relaxed);
+	if (identity == 0)
 	{
-		vtFatalError("Failed to open VTFF page file \"" << filename << "\"! Sys err: " << std::strerror(errno));
+		struct stat fileStats;
+		if (stat(inputFileName.c_str(), &fileStats) != 0)
+		{
+			return 0;
+		}
+		identity = hashFileIdentity(fileStats);
+		fileIdentity.store(identity, std::memory_order_relaxed);
 	}
-	return pageFile;
+	return makeSharedCacheKey(identity, 0, addDebugInfo);
+}
+
+size_t VTFFPageFile::getPageReadBytes(const PageId pageId) const
+{
+	const int x = pageIdExtractPageX(pageId);
+	const int y = pageIdExtractPageY(pageId);
+	const int level = pageIdExtractMipLevel(pageId);
+
+	// Only peeks at the index. Never loads it or touches its LRU position.
+	std::lock_guard<std::mutex> lock(residencyLock);
+	if (pageTree == nullptr || level >= pageTree->getNumLevels() ||
+	    x >= pageTree->getNumPagesX(level) || y >= pageTree->getNumPagesY(level))
+	{
+		return PageFile::getPageReadBytes(pageId);
+	}
+	return pageTree->get(pageId).sizeInBytes;
 }
 
-void VTFFPageFile::loadPage(const PageId pageId, PageRequestDataPacket & pageRequest)
+VTFFPageFile::PinnedPageTree VTFFPageFile::getPageTree()
 {
-	assert(pageFile != nullptr);
-	assert(pageTree != nullptr);
+	ensureHeaderLoaded();
 
 	#if VT_THREAD_SAFE_VTFF_PAGE_FILE
 	std::lock_guard<std::mutex> lock(fileLock);
 	#endif // VT_THREAD_SAFE_VTFF_PAGE_FILE
 
-	if (pageId == InvalidPageId)
+	std::string errorMessage;
+	FILE * fileStream = acquireFileHandle();
+	const bool success = (pageTree != nullptr) || ((fileStream != nullptr) && loadPageIndex(fileStream, errorMessage));
+
+	if (!success)
+	{
+		releaseFileHandle();
+		vtFatalError("Failed to load page index of VTFF file \"" << inputFileName << "\"! " << errorMessage);
+	}
+
+	// The pin taken above is handed over to the returned object.
+	return PinnedPageTree(this, pageTree.get());
+}
+
+void VTFFPageFile::evictResidentData()
+{
+	std::lock_guard<std::mutex> lock(residencyLock);
+	if (pinCount != 0)
 	{
-		vtLogError("VTFFPageFile: Invalid page id!");
-		std::memset(pageRequest.pageData, 0, sizeof(pageRequest.pageData));
 		return;
 	}
 
-	const VTFFPageTree::PageInfo & pageInfo = pageTree->get(pageId);
+	if (pageFile != nullptr)
+	{
+		std::fclose(pageFile);
+		pageFile = nullptr;
+		lruUnlink(openFiles, this);
+	}
+	if (pageTree != nullptr)
+	{
+		pageTree.reset();
+		lruUnlink(residentIndexes, this);
+	}
+}
+
+size_t VTFFPageFile::getMemoryBytes() const
+{
+	std::lock_guard<std::mutex> lock(residencyLock);
+	return (pageTree != nullptr) ? pageTree->getMemoryBytes() : 0;
+}
 
-	if (std::fseek(pageFile, pageInfo.fileOffset, SEEK_SET) != 0)
+bool VTFFPageFile::loadMipTail(MipTailData & tail)
+{
+	ensureHeaderLoaded();
+	if (mipTailInfo.numLevels == 0)
 	{
-		vtLogError("VTFFPageFile: Failed to seek file offset " << pageInfo.fileOffset << "! fseek() failed!");
+		return false;
+	}
+
+	#if VT_THREAD_SAFE_VTFF_PAGE_FILE
+	std::lock_guard<std::mutex> lock(fileLock);
+	#endif // VT_THREAD_SAFE_VTFF_PAGE_FILE
+
+	tail.width     = static_cast<int>(mipTailInfo.width);
+	tail.height    = static_cast<int>(mipTailInfo.height);
+	tail.numLevels = static_cast<int>(mipTailInfo.numLevels);
+	tail.pixels.resize(mipTailInfo.sizeInBytes / sizeof(Pixel4b));
+
+	FILE * fileStream = acquireFileHandle();
+	const bool success = (fileStream != nullptr) &&
+		(std::fseek(fileStream, static_cast<long>(mipTailInfo.fileOffset), SEEK_SET) == 0) &&
+		(std::fread(tail.pixels.data(), 1, mipTailInfo.sizeInBytes, fileStream) == mipTailInfo.sizeInBytes);
+	releaseFileHandle();
+
+	if (!success)
+	{
+		vtLogError("Failed to read the mip tail of VTFF file \"" << inputFileName << "\"!");
+		tail = MipTailData{};
+		return false;
+	}
+	return true;
+}
+
+void VTFFPageFile::setMaxOpenFiles(const int count)
+{
+	assert(count > 0);
+	std::lock_guard<std::mutex> lock(residencyLock);
+	openFiles.limit = count;
+}
+
+void VTFFPageFile::setMaxResidentPageIndexes(const int count)
+{
+	assert(count > 0);
+	std::lock_guard<std::mutex> lock(residencyLock);
+	residentIndexes.limit = count;
+}
+
+int VTFFPageFile::getNumOpenFiles()
+{
+	std::lock_guard<std::mutex> lock(residencyLock);
+	return openFiles.count;
+}
+
+int VTFFPageFile::getNumResidentPageIndexes()
+{
+	std::lock_guard<std::mutex> lock(residencyLock);
+	return residentIndexes.count;
+}
+
+bool VTFFPageFile::loadPage(const PageId pageId, PageRequestDataPacket & pageRequest)
+{
+	#if VT_THREAD_SAFE_VTFF_PAGE_FILE
+	std::lock_guard<std::mutex> lock(fileLock);
+	#endif // VT_THREAD_SAFE_VTFF_PAGE_FILE
+
+	if (pageId == InvalidPageId)
+	{
+		vtLogError("VTFFPageFile: Invalid page id!");
 		std::memset(pageRequest.pageData, 0, sizeof(pageRequest.pageData));
-		return;
+		return false;
 	}
 
-	if (std::fread(pageRequest.pageData, sizeof(pageRequest.pageData), 1, pageFile) != 1)
+	// Pin the file while we use it, so that the handle and
+	// index don't get evicted by requests for other files.
+	FILE * fileStream = acquireFileHandle();
+	const bool success = (fileStream != nullptr) && readPage(fileStream, pageId, pageRequest);
+	releaseFileHandle();
+
+	if (!success)
 	{
-		vtLogWarning("VTFFPageFile: fread() failed to read " << sizeof(pageRequest.pageData)
-				<< " bytes of page file \"" << inputFileName << "\"!");
 		std::memset(pageRequest.pageData, 0, sizeof(pageRequest.pageData));
-		return;
+		return false;
 	}
 
 	if (addDebugInfo)
@@ -340,6 +816,675 @@ void VTFFPageFile::loadPage(const PageId pageId, PageRequestDataPacket & pageReq
 			PageTable::PageSizeInPixels,
 			PageTable::PageBorderSizeInPixels);
 	}
+	return true;
+}
+
+bool VTFFPageFile::readPage(FILE * fileStream, const PageId pageId, PageRequestDataPacket & pageRequest)
+{
+	// Lazy load the header and page index on first use:
+	std::string errorMessage;
+	if (!headerLoaded && !loadHeaderOnce(fileStream, errorMessage))
+	{
+		vtLogError("VTFFPageFile: " << errorMessage);
+		return false;
+	}
+	if (pageTree == nullptr && !loadPageIndex(fileStream, errorMessage))
+	{
+		vtLogError("VTFFPageFile: " << errorMessage);
+		return false;
+	}
+
+	// Still touch the index, to keep it hot:
+	{
+		std::lock_guard<std::mutex> lock(residencyLock);
+		lruTouch(residentIndexes, this);
+	}
+
+	const VTFFPageTree::PageInfo pageInfo = pageTree->get(pageId);
+
+	if (std::fseek(fileStream, pageInfo.fileOffset, SEEK_SET) != 0)
+	{
+		vtLogError("VTFFPageFile: Failed to seek file offset " << pageInfo.fileOffset << "! fseek() failed!");
+		return false;
+	}
+
+	// Reduced resolution pages are upsampled on the calling (provider) thread.
+	// They are at most half size, so a local buffer will do.
+	uint8_t reducedPageData[(PageTable::PageSizeInPixels / 2) * (PageTable::PageSizeInPixels / 2) * 4];
+	uint8_t * dest = (pageInfo.storageShift != 0) ? reducedPageData : reinterpret_cast<uint8_t *>(pageRequest.pageData);
+
+	if (std::fread(dest, pageInfo.sizeInBytes, 1, fileStream) != 1)
+	{
+		vtLogWarning("VTFFPageFile: fread() failed to read " << pageInfo.sizeInBytes
+				<< " bytes of page file \"" << inputFileName << "\"!");
+		return false;
+	}
+
+	if (pageInfo.storageShift != 0)
+	{
+		tool::expandPageRgbaU8(dest, PageTable::PageSizeInPixels, pageInfo.storageShift,
+		                       static_cast<tool::FilterType>(pageStorageInfo.upsampleFilter),
+		                       reinterpret_cast<uint8_t *>(pageRequest.pageData));
+	}
+	return true;
+}
+
+// ======================================================
+// VTFFArchive:
+// ======================================================
+
+VTFFArchive::VTFFArchive(std::string filename)
+	: mappedData(nullptr)
+	, mappedSize(0)
+	, fileIdentity(0)
+	, archiveFileName(std::move(filename))
+{
+	const int fd = open(archiveFileName.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		vtFatalError("Unable to open VTFA archive \"" << archiveFileName << "\": " << std::strerror(errno));
+	}
+
+	struct stat fileStats;
+	if (fstat(fd, &fileStats) != 0 || fileStats.st_size < static_cast<off_t>(sizeof(VTFA::Header)))
+	{
+		close(fd);
+		vtFatalError("VTFA archive \"" << archiveFileName << "\" is too small to be valid!");
+	}
+
+	mappedSize   = static_cast<size_t>(fileStats.st_size);
+	fileIdentity = hashFileIdentity(fileStats);
+	void * mapping = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // The mapping stays valid without the descriptor.
+
+	if (mapping == MAP_FAILED)
+	{
+		mappedSize = 0;
+		vtFatalError("Failed to memory map VTFA archive \"" << archiveFileName << "\": " << std::strerror(errno));
+	}
+	mappedData = static_cast<const uint8_t *>(mapping);
+
+	// Validate the header and the directory. Page infos are not touched.
+	// On error, unmap before throwing, since the destructor won't run.
+	std::ostringstream errStr;
+	errStr << "VTFA \"" << archiveFileName << "\": ";
+
+	VTFA::Header header;
+	std::memcpy(&header, mappedData, sizeof(header));
+
+	if ((header.magic != VTFA::Magic) || (header.version < VTFA::MinVersion) || (header.version > VTFA::Version))
+	{
+		unmap();
+		vtFatalError(errStr.str() << "Wrong file type / bad archive version! Version 1 archives must be packed again.");
+	}
+
+	// Level records are only read here, so older layouts are converted as they are read.
+	const uint32_t levelInfoSize    = VTFA::getMipLevelInfoSize(header.version);
+	const uint32_t levelVTFFVersion = (header.version >= VTFA::FirstVersionWithValidExtents) ?
+	                                  VTFF::FirstVersionWithValidExtents : VTFF::FirstVersionWithPageStorage;
+
+	const uint32_t textureEntrySize = VTFA::getTextureEntrySize(header.version);
+	const uint64_t levelTableStart  = sizeof(VTFA::Header) + uint64_t(header.numTextures) * textureEntrySize;
+	const uint64_t pageTableStart  = levelTableStart + uint64_t(header.totalLevels) * levelInfoSize;
+	const uint64_t pageTableEnd    = pageTableStart  + uint64_t(header.totalPages)  * sizeof(VTFF::PageInfo);
+
+	if (pageTableEnd > mappedSize || header.pageDataStart < pageTableEnd || header.pageDataStart > mappedSize)
+	{
+		unmap();
+		vtFatalError(errStr.str() << "Truncated archive or bad directory layout!");
+	}
+
+	const uint8_t * textureRecords = mappedData + sizeof(VTFA::Header);
+	const uint8_t * levelRecords   = mappedData + levelTableStart;
+	const auto * pageInfos    = reinterpret_cast<const VTFF::PageInfo *>(mappedData + pageTableStart);
+
+	entries.resize(header.numTextures);
+	for (uint32_t t = 0; t < header.numTextures; ++t)
+	{
+		TextureEntry & entry = entries[t];
+		VTFA::unpackTextureEntry(textureRecords + uint64_t(t) * textureEntrySize, header.version, entry.info);
+		const VTFA::TextureEntry & info = entry.info;
+
+		if ((info.numMipMapLevels == 0) ||
+			(info.numMipMapLevels > MaxVTMipLevels) ||
+			(info.pageSize != PageTable::PageSizeInPixels) ||
+			(info.borderSize != PageTable::PageBorderSizeInPixels) ||
+			(info.pageContentSize != PageTable::PageSizeInPixels - (PageTable::PageBorderSizeInPixels * 2)) ||
+			(info.pixelFormat != tool::PixelFormat::RgbaU8) ||
+			(info.upsampleFilter > static_cast<uint32_t>(tool::FilterType::Kaiser)) ||
+			(uint64_t(info.firstLevel) + info.numMipMapLevels > header.totalLevels) ||
+			(std::memchr(info.name, '\0', VTFA::MaxNameLength) == nullptr))
+		{
+			unmap();
+			vtFatalError(errStr.str() << "Bad directory entry for texture #" << t << "!");
+		}
+
+		uint64_t numPages = 0;
+		clearArray(entry.numPagesX);
+		clearArray(entry.numPagesY);
+		for (uint32_t l = 0; l < info.numMipMapLevels; ++l)
+		{
+			VTFF::MipLevelInfo levelInfo;
+			VTFF::unpackMipLevelInfo(levelRecords + uint64_t(info.firstLevel + l) * levelInfoSize,
+			                         levelVTFFVersion, info.pageContentSize, levelInfo);
+
+			if (levelInfo.numPagesX == 0 || levelInfo.numPagesY == 0 ||
+			    (levelInfo.numPagesX & (levelInfo.numPagesX - 1)) != 0 ||
+			    (levelInfo.numPagesY & (levelInfo.numPagesY - 1)) != 0)
+			{
+				unmap();
+				vtFatalError(errStr.str() << "Texture \"" << info.name << "\", mipmap level " << l
+				             << ": numPagesX/Y is not a power-of-2!");
+			}
+
+			if ((levelInfo.validWidth  == 0) || (levelInfo.validWidth  > levelInfo.numPagesX * info.pageContentSize) ||
+			    (levelInfo.validHeight == 0) || (levelInfo.validHeight > levelInfo.numPagesY * info.pageContentSize))
+			{
+				unmap();
+				vtFatalError(errStr.str() << "Texture \"" << info.name << "\", mipmap level " << l
+				             << ": bad valid extents!");
+			}
+
+			if (l == 0)
+			{
+				entry.uvScale[0] = static_cast<float>(levelInfo.validWidth)  / (levelInfo.numPagesX * info.pageContentSize);
+				entry.uvScale[1] = static_cast<float>(levelInfo.validHeight) / (levelInfo.numPagesY * info.pageContentSize);
+			}
+
+			entry.numPagesX[l] = levelInfo.numPagesX;
+			entry.numPagesY[l] = levelInfo.numPagesY;
+			numPages += uint64_t(levelInfo.numPagesX) * levelInfo.numPagesY;
+		}
+
+		if (uint64_t(info.firstPage) + numPages > header.totalPages)
+		{
+			unmap();
+			vtFatalError(errStr.str() << "Texture \"" << info.name << "\" page index is out of bounds!");
+		}
+
+		entry.pageTree.reset(new VTFFPageTree(entry.numPagesX.data(), entry.numPagesY.data(),
+		                                      info.numMipMapLevels, pageInfos + info.firstPage));
+
+		// A bad tail only costs the texture its tail, same as in a VTFF file.
+		const VTFF::MipTailInfo & tail = info.mipTail;
+		if (tail.numLevels != 0)
+		{
+			// Levels down to 1x1 of a 32bits size can't be more than 32.
+			const uint32_t numLevels = std::min(tail.numLevels, 32u);
+			uint64_t expectedBytes = 0;
+			for (uint32_t l = 0; l < numLevels; ++l)
+			{
+				expectedBytes += uint64_t(std::max(tail.width >> l, 1u)) * std::max(tail.height >> l, 1u) * 4;
+			}
+			if (numLevels != tail.numLevels || tail.sizeInBytes != expectedBytes ||
+			    getPageDataPtr(tail.fileOffset, tail.sizeInBytes) == nullptr)
+			{
+				vtLogWarning(errStr.str() << "Texture \"" << info.name << "\" has a bad mip tail. Ignoring it...");
+				std::memset(&entry.info.mipTail, 0, sizeof(entry.info.mipTail));
+			}
+		}
+	}
+
+	vtLogComment("Mapped VTFA archive \"" << archiveFileName << "\" with "
+	             << entries.size() << " textures, " << header.totalPages << " pages.");
+}
+
+VTFFArchive::~VTFFArchive()
+{
+	unmap();
+}
+
+void VTFFArchive::unmap()
+{
+	if (mappedData != nullptr)
+	{
+		munmap(const_cast<uint8_t *>(mappedData), mappedSize);
+		mappedData = nullptr;
+		mappedSize = 0;
+	}
+}
+
+const char * VTFFArchive::getTextureName(const int textureIndex) const
+{
+	assert(textureIndex >= 0 && textureIndex < getNumTextures());
+	return entries[textureIndex].info.name;
+}
+
+int VTFFArchive::findTexture(const std::string & name) const
+{
+	for (size_t t = 0; t < entries.size(); ++t)
+	{
+		if (name == entries[t].info.name)
+		{
+			return static_cast<int>(t);
+		}
+	}
+	return -1;
+}
+
+int VTFFArchive::getNumLevels(const int textureIndex) const
+{
+	assert(textureIndex >= 0 && textureIndex < getNumTextures());
+	return entries[textureIndex].pageTree->getNumLevels();
+}
+
+const int * VTFFArchive::getNumPagesX(const int textureIndex) const
+{
+	assert(textureIndex >= 0 && textureIndex < getNumTextures());
+	return entries[textureIndex].numPagesX.data();
+}
+
+const int * VTFFArchive::getNumPagesY(const int textureIndex) const
+{
+	assert(textureIndex >= 0 && textureIndex < getNumTextures());
+	return entries[textureIndex].numPagesY.data();
+}
+
+const float * VTFFArchive::getUVScale(const int textureIndex) const
+{
+	assert(textureIndex >= 0 && textureIndex < getNumTextures());
+	return entries[textureIndex].uvScale;
+}
+
+const VTFFPageTree & VTFFArchive::getPageTree(const int textureIndex) const
+{
+	assert(textureIndex >= 0 && textureIndex < getNumTextures());
+	return *entries[textureIndex].pageTree;
+}
+
+std::unique_ptr<VTFFArchivePageFile> VTFFArchive::createPageFile(const int textureIndex, const bool debug) const
+{
+	if (textureIndex < 0 || textureIndex >= getNumTextures())
+	{
+		vtFatalError("VTFA \"" << archiveFileName << "\": Texture index " << textureIndex << " out of range!");
+	}
+	return std::unique_ptr<VTFFArchivePageFile>(new VTFFArchivePageFile(*this, textureIndex, debug));
+}
+
+bool VTFFArchive::readPageData(const uint64_t fileOffset, const uint32_t sizeInBytes, void * dest) const
+{
+	const uint8_t * src = getPageDataPtr(fileOffset, sizeInBytes);
+	if (src == nullptr)
+	{
+		return false;
+	}
+
+	std::memcpy(dest, src, sizeInBytes);
+	return true;
+}
+
+const uint8_t * VTFFArchive::getPageDataPtr(const uint64_t fileOffset, const uint32_t sizeInBytes) const
+{
+	if (fileOffset > mappedSize || sizeInBytes > (mappedSize - fileOffset))
+	{
+		return nullptr;
+	}
+	return mappedData + fileOffset;
+}
+
+uint32_t VTFFArchive::getPageUpsampleFilter(const int textureIndex) const
+{
+	assert(textureIndex >= 0 && textureIndex < getNumTextures());
+	return entries[textureIndex].info.upsampleFilter;
+}
+
+const VTFF::MipTailInfo & VTFFArchive::getMipTailInfo(const int textureIndex) const
+{
+	assert(textureIndex >= 0 && textureIndex < getNumTextures());
+	return entries[textureIndex].info.mipTail;
+}
+
+// ======================================================
+// VTFFArchivePageFile:
+// ======================================================
+
+uint64_t VTFFArchivePageFile::getSharedCacheKey() const
+{
+	return makeSharedCacheKey(archive.getFileIdentity(), static_cast<uint32_t>(textureIndex), addDebugInfo);
+}
+
+size_t VTFFArchivePageFile::getPageReadBytes(const PageId pageId) const
+{
+	const VTFFPageTree & tree = archive.getPageTree(textureIndex);
+	const int level = pageIdExtractMipLevel(pageId);
+	if (level >= tree.getNumLevels() ||
+	    pageIdExtractPageX(pageId) >= tree.getNumPagesX(level) ||
+	    pageIdExtractPageY(pageId) >= tree.getNumPagesY(level))
+	{
+		return PageFile::getPageReadBytes(pageId);
+	}
+	return tree.get(pageId).sizeInBytes;
+}
+
+bool VTFFArchivePageFile::loadMipTail(MipTailData & tail)
+{
+	const VTFF::MipTailInfo & tailInfo = archive.getMipTailInfo(textureIndex);
+	if (tailInfo.numLevels == 0)
+	{
+		return false;
+	}
+
+	tail.width     = static_cast<int>(tailInfo.width);
+	tail.height    = static_cast<int>(tailInfo.height);
+	tail.numLevels = static_cast<int>(tailInfo.numLevels);
+	tail.pixels.resize(tailInfo.sizeInBytes / sizeof(Pixel4b));
+
+	// Bounds were checked when the archive was opened.
+	if (!archive.readPageData(tailInfo.fileOffset, tailInfo.sizeInBytes, tail.pixels.data()))
+	{
+		vtLogError("Failed to read the mip tail of texture \"" << archive.getTextureName(textureIndex)
+		           << "\" of archive \"" << archive.getFileName() << "\"!");
+		tail = MipTailData{};
+		return false;
+	}
+	return true;
+}
+
+bool VTFFArchivePageFile::loadPage(const PageId pageId, PageRequestDataPacket & pageRequest)
+{
+	if (pageId == InvalidPageId)
+	{
+		vtLogError("VTFFArchivePageFile: Invalid page id!");
+		std::memset(pageRequest.pageData, 0, sizeof(pageRequest.pageData));
+		return false;
+	}
+
+	const VTFFPageTree::PageInfo pageInfo = archive.getPageTree(textureIndex).get(pageId);
+	const uint8_t * pageData = (pageInfo.storageShift <= tool::MaxPageStorageShift) ?
+		archive.getPageDataPtr(pageInfo.fileOffset, pageInfo.sizeInBytes) : nullptr;
+
+	if (pageData == nullptr ||
+	    pageInfo.sizeInBytes != tool::reducedPageSizeBytes(PageTable::PageSizeInPixels, pageInfo.storageShift))
+	{
+		vtLogWarning("VTFFArchivePageFile: Bad page info for page in texture \""
+		             << archive.getTextureName(textureIndex) << "\" of archive \"" << archive.getFileName() << "\"!");
+		std::memset(pageRequest.pageData, 0, sizeof(pageRequest.pageData));
+		return false;
+	}
+
+	if (pageInfo.storageShift != 0)
+	{
+		// Upsampled straight from the mapping, on the calling (provider) thread.
+		tool::expandPageRgbaU8(pageData, PageTable::PageSizeInPixels, pageInfo.storageShift,
+		                       static_cast<tool::FilterType>(archive.getPageUpsampleFilter(textureIndex)),
+		                       reinterpret_cast<uint8_t *>(pageRequest.pageData));
+	}
+	else
+	{
+		std::memcpy(pageRequest.pageData, pageData, pageInfo.sizeInBytes);
+	}
+
+	if (addDebugInfo)
+	{
+		tool::addDebugInfoToPageData(
+			pageIdExtractPageX(pageId),
+			pageIdExtractPageY(pageId),
+			pageIdExtractMipLevel(pageId),
+			reinterpret_cast<uint8_t *>(pageRequest.pageData),
+			/* colorComps     = */ 4, // RGBA
+			/* drawPageBorder = */ true,
+			/* flipText       = */ false,
+			PageTable::PageSizeInPixels,
+			PageTable::PageBorderSizeInPixels);
+	}
+	return true;
+}
+
+// ======================================================
+// AtlasRemapTable:
+// ======================================================
+
+AtlasRemapTable::AtlasRemapTable(std::string filename)
+	: atlasWidth(0)
+	, atlasHeight(0)
+	, tableFileName(std::move(filename))
+{
+	FILE * file = std::fopen(tableFileName.c_str(), "rb");
+	if (file == nullptr)
+	{
+		vtFatalError("Unable to open VTAT table \"" << tableFileName << "\": " << std::strerror(errno));
+	}
+
+	// The table is small, so it is read in one go and the file closed before validating.
+	VTAT::Header header;
+	std::vector<VTAT::Entry> fileEntries;
+	bool readOk = (std::fread(&header, sizeof(header), 1, file) == 1) &&
+	              (header.magic == VTAT::Magic) && (header.version == VTAT::Version);
+	if (readOk)
+	{
+		fileEntries.resize(header.numTextures);
+		readOk = (std::fread(fileEntries.data(), sizeof(VTAT::Entry), fileEntries.size(), file) == fileEntries.size());
+	}
+	std::fclose(file);
+
+	if (!readOk)
+	{
+		vtFatalError("VTAT \"" << tableFileName << "\": Wrong file type, bad table version or truncated table!");
+	}
+	if (fileEntries.empty() || header.atlasWidth == 0 || header.atlasHeight == 0)
+	{
+		vtFatalError("VTAT \"" << tableFileName << "\": Empty table or atlas!");
+	}
+
+	atlasWidth  = static_cast<int>(header.atlasWidth);
+	atlasHeight = static_cast<int>(header.atlasHeight);
+
+	entries.resize(fileEntries.size());
+	for (size_t t = 0; t < fileEntries.size(); ++t)
+	{
+		const VTAT::Entry & entry = fileEntries[t];
+		if (std::memchr(entry.name, '\0', VTAT::MaxNameLength) == nullptr)
+		{
+			vtFatalError("VTAT \"" << tableFileName << "\": Bad name for texture #" << t << "!");
+		}
+
+		entries[t].name = entry.name;
+		entries[t].scaleBias[0] = entry.scaleU;
+		entries[t].scaleBias[1] = entry.scaleV;
+		entries[t].scaleBias[2] = entry.biasU;
+		entries[t].scaleBias[3] = entry.biasV;
+	}
+
+	vtLogComment("Loaded VTAT table \"" << tableFileName << "\" with " << header.numTextures << " textures.");
+}
+
+const char * AtlasRemapTable::getTextureName(const int textureIndex) const
+{
+	assert(textureIndex >= 0 && textureIndex < getNumTextures());
+	return entries[textureIndex].name.c_str();
+}
+
+int AtlasRemapTable::findTexture(const std::string & name) const
+{
+	for (size_t t = 0; t < entries.size(); ++t)
+	{
+		if (name == entries[t].name)
+		{
+			return static_cast<int>(t);
+		}
+	}
+	return -1;
+}
+
+const float * AtlasRemapTable::getScaleBias(const int textureIndex) const
+{
+	assert(textureIndex >= 0 && textureIndex < getNumTextures());
+	return entries[textureIndex].scaleBias;
+}
+
+// ======================================================
+// ReducedLayerPageFile:
+// ======================================================
+
+ReducedLayerPageFile::ReducedLayerPageFile(PageFilePtr reduced, const int offset,
+                                           const int baseNumLevels, const int cacheSizeInPages)
+	: reducedFile(std::move(reduced))
+	, mipOffset(offset)
+	, baseLevels(baseNumLevels)
+	, maxCachedPages(std::max(cacheSizeInPages, 1))
+	, useCounter(0)
+{
+	assert(reducedFile != nullptr);
+	assert(mipOffset > 0 && mipOffset <= MaxMipOffset);
+	assert(baseLevels > 0 && baseLevels <= MaxVTMipLevels);
+
+	setIoDeviceId(reducedFile->getIoDeviceId());
+	cachedPages.reserve(maxCachedPages);
+}
+
+PageId ReducedLayerPageFile::getReducedPageId(const PageId pageId) const
+{
+	// Base level 'l' has the pages of reduced level 'l' scaled up by 2^mipOffset.
+	// Past the last reduced level, the coarsest one covers 2^(baseLevels - 1 - l) base pages.
+	const int level        = pageIdExtractMipLevel(pageId);
+	const int reducedLast  = std::max(baseLevels - mipOffset, 1) - 1;
+	const int reducedLevel = std::min(level, reducedLast);
+	const int shift        = reducedLevel + mipOffset - level;
+
+	return makePageId(pageIdExtractPageX(pageId) >> shift,
+	                  pageIdExtractPageY(pageId) >> shift,
+	                  reducedLevel, pageIdExtractTextureIndex(pageId));
+}
+
+bool ReducedLayerPageFile::loadPage(const PageId pageId, PageRequestDataPacket & pageRequest)
+{
+	const PageId reducedId = getReducedPageId(pageId);
+	std::shared_ptr<const std::vector<Pixel4b>> pixels;
+	bool success = true;
+
+	std::unique_lock<std::mutex> lock(cacheMutex);
+	auto it = cachedPages.find(reducedId);
+	if (it != cachedPages.end())
+	{
+		// A sibling may be reading it right now. The entry is gone if that read was purged.
+		pageLoadedCond.wait(lock, [this, reducedId]
+		{
+			auto entry = cachedPages.find(reducedId);
+			return entry == cachedPages.end() || entry->second.pixels != nullptr;
+		});
+		it = cachedPages.find(reducedId);
+	}
+
+	if (it != cachedPages.end())
+	{
+		it->second.lastUsed = ++useCounter;
+		pixels = it->second.pixels;
+	}
+	else
+	{
+		// Mark it in flight, then read without holding the lock.
+		cachedPages[reducedId] = CachedPage{ nullptr, ++useCounter };
+		lock.unlock();
+
+		std::unique_ptr<PageRequestDataPacket> reducedRequest(new PageRequestDataPacket);
+		reducedRequest->pageId = reducedId;
+		reducedRequest->fileId = pageRequest.fileId;
+		success = reducedFile->loadPage(reducedId, *reducedRequest);
+
+		auto loaded = std::make_shared<std::vector<Pixel4b>>(reducedRequest->pageData,
+				reducedRequest->pageData + PageRequestDataPacket::TotalPagePixels);
+		pixels = loaded;
+
+		lock.lock();
+		it = cachedPages.find(reducedId);
+		if (it != cachedPages.end())
+		{
+			// Failed reads are not kept, so the siblings waiting on it try again.
+			if (success)
+			{
+				it->second.pixels = std::move(loaded);
+			}
+			else
+			{
+				cachedPages.erase(it);
+			}
+		}
+
+		// Evict the least recently used pages that are not in flight.
+		while (static_cast<int>(cachedPages.size()) > maxCachedPages)
+		{
+			auto victim = cachedPages.end();
+			for (auto entry = cachedPages.begin(); entry != cachedPages.end(); ++entry)
+			{
+				if (entry->second.pixels != nullptr && (victim == cachedPages.end() ||
+				    entry->second.lastUsed < victim->second.lastUsed))
+				{
+					victim = entry;
+				}
+			}
+			if (victim == cachedPages.end())
+			{
+				break;
+			}
+			cachedPages.erase(victim);
+		}
+
+		lock.unlock();
+		pageLoadedCond.notify_all();
+	}
+
+	if (lock.owns_lock())
+	{
+		lock.unlock();
+	}
+	std::memcpy(pageRequest.pageData, pixels->data(), sizeof(pageRequest.pageData));
+	return success;
+}
+
+void ReducedLayerPageFile::setAddDebugInfoToPages(const bool debug)
+{
+	if (debug != reducedFile->isAddingDebugInfoToPages())
+	{
+		reducedFile->setAddDebugInfoToPages(debug);
+		purgeCache();
+	}
+}
+
+size_t ReducedLayerPageFile::getMemoryBytes() const
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	return reducedFile->getMemoryBytes() + cachedPages.size() * sizeof(Pixel4b) * PageRequestDataPacket::TotalPagePixels;
+}
+
+size_t ReducedLayerPageFile::getPageReadBytes(const PageId pageId) const
+{
+	const PageId reducedId = getReducedPageId(pageId);
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		if (cachedPages.find(reducedId) != cachedPages.end())
+		{
+			return 0;
+		}
+	}
+	return reducedFile->getPageReadBytes(reducedId);
+}
+
+uint64_t ReducedLayerPageFile::getSharedCacheKey() const
+{
+	const uint64_t reducedKey = reducedFile->getSharedCacheKey();
+	if (reducedKey == 0)
+	{
+		return 0;
+	}
+	const uint64_t key = fnv1aAppend(fnv1aAppend(reducedKey, uint64_t(mipOffset)), uint64_t(baseLevels));
+	return (key != 0) ? key : 1;
+}
+
+void ReducedLayerPageFile::swapReducedFile(PageFilePtr & other)
+{
+	assert(other != nullptr);
+	std::swap(reducedFile, other);
+	setIoDeviceId(reducedFile->getIoDeviceId());
+	purgeCache();
+}
+
+void ReducedLayerPageFile::purgeCache()
+{
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		cachedPages.clear();
+	}
+	pageLoadedCond.notify_all();
 }
 
 } // namespace vt {}
@@ -32,7 +32,8 @@
 
 #include "vt.hpp"
 #include "vt_tool_image.hpp"
-#include <cmath> // std::log2()
+#include <algorithm> // std::fill_n()
+#include <cmath>     // std::log2()
 
 namespace vt
 {
@@ -135,17 +136,8 @@ void PageIndirectionTableRgba8888::initTexture()
 	{
 		assert(tableLevels[l] != nullptr);
 
-		// Default initialize the entries:
-		for (int e = 0; e < numPagesX[l] * numPagesY[l]; ++e)
-		{
-			TableEntry & entry = tableLevels[l][e];
-			entry.cachePageX = 0;
-			entry.cachePageY = 0;
-
-			const uint16_t scale = (numPagesX[0] * 16) >> l;
-			entry.scaleHigh = (scale & 0xFF);
-			entry.scaleLow  = (scale >> 8);
-		}
+		// Nothing is mapped initially:
+		std::fill_n(reinterpret_cast<uint32_t *>(tableLevels[l]), numPagesX[l] * numPagesY[l], uint32_t(EmptyEntry));
 
 		glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA, numPagesX[l], numPagesY[l], 0, GL_RGBA, GL_UNSIGNED_BYTE, tableLevels[l]);
 		vtLogComment("Allocated indirection tex level #" << l << ". Size: " << numPagesX[l] << "x" << numPagesY[l] << " pixels.");
@@ -185,6 +177,13 @@ void PageIndirectionTableRgba8888::updateIndirectionTexture(const CacheEntry * _
 	// stating from the lowest resolution one:
 	for (int l = (numLevels - 1); l >= 0; --l)
 	{
+		// The finer levels are rebuilt from the upsampled coarser one, but the coarsest
+		// level must be cleared, or it would keep pointing to evicted pages.
+		if (l == (numLevels - 1))
+		{
+			std::fill_n(reinterpret_cast<uint32_t *>(tableLevels[l]), numPagesX[l] * numPagesY[l], uint32_t(EmptyEntry));
+		}
+
 		// Write all pages in a level:
 		for (int p = 0; p < PageCacheMgr::TotalCachePages; ++p)
 		{
@@ -328,14 +327,8 @@ void PageIndirectionTableRgb565::initTexture()
 	{
 		assert(tableLevels[l] != nullptr);
 
-		// Default initialize the entries:
-		for (int e = 0; e < numPagesX[l] * numPagesY[l]; ++e)
-		{
-			TableEntry & entry = tableLevels[l][e];
-
-			entry = 0;
-			entry = ((log2VirtPagesWide - l) << 5);
-		}
+		// Nothing is mapped initially:
+		std::fill_n(tableLevels[l], numPagesX[l] * numPagesY[l], TableEntry(EmptyEntry));
 
 		glTexImage2D(GL_TEXTURE_2D, l, GL_RGB, numPagesX[l], numPagesY[l], 0, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, tableLevels[l]);
 		vtLogComment("Allocated indirection tex level #" << l << ". Size: " << numPagesX[l] << "x" << numPagesY[l] << " pixels.");
@@ -375,6 +368,13 @@ void PageIndirectionTableRgb565::updateIndirectionTexture(const CacheEntry * __r
 	// stating from the lowest resolution one:
 	for (int l = (numLevels - 1); l >= 0; --l)
 	{
+		// The finer levels are rebuilt from the upsampled coarser one, but the coarsest
+		// level must be cleared, or it would keep pointing to evicted pages.
+		if (l == (numLevels - 1))
+		{
+			std::fill_n(tableLevels[l], numPagesX[l] * numPagesY[l], TableEntry(EmptyEntry));
+		}
+
 		// Write all pages in a level:
 		for (int p = 0; p < PageCacheMgr::TotalCachePages; ++p)
 		{
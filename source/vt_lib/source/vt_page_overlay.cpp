@@ -0,0 +1,430 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: vt_page_overlay.cpp
+// Author: Guilherme R. Lampert
+// Created on: 18/10/26
+// Brief: Sparse overlay file and write-back of the pages of writable virtual textures.
+//
+// License:
+//  This source code is released under the MIT License.
+//  Copyright (c) 2014 Guilherme R. Lampert.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+// ================================================================================================
+
+#include "vt.hpp"
+#include "vt_tool_platform_utils.hpp"
+#include "vt_file_format.hpp"
+#include <dispatch/dispatch.h> // Apple's GCD
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+// POSIX file IO:
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace vt
+{
+
+// ======================================================
+// PageOverlay:
+// ======================================================
+
+// Each slot is a header followed by the RGBA page.
+static constexpr uint64_t overlayPageBytes = PageOverlay::TotalPagePixels * sizeof(Pixel4b);
+static constexpr uint64_t overlaySlotBytes = sizeof(VTPO::SlotHeader) + overlayPageBytes;
+
+PageOverlay::PageOverlay(std::string filename)
+	: nextSlotOffset(sizeof(VTPO::Header))
+	, nextGeneration(0)
+	, oldestPendingMs(-1)
+	, flushIntervalMs(DefaultFlushIntervalMs)
+	, flushBatchPages(DefaultFlushBatchPages)
+	, batchInFlight(false)
+	, overlayLoads(0)
+	, fileDesc(-1)
+	, writeQueue(nullptr)
+	, overlayFileName(std::move(filename))
+{
+	clearPodObject(stats);
+	openFile();
+
+	// Writes go through a private serial queue that runs at background
+	// priority, so the page loads on the default priority queue go first.
+	dispatch_queue_t queue = dispatch_queue_create("vt.page_overlay", DISPATCH_QUEUE_SERIAL);
+	dispatch_set_target_queue(queue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0));
+	writeQueue = queue;
+
+	vtLogComment("PageOverlay \"" << overlayFileName << "\" opened with " << slotOffsets.size() << " stored pages.");
+}
+
+PageOverlay::~PageOverlay()
+{
+	flushAndWait();
+
+	dispatch_release(static_cast<dispatch_queue_t>(writeQueue));
+	close(fileDesc);
+}
+
+void PageOverlay::openFile()
+{
+	fileDesc = open(overlayFileName.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fileDesc < 0)
+	{
+		vtFatalError("Unable to open page overlay \"" << overlayFileName << "\": " << std::strerror(errno));
+	}
+
+	struct stat fileStats;
+	if (fstat(fileDesc, &fileStats) != 0)
+	{
+		close(fileDesc);
+		vtFatalError("Unable to stat page overlay \"" << overlayFileName << "\": " << std::strerror(errno));
+	}
+
+	VTPO::Header header;
+	const uint64_t fileSize = static_cast<uint64_t>(fileStats.st_size);
+
+	// New overlay. Just the header.
+	if (fileSize == 0)
+	{
+		header.magic    = VTPO::Magic;
+		header.version  = VTPO::Version;
+		header.pageSize = PageTable::PageSizeInPixels;
+		if (pwrite(fileDesc, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)))
+		{
+			close(fileDesc);
+			vtFatalError("Failed to write the header of page overlay \"" << overlayFileName << "\"!");
+		}
+		return;
+	}
+
+	if (pread(fileDesc, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+		header.magic != VTPO::Magic || header.version != VTPO::Version ||
+		header.pageSize != PageTable::PageSizeInPixels)
+	{
+		close(fileDesc);
+		vtFatalError("\"" << overlayFileName << "\" is not a page overlay or has an incompatible page size!");
+	}
+
+	// Rebuild the index from the slot headers. A partial slot at the end
+	// is left over from an interrupted write and gets overwritten next time.
+	VTPO::SlotHeader slot;
+	for (; nextSlotOffset + overlaySlotBytes <= fileSize; nextSlotOffset += overlaySlotBytes)
+	{
+		if (pread(fileDesc, &slot, sizeof(slot), static_cast<off_t>(nextSlotOffset)) != static_cast<ssize_t>(sizeof(slot)))
+		{
+			vtLogWarning("Failed to read slot header at offset " << nextSlotOffset << " of page overlay \""
+					<< overlayFileName << "\". Ignoring the rest of the file...");
+			break;
+		}
+		slotOffsets[makeKey(slot.pageId, slot.fileId)] = nextSlotOffset;
+	}
+}
+
+uint64_t PageOverlay::makeKey(const PageId pageId, const uint32_t fileId)
+{
+	// The texture index is dropped, it depends on the registration order.
+	const PageId id = makePageId(pageIdExtractPageX(pageId), pageIdExtractPageY(pageId), pageIdExtractMipLevel(pageId), 0);
+	return (static_cast<uint64_t>(fileId) << 32) | id;
+}
+
+void PageOverlay::storePage(const PageId pageId, const uint32_t fileId, const Pixel4b * pageData)
+{
+	assert(pageData != nullptr);
+
+	// Copied before taking the lock.
+	std::shared_ptr<PageData> data(new PageData);
+	std::memcpy(data->data(), pageData, overlayPageBytes);
+
+	std::lock_guard<std::mutex> lock(overlayLock);
+
+	PendingPage & pending = pendingPages[makeKey(pageId, fileId)];
+	if (pending.data != nullptr)
+	{
+		++stats.coalescedWrites;
+	}
+	pending.data       = std::move(data);
+	pending.generation = ++nextGeneration;
+
+	if (oldestPendingMs < 0)
+	{
+		oldestPendingMs = tool::getClockMillisec();
+	}
+}
+
+bool PageOverlay::loadPage(const PageId pageId, const uint32_t fileId, Pixel4b * dest)
+{
+	assert(dest != nullptr);
+
+	const uint64_t key = makeKey(pageId, fileId);
+	PageDataPtr data;
+	uint64_t slotOffset = 0;
+	{
+		std::lock_guard<std::mutex> lock(overlayLock);
+
+		// Pending pages are only dropped once they are on disk,
+		// so a miss here means the file has the latest copy, if any.
+		const auto pending = pendingPages.find(key);
+		if (pending != pendingPages.end())
+		{
+			data = pending->second.data;
+		}
+		else
+		{
+			const auto slot = slotOffsets.find(key);
+			if (slot == slotOffsets.end())
+			{
+				return false;
+			}
+			slotOffset = slot->second;
+		}
+	}
+
+	overlayLoads.fetch_add(1, std::memory_order_relaxed);
+	if (data != nullptr)
+	{
+		std::memcpy(dest, data->data(), overlayPageBytes);
+		return true;
+	}
+
+	const off_t pageOffset = static_cast<off_t>(slotOffset + sizeof(VTPO::SlotHeader));
+	if (pread(fileDesc, dest, overlayPageBytes, pageOffset) != static_cast<ssize_t>(overlayPageBytes))
+	{
+		vtLogError("Failed to read page from overlay \"" << overlayFileName << "\": " << std::strerror(errno));
+		std::memset(dest, 0, overlayPageBytes);
+	}
+	return true;
+}
+
+bool PageOverlay::hasPage(const PageId pageId, const uint32_t fileId) const
+{
+	const uint64_t key = makeKey(pageId, fileId);
+	std::lock_guard<std::mutex> lock(overlayLock);
+	return pendingPages.count(key) != 0 || slotOffsets.count(key) != 0;
+}
+
+bool PageOverlay::flush(const bool force)
+{
+	if (batchInFlight.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(overlayLock);
+		if (pendingPages.empty())
+		{
+			return false;
+		}
+
+		const bool batchFull = pendingPages.size() >= static_cast<size_t>(flushBatchPages);
+		const bool timedOut  = (tool::getClockMillisec() - oldestPendingMs) >= flushIntervalMs;
+		if (!force && !batchFull && !timedOut)
+		{
+			return false;
+		}
+	}
+
+	startBatch();
+	return true;
+}
+
+void PageOverlay::flushAndWait()
+{
+	// Wait for the batch in flight, then write whatever is left.
+	// Pages that failed to write stay pending, so don't loop on them.
+	dispatch_sync_f(static_cast<dispatch_queue_t>(writeQueue), nullptr, [](void *) { });
+	if (flush(true))
+	{
+		dispatch_sync_f(static_cast<dispatch_queue_t>(writeQueue), nullptr, [](void *) { });
+	}
+}
+
+void PageOverlay::startBatch()
+{
+	WriteBatch * batch = new WriteBatch{ this, {} };
+	{
+		std::lock_guard<std::mutex> lock(overlayLock);
+
+		batch->pages.reserve(pendingPages.size());
+		for (const auto & pending : pendingPages)
+		{
+			// Pages written for the first time get a new slot at the end of the file.
+			auto slot = slotOffsets.find(pending.first);
+			if (slot == slotOffsets.end())
+			{
+				slot = slotOffsets.emplace(pending.first, nextSlotOffset).first;
+				nextSlotOffset += overlaySlotBytes;
+			}
+			batch->pages.push_back({ pending.first, slot->second, pending.second.generation, pending.second.data });
+		}
+		oldestPendingMs = -1;
+	}
+
+	// In file order, so that adjacent slots can be merged.
+	std::sort(batch->pages.begin(), batch->pages.end(),
+		[](const BatchPage & a, const BatchPage & b) { return a.slotOffset < b.slotOffset; });
+
+	batchInFlight.store(true, std::memory_order_release);
+	dispatch_async_f(static_cast<dispatch_queue_t>(writeQueue), batch, &PageOverlay::writeBatchTask);
+}
+
+void PageOverlay::writeBatchTask(void * param)
+{
+	std::unique_ptr<WriteBatch> batch(static_cast<WriteBatch *>(param));
+	PageOverlay * overlay = batch->overlay;
+	const std::vector<BatchPage> & pages = batch->pages;
+
+	// Runs of adjacent slots are written with a single call.
+	std::vector<uint8_t> buffer;
+	std::vector<bool> written(pages.size(), false);
+	uint64_t numWriteCalls = 0;
+	uint64_t numPagesWritten = 0;
+
+	for (size_t first = 0; first < pages.size();)
+	{
+		size_t count = 1;
+		while ((first + count) < pages.size() && count < MaxSlotsPerWrite &&
+		       pages[first + count].slotOffset == pages[first + count - 1].slotOffset + overlaySlotBytes)
+		{
+			++count;
+		}
+
+		if (overlay->writeSlots(&pages[first], count, buffer))
+		{
+			std::fill(written.begin() + first, written.begin() + first + count, true);
+			numPagesWritten += count;
+		}
+		++numWriteCalls;
+		first += count;
+	}
+
+	// Drop the pending copies that reached the disk, unless written again meanwhile.
+	// Failed ones stay pending and are retried by the next batch.
+	{
+		std::lock_guard<std::mutex> lock(overlay->overlayLock);
+		for (size_t p = 0; p < pages.size(); ++p)
+		{
+			const auto pending = overlay->pendingPages.find(pages[p].key);
+			if (written[p] && pending != overlay->pendingPages.end() && pending->second.generation == pages[p].generation)
+			{
+				overlay->pendingPages.erase(pending);
+			}
+		}
+
+		if (!overlay->pendingPages.empty() && overlay->oldestPendingMs < 0)
+		{
+			overlay->oldestPendingMs = tool::getClockMillisec();
+		}
+
+		overlay->stats.pagesWritten += numPagesWritten;
+		overlay->stats.writeCalls   += numWriteCalls;
+		overlay->stats.batchesWritten++;
+	}
+
+	overlay->batchInFlight.store(false, std::memory_order_release);
+}
+
+bool PageOverlay::writeSlots(const BatchPage * pages, const size_t count, std::vector<uint8_t> & buffer)
+{
+	buffer.resize(count * overlaySlotBytes);
+	uint8_t * slotPtr = buffer.data();
+
+	for (size_t p = 0; p < count; ++p)
+	{
+		VTPO::SlotHeader slot;
+		slot.pageId = static_cast<uint32_t>(pages[p].key & 0xFFFFFFFF);
+		slot.fileId = static_cast<uint32_t>(pages[p].key >> 32);
+
+		std::memcpy(slotPtr, &slot, sizeof(slot));
+		std::memcpy(slotPtr + sizeof(slot), pages[p].data->data(), overlayPageBytes);
+		slotPtr += overlaySlotBytes;
+	}
+
+	const off_t offset = static_cast<off_t>(pages[0].slotOffset);
+	if (pwrite(fileDesc, buffer.data(), buffer.size(), offset) != static_cast<ssize_t>(buffer.size()))
+	{
+		vtLogError("Failed to write " << count << " pages to overlay \"" << overlayFileName << "\": " << std::strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+void PageOverlay::setFlushThresholds(const int intervalMs, const int batchPages)
+{
+	std::lock_guard<std::mutex> lock(overlayLock);
+	flushIntervalMs = std::max(intervalMs, 0);
+	flushBatchPages = std::max(batchPages, 1);
+}
+
+PageOverlay::Stats PageOverlay::getStats() const
+{
+	std::lock_guard<std::mutex> lock(overlayLock);
+
+	Stats result = stats;
+	result.pendingPages = static_cast<unsigned>(pendingPages.size());
+	result.storedPages  = static_cast<unsigned>(slotOffsets.size());
+	result.overlayLoads = overlayLoads.load(std::memory_order_relaxed);
+	return result;
+}
+
+size_t PageOverlay::getPendingMemoryBytes() const
+{
+	std::lock_guard<std::mutex> lock(overlayLock);
+	return pendingPages.size() * sizeof(PageData);
+}
+
+// ======================================================
+// OverlayPageFile:
+// ======================================================
+
+OverlayPageFile::OverlayPageFile(PageFilePtr base, PageOverlayPtr pageOverlay, const uint32_t fileIndex)
+	: baseFile(std::move(base))
+	, overlay(std::move(pageOverlay))
+	, fileId(fileIndex)
+{
+	assert(baseFile != nullptr);
+	assert(overlay  != nullptr);
+
+	// Reads of pages never written still hit the original file's device.
+	setIoDeviceId(baseFile->getIoDeviceId());
+}
+
+bool OverlayPageFile::loadPage(const PageId pageId, PageRequestDataPacket & pageRequest)
+{
+	if (overlay->loadPage(pageId, fileId, pageRequest.pageData))
+	{
+		return true;
+	}
+	return baseFile->loadPage(pageId, pageRequest);
+}
+
+void OverlayPageFile::swapBaseFile(PageFilePtr & other)
+{
+	assert(other != nullptr);
+	std::swap(baseFile, other);
+	setIoDeviceId(baseFile->getIoDeviceId());
+}
+
+} // namespace vt {}
@@ -31,7 +31,10 @@
 // ================================================================================================
 
 #include "vt.hpp"
+#include "vt_tool_platform_utils.hpp"
 #include <dispatch/dispatch.h> // Apple's GCD
+#include <chrono>
+#include <cmath>
 
 namespace vt
 {
@@ -42,8 +45,19 @@ namespace vt
 
 PageProvider::PageProvider(const bool async)
 	: outstandingRequests(0)
+	, maxOutstandingRequests(MaxOutstandingPageRequests)
+	, completedRequests(0)
+	, totalLatencyUs(0)
+	, totalServiceUs(0)
+	, readyQueueSize(0)
+	, readyQueuePeakSize(0)
+	, sharedPageCache(nullptr)
 	, forceSynchronous(!async)
 {
+	clearPodObject(queueDepth);
+	queueDepth.targetLatencyMs   = DefaultTargetLatencyMs;
+	queueDepth.frameRequestLimit = PageResolver::DefaultMaxPageRequestsPerFrame;
+
 	if (isAsync())
 	{
 		vtLogComment("New asynchronous PageProvider created...");
@@ -56,11 +70,17 @@ PageProvider::PageProvider(const bool async)
 
 bool PageProvider::addPageRequest(const PageId requestId)
 {
-	if (outstandingRequests == MaxOutstandingPageRequests)
+	if (outstandingRequests >= maxOutstandingRequests)
 	{
 		vtLogComment("Max outstanding page requests limit (" <<
-				MaxOutstandingPageRequests << ") reached! Dropping request...");
+				maxOutstandingRequests << ") reached! Dropping request...");
+
+		++queueDepth.windowLimitRefusals;
+		return false;
+	}
 
+	if (!admitIoRequest(requestId))
+	{
 		return false;
 	}
 
@@ -74,37 +94,81 @@ bool PageProvider::addPageRequest(const PageId requestId)
 	}
 }
 
+size_t PageProvider::getReadyQueue(const int textureIndex, FulfilledPageRequestQueue & readyQueueOut)
+{
+	std::lock_guard<std::mutex> lock(readyQueueMutex);
+
+	if (textureIndex < 0 || static_cast<size_t>(textureIndex) >= readyQueues.size())
+	{
+		readyQueueOut.clear();
+		return 0;
+	}
+
+	// Swap rather than move, so the caller's previous buffer becomes the
+	// provider's next one and the two ping-pong between frames.
+	FulfilledPageRequestQueue & readyQueue = readyQueues[textureIndex];
+	readyQueueOut.clear();
+	readyQueueOut.swap(readyQueue);
+
+	assert(readyQueueSize >= readyQueueOut.size());
+	readyQueueSize -= readyQueueOut.size();
+
+	return readyQueueOut.size();
+}
+
 size_t PageProvider::getReadyQueue(FulfilledPageRequestQueue & readyQueueOut)
 {
 	std::lock_guard<std::mutex> lock(readyQueueMutex);
 
-	readyQueueOut = std::move(readyQueue);
-	assert(readyQueue.empty());
+	readyQueueOut.clear();
+	for (FulfilledPageRequestQueue & readyQueue : readyQueues)
+	{
+		if (readyQueueOut.empty())
+		{
+			readyQueueOut.swap(readyQueue);
+		}
+		else
+		{
+			readyQueueOut.insert(readyQueueOut.end(), readyQueue.begin(), readyQueue.end());
+		}
+		readyQueue.clear();
+	}
 
+	readyQueueSize = 0;
 	return readyQueueOut.size();
 }
 
 bool PageProvider::runAsyncRequest(const PageId requestId)
 {
-	const size_t textureIndex = std::min(static_cast<size_t>(pageIdExtractTextureIndex(requestId)), registeredTextures.size());
+	VirtualTexture * vtTex = getTextureForRequest(requestId);
+	if (vtTex == nullptr)
+	{
+		return false;
+	}
 
 	// Place a request for each file in the texture.
-	const unsigned int numPageFiles = registeredTextures[textureIndex]->getNumPageFiles();
+	const unsigned int numPageFiles = vtTex->getNumPageFiles();
 	for (unsigned int f = 0; f < numPageFiles; ++f)
 	{
-		PageFile * pageFile = registeredTextures[textureIndex]->getPageFile(f);
+		PageFile * pageFile = vtTex->getPageFile(f);
 		assert(pageFile != nullptr);
 
 		struct WorkerContext
 		{
-			PageProvider * provider;  // Provider that started the request
-			PageFile     * pageFile;  // Page file where to fetch the page from
-			PageId         requestId; // Page to be loaded
-			uint32_t       fileId;    // Page file index within the VT
+			PageProvider * provider;     // Provider that started the request
+			PageFile     * pageFile;     // Page file where to fetch the page from
+			PageId         requestId;    // Page to be loaded
+			uint32_t       fileId;       // Page file index within the VT
+			uint32_t       generation;   // Generation of the texture slot when issued
+			int64_t        submitTimeUs; // When the request was queued
+			IoCharge       ioCharge;     // Refunded if the page file is not read
 		};
 
+		const IoCharge ioCharge = (f < admittedIoCharges.size()) ? admittedIoCharges[f] : IoCharge{ -1, 0.0 };
+
 		// Would love to get rid of this memory allocation somehow...
-		WorkerContext * context = new WorkerContext{ this, pageFile, requestId, f };
+		WorkerContext * context = new WorkerContext{ this, pageFile, requestId, f,
+		                                             getSlotGeneration(requestId), getClockMicrosec(), ioCharge };
 
 		// Run the request asynchronously using GCD:
 		dispatch_async_f(
@@ -123,8 +187,13 @@ bool PageProvider::runAsyncRequest(const PageId requestId)
 				pageRequest.pageId = workerCtx->requestId;
 				pageRequest.fileId = workerCtx->fileId;
 
-				workerCtx->pageFile->loadPage(workerCtx->requestId, pageRequest);
-				workerCtx->provider->pushReadyRequest(pageRequest);
+				const int64_t loadStartUs = getClockMicrosec();
+				if (!workerCtx->provider->loadPageData(workerCtx->pageFile, workerCtx->requestId, pageRequest))
+				{
+					workerCtx->provider->refundIoCharge(workerCtx->ioCharge.bucketIndex, workerCtx->ioCharge.bytes);
+				}
+				workerCtx->provider->pushReadyRequest(pageRequest, workerCtx->generation);
+				workerCtx->provider->recordCompletion(workerCtx->submitTimeUs, loadStartUs);
 
 				delete workerCtx;
 			}
@@ -144,13 +213,17 @@ bool PageProvider::runAsyncRequest(const PageId requestId)
 
 bool PageProvider::runImmediateRequest(const PageId requestId)
 {
-	const size_t textureIndex = std::min(static_cast<size_t>(pageIdExtractTextureIndex(requestId)), registeredTextures.size());
+	VirtualTexture * vtTex = getTextureForRequest(requestId);
+	if (vtTex == nullptr)
+	{
+		return false;
+	}
 
 	// Place a request for each file in the texture.
-	const unsigned int numPageFiles = registeredTextures[textureIndex]->getNumPageFiles();
+	const unsigned int numPageFiles = vtTex->getNumPageFiles();
 	for (unsigned int f = 0; f < numPageFiles; ++f)
 	{
-		PageFile * pageFile = registeredTextures[textureIndex]->getPageFile(f);
+		PageFile * pageFile = vtTex->getPageFile(f);
 		assert(pageFile != nullptr);
 
 		// Load the page data immediately, from this thread:
@@ -159,50 +232,532 @@ bool PageProvider::runImmediateRequest(const PageId requestId)
 		pageRequest.fileId = f;
 
 		++outstandingRequests;
-		pageFile->loadPage(requestId, pageRequest);
+		const int64_t loadStartUs = getClockMicrosec();
+		if (!loadPageData(pageFile, requestId, pageRequest) && f < admittedIoCharges.size())
+		{
+			refundIoCharge(admittedIoCharges[f].bucketIndex, admittedIoCharges[f].bytes);
+		}
 
-		pushReadyRequest(pageRequest);
+		pushReadyRequest(pageRequest, getSlotGeneration(requestId));
+		recordCompletion(loadStartUs, loadStartUs);
 	}
 
 	return true;
 }
 
-void PageProvider::pushReadyRequest(const PageRequestDataPacket & readyRequest)
+bool PageProvider::loadPageData(PageFile * pageFile, const PageId requestId, PageRequestDataPacket & pageRequest)
+{
+	// Returns false if the page came from the shared cache, without reading the page file.
+	const uint64_t fileKey = (sharedPageCache != nullptr) ? pageFile->getSharedCacheKey() : 0;
+	if (fileKey == 0)
+	{
+		pageFile->loadPage(requestId, pageRequest);
+		return true;
+	}
+
+	// Another process may have read this page already, or be reading it now.
+	SharedPageCache::Reservation reservation;
+	switch (sharedPageCache->lookupOrReserve(fileKey, requestId, pageRequest.pageData, reservation))
+	{
+	case SharedPageCache::LookupResult::Hit :
+		return false;
+
+	case SharedPageCache::LookupResult::Reserved :
+		// Don't hand a zeroed page from a failed read to the other processes.
+		if (pageFile->loadPage(requestId, pageRequest))
+		{
+			sharedPageCache->publish(reservation, pageRequest.pageData);
+		}
+		else
+		{
+			sharedPageCache->cancel(reservation);
+		}
+		break;
+
+	default : // Uncached
+		pageFile->loadPage(requestId, pageRequest);
+		break;
+	}
+	return true;
+}
+
+uint32_t PageProvider::getSlotGeneration(const PageId requestId) const
+{
+	// Only the main thread writes the generations, and requests are
+	// issued from the main thread, so this doesn't need the lock.
+	const size_t textureIndex = static_cast<size_t>(pageIdExtractTextureIndex(requestId));
+	return (textureIndex < slotGenerations.size()) ? slotGenerations[textureIndex] : 0;
+}
+
+void PageProvider::pushReadyRequest(const PageRequestDataPacket & readyRequest, const uint32_t slotGeneration)
 {
 	std::lock_guard<std::mutex> lock(readyQueueMutex);
-	readyQueue.push_back(readyRequest);
+
+	// Route to the queue of the owning texture. The texture might have been
+	// unregistered while the request was in flight, and the slot reused by
+	// another one since. The generation tells the two apart.
+	const size_t textureIndex = static_cast<size_t>(pageIdExtractTextureIndex(readyRequest.pageId));
+	if (textureIndex < readyQueues.size() && slotGenerations[textureIndex] == slotGeneration)
+	{
+		readyQueues[textureIndex].push_back(readyRequest);
+		++readyQueueSize;
+		readyQueuePeakSize = std::max(readyQueuePeakSize, readyQueueSize);
+	}
 
 	--outstandingRequests;
 }
 
+size_t PageProvider::getReadyQueueMemoryBytes() const
+{
+	std::lock_guard<std::mutex> lock(readyQueueMutex);
+	return readyQueueSize * sizeof(PageRequestDataPacket);
+}
+
+size_t PageProvider::getPeakReadyQueueMemoryBytes() const
+{
+	std::lock_guard<std::mutex> lock(readyQueueMutex);
+	return readyQueuePeakSize * sizeof(PageRequestDataPacket);
+}
+
+void PageProvider::resetPeakReadyQueueMemoryBytes()
+{
+	std::lock_guard<std::mutex> lock(readyQueueMutex);
+	readyQueuePeakSize = readyQueueSize;
+}
+
+// ======================================================
+// Adaptive queue depth:
+// ======================================================
+
+// Measurement window and smoothing of the controller. The window spans several
+// frames so that a handful of slow reads don't swing the limits.
+static constexpr int64_t queueDepthWindowUs  = 250000;
+static constexpr double  queueDepthSmoothing = 0.3;
+
+int64_t PageProvider::getClockMicrosec()
+{
+	// Millisecond resolution is too coarse for a single page read.
+	using namespace std::chrono;
+	return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void PageProvider::recordCompletion(const int64_t submitTimeUs, const int64_t loadStartUs)
+{
+	const int64_t nowUs = getClockMicrosec();
+	totalLatencyUs.fetch_add(static_cast<uint64_t>(std::max(nowUs - submitTimeUs, int64_t(0))), std::memory_order_relaxed);
+	totalServiceUs.fetch_add(static_cast<uint64_t>(std::max(nowUs - loadStartUs,  int64_t(0))), std::memory_order_relaxed);
+	completedRequests.fetch_add(1, std::memory_order_release);
+}
+
+void PageProvider::setAdaptiveQueueDepth(const bool enable, const double targetLatencyMs)
+{
+	assert(targetLatencyMs > 0.0);
+
+	queueDepth.enabled         = enable;
+	queueDepth.targetLatencyMs = targetLatencyMs;
+
+	// Restart measuring from now. Smoothed values are kept as the starting point.
+	queueDepth.windowStartUs       = getClockMicrosec();
+	queueDepth.windowCompleted     = completedRequests.load(std::memory_order_acquire);
+	queueDepth.windowLatencyUs     = totalLatencyUs.load(std::memory_order_relaxed);
+	queueDepth.windowServiceUs     = totalServiceUs.load(std::memory_order_relaxed);
+	queueDepth.windowFrames        = 0;
+	queueDepth.windowLimitRefusals = 0;
+
+	if (!enable)
+	{
+		maxOutstandingRequests = MaxOutstandingPageRequests;
+	}
+
+	vtLogComment("Adaptive queue depth " << (enable ? "enabled" : "disabled")
+			<< ". Latency goal: " << targetLatencyMs << "ms.");
+}
+
+void PageProvider::updateQueueDepth()
+{
+	++queueDepth.windowFrames;
+
+	const int64_t nowUs     = getClockMicrosec();
+	const int64_t elapsedUs = nowUs - queueDepth.windowStartUs;
+	if (elapsedUs < queueDepthWindowUs)
+	{
+		return;
+	}
+
+	const uint64_t completed = completedRequests.load(std::memory_order_acquire);
+	const uint64_t latencyUs = totalLatencyUs.load(std::memory_order_relaxed);
+	const uint64_t serviceUs = totalServiceUs.load(std::memory_order_relaxed);
+	const uint64_t windowCompleted = completed - queueDepth.windowCompleted;
+
+	const double elapsedSec = elapsedUs * 1e-6;
+	const double alpha      = queueDepthSmoothing;
+
+	// Completion rate is measured even for idle windows, so it decays when there's no work.
+	queueDepth.completionsPerSec   += alpha * ((windowCompleted / elapsedSec) - queueDepth.completionsPerSec);
+	queueDepth.completionsPerFrame += alpha * (double(windowCompleted) / queueDepth.windowFrames - queueDepth.completionsPerFrame);
+	if (windowCompleted != 0)
+	{
+		const double windowLatencyMs = (latencyUs - queueDepth.windowLatencyUs) * 0.001 / windowCompleted;
+		const double windowServiceMs = (serviceUs - queueDepth.windowServiceUs) * 0.001 / windowCompleted;
+		queueDepth.latencyMs     += alpha * (windowLatencyMs - queueDepth.latencyMs);
+		queueDepth.serviceTimeMs += alpha * (windowServiceMs - queueDepth.serviceTimeMs);
+	}
+
+	if (queueDepth.enabled && windowCompleted != 0)
+	{
+		// Little's law: the depth that sustains the measured completion rate at the latency goal.
+		double targetDepth = queueDepth.completionsPerSec * queueDepth.targetLatencyMs * 0.001;
+
+		// If the limit refused requests while under the goal, the completion rate was capped
+		// by the limit itself, not by the device, so probe upwards. Over the goal, the queue
+		// is drained towards the Little's law depth, halving at most per window.
+		const int currentLimit = maxOutstandingRequests;
+		if (queueDepth.windowLimitRefusals != 0 && queueDepth.latencyMs < queueDepth.targetLatencyMs)
+		{
+			targetDepth = std::max(targetDepth, currentLimit * 1.25 + 1.0);
+		}
+		targetDepth = std::max(targetDepth, currentLimit * 0.5);
+		maxOutstandingRequests = clamp(static_cast<int>(std::ceil(targetDepth)),
+		                               MinOutstandingPageRequests, UpperOutstandingPageRequests);
+
+		// Enough new requests per frame to replace the completed ones, with headroom
+		// to refill the queue. Never more than the queue can take.
+		const int frameLimit = static_cast<int>(std::ceil(queueDepth.completionsPerFrame * 2.0));
+		queueDepth.frameRequestLimit = clamp(frameLimit, MinOutstandingPageRequests, maxOutstandingRequests);
+	}
+
+	queueDepth.windowStartUs       = nowUs;
+	queueDepth.windowCompleted     = completed;
+	queueDepth.windowLatencyUs     = latencyUs;
+	queueDepth.windowServiceUs     = serviceUs;
+	queueDepth.windowFrames        = 0;
+	queueDepth.windowLimitRefusals = 0;
+}
+
+PageProvider::QueueDepthStats PageProvider::getQueueDepthStats() const
+{
+	QueueDepthStats stats;
+	stats.latencyMs         = queueDepth.latencyMs;
+	stats.serviceTimeMs     = queueDepth.serviceTimeMs;
+	stats.completionsPerSec = queueDepth.completionsPerSec;
+	stats.targetLatencyMs   = queueDepth.targetLatencyMs;
+	stats.outstandingLimit  = maxOutstandingRequests;
+	stats.frameRequestLimit = queueDepth.frameRequestLimit;
+	stats.adaptive          = queueDepth.enabled;
+	return stats;
+}
+
+// ======================================================
+// I/O rate limiting:
+// ======================================================
+
+void PageProvider::IoRateBucket::refill(const int64_t nowMs)
+{
+	const double elapsedSec = (nowMs - lastRefillMs) * 0.001;
+	if (elapsedSec > 0.0)
+	{
+		tokens = std::min(tokens + elapsedSec * bytesPerSecond, burstBytes);
+		lastRefillMs = nowMs;
+	}
+}
+
+void PageProvider::setIoRateLimit(const double bytesPerSecond, const double burstBytes, const int ioDeviceId)
+{
+	assert(ioDeviceId >= 0);
+
+	if (static_cast<size_t>(ioDeviceId) >= ioBuckets.size())
+	{
+		if (bytesPerSecond <= 0.0)
+		{
+			return; // Nothing to remove.
+		}
+
+		IoRateBucket unlimited;
+		clearPodObject(unlimited);
+		unlimited.throttleStartMs = -1;
+		ioBuckets.resize(ioDeviceId + 1, unlimited);
+
+		std::lock_guard<std::mutex> lock(ioRefundMutex);
+		ioRefunds.resize(ioBuckets.size(), 0.0);
+	}
+
+	// A burst smaller than one page would never admit anything.
+	IoRateBucket & bucket = ioBuckets[ioDeviceId];
+	bucket.bytesPerSecond  = bytesPerSecond;
+	bucket.burstBytes      = std::max(burstBytes, static_cast<double>(PageRequestIoBytes));
+	bucket.tokens          = bucket.burstBytes;
+	bucket.lastRefillMs    = tool::getClockMillisec();
+	bucket.throttleStartMs = -1;
+
+	vtLogComment("I/O rate limit for device #" << ioDeviceId << " set to "
+			<< bytesPerSecond << " bytes/s, burst " << bucket.burstBytes << " bytes.");
+}
+
+double PageProvider::getIoRateLimit(const int ioDeviceId) const
+{
+	if (ioDeviceId < 0 || static_cast<size_t>(ioDeviceId) >= ioBuckets.size())
+	{
+		return 0.0;
+	}
+	return ioBuckets[ioDeviceId].bytesPerSecond;
+}
+
+PageProvider::IoThrottleStats PageProvider::getIoThrottleStats(const int ioDeviceId) const
+{
+	IoThrottleStats stats;
+	clearPodObject(stats);
+
+	if (ioDeviceId < 0 || static_cast<size_t>(ioDeviceId) >= ioBuckets.size())
+	{
+		return stats;
+	}
+
+	// Include the throttling interval still open, if any.
+	const IoRateBucket & bucket = ioBuckets[ioDeviceId];
+	int64_t throttledMs = bucket.throttledMs;
+	if (bucket.throttleStartMs >= 0)
+	{
+		throttledMs += tool::getClockMillisec() - bucket.throttleStartMs;
+	}
+
+	stats.throttledSeconds  = throttledMs * 0.001;
+	stats.throttledRequests = bucket.throttledRequests;
+	stats.admittedBytes     = bucket.admittedBytes;
+	stats.availableBytes    = bucket.tokens;
+	return stats;
+}
+
+void PageProvider::resetIoThrottleStats()
+{
+	const int64_t nowMs = tool::getClockMillisec();
+	for (IoRateBucket & bucket : ioBuckets)
+	{
+		bucket.throttledMs       = 0;
+		bucket.throttledRequests = 0;
+		bucket.admittedBytes     = 0;
+		if (bucket.throttleStartMs >= 0)
+		{
+			bucket.throttleStartMs = nowMs;
+		}
+	}
+}
+
+int PageProvider::findIoBucket(const int ioDeviceId) const
+{
+	// A device without its own limit shares the default bucket.
+	if (ioDeviceId > 0 && static_cast<size_t>(ioDeviceId) < ioBuckets.size() && ioBuckets[ioDeviceId].isLimited())
+	{
+		return ioDeviceId;
+	}
+	if (!ioBuckets.empty() && ioBuckets[0].isLimited())
+	{
+		return 0;
+	}
+	return -1;
+}
+
+void PageProvider::refundIoCharge(const int bucketIndex, const double bytes)
+{
+	if (bucketIndex < 0 || bytes <= 0.0)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(ioRefundMutex);
+	if (static_cast<size_t>(bucketIndex) < ioRefunds.size())
+	{
+		ioRefunds[bucketIndex] += bytes;
+	}
+}
+
+void PageProvider::applyIoRefunds()
+{
+	std::lock_guard<std::mutex> lock(ioRefundMutex);
+	for (size_t b = 0; b < ioRefunds.size(); ++b)
+	{
+		if (ioRefunds[b] <= 0.0)
+		{
+			continue;
+		}
+
+		IoRateBucket & bucket = ioBuckets[b];
+		bucket.tokens = std::min(bucket.tokens + ioRefunds[b], bucket.burstBytes);
+		bucket.admittedBytes -= std::min(bucket.admittedBytes, static_cast<uint64_t>(ioRefunds[b]));
+		ioRefunds[b] = 0.0;
+	}
+}
+
+bool PageProvider::admitIoRequest(const PageId requestId)
+{
+	admittedIoCharges.clear();
+	if (ioBuckets.empty())
+	{
+		return true; // No limits set.
+	}
+
+	const VirtualTexture * vtTex = getTextureForRequest(requestId);
+	if (vtTex == nullptr)
+	{
+		return true; // Let the request path refuse it.
+	}
+
+	applyIoRefunds();
+
+	// Each page file of the texture is a separate read, possibly on a different device.
+	bool anyLimited = false;
+	const unsigned int numPageFiles = vtTex->getNumPageFiles();
+	for (unsigned int f = 0; f < numPageFiles; ++f)
+	{
+		const PageFile * pageFile = vtTex->getPageFile(f);
+		const int b = findIoBucket(pageFile->getIoDeviceId());
+		const double bytes = (b >= 0) ? static_cast<double>(pageFile->getPageReadBytes(requestId)) : 0.0;
+		if (b >= 0)
+		{
+			ioBuckets[b].pendingCost += bytes;
+			anyLimited = true;
+		}
+		admittedIoCharges.push_back(IoCharge{ b, bytes });
+	}
+
+	if (!anyLimited)
+	{
+		return true;
+	}
+
+	// Coarse levels may go into debt. Everything else must fit in the current budget.
+	const bool highPriority = pageIdExtractMipLevel(requestId) >= (vtTex->getNumLevels() - IoPriorityCoarseLevels);
+	const int64_t nowMs = tool::getClockMillisec();
+
+	bool admitted = true;
+	for (IoRateBucket & bucket : ioBuckets)
+	{
+		if (bucket.pendingCost <= 0.0)
+		{
+			continue;
+		}
+
+		bucket.refill(nowMs);
+		const double minTokens = highPriority ? -bucket.burstBytes : 0.0;
+		if ((bucket.tokens - bucket.pendingCost) < minTokens)
+		{
+			admitted = false;
+		}
+	}
+
+	for (IoRateBucket & bucket : ioBuckets)
+	{
+		if (bucket.pendingCost <= 0.0)
+		{
+			continue;
+		}
+
+		if (admitted)
+		{
+			bucket.tokens        -= bucket.pendingCost;
+			bucket.admittedBytes += static_cast<uint64_t>(bucket.pendingCost);
+			if (bucket.throttleStartMs >= 0)
+			{
+				bucket.throttledMs += nowMs - bucket.throttleStartMs;
+				bucket.throttleStartMs = -1;
+			}
+		}
+		else
+		{
+			++bucket.throttledRequests;
+			if (bucket.throttleStartMs < 0)
+			{
+				bucket.throttleStartMs = nowMs;
+			}
+		}
+		bucket.pendingCost = 0.0;
+	}
+
+	return admitted;
+}
+
+// ======================================================
+
+VirtualTexture * PageProvider::getTextureForRequest(const PageId requestId) const
+{
+	const size_t textureIndex = static_cast<size_t>(pageIdExtractTextureIndex(requestId));
+	if (textureIndex >= registeredTextures.size() || registeredTextures[textureIndex] == nullptr)
+	{
+		vtLogWarning("Page request for unregistered texture slot #" << textureIndex << "! Dropping request...");
+		return nullptr;
+	}
+	return registeredTextures[textureIndex];
+}
+
 void PageProvider::registerVirtualTexture(VirtualTexture * vtTex)
 {
 	assert(vtTex != nullptr);
+	assert(vtTex->getPageProvider() == nullptr && "Texture already linked to a PageProvider!");
+
+	vtTex->acquireTextureSlot();
+	const size_t slot = static_cast<size_t>(vtTex->getTextureIndex());
 
-	registeredTextures.push_back(vtTex);
-	vtTex->setTextureIndex(static_cast<int>(registeredTextures.size()) - 1);
+	if (slot >= registeredTextures.size())
+	{
+		registeredTextures.resize(slot + 1, nullptr);
+	}
+	assert(registeredTextures[slot] == nullptr && "Texture slot already in use!");
+
+	registeredTextures[slot] = vtTex;
 	vtTex->setPageProvider(this);
+
+	std::lock_guard<std::mutex> lock(readyQueueMutex);
+	if (slot >= readyQueues.size())
+	{
+		readyQueues.resize(slot + 1);
+		slotGenerations.resize(slot + 1, 0);
+	}
 }
 
 void PageProvider::unregisterVirtualTexture(VirtualTexture * vtTex)
 {
 	assert(vtTex != nullptr);
 
-	if (!registeredTextures.empty())
+	const int slot = vtTex->getTextureIndex();
+	if (slot < 0 || static_cast<size_t>(slot) >= registeredTextures.size() || registeredTextures[slot] != vtTex)
 	{
-		auto it = std::find(std::begin(registeredTextures), std::end(registeredTextures), vtTex);
-		if (it != std::end(registeredTextures))
-		{
-			registeredTextures.erase(it);
-		}
-		vtTex->setTextureIndex(-1);
-		vtTex->setPageProvider(nullptr);
+		return; // Not registered with this provider.
 	}
+
+	// Slots are never compacted, so the other textures keep their indexes.
+	registeredTextures[slot] = nullptr;
+	vtTex->setPageProvider(nullptr);
+	vtTex->releaseTextureSlot();
+
+	// Drop pages not yet consumed, and any still being loaded,
+	// so that they don't leak into the next owner of the slot.
+	std::lock_guard<std::mutex> lock(readyQueueMutex);
+	readyQueueSize -= readyQueues[slot].size();
+	readyQueues[slot].clear();
+	++slotGenerations[slot];
 }
 
 void PageProvider::unregisterAllVirtualTextures()
 {
+	for (VirtualTexture * vtTex : registeredTextures)
+	{
+		if (vtTex != nullptr)
+		{
+			vtTex->setPageProvider(nullptr);
+			vtTex->releaseTextureSlot();
+		}
+	}
 	registeredTextures.clear();
+
+	std::lock_guard<std::mutex> lock(readyQueueMutex);
+	for (FulfilledPageRequestQueue & readyQueue : readyQueues)
+	{
+		readyQueue.clear();
+	}
+	for (uint32_t & generation : slotGenerations)
+	{
+		++generation;
+	}
+	readyQueueSize = 0;
 }
 
 } // namespace vt {}
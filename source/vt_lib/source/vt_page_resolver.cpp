@@ -32,6 +32,7 @@
 
 #include "vt.hpp"
 #include <algorithm>
+#include <cstring>
 
 namespace vt
 {
@@ -39,6 +40,28 @@ namespace vt
 // We are casting Pixel4b to PageId.
 static_assert(sizeof(Pixel4b) == sizeof(PageId), "Sizes must match!");
 
+// ======================================================
+// Compact feedback helpers:
+// ======================================================
+
+// Pages in one axis of a mip level. Must match compactPageIdColor() in page_id_funcs.glsl.
+static unsigned int compactLevelPages(const VirtualTexture & vtTex, const int level, const int axis)
+{
+	const unsigned int level0Pages = static_cast<unsigned int>(vtTex.getLevel0SizeInPages()[axis]);
+	return std::max(level0Pages >> level, 1u);
+}
+
+// Pages of all mip levels of a texture.
+static unsigned int countCompactPages(const VirtualTexture & vtTex)
+{
+	unsigned int numPages = 0;
+	for (int level = 0; level < vtTex.getNumLevels(); ++level)
+	{
+		numPages += compactLevelPages(vtTex, level, 0) * compactLevelPages(vtTex, level, 1);
+	}
+	return numPages;
+}
+
 // ======================================================
 // PageResolver:
 // ======================================================
@@ -58,7 +81,31 @@ PageResolver::PageResolver(PageProvider & provider, const int fboWidth, const in
 	, pageIdFboHeight(0)
 	, originalFbo(0)
 	, originalRbo(0)
+	, compactFeedbackEnabled(true)
+	, compactFeedbackSupported(false)
+	, compactFeedbackActive(false)
+	, packFbo(0)
+	, packColorTex(0)
+	, packFboWidth(0)
+	, feedbackBlocksX(0)
+	, feedbackBlocksY(0)
+	, frameChangedBlocks(0)
+	, incrementalFeedbackEnabled(true)
+	, feedbackHistoryValid(false)
+	, feedbackHistoryCompact(false)
 	, visiblePages(0)
+	, lastViewSignature(0)
+	, hasViewSignature(false)
+	, feedbackConverged(false)
+	, skipPageIdPass(false)
+	, framesSinceLastPass(0)
+	, convergedRefreshInterval(DefaultConvergedRefreshInterval)
+	, numSkippedPasses(0)
+	, frameNewRequests(0)
+	, frameDroppedRequests(0)
+	, requestDowngradeEnabled(true)
+	, frameDowngradedPages(0)
+	, peakSystemMemoryBytes(0)
 {
 	clearArray(originalViewport);
 	initFrameBuffer(fboWidth, fboHeight);
@@ -68,10 +115,49 @@ PageResolver::~PageResolver()
 {
 	gl::deleteFrameBuffer(pageIdFbo);
 	gl::delete2DTexture(fboColorTex);
+	gl::deleteFrameBuffer(packFbo);
+	gl::delete2DTexture(packColorTex);
+}
+
+void PageResolver::setViewSignature(const uint64_t signature, const bool sceneDirty)
+{
+	const bool viewChanged = !hasViewSignature || (signature != lastViewSignature) || sceneDirty;
+	const bool refreshDue  = (convergedRefreshInterval > 0) && (framesSinceLastPass >= convergedRefreshInterval);
+
+	skipPageIdPass    = feedbackConverged && !viewChanged && !refreshDue;
+	lastViewSignature = signature;
+	hasViewSignature  = true;
+}
+
+void PageResolver::invalidateFeedback()
+{
+	feedbackConverged = false;
+	skipPageIdPass    = false;
+}
+
+uint64_t PageResolver::hashViewMatrix(const float * matrix, const int numFloats)
+{
+	assert(matrix != nullptr);
+
+	const uint8_t * bytes = reinterpret_cast<const uint8_t *>(matrix);
+	const size_t numBytes = numFloats * sizeof(float);
+
+	uint64_t hash = 14695981039346656037ull; // FNV-1a offset basis
+	for (size_t b = 0; b < numBytes; ++b)
+	{
+		hash ^= bytes[b];
+		hash *= 1099511628211ull; // FNV-1a prime
+	}
+	return hash;
 }
 
 void PageResolver::beginPageIdPass()
 {
+	if (skipPageIdPass)
+	{
+		return;
+	}
+
 	gl::useFrameBuffer(pageIdFbo);
 
 	// A white pixel is equivalent to an invalid page.
@@ -83,40 +169,210 @@ void PageResolver::beginPageIdPass()
 
 void PageResolver::endPageIdPass()
 {
+	// Every frame, even skipped ones, so a still period doesn't stretch
+	// the measurement window and read as a collapse of the completion rate.
+	pageProvider.updateQueueDepth();
+
+	if (skipPageIdPass)
+	{
+		// Converged and nothing changed. The skip only lasts for one frame.
+		skipPageIdPass = false;
+		++framesSinceLastPass;
+		++numSkippedPasses;
+		return;
+	}
+
 	feedbackBufferAnalysis();
+	framesSinceLastPass = 0;
 
 	gl::useFrameBuffer(originalFbo);
 	glViewport(originalViewport[0], originalViewport[1], originalViewport[2], originalViewport[3]);
 }
 
+void PageResolver::resolveExternalPageIds(const GLuint pageIdTexture)
+{
+	assert(pageIdTexture != 0);
+
+	if (skipPageIdPass)
+	{
+		endPageIdPass(); // Just counts the skipped pass.
+		return;
+	}
+
+	// Point sample the source, or ids would get blended together:
+	gl::use2DTexture(pageIdTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	runFullScreenPass(pageIdFbo, pageIdFboWidth, pageIdFboHeight,
+			getGlobalShaders().pageIdDownsample.programId, pageIdTexture);
+
+	// Analysis and framebuffer/viewport restore:
+	endPageIdPass();
+}
+
+void PageResolver::runFullScreenPass(const GLuint fbo, const int w, const int h, const GLuint programId, const GLuint srcTexture) const
+{
+	// The quad covers every pixel of the target, so no clear is needed.
+	// Depth test and blending would interfere with the copy.
+	const bool depthTestEnabled = gl::isEnabled(GL_DEPTH_TEST);
+	const bool blendEnabled     = gl::isEnabled(GL_BLEND);
+	gl::setEnabled(GL_DEPTH_TEST, false);
+	gl::setEnabled(GL_BLEND, false);
+
+	gl::useFrameBuffer(fbo);
+	glViewport(0, 0, w, h);
+
+	gl::useShaderProgram(programId);
+	gl::use2DTexture(srcTexture);
+	gl::drawNdcQuadrilateral();
+	gl::use2DTexture(0);
+	gl::useShaderProgram(0);
+
+	gl::setEnabled(GL_DEPTH_TEST, depthTestEnabled);
+	gl::setEnabled(GL_BLEND, blendEnabled);
+}
+
 void PageResolver::registerVirtualTexture(VirtualTexture * vtTex)
 {
 	assert(vtTex != nullptr);
+	assert(vtTex->getPageResolver() == nullptr && "Texture already linked to a PageResolver!");
+
+	vtTex->acquireTextureSlot();
+	const size_t slot = static_cast<size_t>(vtTex->getTextureIndex());
+
+	if (slot >= registeredTextures.size())
+	{
+		registeredTextures.resize(slot + 1, nullptr);
+	}
+	assert(registeredTextures[slot] == nullptr && "Texture slot already in use!");
 
-	registeredTextures.push_back(vtTex);
-	vtTex->setTextureIndex(static_cast<int>(registeredTextures.size()) - 1);
+	registeredTextures[slot] = vtTex;
 	vtTex->setPageResolver(this);
+	vtTex->loadMipTails();
+	updateCompactFeedbackLayout();
+	invalidateFeedback();
 }
 
 void PageResolver::unregisterVirtualTexture(VirtualTexture * vtTex)
 {
 	assert(vtTex != nullptr);
 
-	if (!registeredTextures.empty())
+	const int slot = vtTex->getTextureIndex();
+	if (slot < 0 || static_cast<size_t>(slot) >= registeredTextures.size() || registeredTextures[slot] != vtTex)
 	{
-		auto it = std::find(std::begin(registeredTextures), std::end(registeredTextures), vtTex);
-		if (it != std::end(registeredTextures))
-		{
-			registeredTextures.erase(it);
-		}
-		vtTex->setTextureIndex(-1);
-		vtTex->setPageResolver(nullptr);
+		return; // Not registered with this resolver.
 	}
+
+	// Slots are never compacted, so the other textures keep their indexes.
+	registeredTextures[slot] = nullptr;
+	vtTex->setPageResolver(nullptr);
+	vtTex->releaseTextureSlot();
+	updateCompactFeedbackLayout();
+	invalidateFeedback();
 }
 
 void PageResolver::unregisterAllVirtualTextures()
 {
+	for (VirtualTexture * vtTex : registeredTextures)
+	{
+		if (vtTex != nullptr)
+		{
+			vtTex->setPageResolver(nullptr);
+			vtTex->releaseTextureSlot();
+		}
+	}
 	registeredTextures.clear();
+	updateCompactFeedbackLayout();
+	invalidateFeedback();
+}
+
+void PageResolver::setCompactFeedbackEnabled(const bool enable)
+{
+	compactFeedbackEnabled = enable;
+	updateCompactFeedbackLayout();
+}
+
+int PageResolver::getCompactPageBase(const int textureIndex) const
+{
+	if (!compactFeedbackActive || textureIndex < 0 || static_cast<size_t>(textureIndex) >= compactPageBases.size())
+	{
+		return -1;
+	}
+	return compactPageBases[textureIndex];
+}
+
+void PageResolver::setIncrementalFeedbackEnabled(const bool enable)
+{
+	incrementalFeedbackEnabled = enable;
+	resetFeedbackHistory();
+}
+
+void PageResolver::updateCompactFeedbackLayout()
+{
+	// Page numbers are about to change meaning. Count everything again on the next analysis.
+	resetFeedbackHistory();
+
+	compactPageBases.assign(registeredTextures.size(), -1);
+	compactFeedbackActive = false;
+
+	if (!compactFeedbackEnabled || !compactFeedbackSupported)
+	{
+		return;
+	}
+
+	// Assign each texture a range of the page number space, in slot order:
+	unsigned int nextBase = 0;
+	for (size_t t = 0; t < registeredTextures.size(); ++t)
+	{
+		if (registeredTextures[t] == nullptr)
+		{
+			continue;
+		}
+
+		const unsigned int numPages = countCompactPages(*registeredTextures[t]);
+		if ((nextBase + numPages) >= InvalidCompactPageNumber)
+		{
+			vtLogComment("Registered textures have too many pages for compact feedback. Using wide page ids...");
+			compactPageBases.assign(registeredTextures.size(), -1);
+			return;
+		}
+
+		compactPageBases[t] = static_cast<int>(nextBase);
+		nextBase += numPages;
+	}
+
+	compactFeedbackActive = true;
+}
+
+PageId PageResolver::decodeCompactPageNumber(const unsigned int pageNumber) const
+{
+	// Bases are ascending in slot order, so the first texture
+	// whose range contains the number is the owner.
+	for (size_t t = 0; t < compactPageBases.size(); ++t)
+	{
+		const int base = compactPageBases[t];
+		if (base < 0 || pageNumber < static_cast<unsigned int>(base))
+		{
+			continue;
+		}
+
+		const VirtualTexture & vtTex = *registeredTextures[t];
+		unsigned int localNumber = pageNumber - base;
+
+		for (int level = 0; level < vtTex.getNumLevels(); ++level)
+		{
+			const unsigned int pagesX = compactLevelPages(vtTex, level, 0);
+			const unsigned int pagesY = compactLevelPages(vtTex, level, 1);
+			if (localNumber < (pagesX * pagesY))
+			{
+				return makePageId(localNumber % pagesX, localNumber / pagesX, level, static_cast<unsigned int>(t));
+			}
+			localNumber -= pagesX * pagesY;
+		}
+	}
+
+	return InvalidPageId;
 }
 
 void PageResolver::visualizePageIds(const float overlayScale[2]) const
@@ -139,15 +395,38 @@ void PageResolver::visualizePageIds(const float overlayScale[2]) const
 
 void PageResolver::feedbackBufferAnalysis()
 {
+	// Sanity checks:
+	assert(pageMap.empty());
+	assert(sortedPages.empty());
+
 	// Data read-back.
 	// This could be asynchronous if we had PBOs on GL-ES.
 	// AFAIK, currently there is no other alternative.
-	gl::readFrameBuffer(pageIdFbo, 0, 0, pageIdFboWidth, pageIdFboHeight,
-			GL_RGBA, GL_UNSIGNED_BYTE, feedbackBuffer.get());
+	if (compactFeedbackActive)
+	{
+		// Pack two 16-bit page numbers per texel, so only half of the bytes are read back:
+		runFullScreenPass(packFbo, packFboWidth, pageIdFboHeight, getGlobalShaders().pageIdPack.programId, fboColorTex);
+		gl::readFrameBuffer(packFbo, 0, 0, packFboWidth, pageIdFboHeight,
+				GL_RGBA, GL_UNSIGNED_BYTE, feedbackBuffer.get());
+	}
+	else
+	{
+		gl::readFrameBuffer(pageIdFbo, 0, 0, pageIdFboWidth, pageIdFboHeight,
+				GL_RGBA, GL_UNSIGNED_BYTE, feedbackBuffer.get());
+	}
 
-	// Each pixel = 1 page.
-	const size_t numPages = pageIdFboWidth * pageIdFboHeight;
-	const PageId * __restrict framePages = reinterpret_cast<const PageId *>(feedbackBuffer.get());
+	if (incrementalFeedbackEnabled)
+	{
+		countChangedFeedbackBlocks();
+	}
+	else if (compactFeedbackActive)
+	{
+		countCompactPageNumbers();
+	}
+	else
+	{
+		countWidePageIds();
+	}
 
 	//
 	// Notes:
@@ -163,22 +442,6 @@ void PageResolver::feedbackBufferAnalysis()
 	// higher frequency first.
 	//
 
-	// Sanity checks:
-	assert(pageMap.empty());
-	assert(sortedPages.empty());
-
-	// Insert into map, counting frequencies.
-	// This will result in a table of unique pages.
-	for (size_t p = 0; p < numPages; ++p)
-	{
-		if (framePages[p] != InvalidPageId)
-		{
-			pageMap[framePages[p]]++;
-		}
-		// Invalid pages are a result of the background color
-		// and parts of the scene that are not using the VT renderer.
-	}
-
 	// Copy unique pages to the vector:
 	sortedPages.reserve(pageMap.size());
 	for (const auto & pagePair : pageMap)
@@ -233,6 +496,13 @@ void PageResolver::feedbackBufferAnalysis()
 		maxPageRequestsPerFrame = PageTable::TotalTablePages;
 	}
 
+	// With an adaptive provider queue, the per-frame cap follows the measured I/O throughput.
+	// The provider's controller was updated for this frame by endPageIdPass().
+	if (pageProvider.isAdaptiveQueueDepthEnabled())
+	{
+		maxPageRequestsPerFrame = std::min(pageProvider.getFrameRequestLimit(), int(PageTable::TotalTablePages));
+	}
+
 	// Ensure that the top page (max_mip - 1) is alway in cache
 	// by automatically requesting it every frame.
 //	addDefaultRequests();
@@ -240,10 +510,13 @@ void PageResolver::feedbackBufferAnalysis()
 	// Better without, but still gotta fix this somehow...
 	// Need to lock pages directly in the PageCacheMgr.
 
-	// Generate the needed page requests:
-	// (Up to the max new requests allowed per frame).
-	size_t newRequests = 0;
-	for (size_t r = 0; (r < sortedPages.size() && newRequests < static_cast<size_t>(maxPageRequestsPerFrame)); ++r)
+	// Split the visible pages into the ones already resident or in-flight and the
+	// missing ones. The former are just touched, so they stay in the cache. The
+	// latter cost a request each and are issued up to the frame's budget.
+	frameNewRequests     = 0;
+	frameDroppedRequests = 0;
+	frameDowngradedPages = 0;
+	for (const PageId pageId : sortedPages)
 	{
 		// I'm forced to sanitize the page ids here because of out-of-range values.
 		// This should not be necessary, assuming everything is implemented correctly.
@@ -254,26 +527,418 @@ void PageResolver::feedbackBufferAnalysis()
 		// seem to produce any noticeable visual artifacts. Worst case you'll get
 		// a slightly more blurred texture.
 
-		const PageId requestId = sortedPages[r];
-		const size_t textureIndex = std::min(static_cast<size_t>(pageIdExtractTextureIndex(requestId)), registeredTextures.size());
+		const size_t textureIndex = static_cast<size_t>(pageIdExtractTextureIndex(pageId));
+
+		// Stale ids from a texture that was just unregistered are ignored:
+		if (textureIndex >= registeredTextures.size() || registeredTextures[textureIndex] == nullptr)
+		{
+			continue;
+		}
 
 		PageCacheMgr * pageCache = registeredTextures[textureIndex]->getPageCache();
-		newRequests += processPageRequest(pageCache->sanitizePageId(requestId), *pageCache);
+		const PageId requestId = pageCache->sanitizePageId(pageId);
+
+		if (pageCache->queryPage(requestId) == CachePageStatus::Unavailable)
+		{
+			missingPages.push_back({ requestId, pageMap[pageId] });
+		}
+		else
+		{
+			processPageRequest(requestId, *pageCache);
+		}
+	}
+
+	// Too many missing pages for this frame? Request coarser pages instead of dropping the excess.
+	const size_t budget = static_cast<size_t>(getFrameRequestBudget());
+	if (requestDowngradeEnabled && budget != 0 && missingPages.size() > budget)
+	{
+		downgradeMissingPages(budget);
+	}
+
+	size_t newRequests = 0;
+	size_t r = 0;
+	for (; (r < missingPages.size() && newRequests < budget); ++r)
+	{
+		const PageId requestId = missingPages[r].pageId;
+		PageCacheMgr * pageCache = registeredTextures[pageIdExtractTextureIndex(requestId)]->getPageCache();
+		newRequests += processPageRequest(requestId, *pageCache);
 	}
 
 	#ifndef VT_NO_LOGGING
-	if (newRequests < sortedPages.size())
+	if (r < missingPages.size())
 	{
-		const size_t dropped = sortedPages.size() - newRequests;
+		const size_t dropped = missingPages.size() - r;
 		vtLogComment(dropped << " page requests were dropped from PageResolver this frame...");
 	}
+	if (frameDowngradedPages != 0)
+	{
+		vtLogComment(frameDowngradedPages << " page requests were downgraded to a parent page this frame...");
+	}
 	#endif // VT_NO_LOGGING
 
+	// Converged if every visible page was already resident or in-flight. A page left out by
+	// the per-frame limit, downgraded or refused by the provider means there is still work to do.
+	feedbackConverged = (frameNewRequests == 0) && (frameDroppedRequests == 0) &&
+	                    (frameDowngradedPages == 0) && (r == missingPages.size());
+
+	// Sample memory usage while the frame's map and vector are still populated:
+	peakSystemMemoryBytes = std::max(peakSystemMemoryBytes, getSystemMemoryBytes());
+
 	// Cleanup for next frame.
 	sortedPages.clear();
+	missingPages.clear();
 	pageMap.clear();
 }
 
+int PageResolver::getFrameRequestBudget() const
+{
+	// Per-frame limit, but never more than the provider can take right now.
+	// Textures with several page files take one provider slot per file, so
+	// the provider might still refuse some of these.
+	const int providerFree = pageProvider.getMaxOutstandingRequests() - pageProvider.getNumOutstandingRequests();
+	return std::max(std::min(maxPageRequestsPerFrame, providerFree), 0);
+}
+
+void PageResolver::downgradeMissingPages(const size_t budget)
+{
+	//
+	// Missing pages are grouped by parent, one level at a time, finest first.
+	// A group of two or more siblings can be replaced by a single request for
+	// their parent, which covers all their screen pixels, if at a lower resolution.
+	// Groups are replaced in order of fewest pixels per request, so the ones
+	// that would have given the least coverage for their I/O go first, until
+	// the missing pages fit the budget. Parents added by a level can be grouped
+	// again by the next one.
+	//
+	struct SiblingGroup
+	{
+		unsigned int pixels;     // Screen pixels of the missing children.
+		unsigned int numPages;   // Missing children.
+		bool parentMissing;      // Parent is visible and missing, already in the list.
+		bool replaced;
+	};
+
+	std::unordered_map<PageId, SiblingGroup> groups;
+	std::vector<std::pair<PageId, SiblingGroup *>> candidates;
+	std::vector<MissingPage> downgraded;
+
+	for (int level = 0; level < (MaxVTMipLevels - 1) && missingPages.size() > budget; ++level)
+	{
+		groups.clear();
+		candidates.clear();
+
+		for (const MissingPage & page : missingPages)
+		{
+			const PageId id = page.pageId;
+			const int texId = pageIdExtractTextureIndex(id);
+			if (pageIdExtractMipLevel(id) != level || (level + 1) >= registeredTextures[texId]->getNumLevels())
+			{
+				continue;
+			}
+
+			const PageId parentId = makePageId(pageIdExtractPageX(id) / 2, pageIdExtractPageY(id) / 2, level + 1, texId);
+			SiblingGroup & group = groups[parentId];
+			group.pixels += page.pixels;
+			group.numPages++;
+		}
+
+		if (groups.empty())
+		{
+			continue;
+		}
+
+		// Parents that are visible themselves are already in the list:
+		for (const MissingPage & page : missingPages)
+		{
+			if (pageIdExtractMipLevel(page.pageId) == (level + 1))
+			{
+				const auto group = groups.find(page.pageId);
+				if (group != groups.end())
+				{
+					group->second.parentMissing = true;
+				}
+			}
+		}
+
+		for (auto & group : groups)
+		{
+			if (group.second.numPages >= 2)
+			{
+				candidates.emplace_back(group.first, &group.second);
+			}
+		}
+
+		// Fewest pixels per request first (a.pixels / a.numPages < b.pixels / b.numPages):
+		std::sort(std::begin(candidates), std::end(candidates),
+			[](const std::pair<PageId, SiblingGroup *> & a, const std::pair<PageId, SiblingGroup *> & b) -> bool
+			{
+				return (uint64_t(a.second->pixels) * b.second->numPages) < (uint64_t(b.second->pixels) * a.second->numPages);
+			}
+		);
+
+		// A parent already resident, in-flight or in the list costs nothing extra.
+		size_t excess = missingPages.size() - budget;
+		bool anyReplaced = false;
+		for (auto & candidate : candidates)
+		{
+			if (excess == 0)
+			{
+				break;
+			}
+
+			SiblingGroup & group = *candidate.second;
+			const PageCacheMgr * pageCache = registeredTextures[pageIdExtractTextureIndex(candidate.first)]->getPageCache();
+			const bool parentIsFree = group.parentMissing || (pageCache->queryPage(candidate.first) != CachePageStatus::Unavailable);
+
+			const size_t saved = parentIsFree ? group.numPages : (group.numPages - 1);
+			excess -= std::min(saved, excess);
+			group.replaced = true;
+			frameDowngradedPages += group.numPages;
+			anyReplaced = true;
+		}
+
+		if (!anyReplaced)
+		{
+			continue;
+		}
+
+		// Rebuild the list without the replaced children. Replaced parents take their pixels.
+		downgraded.clear();
+		for (const MissingPage & page : missingPages)
+		{
+			const PageId id = page.pageId;
+			if (pageIdExtractMipLevel(id) == level)
+			{
+				const PageId parentId = makePageId(pageIdExtractPageX(id) / 2, pageIdExtractPageY(id) / 2,
+				                                   level + 1, pageIdExtractTextureIndex(id));
+				const auto group = groups.find(parentId);
+				if (group != groups.end() && group->second.replaced)
+				{
+					continue;
+				}
+			}
+			else if (pageIdExtractMipLevel(id) == (level + 1))
+			{
+				const auto group = groups.find(id);
+				if (group != groups.end() && group->second.replaced)
+				{
+					downgraded.push_back({ id, page.pixels + group->second.pixels });
+					continue;
+				}
+			}
+			downgraded.push_back(page);
+		}
+
+		for (const auto & candidate : candidates)
+		{
+			const SiblingGroup & group = *candidate.second;
+			if (!group.replaced || group.parentMissing)
+			{
+				continue;
+			}
+
+			const PageCacheMgr * pageCache = registeredTextures[pageIdExtractTextureIndex(candidate.first)]->getPageCache();
+			if (pageCache->queryPage(candidate.first) == CachePageStatus::Unavailable)
+			{
+				downgraded.push_back({ candidate.first, group.pixels });
+			}
+		}
+
+		missingPages.swap(downgraded);
+	}
+
+	// Same order as the sorted pages: coarser levels first, then by pixel count.
+	std::sort(std::begin(missingPages), std::end(missingPages),
+		[](const MissingPage & a, const MissingPage & b) -> bool
+		{
+			const int aMip = pageIdExtractMipLevel(a.pageId);
+			const int bMip = pageIdExtractMipLevel(b.pageId);
+			return (aMip != bMip) ? (aMip > bMip) : (a.pixels > b.pixels);
+		}
+	);
+}
+
+void PageResolver::countWidePageIds()
+{
+	// Each pixel = 1 page.
+	const size_t numPages = pageIdFboWidth * pageIdFboHeight;
+	const PageId * __restrict framePages = reinterpret_cast<const PageId *>(feedbackBuffer.get());
+
+	// Insert into map, counting frequencies.
+	// This will result in a table of unique pages.
+	for (size_t p = 0; p < numPages; ++p)
+	{
+		if (framePages[p] != InvalidPageId)
+		{
+			pageMap[framePages[p]]++;
+		}
+		// Invalid pages are a result of the background color
+		// and parts of the scene that are not using the VT renderer.
+	}
+}
+
+void PageResolver::countCompactPageNumbers()
+{
+	// Each texel of the pack target holds two page numbers, low byte first (RG, BA).
+	// With an odd feedback width, the last number of each row is padding.
+	const uint8_t * __restrict texels = reinterpret_cast<const uint8_t *>(feedbackBuffer.get());
+
+	for (int y = 0; y < pageIdFboHeight; ++y)
+	{
+		const uint8_t * __restrict row = texels + (y * packFboWidth * 4);
+		for (int x = 0; x < pageIdFboWidth; ++x)
+		{
+			const unsigned int pageNumber = row[x * 2] | (row[(x * 2) + 1] << 8);
+			if (pageNumber != InvalidCompactPageNumber)
+			{
+				compactPageMap[static_cast<uint16_t>(pageNumber)]++;
+			}
+		}
+	}
+
+	// Only the unique page numbers need to be decoded:
+	for (const auto & pagePair : compactPageMap)
+	{
+		const PageId pageId = decodeCompactPageNumber(pagePair.first);
+		if (pageId != InvalidPageId)
+		{
+			pageMap[pageId] += pagePair.second;
+		}
+	}
+	compactPageMap.clear();
+}
+
+void PageResolver::countChangedFeedbackBlocks()
+{
+	// Pixel layout of the read-back. Compact feedback packs two 16-bit
+	// page numbers per texel, so a pixel is 2 bytes and rows are padded.
+	const bool compact = compactFeedbackActive;
+	const size_t pixelBytes  = compact ? 2 : sizeof(PageId);
+	const size_t rowBytes    = compact ? (packFboWidth * 4) : (pageIdFboWidth * sizeof(PageId));
+	const uint32_t invalidValue = compact ? InvalidCompactPageNumber : InvalidPageId;
+
+	const uint8_t * __restrict curr = reinterpret_cast<const uint8_t *>(feedbackBuffer.get());
+	const uint8_t * __restrict prev = reinterpret_cast<const uint8_t *>(prevFeedbackBuffer.get());
+
+	if (!feedbackHistoryValid || feedbackHistoryCompact != compact)
+	{
+		resetFeedbackHistory();
+		blockHistograms.resize(feedbackBlocksX * feedbackBlocksY);
+		feedbackHistoryCompact = compact;
+	}
+
+	frameChangedBlocks = 0;
+	for (int by = 0; by < feedbackBlocksY; ++by)
+	{
+		const int y0 = by * FeedbackBlockSize;
+		const int y1 = std::min(y0 + FeedbackBlockSize, pageIdFboHeight);
+
+		for (int bx = 0; bx < feedbackBlocksX; ++bx)
+		{
+			const int x0 = bx * FeedbackBlockSize;
+			const int x1 = std::min(x0 + FeedbackBlockSize, pageIdFboWidth);
+			const size_t blockRowBytes = (x1 - x0) * pixelBytes;
+
+			// memcmp is vectorized by the C library, and most blocks are identical,
+			// so the early exit on the first differing row rarely triggers.
+			bool changed = !feedbackHistoryValid;
+			for (int y = y0; (y < y1 && !changed); ++y)
+			{
+				const size_t offset = (y * rowBytes) + (x0 * pixelBytes);
+				changed = std::memcmp(curr + offset, prev + offset, blockRowBytes) != 0;
+			}
+			if (!changed)
+			{
+				continue;
+			}
+			++frameChangedBlocks;
+
+			// Take the block's old counts out of the histogram:
+			std::vector<FeedbackCount> & blockHist = blockHistograms[(by * feedbackBlocksX) + bx];
+			for (const FeedbackCount & count : blockHist)
+			{
+				const auto entry = feedbackHistogram.find(count.first);
+				assert(entry != feedbackHistogram.end() && entry->second >= count.second);
+				if ((entry->second -= count.second) == 0)
+				{
+					feedbackHistogram.erase(entry);
+				}
+			}
+			blockHist.clear();
+
+			// Count the block again. Blocks hold a handful of pages at most,
+			// in runs, so a linear search with the last hit cached is enough.
+			size_t lastHit = 0;
+			for (int y = y0; y < y1; ++y)
+			{
+				const uint8_t * __restrict row = curr + (y * rowBytes);
+				for (int x = x0; x < x1; ++x)
+				{
+					uint32_t value;
+					if (compact)
+					{
+						value = row[x * 2] | (row[(x * 2) + 1] << 8);
+					}
+					else
+					{
+						value = reinterpret_cast<const PageId *>(row)[x];
+					}
+
+					if (value == invalidValue)
+					{
+						continue;
+					}
+
+					if (lastHit < blockHist.size() && blockHist[lastHit].first == value)
+					{
+						blockHist[lastHit].second++;
+						continue;
+					}
+
+					lastHit = 0;
+					while (lastHit < blockHist.size() && blockHist[lastHit].first != value)
+					{
+						++lastHit;
+					}
+					if (lastHit == blockHist.size())
+					{
+						blockHist.emplace_back(value, 0);
+					}
+					blockHist[lastHit].second++;
+				}
+			}
+
+			// And put the new ones in:
+			for (const FeedbackCount & count : blockHist)
+			{
+				feedbackHistogram[count.first] += count.second;
+			}
+		}
+	}
+
+	// This frame's read-back is the next one's reference:
+	std::swap(feedbackBuffer, prevFeedbackBuffer);
+	feedbackHistoryValid = true;
+
+	// Unique values into the page map, decoding them in compact mode:
+	for (const auto & valuePair : feedbackHistogram)
+	{
+		const PageId pageId = compact ? decodeCompactPageNumber(valuePair.first) : valuePair.first;
+		if (pageId != InvalidPageId)
+		{
+			pageMap[pageId] += valuePair.second;
+		}
+	}
+}
+
+void PageResolver::resetFeedbackHistory()
+{
+	blockHistograms.clear();
+	feedbackHistogram.clear();
+	feedbackHistoryValid = false;
+	frameChangedBlocks = 0;
+}
+
 int PageResolver::processPageRequest(const PageId requestId, PageCacheMgr & pageCache)
 {
 	// Lookup the page, returning 'Cached' if available and incrementing its use count.
@@ -285,8 +950,10 @@ int PageResolver::processPageRequest(const PageId requestId, PageCacheMgr & page
 	{
 		if (pageProvider.addPageRequest(requestId))
 		{
+			++frameNewRequests;
 			return 1; // One new request added.
 		}
+		++frameDroppedRequests;
 
 		// PageProvider couldn't fit another request.
 		// Tell to cache to restore the reference count:
@@ -305,12 +972,49 @@ void PageResolver::addDefaultRequests()
 	// request according to its mip-level count.
 	for (auto vtTex : registeredTextures)
 	{
+		if (vtTex == nullptr)
+		{
+			continue;
+		}
+
 		const unsigned int maxMip = vtTex->getNumLevels() - 1;
 		const unsigned int texId  = vtTex->getTextureIndex();
 		processPageRequest(makePageId(0, 0, maxMip, texId), *vtTex->getPageCache());
 	}
 }
 
+size_t PageResolver::getSystemMemoryBytes() const
+{
+	// Each node of the map holds the key/value pair plus a link (and possibly a cached hash).
+	const size_t mapNodeBytes = sizeof(std::pair<const PageId, unsigned int>) + sizeof(void *) + sizeof(size_t);
+
+	const size_t compactNodeBytes = sizeof(std::pair<const uint16_t, unsigned int>) + sizeof(void *) + sizeof(size_t);
+	const size_t histogramNodeBytes = sizeof(std::pair<const uint32_t, unsigned int>) + sizeof(void *) + sizeof(size_t);
+
+	size_t blockHistogramEntries = 0;
+	for (const auto & blockHist : blockHistograms)
+	{
+		blockHistogramEntries += blockHist.capacity();
+	}
+
+	return (pageIdFboWidth * pageIdFboHeight * sizeof(Pixel4b))
+	     + (pageMap.bucket_count() * sizeof(void *)) + (pageMap.size() * mapNodeBytes)
+	     + (compactPageMap.bucket_count() * sizeof(void *)) + (compactPageMap.size() * compactNodeBytes)
+	     + (compactPageBases.capacity() * sizeof(int))
+	     + (prevFeedbackBuffer != nullptr ? (pageIdFboWidth * pageIdFboHeight * sizeof(Pixel4b)) : 0)
+	     + (blockHistograms.capacity() * sizeof(std::vector<FeedbackCount>)) + (blockHistogramEntries * sizeof(FeedbackCount))
+	     + (feedbackHistogram.bucket_count() * sizeof(void *)) + (feedbackHistogram.size() * histogramNodeBytes)
+	     + (sortedPages.capacity() * sizeof(PageId))
+	     + (missingPages.capacity() * sizeof(MissingPage))
+	     + (registeredTextures.capacity() * sizeof(VirtualTexture *));
+}
+
+size_t PageResolver::getGpuMemoryBytes() const
+{
+	return (pageIdFboWidth * pageIdFboHeight * (sizeof(Pixel4b) + sizeof(uint16_t)))
+	     + (packFboWidth * pageIdFboHeight * sizeof(Pixel4b));
+}
+
 void PageResolver::initFrameBuffer(const int w, const int h)
 {
 	assert(w > 0);
@@ -370,13 +1074,80 @@ void PageResolver::initFrameBuffer(const int w, const int h)
 		vtFatalError("Failed to create OpenGL framebuffer: " << errStr);
 	}
 
+	// Compact feedback target, if the GPU can handle it:
+	initPackFrameBuffer();
+
 	gl::useRenderBuffer(originalRbo);
 	gl::useFrameBuffer(originalFbo);
 
 	feedbackBuffer.reset(new Pixel4b[pageIdFboWidth * pageIdFboHeight]);
+	prevFeedbackBuffer.reset(new Pixel4b[pageIdFboWidth * pageIdFboHeight]);
+
+	feedbackBlocksX = (pageIdFboWidth  + FeedbackBlockSize - 1) / FeedbackBlockSize;
+	feedbackBlocksY = (pageIdFboHeight + FeedbackBlockSize - 1) / FeedbackBlockSize;
+	resetFeedbackHistory();
 
 	vtLogComment("PageResolver feedback framebuffer initialized! Size: "
 			<< pageIdFboWidth << "x" << pageIdFboHeight << " pixels.");
 }
 
+void PageResolver::initPackFrameBuffer()
+{
+	// Page numbers use up to 16 bits, which mediump floats can't represent exactly.
+	GLint range[2] = { 0, 0 };
+	GLint precision = 0;
+	glGetShaderPrecisionFormat(GL_FRAGMENT_SHADER, GL_HIGH_FLOAT, range, &precision);
+	if (precision < 16)
+	{
+		vtLogComment("No highp float support in fragment shaders. Compact page feedback disabled.");
+		return;
+	}
+
+	packFboWidth = (pageIdFboWidth + 1) / 2;
+	packColorTex = gl::create2DTexture(
+		packFboWidth,
+		pageIdFboHeight,
+		GL_RGBA,
+		GL_UNSIGNED_BYTE,
+		GL_CLAMP_TO_EDGE,
+		GL_CLAMP_TO_EDGE,
+		GL_NEAREST,
+		GL_NEAREST,
+		nullptr);
+
+	packFbo = gl::createFrameBuffer(
+		packFboWidth, pageIdFboHeight,
+		/* defaultDepthBuffer   = */ false,
+		/* defaultStencilBuffer = */ false);
+
+	std::string errStr;
+	if (packColorTex != 0 && packFbo != 0)
+	{
+		gl::attachTextureToFrameBuffer(packFbo, packColorTex, 0, GL_TEXTURE_2D, GL_COLOR_ATTACHMENT0);
+	}
+	if (packColorTex == 0 || packFbo == 0 || !gl::validateFrameBuffer(packFbo, &errStr))
+	{
+		// Not fatal. We just stay with the wide page ids.
+		vtLogWarning("Failed to create compact feedback framebuffer: " << errStr);
+		gl::deleteFrameBuffer(packFbo);
+		gl::delete2DTexture(packColorTex);
+		packFbo      = 0;
+		packColorTex = 0;
+		packFboWidth = 0;
+		return;
+	}
+
+	// The source size never changes:
+	const float srcSize[] = { static_cast<float>(pageIdFboWidth), static_cast<float>(pageIdFboHeight) };
+	gl::useShaderProgram(getGlobalShaders().pageIdPack.programId);
+	gl::setShaderProgramUniform(getGlobalShaders().pageIdPack.unifSrcSize, srcSize, 2);
+	gl::useShaderProgram(0);
+
+	compactFeedbackSupported = true;
+	updateCompactFeedbackLayout();
+
+	vtLogComment("PageResolver compact feedback framebuffer initialized! Size: "
+			<< packFboWidth << "x" << pageIdFboHeight << " pixels.");
+}
+
 } // namespace vt {}
@@ -0,0 +1,560 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: vt_page_sampler.cpp
+// Author: Guilherme R. Lampert
+// Created on: 18/10/26
+// Brief: CPU-side sampling of virtual textures, for non-rendering consumers.
+//
+// License:
+//  This source code is released under the MIT License.
+//  Copyright (c) 2014 Guilherme R. Lampert.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+// ================================================================================================
+
+#include "vt.hpp"
+#include "vt_page_sampler.hpp"
+#include <dispatch/dispatch.h> // Apple's GCD
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// SIMD path for the address translation:
+#if defined(__SSE2__)
+	#define VT_SAMPLER_SSE2 1
+	#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+	#define VT_SAMPLER_NEON 1
+	#include <arm_neon.h>
+#endif // SIMD
+
+namespace vt
+{
+
+// ======================================================
+// Local helpers:
+// ======================================================
+
+namespace {
+
+using SamplerClock = std::chrono::steady_clock;
+
+// Page layout. Texels sampled are always inside the content area or its border.
+constexpr int   pageSize        = PageTable::PageSizeInPixels;
+constexpr int   pageBorder      = PageTable::PageBorderSizeInPixels;
+constexpr float pageContentSize = static_cast<float>(pageSize - 2 * pageBorder);
+constexpr float texelBias       = static_cast<float>(pageBorder) - 0.5f;
+
+inline float clampUnit(const float x)
+{
+	return (x < 0.0f) ? 0.0f : ((x > 1.0f) ? 1.0f : x);
+}
+
+inline void writeGrey(float * rgbaOut)
+{
+	rgbaOut[0] = 0.5f;
+	rgbaOut[1] = 0.5f;
+	rgbaOut[2] = 0.5f;
+	rgbaOut[3] = 1.0f;
+}
+
+// Bilinear blend of 4 RGBA8 texels, output in [0,1].
+inline void bilinearBlend(const Pixel4b & t00, const Pixel4b & t10, const Pixel4b & t01, const Pixel4b & t11,
+                          const float fx, const float fy, float * rgbaOut)
+{
+	const float w00 = (1.0f - fx) * (1.0f - fy) * (1.0f / 255.0f);
+	const float w10 = fx * (1.0f - fy) * (1.0f / 255.0f);
+	const float w01 = (1.0f - fx) * fy * (1.0f / 255.0f);
+	const float w11 = fx * fy * (1.0f / 255.0f);
+
+	rgbaOut[0] = t00.r * w00 + t10.r * w10 + t01.r * w01 + t11.r * w11;
+	rgbaOut[1] = t00.g * w00 + t10.g * w10 + t01.g * w01 + t11.g * w11;
+	rgbaOut[2] = t00.b * w00 + t10.b * w10 + t01.b * w01 + t11.b * w11;
+	rgbaOut[3] = t00.a * w00 + t10.a * w10 + t01.a * w01 + t11.a * w11;
+}
+
+} // namespace {}
+
+// ======================================================
+// PageSampler:
+// ======================================================
+
+PageSampler::PageSampler(const int cacheSizeInPages)
+	: maxCachedPages(std::max(cacheSizeInPages, 1))
+	, useCounter(0)
+{
+	clearPodObject(stats);
+	cachedPages.reserve(maxCachedPages);
+
+	vtLogComment("New PageSampler with room for " << maxCachedPages << " pages.");
+}
+
+PageSampler::~PageSampler()
+{
+	// Loads in flight hold a pointer to us.
+	std::unique_lock<std::mutex> lock(cacheMutex);
+	pageLoadedCond.wait(lock, [this] { return pendingPages.empty(); });
+}
+
+int PageSampler::levelPages(const VirtualTexture & vtTex, const int level, const int axis, const int mipOffset)
+{
+	const int level0Pages = static_cast<int>(vtTex.getLevel0SizeInPages()[axis]);
+	return std::max(level0Pages >> std::min(level + mipOffset, vtTex.getNumLevels() - 1), 1);
+}
+
+PageSampler::PageKey PageSampler::makePageKey(const VirtualTexture & vtTex, const PageFile * pageFile,
+                                              const SampleAddress & addr, const int level, const int mipOffset)
+{
+	// The texture index only matters to the DebugPageFile, but keep it right.
+	const int texIndex = std::max(vtTex.getTextureIndex(), 0);
+
+	// Reduced layers are addressed with the id of the first base page
+	// covered by the reduced page. The ReducedLayerPageFile maps it back.
+	const int shift = std::min(level + mipOffset, vtTex.getNumLevels() - 1) - level;
+	return { pageFile, makePageId(addr.pageX << shift, addr.pageY << shift, level, texIndex) };
+}
+
+void PageSampler::translateAddresses(const float * uvs, const int count, const int pagesX, const int pagesY,
+                                     const float * uvScale, SampleAddress * addresses)
+{
+	static_assert(sizeof(SampleAddress) == 16, "SampleAddress is stored with 16 byte SIMD writes!");
+
+	int i = 0;
+
+#if defined(VT_SAMPLER_SSE2)
+	// Each register holds two [u,v] pairs.
+	const __m128 zero     = _mm_setzero_ps();
+	const __m128 one      = _mm_set1_ps(1.0f);
+	const __m128 scale    = _mm_setr_ps(pagesX * uvScale[0], pagesY * uvScale[1], pagesX * uvScale[0], pagesY * uvScale[1]);
+	const __m128 maxPage  = _mm_setr_ps(float(pagesX - 1), float(pagesY - 1), float(pagesX - 1), float(pagesY - 1));
+	const __m128 content  = _mm_set1_ps(pageContentSize);
+	const __m128 bias     = _mm_set1_ps(texelBias);
+
+	for (; (i + 2) <= count; i += 2)
+	{
+		const __m128 uv    = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(uvs + i * 2), zero), one);
+		const __m128 pos   = _mm_mul_ps(uv, scale);
+		const __m128 page  = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(pos)), maxPage);
+		const __m128 texel = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(pos, page), content), bias);
+
+		const __m128i pageInt  = _mm_cvttps_epi32(page);
+		const __m128i texelInt = _mm_castps_si128(texel);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(&addresses[i + 0]), _mm_unpacklo_epi64(pageInt, texelInt));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(&addresses[i + 1]), _mm_unpackhi_epi64(pageInt, texelInt));
+	}
+#elif defined(VT_SAMPLER_NEON)
+	const float scaleArr[]   = { pagesX * uvScale[0], pagesY * uvScale[1], pagesX * uvScale[0], pagesY * uvScale[1] };
+	const float maxPageArr[] = { float(pagesX - 1), float(pagesY - 1), float(pagesX - 1), float(pagesY - 1) };
+	const float32x4_t zero    = vdupq_n_f32(0.0f);
+	const float32x4_t one     = vdupq_n_f32(1.0f);
+	const float32x4_t scale   = vld1q_f32(scaleArr);
+	const float32x4_t maxPage = vld1q_f32(maxPageArr);
+	const float32x4_t content = vdupq_n_f32(pageContentSize);
+	const float32x4_t bias    = vdupq_n_f32(texelBias);
+
+	for (; (i + 2) <= count; i += 2)
+	{
+		const float32x4_t uv    = vminq_f32(vmaxq_f32(vld1q_f32(uvs + i * 2), zero), one);
+		const float32x4_t pos   = vmulq_f32(uv, scale);
+		const float32x4_t page  = vminq_f32(vcvtq_f32_s32(vcvtq_s32_f32(pos)), maxPage);
+		const float32x4_t texel = vmlaq_f32(bias, vsubq_f32(pos, page), content);
+
+		const int32x4_t pageInt  = vcvtq_s32_f32(page);
+		const int32x4_t texelInt = vreinterpretq_s32_f32(texel);
+		vst1q_s32(reinterpret_cast<int32_t *>(&addresses[i + 0]), vcombine_s32(vget_low_s32(pageInt),  vget_low_s32(texelInt)));
+		vst1q_s32(reinterpret_cast<int32_t *>(&addresses[i + 1]), vcombine_s32(vget_high_s32(pageInt), vget_high_s32(texelInt)));
+	}
+#endif // SIMD
+
+	for (; i < count; ++i)
+	{
+		const float posX = clampUnit(uvs[i * 2 + 0]) * (pagesX * uvScale[0]);
+		const float posY = clampUnit(uvs[i * 2 + 1]) * (pagesY * uvScale[1]);
+
+		SampleAddress & addr = addresses[i];
+		addr.pageX  = std::min(static_cast<int>(posX), pagesX - 1);
+		addr.pageY  = std::min(static_cast<int>(posY), pagesY - 1);
+		addr.texelX = (posX - addr.pageX) * pageContentSize + texelBias;
+		addr.texelY = (posY - addr.pageY) * pageContentSize + texelBias;
+	}
+}
+
+void PageSampler::samplePage(const Pixel4b * pageData, const SampleAddress & addr, float * rgbaOut)
+{
+	// Positions are always inside the border, so the 2x2 footprint never leaves the page.
+	const int x0 = static_cast<int>(addr.texelX);
+	const int y0 = static_cast<int>(addr.texelY);
+	assert(x0 >= 0 && (x0 + 1) < pageSize);
+	assert(y0 >= 0 && (y0 + 1) < pageSize);
+
+	const Pixel4b * row0 = pageData + y0 * pageSize + x0;
+	const Pixel4b * row1 = row0 + pageSize;
+	bilinearBlend(row0[0], row0[1], row1[0], row1[1], addr.texelX - x0, addr.texelY - y0, rgbaOut);
+}
+
+void PageSampler::sampleMipTail(const MipTailData & tail, const float * uv, const float * uvScale, float * rgbaOut)
+{
+	// Largest level of the tail, clamped at the edges.
+	// The tail covers the whole page area, like the pages.
+	const float posX = std::max(clampUnit(uv[0]) * uvScale[0] * tail.width  - 0.5f, 0.0f);
+	const float posY = std::max(clampUnit(uv[1]) * uvScale[1] * tail.height - 0.5f, 0.0f);
+
+	const int x0 = std::min(static_cast<int>(posX), tail.width  - 1);
+	const int y0 = std::min(static_cast<int>(posY), tail.height - 1);
+	const int x1 = std::min(x0 + 1, tail.width  - 1);
+	const int y1 = std::min(y0 + 1, tail.height - 1);
+
+	const Pixel4b * pixels = tail.pixels.data();
+	bilinearBlend(pixels[x0 + y0 * tail.width], pixels[x1 + y0 * tail.width],
+	              pixels[x0 + y1 * tail.width], pixels[x1 + y1 * tail.width],
+	              posX - x0, posY - y0, rgbaOut);
+}
+
+const Pixel4b * PageSampler::findPage(const PageKey & key)
+{
+	auto it = cachedPages.find(key);
+	if (it == cachedPages.end())
+	{
+		return nullptr;
+	}
+
+	it->second.lastUsed = ++useCounter;
+	return it->second.data->pageData;
+}
+
+void PageSampler::requestPageLoad(PageFile * pageFile, const PageKey & key, const unsigned int fileIndex)
+{
+	if (!pendingPages.insert(key).second)
+	{
+		return; // Already on its way.
+	}
+
+	LoadContext * context = new LoadContext{ this, pageFile, key, fileIndex };
+	dispatch_async_f(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), context, &PageSampler::pageLoadTask);
+}
+
+void PageSampler::pageLoadTask(void * param)
+{
+	std::unique_ptr<LoadContext> context(reinterpret_cast<LoadContext *>(param));
+	assert(context->sampler  != nullptr);
+	assert(context->pageFile != nullptr);
+
+	std::unique_ptr<PageRequestDataPacket> pageRequest(new PageRequestDataPacket);
+	pageRequest->pageId = context->key.pageId;
+	pageRequest->fileId = context->fileId;
+
+	context->pageFile->loadPage(context->key.pageId, *pageRequest);
+	context->sampler->insertLoadedPage(context->key, std::move(pageRequest));
+}
+
+void PageSampler::insertLoadedPage(const PageKey & key, std::unique_ptr<PageRequestDataPacket> data)
+{
+	// Notified with the lock held, so a destructor waiting
+	// for the last load can't run before we are done.
+	std::lock_guard<std::mutex> lock(cacheMutex);
+
+	if (static_cast<int>(cachedPages.size()) >= maxCachedPages)
+	{
+		// Evict the least recently used. Loads are rare next to samples,
+		// and the cache is small, so a linear search is fine here.
+		auto lru = cachedPages.begin();
+		for (auto it = cachedPages.begin(); it != cachedPages.end(); ++it)
+		{
+			if (it->second.lastUsed < lru->second.lastUsed)
+			{
+				lru = it;
+			}
+		}
+		cachedPages.erase(lru);
+		++stats.pageEvictions;
+	}
+
+	CachedPage & page = cachedPages[key];
+	page.data     = std::move(data);
+	page.lastUsed = ++useCounter;
+
+	pendingPages.erase(key);
+	++stats.pageLoads;
+
+	pageLoadedCond.notify_all();
+}
+
+const MipTailData * PageSampler::findMipTail(PageFile * pageFile, std::unique_lock<std::mutex> & lock)
+{
+	auto it = mipTails.find(pageFile);
+	if (it == mipTails.end())
+	{
+		// Loaded once per page file, without holding the lock, since it is file I/O.
+		// Null if the file has no tail. If another thread got there first, its tail is kept.
+		lock.unlock();
+		std::unique_ptr<MipTailData> tail(new MipTailData);
+		if (!pageFile->loadMipTail(*tail) || tail->pixels.empty())
+		{
+			tail.reset();
+		}
+		lock.lock();
+		it = mipTails.emplace(pageFile, std::move(tail)).first;
+	}
+	return it->second.get();
+}
+
+void PageSampler::sampleBestResident(const VirtualTexture & vtTex, PageFile * pageFile, const int mipOffset,
+                                     const float * uv, const int firstLevel, float * rgbaOut, int & servedLevel,
+                                     std::unique_lock<std::mutex> & lock)
+{
+	for (int level = firstLevel; level < vtTex.getNumLevels(); ++level)
+	{
+		SampleAddress addr;
+		translateAddresses(uv, 1, levelPages(vtTex, level, 0, mipOffset), levelPages(vtTex, level, 1, mipOffset),
+		                   vtTex.getUVScale(), &addr);
+
+		const Pixel4b * pageData = findPage(makePageKey(vtTex, pageFile, addr, level, mipOffset));
+		if (pageData != nullptr)
+		{
+			samplePage(pageData, addr, rgbaOut);
+			servedLevel = level;
+			return;
+		}
+	}
+
+	const MipTailData * tail = findMipTail(pageFile, lock);
+	if (tail != nullptr)
+	{
+		sampleMipTail(*tail, uv, vtTex.getUVScale(), rgbaOut);
+	}
+	else
+	{
+		writeGrey(rgbaOut);
+	}
+	servedLevel = MipTailLevel;
+}
+
+int PageSampler::sample(VirtualTexture & vtTex, const float * uvs, const int count, const int mipLevel,
+                        float * rgbaOut, int * servedLevels, const unsigned int fileIndex,
+                        const MissPolicy missPolicy, const int timeoutMs)
+{
+	assert(uvs     != nullptr);
+	assert(rgbaOut != nullptr);
+	assert(fileIndex < vtTex.getNumPageFiles());
+
+	if (count <= 0)
+	{
+		return 0;
+	}
+
+	const SamplerClock::time_point startTime = SamplerClock::now();
+	const int level  = std::min(std::max(mipLevel, 0), vtTex.getNumLevels() - 1);
+	const int offset = vtTex.getLayerMipOffset(fileIndex);
+	const int pagesX = levelPages(vtTex, level, 0, offset);
+	const int pagesY = levelPages(vtTex, level, 1, offset);
+	PageFile * pageFile = vtTex.getPageFile(fileIndex);
+
+	std::vector<SampleAddress> addresses(count);
+	translateAddresses(uvs, count, pagesX, pagesY, vtTex.getUVScale(), addresses.data());
+
+	std::unique_lock<std::mutex> lock(cacheMutex);
+
+	if (missPolicy == MissPolicy::Block)
+	{
+		// Request every missing page of the batch, then wait for them.
+		std::vector<PageKey> waitKeys;
+		PageKey lastKey = { nullptr, InvalidPageId };
+		for (int i = 0; i < count; ++i)
+		{
+			const PageKey key = makePageKey(vtTex, pageFile, addresses[i], level, offset);
+			if (key == lastKey)
+			{
+				continue;
+			}
+			lastKey = key;
+
+			if ((cachedPages.find(key) == cachedPages.end()) &&
+			    (std::find(waitKeys.begin(), waitKeys.end(), key) == waitKeys.end()))
+			{
+				requestPageLoad(pageFile, key, fileIndex);
+				waitKeys.push_back(key);
+			}
+		}
+
+		if (!waitKeys.empty())
+		{
+			const bool allLoaded = pageLoadedCond.wait_until(lock,
+				startTime + std::chrono::milliseconds(timeoutMs), [this, &waitKeys]
+				{
+					for (const PageKey & key : waitKeys)
+					{
+						if (pendingPages.count(key) != 0)
+						{
+							return false;
+						}
+					}
+					return true;
+				});
+
+			if (!allLoaded)
+			{
+				++stats.blockTimeouts;
+			}
+		}
+	}
+
+	// Samples are usually coherent, so remember the last page looked up.
+	PageKey lastKey = { nullptr, InvalidPageId };
+	const Pixel4b * lastPage = nullptr;
+	int numServed = 0;
+
+	for (int i = 0; i < count; ++i)
+	{
+		const PageKey key = makePageKey(vtTex, pageFile, addresses[i], level, offset);
+		if (!(key == lastKey))
+		{
+			lastKey  = key;
+			lastPage = findPage(key);
+		}
+
+		float * rgba = rgbaOut + i * 4;
+		int servedLevel = level;
+
+		if (lastPage != nullptr)
+		{
+			samplePage(lastPage, addresses[i], rgba);
+			++numServed;
+		}
+		else
+		{
+			// May drop the lock to read the mip tail. 'lastPage' is null here, so nothing goes stale.
+			requestPageLoad(pageFile, key, fileIndex);
+			sampleBestResident(vtTex, pageFile, offset, uvs + i * 2, level + 1, rgba, servedLevel, lock);
+			++stats.fallbackSamples;
+		}
+
+		if (servedLevels != nullptr)
+		{
+			servedLevels[i] = servedLevel;
+		}
+	}
+
+	stats.samples += count;
+	stats.sampleSeconds += std::chrono::duration<double>(SamplerClock::now() - startTime).count();
+	return numServed;
+}
+
+void PageSampler::prefetch(VirtualTexture & vtTex, const float * uvs, const int count,
+                           const int mipLevel, const unsigned int fileIndex)
+{
+	assert(uvs != nullptr);
+	assert(fileIndex < vtTex.getNumPageFiles());
+
+	if (count <= 0)
+	{
+		return;
+	}
+
+	const int level  = std::min(std::max(mipLevel, 0), vtTex.getNumLevels() - 1);
+	const int offset = vtTex.getLayerMipOffset(fileIndex);
+	PageFile * pageFile = vtTex.getPageFile(fileIndex);
+
+	std::vector<SampleAddress> addresses(count);
+	translateAddresses(uvs, count, levelPages(vtTex, level, 0, offset), levelPages(vtTex, level, 1, offset),
+	                   vtTex.getUVScale(), addresses.data());
+
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	for (int i = 0; i < count; ++i)
+	{
+		const PageKey key = makePageKey(vtTex, pageFile, addresses[i], level, offset);
+		if (cachedPages.find(key) == cachedPages.end())
+		{
+			requestPageLoad(pageFile, key, fileIndex);
+		}
+	}
+}
+
+void PageSampler::purgeCache()
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	cachedPages.clear();
+	mipTails.clear();
+}
+
+void PageSampler::forgetPageFile(const PageFile * pageFile)
+{
+	std::unique_lock<std::mutex> lock(cacheMutex);
+
+	pageLoadedCond.wait(lock, [this, pageFile]
+	{
+		for (const PageKey & key : pendingPages)
+		{
+			if (key.pageFile == pageFile)
+			{
+				return false;
+			}
+		}
+		return true;
+	});
+
+	for (auto it = cachedPages.begin(); it != cachedPages.end(); )
+	{
+		if (it->first.pageFile == pageFile)
+		{
+			it = cachedPages.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+	mipTails.erase(pageFile);
+}
+
+PageSampler::Stats PageSampler::getStats() const
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+
+	Stats result = stats;
+	result.samplesPerSecond = (result.sampleSeconds > 0.0) ? (result.samples / result.sampleSeconds) : 0.0;
+	result.cachedPages  = static_cast<int>(cachedPages.size());
+	result.pendingLoads = static_cast<int>(pendingPages.size());
+	return result;
+}
+
+void PageSampler::resetStats()
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	clearPodObject(stats);
+}
+
+size_t PageSampler::getMemoryBytes() const
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+
+	size_t bytes = cachedPages.size() * (sizeof(PageRequestDataPacket) + sizeof(CachedPage) + sizeof(PageKey));
+	for (const auto & tail : mipTails)
+	{
+		if (tail.second != nullptr)
+		{
+			bytes += tail.second->pixels.size() * sizeof(Pixel4b);
+		}
+	}
+	return bytes;
+}
+
+} // namespace vt {}
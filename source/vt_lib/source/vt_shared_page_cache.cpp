@@ -0,0 +1,636 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: vt_shared_page_cache.cpp
+// Author: Guilherme R. Lampert
+// Created on: 18/10/26
+// Brief: Host-wide page cache in POSIX shared memory, shared by renderer processes.
+//
+// License:
+//  This source code is released under the MIT License.
+//  Copyright (c) 2014 Guilherme R. Lampert.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+// ================================================================================================
+
+#include "vt.hpp"
+#include "vt_shared_page_cache.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+
+// POSIX shared memory:
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// The segment is shared between processes, so every atomic in it must be
+// address-free. That is only guaranteed for the lock-free ones.
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+              "SharedPageCache needs lock-free 32 and 64 bits atomics!");
+
+namespace vt
+{
+
+// ======================================================
+// Segment layout:
+// ======================================================
+
+//
+// [SegmentHeader][SetInfo x numSets][SlotInfo x numSlots][page data x numSlots]
+//
+// The page data starts at a 16KB aligned offset (the largest VM page size
+// of the supported platforms). A fresh segment is
+// zero filled, which is a valid initial state for every field: all
+// slots Empty, all counters zero and 'initialized' not yet set.
+//
+struct SharedPageCache::SegmentHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t numSlots;
+	uint32_t waysPerSet;
+	uint32_t pageBytes;
+	uint32_t dataOffset;
+
+	// Set last by the creating process. Attaching processes wait for it.
+	std::atomic<uint32_t> initialized;
+
+	std::atomic<uint64_t> hits;
+	std::atomic<uint64_t> misses;
+	std::atomic<uint64_t> loadWaits;
+	std::atomic<uint64_t> waitTimeouts;
+	std::atomic<uint64_t> publishes;
+	std::atomic<uint64_t> evictions;
+	std::atomic<uint64_t> staleReclaims;
+};
+
+struct SharedPageCache::SetInfo
+{
+	// Bumped by every reservation made in the set.
+	std::atomic<uint32_t> reserveSeq;
+};
+
+struct SharedPageCache::SlotInfo
+{
+	// [generation:32][unused:6][state:2][readers:24]. See the slot helpers below.
+	std::atomic<uint64_t> control;
+
+	// Key of the page. Only written while the slot is Claimed.
+	std::atomic<uint64_t> fileKey;
+	std::atomic<uint32_t> pageKey;
+
+	// Clock of the last hit or publish (LRU victim selection) and of the reservation (staleness).
+	std::atomic<uint32_t> lastUseMs;
+	std::atomic<uint32_t> reservedMs;
+	uint32_t padding;
+};
+
+namespace {
+
+constexpr uint32_t segmentMagic   = 0x43505456; // 'VTPC'
+constexpr uint32_t segmentVersion = 1;
+constexpr uint32_t pageBytes      = sizeof(Pixel4b) * PageRequestDataPacket::TotalPagePixels;
+
+// Slot states:
+//  Empty   - Free. Never held a page, or its reservation was cancelled.
+//  Claimed - Owned by one process, which is writing its key or page data. Invisible to lookups.
+//  Loading - Key is set, page is being read from the page file by the reserving process.
+//  Ready   - Holds a page. Can be pinned by readers and, when it has none, recycled.
+enum SlotState : uint64_t
+{
+	SlotEmpty   = 0,
+	SlotClaimed = 1,
+	SlotLoading = 2,
+	SlotReady   = 3
+};
+
+constexpr uint64_t readersMask = 0x00FFFFFF;
+constexpr int      stateShift  = 24;
+constexpr int      genShift    = 32;
+
+inline uint64_t makeControl(const uint64_t state, const uint32_t generation) noexcept
+{
+	return (uint64_t(generation) << genShift) | (state << stateShift);
+}
+
+inline uint64_t controlState(const uint64_t control) noexcept
+{
+	return (control >> stateShift) & 3;
+}
+
+inline uint32_t controlGeneration(const uint64_t control) noexcept
+{
+	return static_cast<uint32_t>(control >> genShift);
+}
+
+inline uint32_t controlReaders(const uint64_t control) noexcept
+{
+	return static_cast<uint32_t>(control & readersMask);
+}
+
+// Milliseconds of the steady clock, truncated. The steady clock is
+// the system-wide monotonic clock on the supported platforms, so
+// stamps can be compared across processes. Differences wrap correctly.
+inline uint32_t getSharedClockMs() noexcept
+{
+	using namespace std::chrono;
+	return static_cast<uint32_t>(duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+inline uint32_t getPageKey(const PageId pageId) noexcept
+{
+	// Drop the texture slot. It is local to each process.
+	return makePageId(pageIdExtractPageX(pageId), pageIdExtractPageY(pageId), pageIdExtractMipLevel(pageId), 0);
+}
+
+} // namespace {}
+
+// ======================================================
+// SharedPageCache:
+// ======================================================
+
+// How long an attaching process waits for the creator to size and initialize the segment.
+static constexpr uint32_t attachTimeoutMs = 2000;
+
+// Rounds of scan/reserve a lookup may lose to other processes before giving up on the cache.
+static constexpr int maxReserveRounds = 8;
+
+SharedPageCache::SharedPageCache(const std::string & name, const int slotCount, const int waitMs)
+	: mappedData(nullptr)
+	, segmentSize(0)
+	, header(nullptr)
+	, sets(nullptr)
+	, slots(nullptr)
+	, numSlots(0)
+	, numSets(0)
+	, loadWaitMs(std::max(waitMs, 0))
+	, segmentCreator(false)
+	, segmentName(name)
+{
+	const uint32_t ways = WaysPerSet;
+	const uint32_t requestedSlots = (static_cast<uint32_t>(std::max(slotCount, 1)) + ways - 1) / ways * ways;
+
+	// Whoever creates the segment sizes and initializes it. Everyone else attaches.
+	int fd = shm_open(segmentName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0660);
+	if (fd >= 0)
+	{
+		segmentCreator = true;
+		segmentSize = getDataOffset(requestedSlots) + size_t(requestedSlots) * pageBytes;
+
+		if (ftruncate(fd, static_cast<off_t>(segmentSize)) != 0)
+		{
+			const int error = errno;
+			close(fd);
+			shm_unlink(segmentName.c_str());
+			vtFatalError("Unable to size shared page cache \"" << segmentName << "\": " << std::strerror(error));
+		}
+	}
+	else if (errno == EEXIST)
+	{
+		fd = shm_open(segmentName.c_str(), O_RDWR, 0);
+		if (fd < 0)
+		{
+			vtFatalError("Unable to attach to shared page cache \"" << segmentName << "\": " << std::strerror(errno));
+		}
+
+		// The creator might not have sized it yet.
+		const uint32_t startMs = getSharedClockMs();
+		struct stat segmentStats;
+		for (;;)
+		{
+			if (fstat(fd, &segmentStats) != 0)
+			{
+				const int error = errno;
+				close(fd);
+				vtFatalError("Unable to stat shared page cache \"" << segmentName << "\": " << std::strerror(error));
+			}
+			if (segmentStats.st_size > 0)
+			{
+				break;
+			}
+			if ((getSharedClockMs() - startMs) > attachTimeoutMs)
+			{
+				close(fd);
+				vtFatalError("Shared page cache \"" << segmentName << "\" was never sized by its creator!");
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		segmentSize = static_cast<size_t>(segmentStats.st_size);
+	}
+	else
+	{
+		vtFatalError("Unable to create shared page cache \"" << segmentName << "\": " << std::strerror(errno));
+	}
+
+	void * mapping = mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd); // The mapping stays valid without the descriptor.
+
+	if (mapping == MAP_FAILED)
+	{
+		const int error = errno;
+		if (segmentCreator)
+		{
+			shm_unlink(segmentName.c_str());
+		}
+		segmentSize = 0;
+		vtFatalError("Failed to map shared page cache \"" << segmentName << "\": " << std::strerror(error));
+	}
+
+	mappedData = static_cast<uint8_t *>(mapping);
+	header     = reinterpret_cast<SegmentHeader *>(mappedData);
+
+	if (segmentCreator)
+	{
+		header->magic      = segmentMagic;
+		header->version    = segmentVersion;
+		header->numSlots   = requestedSlots;
+		header->waysPerSet = ways;
+		header->pageBytes  = pageBytes;
+		header->dataOffset = static_cast<uint32_t>(getDataOffset(requestedSlots));
+		header->initialized.store(1, std::memory_order_release);
+	}
+	else
+	{
+		// Wait for the creator to finish, then make sure we agree on the layout.
+		// On error, unmap before throwing, since the destructor won't run.
+		const uint32_t startMs = getSharedClockMs();
+		while (header->initialized.load(std::memory_order_acquire) == 0)
+		{
+			if ((getSharedClockMs() - startMs) > attachTimeoutMs)
+			{
+				unmap();
+				vtFatalError("Shared page cache \"" << segmentName << "\" was never initialized by its creator!");
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		const uint32_t slotsInSegment = header->numSlots;
+		if ((header->magic != segmentMagic) || (header->version != segmentVersion) ||
+		    (header->waysPerSet != ways) || (header->pageBytes != pageBytes) ||
+		    (slotsInSegment == 0) || (slotsInSegment % ways) != 0 ||
+		    (header->dataOffset != getDataOffset(slotsInSegment)) ||
+		    (getDataOffset(slotsInSegment) + size_t(slotsInSegment) * pageBytes) > segmentSize)
+		{
+			unmap();
+			vtFatalError("Shared page cache \"" << segmentName << "\" has an incompatible layout! "
+			             "Remove it with SharedPageCache::removeSegment() once no process is using it.");
+		}
+	}
+
+	numSlots = header->numSlots;
+	numSets  = numSlots / ways;
+	sets     = reinterpret_cast<SetInfo  *>(mappedData + sizeof(SegmentHeader));
+	slots    = reinterpret_cast<SlotInfo *>(mappedData + getSlotTableOffset(numSlots));
+
+	vtLogComment((segmentCreator ? "Created" : "Attached to") << " shared page cache \"" << segmentName
+			<< "\" with " << numSlots << " page slots (" << (segmentSize / 1024 / 1024) << "MB).");
+}
+
+SharedPageCache::~SharedPageCache()
+{
+	unmap();
+}
+
+void SharedPageCache::unmap()
+{
+	if (mappedData != nullptr)
+	{
+		munmap(mappedData, segmentSize);
+		mappedData = nullptr;
+		header     = nullptr;
+		sets       = nullptr;
+		slots      = nullptr;
+	}
+}
+
+bool SharedPageCache::removeSegment(const std::string & name)
+{
+	return shm_unlink(name.c_str()) == 0;
+}
+
+size_t SharedPageCache::getSlotTableOffset(const uint32_t slotCount)
+{
+	const size_t setTableEnd = sizeof(SegmentHeader) + size_t(slotCount / WaysPerSet) * sizeof(SetInfo);
+	return (setTableEnd + alignof(SlotInfo) - 1) & ~(alignof(SlotInfo) - 1);
+}
+
+size_t SharedPageCache::getDataOffset(const uint32_t slotCount)
+{
+	const size_t slotTableEnd = getSlotTableOffset(slotCount) + size_t(slotCount) * sizeof(SlotInfo);
+	return (slotTableEnd + 16383) & ~size_t(16383);
+}
+
+uint32_t SharedPageCache::getSetIndex(const uint64_t fileKey, const uint32_t pageKey) const
+{
+	// Neighboring pages of a file should land on unrelated sets. SplitMix64 finalizer.
+	uint64_t h = fileKey ^ (uint64_t(pageKey) * 0x9E3779B97F4A7C15ull);
+	h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+	h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+	h = h ^ (h >> 31);
+	return static_cast<uint32_t>(h % numSets);
+}
+
+uint8_t * SharedPageCache::getSlotData(const uint32_t slot) const
+{
+	return mappedData + header->dataOffset + size_t(slot) * pageBytes;
+}
+
+SharedPageCache::LookupResult SharedPageCache::lookupOrReserve(const uint64_t fileKey, const PageId pageId,
+                                                               Pixel4b * pageData, Reservation & reservation)
+{
+	assert(pageData != nullptr);
+	assert(fileKey  != 0);
+
+	const uint32_t pageKey  = getPageKey(pageId);
+	const uint32_t setIndex = getSetIndex(fileKey, pageKey);
+	std::atomic<uint32_t> & reserveSeq = sets[setIndex].reserveSeq;
+
+	bool     waiting     = false;
+	uint32_t waitStartMs = 0;
+
+	for (int round = 0; round < maxReserveRounds; )
+	{
+		uint32_t seq = reserveSeq.load(std::memory_order_acquire);
+
+		const ScanResult result = scanSet(setIndex, fileKey, pageKey, pageData);
+		if (result == ScanResult::Hit)
+		{
+			header->hits.fetch_add(1, std::memory_order_relaxed);
+			return LookupResult::Hit;
+		}
+
+		if (result == ScanResult::Loading)
+		{
+			// Another process is reading the page. Poll until it is published,
+			// or give up and read it too if that takes longer than the wait limit.
+			if (!waiting)
+			{
+				waiting     = true;
+				waitStartMs = getSharedClockMs();
+				header->loadWaits.fetch_add(1, std::memory_order_relaxed);
+			}
+			else if ((getSharedClockMs() - waitStartMs) >= static_cast<uint32_t>(loadWaitMs))
+			{
+				header->waitTimeouts.fetch_add(1, std::memory_order_relaxed);
+				header->misses.fetch_add(1, std::memory_order_relaxed);
+				return LookupResult::Uncached;
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(250));
+			continue;
+		}
+
+		// Not in the cache. If another reservation was made in the set since the scan,
+		// it might be for this page, so look again rather than evicting a page for nothing.
+		++round;
+		if (reserveSeq.load(std::memory_order_acquire) != seq)
+		{
+			continue;
+		}
+		if (!reserveSlot(setIndex, fileKey, pageKey, reservation))
+		{
+			break;
+		}
+
+		// The reservation only stands if nobody else reserved in the set meanwhile.
+		// If someone did, exactly one of us wins the counter, so a page is never reserved twice.
+		if (!reserveSeq.compare_exchange_strong(seq, seq + 1, std::memory_order_acq_rel))
+		{
+			cancel(reservation);
+			continue;
+		}
+
+		header->misses.fetch_add(1, std::memory_order_relaxed);
+		return LookupResult::Reserved;
+	}
+
+	// No free slot, or kept losing the set to other processes.
+	header->misses.fetch_add(1, std::memory_order_relaxed);
+	return LookupResult::Uncached;
+}
+
+SharedPageCache::ScanResult SharedPageCache::scanSet(const uint32_t setIndex, const uint64_t fileKey,
+                                                     const uint32_t pageKey, Pixel4b * pageData)
+{
+	const uint32_t firstSlot = setIndex * WaysPerSet;
+	const uint32_t endSlot   = firstSlot + WaysPerSet;
+	const uint32_t nowMs     = getSharedClockMs();
+	bool loading = false;
+
+	for (uint32_t s = firstSlot; s < endSlot; ++s)
+	{
+		SlotInfo & slot = slots[s];
+
+		uint64_t control = slot.control.load(std::memory_order_acquire);
+		const uint64_t state = controlState(control);
+		if (state == SlotEmpty)
+		{
+			continue;
+		}
+
+		if (slot.fileKey.load(std::memory_order_relaxed) != fileKey ||
+		    slot.pageKey.load(std::memory_order_relaxed) != pageKey)
+		{
+			continue;
+		}
+
+		// Loading, or Claimed by its loader to copy the page in. A Loading
+		// reservation that went stale will never be published, so it is ignored.
+		if (state != SlotReady)
+		{
+			if (state == SlotClaimed ||
+			    (nowMs - slot.reservedMs.load(std::memory_order_relaxed)) < static_cast<uint32_t>(StaleReservationMs))
+			{
+				loading = true;
+			}
+			continue;
+		}
+
+		// Pin the slot. The generation is part of the word swapped, so if the slot
+		// was recycled after the keys were read, the pin fails and the slot is skipped.
+		const uint32_t generation = controlGeneration(control);
+		bool pinned = false;
+		while (controlState(control) == SlotReady && controlGeneration(control) == generation &&
+		       controlReaders(control) != readersMask)
+		{
+			if (slot.control.compare_exchange_weak(control, control + 1, std::memory_order_acquire))
+			{
+				pinned = true;
+				break;
+			}
+		}
+		if (!pinned)
+		{
+			continue;
+		}
+
+		std::memcpy(pageData, getSlotData(s), pageBytes);
+		slot.lastUseMs.store(nowMs, std::memory_order_relaxed);
+		slot.control.fetch_sub(1, std::memory_order_release);
+		return ScanResult::Hit;
+	}
+
+	return loading ? ScanResult::Loading : ScanResult::NotFound;
+}
+
+bool SharedPageCache::reserveSlot(const uint32_t setIndex, const uint64_t fileKey,
+                                  const uint32_t pageKey, Reservation & reservation)
+{
+	const uint32_t firstSlot = setIndex * WaysPerSet;
+	const uint32_t endSlot   = firstSlot + WaysPerSet;
+	const uint32_t nowMs     = getSharedClockMs();
+
+	// A second try in case another process takes the chosen slot first.
+	for (int attempt = 0; attempt < 2; ++attempt)
+	{
+		// Victim: an Empty slot, else a stale Loading reservation, else the least recently used
+		// Ready slot without readers. Claimed slots and pinned slots are never taken.
+		uint32_t victim        = ~0u;
+		uint32_t victimAge     = 0;
+		uint64_t victimControl = 0;
+
+		for (uint32_t s = firstSlot; s < endSlot; ++s)
+		{
+			const SlotInfo & slot = slots[s];
+			const uint64_t control = slot.control.load(std::memory_order_acquire);
+			const uint64_t state   = controlState(control);
+
+			uint32_t age;
+			if (state == SlotEmpty)
+			{
+				victim        = s;
+				victimControl = control;
+				break;
+			}
+			else if (state == SlotReady && controlReaders(control) == 0)
+			{
+				age = nowMs - slot.lastUseMs.load(std::memory_order_relaxed);
+			}
+			else if (state == SlotLoading &&
+			         (nowMs - slot.reservedMs.load(std::memory_order_relaxed)) >= static_cast<uint32_t>(StaleReservationMs))
+			{
+				age = ~0u;
+			}
+			else
+			{
+				continue;
+			}
+
+			if (victim == ~0u || age >= victimAge)
+			{
+				victim        = s;
+				victimAge     = age;
+				victimControl = control;
+			}
+		}
+
+		if (victim == ~0u)
+		{
+			return false; // Everything in the set is busy.
+		}
+
+		SlotInfo & slot = slots[victim];
+		const uint32_t generation = controlGeneration(victimControl) + 1;
+		if (!slot.control.compare_exchange_strong(victimControl, makeControl(SlotClaimed, generation)))
+		{
+			continue;
+		}
+
+		if (controlState(victimControl) == SlotReady)
+		{
+			header->evictions.fetch_add(1, std::memory_order_relaxed);
+		}
+		else if (controlState(victimControl) == SlotLoading)
+		{
+			header->staleReclaims.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// Key first, then make it visible as Loading.
+		slot.fileKey.store(fileKey, std::memory_order_relaxed);
+		slot.pageKey.store(pageKey, std::memory_order_relaxed);
+		slot.reservedMs.store(nowMs, std::memory_order_relaxed);
+		slot.control.store(makeControl(SlotLoading, generation), std::memory_order_release);
+
+		reservation.slot       = victim;
+		reservation.generation = generation;
+		return true;
+	}
+
+	return false;
+}
+
+void SharedPageCache::publish(const Reservation & reservation, const Pixel4b * pageData)
+{
+	assert(pageData != nullptr);
+	assert(reservation.slot < numSlots);
+
+	// Take the slot back from Loading. Fails if it was reclaimed as stale.
+	SlotInfo & slot = slots[reservation.slot];
+	uint64_t expected = makeControl(SlotLoading, reservation.generation);
+	if (!slot.control.compare_exchange_strong(expected, makeControl(SlotClaimed, reservation.generation),
+	                                          std::memory_order_acquire))
+	{
+		return;
+	}
+
+	std::memcpy(getSlotData(reservation.slot), pageData, pageBytes);
+	slot.lastUseMs.store(getSharedClockMs(), std::memory_order_relaxed);
+	slot.control.store(makeControl(SlotReady, reservation.generation), std::memory_order_release);
+
+	header->publishes.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SharedPageCache::cancel(const Reservation & reservation)
+{
+	assert(reservation.slot < numSlots);
+
+	uint64_t expected = makeControl(SlotLoading, reservation.generation);
+	slots[reservation.slot].control.compare_exchange_strong(expected,
+			makeControl(SlotEmpty, reservation.generation), std::memory_order_release);
+}
+
+SharedPageCache::Stats SharedPageCache::getStats() const
+{
+	Stats stats;
+	stats.hits          = header->hits.load(std::memory_order_relaxed);
+	stats.misses        = header->misses.load(std::memory_order_relaxed);
+	stats.loadWaits     = header->loadWaits.load(std::memory_order_relaxed);
+	stats.waitTimeouts  = header->waitTimeouts.load(std::memory_order_relaxed);
+	stats.publishes     = header->publishes.load(std::memory_order_relaxed);
+	stats.evictions     = header->evictions.load(std::memory_order_relaxed);
+	stats.staleReclaims = header->staleReclaims.load(std::memory_order_relaxed);
+	stats.numSlots      = static_cast<int>(numSlots);
+	stats.readySlots    = 0;
+
+	for (uint32_t s = 0; s < numSlots; ++s)
+	{
+		if (controlState(slots[s].control.load(std::memory_order_relaxed)) == SlotReady)
+		{
+			++stats.readySlots;
+		}
+	}
+	return stats;
+}
+
+} // namespace vt {}
@@ -0,0 +1,367 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: vt_sprite_batch.cpp
+// Author: Guilherme R. Lampert
+// Created on: 18/10/26
+// Brief: Streaming batcher for the 2D quads of the debug text and UI.
+//
+// License:
+//  This source code is released under the MIT License.
+//  Copyright (c) 2014 Guilherme R. Lampert.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+// ================================================================================================
+
+#include "vt.hpp"
+#include "vt_sprite_batch.hpp"
+
+#include <cstddef>
+
+namespace vt
+{
+
+// ======================================================
+// Local helpers:
+// ======================================================
+
+namespace {
+
+// Vertex attribute locations of the drawText2D shader.
+enum SpriteVertexAttrib
+{
+	AttribPosition  = 0,
+	AttribColor     = 1,
+	AttribTexCoords = 2
+};
+
+static uint8_t packColorChannel(const float c)
+{
+	const float clamped = (c < 0.0f) ? 0.0f : ((c > 1.0f) ? 1.0f : c);
+	return static_cast<uint8_t>(clamped * 255.0f + 0.5f);
+}
+
+static uint16_t packTexCoord(const float t)
+{
+	const float clamped = (t < 0.0f) ? 0.0f : ((t > 1.0f) ? 1.0f : t);
+	return static_cast<uint16_t>(clamped * 65535.0f + 0.5f);
+}
+
+} // namespace {}
+
+// ======================================================
+// SpriteBatch:
+// ======================================================
+
+GLuint SpriteBatch::sharedQuadIbo     = 0;
+int    SpriteBatch::sharedQuadIboRefs = 0;
+
+SpriteBatch::SpriteBatch(const char * debugName)
+	: numQuads(0)
+	, numDrawGroups(0)
+	, lastDrawGroup(-1)
+	, vbo(0)
+	, ringOffset(0)
+	, lastDrawCalls(0)
+	, overflowWarned(false)
+	, name(debugName)
+{
+	static_assert((MaxQuads * 4) <= 65536,  "Quad vertexes must be addressable with 16bit indexes!");
+	static_assert(MaxDrawGroups <= 256,     "Draw group indexes are stored in a byte!");
+	static_assert(sizeof(Vertex) == 16,     "Unexpected SpriteBatch::Vertex size!");
+	assert(debugName != nullptr);
+	clearArray(drawGroups);
+}
+
+void SpriteBatch::ensureBuffersCreated()
+{
+	if (vbo != 0)
+	{
+		return;
+	}
+
+	// Storage for a full flush, allocated once.
+	quads.reset(new Quad[MaxQuads]);
+	sortedQuads.reset(new Quad[MaxQuads]);
+	quadGroups.reset(new uint8_t[MaxQuads]);
+
+	glGenBuffers(1, &vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, MaxQuads * RingBufferFlushes * sizeof(Quad), nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	ringOffset = 0;
+
+	if (sharedQuadIboRefs++ == 0)
+	{
+		// Same two triangles for every quad: 0,1,2 and 2,3,0.
+		std::unique_ptr<uint16_t[]> indexes(new uint16_t[MaxQuads * 6]);
+		for (int q = 0; q < MaxQuads; ++q)
+		{
+			const uint16_t base = static_cast<uint16_t>(q * 4);
+			uint16_t * idx = &indexes[q * 6];
+			idx[0] = base + 0; idx[1] = base + 1; idx[2] = base + 2;
+			idx[3] = base + 2; idx[4] = base + 3; idx[5] = base + 0;
+		}
+
+		glGenBuffers(1, &sharedQuadIbo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sharedQuadIbo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, MaxQuads * 6 * sizeof(uint16_t), indexes.get(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+
+	vtLogComment("Created ring VBO for sprite batch '" << name << "'...");
+}
+
+int SpriteBatch::findDrawGroup(const GLuint textureId, const int layer)
+{
+	if ((lastDrawGroup >= 0) &&
+	    (drawGroups[lastDrawGroup].textureId == textureId) &&
+	    (drawGroups[lastDrawGroup].layer == layer))
+	{
+		return lastDrawGroup;
+	}
+
+	for (int g = 0; g < numDrawGroups; ++g)
+	{
+		if ((drawGroups[g].textureId == textureId) && (drawGroups[g].layer == layer))
+		{
+			lastDrawGroup = g;
+			return g;
+		}
+	}
+
+	if (numDrawGroups == MaxDrawGroups)
+	{
+		return -1;
+	}
+
+	DrawGroup & group = drawGroups[numDrawGroups];
+	group.textureId   = textureId;
+	group.layer       = layer;
+	group.numQuads    = 0;
+	group.firstQuad   = 0;
+
+	lastDrawGroup = numDrawGroups++;
+	return lastDrawGroup;
+}
+
+void SpriteBatch::addQuad(const float x, const float y, const float w, const float h, const float color[4],
+                          const float uvs[][2], const GLuint textureId, const int layer)
+{
+	assert(color != nullptr);
+	assert(uvs   != nullptr);
+	assert(layer >= 0 && layer < MaxLayers);
+
+	ensureBuffersCreated();
+
+	const int groupIndex = (numQuads < MaxQuads) ? findDrawGroup(textureId, layer) : -1;
+	if (groupIndex < 0)
+	{
+		if (!overflowWarned)
+		{
+			vtLogWarning("Sprite batch '" << name << "' is full! Quads will be dropped.");
+			overflowWarned = true;
+		}
+		return;
+	}
+
+	const float xs[] = { x, x + w, x + w, x     };
+	const float ys[] = { y, y,     y + h, y + h };
+
+	const uint8_t r = packColorChannel(color[0]);
+	const uint8_t g = packColorChannel(color[1]);
+	const uint8_t b = packColorChannel(color[2]);
+	const uint8_t a = packColorChannel(color[3]);
+
+	Quad & quad = quads[numQuads];
+	for (int v = 0; v < 4; ++v)
+	{
+		Vertex & vert = quad.verts[v];
+		vert.x = xs[v];
+		vert.y = ys[v];
+		vert.u = packTexCoord(uvs[v][0]);
+		vert.v = packTexCoord(uvs[v][1]);
+		vert.r = r;
+		vert.g = g;
+		vert.b = b;
+		vert.a = a;
+	}
+
+	quadGroups[numQuads++] = static_cast<uint8_t>(groupIndex);
+	drawGroups[groupIndex].numQuads++;
+}
+
+int SpriteBatch::sortQuadsByDrawGroup()
+{
+	// Draw order of the groups: by layer, then by first use.
+	// Insertion sort is stable and there are only a handful of groups.
+	int order[MaxDrawGroups];
+	for (int g = 0; g < numDrawGroups; ++g)
+	{
+		int i = g;
+		while ((i > 0) && (drawGroups[order[i - 1]].layer > drawGroups[g].layer))
+		{
+			order[i] = order[i - 1];
+			--i;
+		}
+		order[i] = g;
+	}
+
+	int firstQuad = 0;
+	for (int i = 0; i < numDrawGroups; ++i)
+	{
+		DrawGroup & group = drawGroups[order[i]];
+		group.firstQuad = firstQuad;
+		firstQuad += group.numQuads;
+	}
+
+	// Counting sort scatter. 'numQuads' is reused as the insert position.
+	for (int g = 0; g < numDrawGroups; ++g)
+	{
+		drawGroups[g].numQuads = 0;
+	}
+	for (int q = 0; q < numQuads; ++q)
+	{
+		DrawGroup & group = drawGroups[quadGroups[q]];
+		sortedQuads[group.firstQuad + group.numQuads++] = quads[q];
+	}
+
+	// Reorder the group array itself, so the draw loop is sequential.
+	DrawGroup sorted[MaxDrawGroups];
+	for (int i = 0; i < numDrawGroups; ++i)
+	{
+		sorted[i] = drawGroups[order[i]];
+	}
+	std::copy(sorted, sorted + numDrawGroups, drawGroups);
+
+	return numQuads;
+}
+
+void SpriteBatch::flush(const float * mvpMatrix)
+{
+	assert(mvpMatrix != nullptr);
+
+	lastDrawCalls = 0;
+	if (numQuads == 0)
+	{
+		return;
+	}
+
+	assert(vbo != 0);
+	assert(sharedQuadIbo != 0);
+
+	const int quadCount = sortQuadsByDrawGroup();
+
+	// Append to the ring buffer, orphaning it when it wraps around,
+	// so we never write over data a pending draw may still be reading.
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	if ((ringOffset + quadCount) > (MaxQuads * RingBufferFlushes))
+	{
+		glBufferData(GL_ARRAY_BUFFER, MaxQuads * RingBufferFlushes * sizeof(Quad), nullptr, GL_STREAM_DRAW);
+		ringOffset = 0;
+	}
+
+	const size_t baseOffset = ringOffset * sizeof(Quad);
+	glBufferSubData(GL_ARRAY_BUFFER, baseOffset, quadCount * sizeof(Quad), sortedQuads.get());
+	ringOffset += quadCount;
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sharedQuadIbo);
+
+	// Vertex format. Indexes are relative to the start of this flush.
+	glEnableVertexAttribArray(AttribPosition);
+	glVertexAttribPointer(AttribPosition, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+		reinterpret_cast<const GLvoid *>(baseOffset + offsetof(Vertex, x)));
+
+	glEnableVertexAttribArray(AttribColor);
+	glVertexAttribPointer(AttribColor, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex),
+		reinterpret_cast<const GLvoid *>(baseOffset + offsetof(Vertex, r)));
+
+	glEnableVertexAttribArray(AttribTexCoords);
+	glVertexAttribPointer(AttribTexCoords, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(Vertex),
+		reinterpret_cast<const GLvoid *>(baseOffset + offsetof(Vertex, u)));
+
+	// Render states:
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	gl::setEnabled(GL_BLEND, true);
+	gl::setEnabled(GL_DEPTH_TEST, false);
+	gl::setEnabled(GL_CULL_FACE, false);
+
+	const GlobalShaders & shaders = getGlobalShaders();
+	gl::useShaderProgram(shaders.drawText2D.programId);
+	gl::setShaderProgramUniform(shaders.drawText2D.unifMvpMatrix, mvpMatrix, 16);
+
+	// One draw call per group:
+	for (int g = 0; g < numDrawGroups; ++g)
+	{
+		const DrawGroup & group = drawGroups[g];
+		if (group.textureId != 0)
+		{
+			gl::use2DTexture(group.textureId, 0);
+		}
+
+		glDrawElements(GL_TRIANGLES, group.numQuads * 6, GL_UNSIGNED_SHORT,
+			reinterpret_cast<const GLvoid *>(group.firstQuad * 6 * sizeof(uint16_t)));
+		++lastDrawCalls;
+	}
+
+	gl::setEnabled(GL_CULL_FACE, true);
+	gl::setEnabled(GL_DEPTH_TEST, true);
+	gl::setEnabled(GL_BLEND, false);
+
+	// Cleanup. The tex coords array is not used by the other
+	// renderers, so don't leave it enabled pointing to our VBO.
+	glDisableVertexAttribArray(AttribTexCoords);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	numQuads      = 0;
+	numDrawGroups = 0;
+	lastDrawGroup = -1;
+}
+
+void SpriteBatch::shutdown()
+{
+	if (vbo == 0)
+	{
+		return;
+	}
+
+	glDeleteBuffers(1, &vbo);
+	vbo = 0;
+	ringOffset = 0;
+
+	if (--sharedQuadIboRefs == 0)
+	{
+		glDeleteBuffers(1, &sharedQuadIbo);
+		sharedQuadIbo = 0;
+	}
+
+	quads.reset();
+	sortedQuads.reset();
+	quadGroups.reset();
+
+	numQuads       = 0;
+	numDrawGroups  = 0;
+	lastDrawGroup  = -1;
+	lastDrawCalls  = 0;
+	overflowWarned = false;
+}
+
+} // namespace vt {}
@@ -34,6 +34,9 @@
 #include "vt_mini_ui.hpp"
 #include "vt_tool_platform_utils.hpp"
 
+#include <algorithm>
+#include <cmath>
+
 namespace vt
 {
 
@@ -42,8 +45,14 @@ namespace vt
 // ======================================================
 
 VirtualTexture::VirtualTexture(VTFFPageFilePtr vtffFile, PageIndirectionTablePtr pageIndirection)
-	: VirtualTexture(vtffFile->getPageTree().getNumPagesX(), vtffFile->getPageTree().getNumPagesY(),
-	                 vtffFile->getPageTree().getNumLevels(), std::move(vtffFile), pageIndirection)
+	: VirtualTexture(vtffFile->getNumPagesX(), vtffFile->getNumPagesY(),
+	                 vtffFile->getNumLevels(), std::move(vtffFile), pageIndirection)
+{
+}
+
+VirtualTexture::VirtualTexture(VTFFArchivePageFilePtr archiveFile, PageIndirectionTablePtr pageIndirection)
+	: VirtualTexture(archiveFile->getNumPagesX(), archiveFile->getNumPagesY(),
+	                 archiveFile->getNumLevels(), std::move(archiveFile), pageIndirection)
 {
 }
 
@@ -52,28 +61,70 @@ VirtualTexture::VirtualTexture(VTFFPageFilePtr * vtffFiles, const size_t numFile
 	, pageProvider(nullptr)
 	, pageResolver(nullptr)
 	, textureIndex(-1)
+	, writeBackRequested(false)
 	, numPageUploads(0)
 	, numIndirectionTableUpdates(0)
 {
 	assert(vtffFiles != nullptr);
 	assert(numFiles  != 0);
 
-	// All files are assumed to point to textures with
-	// equal dimensions. We assert that below.
-	const int * const vtPagesX = vtffFiles[0]->getPageTree().getNumPagesX();
-	const int * const vtPagesY = vtffFiles[0]->getPageTree().getNumPagesY();
-	numLevels = vtffFiles[0]->getPageTree().getNumLevels();
+	// The first file defines the texture dimensions. The others must either
+	// match it or be a reduced resolution layer, with a level 0 that is exactly
+	// 2^k times smaller and k fewer levels. Reduced layers are read through
+	// a ReducedLayerPageFile and magnified by the lit shader.
+	const int * const vtPagesX = vtffFiles[0]->getNumPagesX();
+	const int * const vtPagesY = vtffFiles[0]->getNumPagesY();
+	numLevels = vtffFiles[0]->getNumLevels();
 	assert(numLevels > 0 && numLevels <= MaxVTMipLevels);
 
+	// The layers share the texture coordinates of the first file.
+	float firstUVScale[2];
+	vtffFiles[0]->getUVScale(firstUVScale);
+
 	pageFiles.reserve(numFiles);
 	pageTables.reserve(numFiles);
+	layerMipOffsets.reserve(numFiles);
 	for (size_t f = 0; f < numFiles; ++f)
 	{
-		assert(vtffFiles[f]->getPageTree().getNumPagesX()[f] == vtPagesX[f]);
-		assert(vtffFiles[f]->getPageTree().getNumPagesY()[f] == vtPagesY[f]);
-		assert(vtffFiles[f]->getPageTree().getNumLevels() == numLevels);
+		const int filePagesX = vtffFiles[f]->getNumPagesX()[0];
+		const int filePagesY = vtffFiles[f]->getNumPagesY()[0];
+
+		// A reduced layer rounds its content size to its own texels, so allow one of those.
+		float fileUVScale[2];
+		vtffFiles[f]->getUVScale(fileUVScale);
+		if (std::fabs(fileUVScale[0] - firstUVScale[0]) > 1.0f / (filePagesX * PageTable::PageSizeInPixels) ||
+		    std::fabs(fileUVScale[1] - firstUVScale[1]) > 1.0f / (filePagesY * PageTable::PageSizeInPixels))
+		{
+			vtFatalError("Page file #" << f << " has a UV scale of ("
+					<< fileUVScale[0] << ", " << fileUVScale[1] << "). Doesn't match the first file ("
+					<< firstUVScale[0] << ", " << firstUVScale[1] << ").");
+		}
+
+		int mipOffset = 0;
+		while (mipOffset < ReducedLayerPageFile::MaxMipOffset && (vtPagesX[0] >> mipOffset) > filePagesX)
+		{
+			++mipOffset;
+		}
 
-		pageFiles.push_back(std::move(vtffFiles[f]));
+		if ((vtPagesX[0] >> mipOffset) != filePagesX || (vtPagesY[0] >> mipOffset) != filePagesY ||
+		    vtffFiles[f]->getNumLevels() != std::max(numLevels - mipOffset, 1))
+		{
+			vtFatalError("Page file #" << f << " is "
+					<< filePagesX << "x" << filePagesY << " pages, " << vtffFiles[f]->getNumLevels()
+					<< " levels. Doesn't match, nor is a reduced layer of, the first file ("
+					<< vtPagesX[0] << "x" << vtPagesY[0] << " pages, " << numLevels << " levels).");
+		}
+
+		if (mipOffset != 0)
+		{
+			vtLogComment("Page file #" << f << " is a reduced layer, " << (1 << mipOffset) << "x smaller.");
+			pageFiles.push_back(PageFilePtr(new ReducedLayerPageFile(std::move(vtffFiles[f]), mipOffset, numLevels)));
+		}
+		else
+		{
+			pageFiles.push_back(std::move(vtffFiles[f]));
+		}
+		layerMipOffsets.push_back(mipOffset);
 
 		// Create a page table texture to back each page file.
 		pageTables.push_back(PageTablePtr(new PageTable()));
@@ -92,6 +143,9 @@ VirtualTexture::VirtualTexture(VTFFPageFilePtr * vtffFiles, const size_t numFile
 
 	level0SizePages[0]  = static_cast<float>(vtPagesX[0]);
 	level0SizePages[1]  = static_cast<float>(vtPagesY[0]);
+
+	uvScale[0] = firstUVScale[0];
+	uvScale[1] = firstUVScale[1];
 }
 
 VirtualTexture::VirtualTexture(const int * vtPagesX, const int * vtPagesY, const int vtNumLevels,
@@ -100,6 +154,7 @@ VirtualTexture::VirtualTexture(const int * vtPagesX, const int * vtPagesY, const
 	, pageProvider(nullptr)
 	, pageResolver(nullptr)
 	, textureIndex(-1)
+	, writeBackRequested(false)
 	, numPageUploads(0)
 	, numIndirectionTableUpdates(0)
 {
@@ -108,6 +163,7 @@ VirtualTexture::VirtualTexture(const int * vtPagesX, const int * vtPagesY, const
 
 	pageFiles.push_back(std::move(pageFile));
 	pageTables.push_back(PageTablePtr(new PageTable()));
+	layerMipOffsets.push_back(0);
 	numLevels = vtNumLevels;
 
 	// Optional. Supply if missing.
@@ -123,6 +179,84 @@ VirtualTexture::VirtualTexture(const int * vtPagesX, const int * vtPagesY, const
 
 	level0SizePages[0]  = static_cast<float>(vtPagesX[0]);
 	level0SizePages[1]  = static_cast<float>(vtPagesY[0]);
+
+	pageFiles[0]->getUVScale(uvScale);
+}
+
+VirtualTexture::~VirtualTexture()
+{
+	for (GLuint & texId : mipTailTextures)
+	{
+		gl::delete2DTexture(texId);
+	}
+}
+
+void VirtualTexture::loadMipTails()
+{
+	if (!mipTailTextures.empty())
+	{
+		return;
+	}
+
+	mipTailTextures.resize(pageFiles.size(), 0);
+	mipTailBytes.resize(pageFiles.size(), 0);
+
+	for (unsigned int f = 0; f < pageFiles.size(); ++f)
+	{
+		mipTailBytes[f] = createMipTailTexture(f);
+	}
+}
+
+size_t VirtualTexture::createMipTailTexture(const unsigned int index)
+{
+	gl::delete2DTexture(mipTailTextures[index]);
+
+	MipTailData tail;
+	if (!pageFiles[index]->loadMipTail(tail))
+	{
+		// Neutral placeholder, so the shaders can always sample something.
+		const Pixel4b grey = { 128, 128, 128, 255 };
+		mipTailTextures[index] = gl::create2DTexture(1, 1, GL_RGBA, GL_UNSIGNED_BYTE, GL_CLAMP_TO_EDGE,
+		                                             GL_CLAMP_TO_EDGE, GL_NEAREST, GL_NEAREST, &grey);
+		return sizeof(grey);
+	}
+
+	mipTailTextures[index] = gl::create2DTexture(tail.width, tail.height, GL_RGBA, GL_UNSIGNED_BYTE, GL_CLAMP_TO_EDGE,
+	                                             GL_CLAMP_TO_EDGE, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, tail.pixels.data());
+
+	// Level 0 was uploaded above. Add the rest of the chain:
+	gl::use2DTexture(mipTailTextures[index]);
+	const Pixel4b * levelPixels = tail.pixels.data() + tail.width * tail.height;
+	for (int l = 1; l < tail.numLevels; ++l)
+	{
+		const int w = std::max(tail.width  >> l, 1);
+		const int h = std::max(tail.height >> l, 1);
+		glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, levelPixels);
+		levelPixels += w * h;
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL_APPLE, tail.numLevels - 1);
+	gl::use2DTexture(0);
+	gl::checkGLErrors(__FILE__, __LINE__);
+
+	vtLogComment("Mip tail #" << index << " uploaded. " << tail.width << "x" << tail.height
+			<< ", " << tail.numLevels << " levels.");
+	return tail.pixels.size() * sizeof(Pixel4b);
+}
+
+void VirtualTexture::frameUpdate(const bool updateIndirectionTable)
+{
+	assert(pageProvider != nullptr && "No PageProvider associated with this VirtualTexture!");
+
+	if (pageOverlay != nullptr)
+	{
+		updatePageWriteBack();
+	}
+
+	if (pageProvider->getReadyQueue(textureIndex, readyPages) != 0)
+	{
+		frameUpdate(readyPages, updateIndirectionTable);
+		readyPages.clear();
+	}
 }
 
 void VirtualTexture::frameUpdate(const FulfilledPageRequestQueue & pageRequestUploads, const bool updateIndirectionTable)
@@ -139,11 +273,13 @@ void VirtualTexture::frameUpdate(const FulfilledPageRequestQueue & pageRequestUp
 	}
 
 	// Upload new pages to the page table texture(s):
+	const size_t numRequests   = pageRequestUploads.size();
 	const size_t numPageTables = pageTables.size();
 	PageTable * currentPageTexture = nullptr;
 
-	for (const auto & request : pageRequestUploads)
+	for (size_t r = 0; r < numRequests; ++r)
 	{
+		const PageRequestDataPacket & request = pageRequestUploads[r];
 		if ((pageIdExtractTextureIndex(request.pageId) != textureIndex) || (request.fileId != 0)
 			|| !pageCacheMgr->stillWantPage(request.pageId))
 		{
@@ -151,7 +287,7 @@ void VirtualTexture::frameUpdate(const FulfilledPageRequestQueue & pageRequestUp
 		}
 
 		PageUpload mainUpload;
-		mainUpload.pageData   = request.pageData;
+		mainUpload.pageData   = getPageDataForUpload(request);
 		mainUpload.cacheCoord = pageCacheMgr->accommodatePage(request.pageId);
 
 		if (currentPageTexture != pageTables[0].get())
@@ -163,18 +299,21 @@ void VirtualTexture::frameUpdate(const FulfilledPageRequestQueue & pageRequestUp
 		++numPageUploads;
 
 		// If this texture has a hierarchy or sub-texture (normal map,
-		// specular map, etc) update theses child page tables now:
+		// specular map, etc) update theses child page tables now.
+		// Requests for the other files of a page are issued right after
+		// the main one, so search forward from it first, then wrap around.
 		for (size_t t = 1; t < numPageTables; ++t)
 		{
-			for (const auto & subRequest : pageRequestUploads)
+			for (size_t n = 1; n < numRequests; ++n)
 			{
+				const PageRequestDataPacket & subRequest = pageRequestUploads[(r + n) % numRequests];
 				if ((subRequest.pageId != request.pageId) || (subRequest.fileId != t))
 				{
 					continue;
 				}
 
 				PageUpload subUpload;
-				subUpload.pageData   = subRequest.pageData;
+				subUpload.pageData   = getPageDataForUpload(subRequest);
 				subUpload.cacheCoord = mainUpload.cacheCoord;
 
 				if (currentPageTexture != pageTables[t].get())
@@ -184,8 +323,16 @@ void VirtualTexture::frameUpdate(const FulfilledPageRequestQueue & pageRequestUp
 				}
 				pageTables[t]->uploadPage(subUpload);
 				++numPageUploads;
+				break;
 			}
 		}
+
+		// All files of the page are up to date now.
+		if (!writtenInFlightPages.empty())
+		{
+			writtenInFlightPages.erase(std::remove(writtenInFlightPages.begin(), writtenInFlightPages.end(), request.pageId),
+			                           writtenInFlightPages.end());
+		}
 	}
 
 	if (updateIndirectionTable)
@@ -222,6 +369,13 @@ void VirtualTexture::purgeCache()
 	vtLogComment("Purging VT cache for texture #" << textureIndex);
 
 	pageCacheMgr->purgeCache();
+	writtenInFlightPages.clear();
+
+	// Every visible page has to be requested again:
+	if (pageResolver != nullptr)
+	{
+		pageResolver->invalidateFeedback();
+	}
 
 	// Optionally fill the page tables with dummy data:
 	#if VT_EXTRA_DEBUG
@@ -239,9 +393,199 @@ void VirtualTexture::purgeCache()
 	++numIndirectionTableUpdates;
 }
 
+void VirtualTexture::getMemoryStats(MemoryStats & stats) const
+{
+	stats.cachePageTrees += pageCacheMgr->getMemoryBytes();
+
+	for (const auto & pageFile : pageFiles)
+	{
+		stats.pageFileIndexes += pageFile->getMemoryBytes();
+	}
+
+	stats.indirectionTables    += indirectionTable->getSystemMemoryBytes();
+	stats.indirectionTablesGpu += indirectionTable->getGpuMemoryBytes();
+	stats.pageTablesGpu        += pageTables.size() * PageTable::getGpuMemoryBytes();
+
+	for (const size_t bytes : mipTailBytes)
+	{
+		stats.mipTailsGpu += bytes;
+	}
+}
+
+// Free texture slots and the high-water slot count. Slots are
+// only handed out and returned from the main thread, no locking needed.
+static std::vector<int> freeTextureSlots;
+static int numTextureSlotsUsed;
+
+void VirtualTexture::acquireTextureSlot()
+{
+	if (textureIndex >= 0)
+	{
+		return; // Already holds a slot.
+	}
+
+	if (!freeTextureSlots.empty())
+	{
+		textureIndex = freeTextureSlots.back();
+		freeTextureSlots.pop_back();
+	}
+	else
+	{
+		if (numTextureSlotsUsed == MaxTextureSlots)
+		{
+			vtFatalError("Out of VirtualTexture slots! Max of " << MaxTextureSlots << " registered textures.");
+		}
+		textureIndex = numTextureSlotsUsed++;
+	}
+}
+
+void VirtualTexture::releaseTextureSlot()
+{
+	if (textureIndex < 0 || pageProvider != nullptr || pageResolver != nullptr)
+	{
+		return; // No slot or still linked.
+	}
+
+	freeTextureSlots.push_back(textureIndex);
+	textureIndex = -1;
+}
+
 void VirtualTexture::replacePageFile(PageFilePtr & newPageFile, unsigned int index)
 {
-	std::swap(pageFiles[index], newPageFile);
+	if (layerMipOffsets[index] != 0)
+	{
+		// Reduced layers keep their wrapper; only the file it reads from is swapped.
+		PageFile * wrapper = pageFiles[index].get();
+		if (pageOverlay != nullptr)
+		{
+			wrapper = static_cast<OverlayPageFile *>(wrapper)->getBaseFile();
+		}
+		static_cast<ReducedLayerPageFile *>(wrapper)->swapReducedFile(newPageFile);
+	}
+	else if (pageOverlay != nullptr)
+	{
+		static_cast<OverlayPageFile *>(pageFiles[index].get())->swapBaseFile(newPageFile);
+	}
+	else
+	{
+		std::swap(pageFiles[index], newPageFile);
+	}
+	if (index < mipTailTextures.size())
+	{
+		mipTailBytes[index] = createMipTailTexture(index);
+	}
+	if (index == 0)
+	{
+		pageFiles[0]->getUVScale(uvScale);
+	}
+}
+
+// ======================================================
+// Writable VT:
+// ======================================================
+
+void VirtualTexture::enablePageWriting(PageOverlayPtr overlay)
+{
+	assert(overlay != nullptr);
+	assert(pageOverlay == nullptr && "Page writing already enabled!");
+	assert(pageProvider == nullptr && "Enable page writing before linking the texture to a PageProvider!");
+
+	for (unsigned int f = 0; f < pageFiles.size(); ++f)
+	{
+		pageFiles[f].reset(new OverlayPageFile(std::move(pageFiles[f]), overlay, f));
+	}
+
+	pageOverlay = std::move(overlay);
+	overlayPageScratch.resize(PageOverlay::TotalPagePixels);
+
+	vtLogComment("Page writing enabled for VT #" << textureIndex << ". Overlay: \"" << pageOverlay->getFileName() << "\".");
+}
+
+bool VirtualTexture::writePage(const PageId pageId, const Pixel4b * pageData, const unsigned int fileIndex)
+{
+	assert(pageData != nullptr);
+	assert(fileIndex < pageFiles.size());
+
+	if (pageOverlay == nullptr)
+	{
+		vtLogWarning("writePage() called on VT #" << textureIndex << ", which is not writable!");
+		return false;
+	}
+	if (layerMipOffsets[fileIndex] != 0)
+	{
+		vtLogWarning("writePage(): file #" << fileIndex << " of VT #" << textureIndex << " is a reduced layer and can't be written!");
+		return false;
+	}
+
+	const PageId id = pageCacheMgr->sanitizePageId(pageId);
+	pageOverlay->storePage(id, fileIndex, pageData);
+
+	const PageId cacheId = makePageId(pageIdExtractPageX(id), pageIdExtractPageY(id), pageIdExtractMipLevel(id), textureIndex);
+	CachePageCoord cacheCoord;
+
+	switch (pageCacheMgr->queryPage(cacheId, &cacheCoord))
+	{
+	case CachePageStatus::Cached :
+		{
+			// Visible right away. The indirection table already points to it.
+			PageUpload upload;
+			upload.pageData   = pageData;
+			upload.cacheCoord = cacheCoord;
+
+			pageTables[fileIndex]->bind();
+			pageTables[fileIndex]->uploadPage(upload);
+			pageCacheMgr->markPageDirty(cacheId);
+			++numPageUploads;
+			break;
+		}
+	case CachePageStatus::InFlight :
+		{
+			// The load might have read the old data already.
+			if (std::find(writtenInFlightPages.begin(), writtenInFlightPages.end(), cacheId) == writtenInFlightPages.end())
+			{
+				writtenInFlightPages.push_back(cacheId);
+			}
+			break;
+		}
+	default :
+		// Not resident. The next load gets it from the overlay.
+		break;
+	}
+
+	return true;
+}
+
+void VirtualTexture::updatePageWriteBack()
+{
+	// Dirty pages leaving the cache are written back as soon as possible,
+	// everything else when the overlay's batch or time threshold is reached.
+	if (pageCacheMgr->takeNumEvictedDirtyPages() != 0)
+	{
+		writeBackRequested = true;
+	}
+
+	// Every pending page goes in the batch, so nothing is dirty afterwards.
+	if (pageOverlay->flush(writeBackRequested))
+	{
+		pageCacheMgr->clearDirtyPages();
+		writeBackRequested = false;
+	}
+}
+
+const Pixel4b * VirtualTexture::getPageDataForUpload(const PageRequestDataPacket & request)
+{
+	if (writtenInFlightPages.empty() ||
+		std::find(writtenInFlightPages.begin(), writtenInFlightPages.end(), request.pageId) == writtenInFlightPages.end())
+	{
+		return request.pageData;
+	}
+
+	// Only one page is uploaded at a time, so a single scratch page will do.
+	if (!pageOverlay->loadPage(request.pageId, request.fileId, overlayPageScratch.data()))
+	{
+		return request.pageData; // That file of the page wasn't written.
+	}
+	return overlayPageScratch.data();
 }
 
 // ======================================================
@@ -250,6 +594,13 @@ void VirtualTexture::replacePageFile(PageFilePtr & newPageFile, unsigned int ind
 
 static GLuint currentShader;
 
+// Base of the texture in its resolver's compact page number space. Negative for the wide page ids.
+static float getCompactPageBase(const VirtualTexture & vtTex)
+{
+	const PageResolver * resolver = vtTex.getPageResolver();
+	return (resolver != nullptr) ? static_cast<float>(resolver->getCompactPageBase(vtTex.getTextureIndex())) : -1.0f;
+}
+
 void renderBindPageIdPassShader()
 {
 	currentShader = getGlobalShaders().pageIdGenPass.programId;
@@ -266,6 +617,37 @@ void renderBindTextureForPageIdPass(const VirtualTexture & vtTex)
 	gl::setShaderProgramUniform(globShaders.pageIdGenPass.unifVTIndex,       static_cast<float>(vtTex.getTextureIndex()));
 	gl::setShaderProgramUniform(globShaders.pageIdGenPass.unifVTSizePixels,  vtTex.getLevel0SizeInPixels(), 2);
 	gl::setShaderProgramUniform(globShaders.pageIdGenPass.unifVTSizePages,   vtTex.getLevel0SizeInPages(),  2);
+	gl::setShaderProgramUniform(globShaders.pageIdGenPass.unifVTPageBase,    getCompactPageBase(vtTex));
+	gl::setShaderProgramUniform(globShaders.pageIdGenPass.unifVTUVScale,     vtTex.getUVScale(), 2);
+}
+
+PageIdShaderUniforms renderGetPageIdShaderUniforms(const GLuint programId)
+{
+	assert(programId != 0);
+
+	PageIdShaderUniforms uniforms;
+	uniforms.log2MipScaleFactor = gl::getShaderProgramUniformLocation(programId, "u_log2_mip_scale_factor");
+	uniforms.vtMaxMipLevel      = gl::getShaderProgramUniformLocation(programId, "u_vt_max_mip_level");
+	uniforms.vtIndex            = gl::getShaderProgramUniformLocation(programId, "u_vt_index");
+	uniforms.vtSizePixels       = gl::getShaderProgramUniformLocation(programId, "u_vt_size_pixels");
+	uniforms.vtSizePages        = gl::getShaderProgramUniformLocation(programId, "u_vt_size_pages");
+	uniforms.vtPageBase         = gl::getShaderProgramUniformLocation(programId, "u_vt_page_base");
+	uniforms.vtUVScale          = gl::getShaderProgramUniformLocation(programId, "u_vt_uv_scale");
+	return uniforms;
+}
+
+void renderBindTextureForPageIdOutput(const PageIdShaderUniforms & uniforms, const VirtualTexture & vtTex, const float log2MipScaleFactor)
+{
+	assert(vtTex.getNumLevels()    >= 1);
+	assert(vtTex.getTextureIndex() >= 0);
+
+	gl::setShaderProgramUniform(uniforms.log2MipScaleFactor, log2MipScaleFactor);
+	gl::setShaderProgramUniform(uniforms.vtMaxMipLevel, static_cast<float>(vtTex.getNumLevels() - 1));
+	gl::setShaderProgramUniform(uniforms.vtIndex,       static_cast<float>(vtTex.getTextureIndex()));
+	gl::setShaderProgramUniform(uniforms.vtSizePixels,  vtTex.getLevel0SizeInPixels(), 2);
+	gl::setShaderProgramUniform(uniforms.vtSizePages,   vtTex.getLevel0SizeInPages(),  2);
+	gl::setShaderProgramUniform(uniforms.vtPageBase,    getCompactPageBase(vtTex));
+	gl::setShaderProgramUniform(uniforms.vtUVScale,     vtTex.getUVScale(), 2);
 }
 
 void renderBindTexturedPassShader(const bool simpleRender)
@@ -278,6 +660,30 @@ void renderBindTextureForTexturedPass(const VirtualTexture & vtTex)
 {
 	assert(vtTex.getNumPageFiles() == vtTex.getNumPageTables());
 
+	// The texture coordinates are scaled by the vertex shader of the bound textured pass.
+	const GlobalShaders & globShaders = getGlobalShaders();
+	if (currentShader == globShaders.vtRenderSimple.programId)
+	{
+		gl::setShaderProgramUniform(globShaders.vtRenderSimple.unifVTUVScale, vtTex.getUVScale(), 2);
+	}
+	else if (currentShader == globShaders.vtRenderSimpleBatched.programId)
+	{
+		gl::setShaderProgramUniform(globShaders.vtRenderSimpleBatched.unifVTUVScale, vtTex.getUVScale(), 2);
+	}
+	else if (currentShader == globShaders.vtRenderLit.programId)
+	{
+		gl::setShaderProgramUniform(globShaders.vtRenderLit.unifVTUVScale, vtTex.getUVScale(), 2);
+
+		// Diffuse, normal and specular. Reduced layers address pages 2^offset times bigger.
+		float layerScale[3];
+		for (unsigned int t = 0; t < 3; ++t)
+		{
+			const int offset = (t < vtTex.getNumPageFiles()) ? vtTex.getLayerMipOffset(t) : 0;
+			layerScale[t] = 1.0f / static_cast<float>(1 << offset);
+		}
+		gl::setShaderProgramUniform(globShaders.vtRenderLit.unifVTLayerScale, layerScale, 3);
+	}
+
 	if (vtTex.getNumPageFiles() == 1)
 	{
 		// Page table sampler at TMU 0
@@ -285,6 +691,9 @@ void renderBindTextureForTexturedPass(const VirtualTexture & vtTex)
 
 		// Indirection sampler at TMU 1
 		vtTex.getPageIndirectionTable()->bind(1);
+
+		// Mip tail sampler at TMU 2
+		gl::use2DTexture(vtTex.getMipTailTexture(0), 2);
 	}
 	else
 	{
@@ -296,9 +705,210 @@ void renderBindTextureForTexturedPass(const VirtualTexture & vtTex)
 		{
 			vtTex.getPageTable(t)->bind(t + 1);
 		}
+
+		// Mip tails follow the page tables:
+		for (unsigned int t = 0; t < numTextures; ++t)
+		{
+			gl::use2DTexture(vtTex.getMipTailTexture(t), numTextures + t + 1);
+		}
+	}
+}
+
+// Per-batch uniform data. Rendering is single threaded, so these can be shared.
+static float batchMvpMatrices[MaxRenderBatchInstances * 16];
+static float batchVTParams[MaxRenderBatchInstances * 3 * 4];
+static std::vector<int> batchOrder;
+
+void renderBindBatchedPageIdPassShader()
+{
+	currentShader = getGlobalShaders().pageIdGenPassBatched.programId;
+	gl::useShaderProgram(currentShader);
+}
+
+void renderBindBatchedTexturedPassShader()
+{
+	currentShader = getGlobalShaders().vtRenderSimpleBatched.programId;
+	gl::useShaderProgram(currentShader);
+}
+
+// Draws instances [0, numInstances) of the batch already in the uniform arrays.
+static void drawBatch(const int numInstances, const RenderDrawElements & draw)
+{
+	if (gl::hasInstancedArrays())
+	{
+		gl::drawElementsInstanced(draw.mode, draw.indexCount, draw.indexType, draw.indices, numInstances);
+		return;
+	}
+
+	// The instance index is a constant attribute value. Changing it is much cheaper than a uniform upload.
+	for (int i = 0; i < numInstances; ++i)
+	{
+		glVertexAttrib1f(RenderInstanceIndexAttrib, static_cast<float>(i));
+		glDrawElements(draw.mode, draw.indexCount, draw.indexType, draw.indices);
+	}
+}
+
+// Per-instance index array for the instanced draws: 0, 1, 2, ... MaxRenderBatchInstances-1.
+static void beginInstanceIndexes()
+{
+	if (!gl::hasInstancedArrays())
+	{
+		glDisableVertexAttribArray(RenderInstanceIndexAttrib);
+		return;
+	}
+
+	static GLuint instanceIndexVBO = 0;
+
+	// Only created once. Never deleted, like the NDC quadrilateral VBO.
+	if (instanceIndexVBO == 0)
+	{
+		float indexes[MaxRenderBatchInstances];
+		for (int i = 0; i < MaxRenderBatchInstances; ++i)
+		{
+			indexes[i] = static_cast<float>(i);
+		}
+
+		glGenBuffers(1, &instanceIndexVBO);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceIndexVBO);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(indexes), indexes, GL_STATIC_DRAW);
+	}
+
+	// The application's vertex arrays are already set, so only the buffer binding has to be restored.
+	GLint appVBO = 0;
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &appVBO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, instanceIndexVBO);
+	glEnableVertexAttribArray(RenderInstanceIndexAttrib);
+	glVertexAttribPointer(RenderInstanceIndexAttrib, 1, GL_FLOAT, GL_FALSE, 0, nullptr);
+	gl::setVertexAttribDivisor(RenderInstanceIndexAttrib, 1);
+
+	glBindBuffer(GL_ARRAY_BUFFER, static_cast<GLuint>(appVBO));
+}
+
+static void endInstanceIndexes()
+{
+	if (gl::hasInstancedArrays())
+	{
+		gl::setVertexAttribDivisor(RenderInstanceIndexAttrib, 0);
+		glDisableVertexAttribArray(RenderInstanceIndexAttrib);
 	}
 }
 
+static void drawPageIdPassInstances(const RenderInstance * instances, const int numInstances, const RenderDrawElements & draw)
+{
+	const GlobalShaders & globShaders = getGlobalShaders();
+
+	for (int first = 0; first < numInstances; first += MaxRenderBatchInstances)
+	{
+		const int batchSize = std::min(numInstances - first, MaxRenderBatchInstances);
+		for (int i = 0; i < batchSize; ++i)
+		{
+			const RenderInstance & instance = instances[first + i];
+			const VirtualTexture & vtTex = *instance.vtTex;
+			assert(vtTex.getNumLevels()    >= 1);
+			assert(vtTex.getTextureIndex() >= 0);
+
+			// Same layout as u_vt_params in page_id_gen_pass_batched.vert:
+			float * params = &batchVTParams[i * 12];
+			params[0] = static_cast<float>(vtTex.getNumLevels() - 1);
+			params[1] = static_cast<float>(vtTex.getTextureIndex());
+			params[2] = getCompactPageBase(vtTex);
+			params[3] = 0.0f;
+			params[4] = vtTex.getLevel0SizeInPixels()[0];
+			params[5] = vtTex.getLevel0SizeInPixels()[1];
+			params[6] = vtTex.getLevel0SizeInPages()[0];
+			params[7] = vtTex.getLevel0SizeInPages()[1];
+			params[8]  = vtTex.getUVScale()[0];
+			params[9]  = vtTex.getUVScale()[1];
+			params[10] = 0.0f;
+			params[11] = 0.0f;
+
+			std::memcpy(&batchMvpMatrices[i * 16], instance.mvpMatrix, 16 * sizeof(float));
+		}
+
+		gl::setShaderProgramUniformArray(globShaders.pageIdGenPassBatched.unifMvpMatrices, batchMvpMatrices, 16, batchSize);
+		gl::setShaderProgramUniformArray(globShaders.pageIdGenPassBatched.unifVTParams, batchVTParams, 4, batchSize * 3);
+		drawBatch(batchSize, draw);
+	}
+}
+
+static void drawTexturedPassInstances(const RenderInstance * instances, const int numInstances, const RenderDrawElements & draw)
+{
+	const GlobalShaders & globShaders = getGlobalShaders();
+
+	// Group the instances by texture, so each one is only bound once:
+	batchOrder.resize(numInstances);
+	for (int i = 0; i < numInstances; ++i)
+	{
+		batchOrder[i] = i;
+	}
+	std::stable_sort(std::begin(batchOrder), std::end(batchOrder),
+		[instances](const int a, const int b) -> bool
+		{
+			return instances[a].vtTex < instances[b].vtTex;
+		}
+	);
+
+	int first = 0;
+	while (first < numInstances)
+	{
+		const VirtualTexture * vtTex = instances[batchOrder[first]].vtTex;
+		assert(vtTex->getNumPageFiles() == 1 && "Batched textured pass only supports single page file textures!");
+		renderBindTextureForTexturedPass(*vtTex);
+
+		int batchSize = 0;
+		while (first < numInstances && instances[batchOrder[first]].vtTex == vtTex)
+		{
+			std::memcpy(&batchMvpMatrices[batchSize * 16], instances[batchOrder[first]].mvpMatrix, 16 * sizeof(float));
+			++batchSize;
+			++first;
+
+			if (batchSize == MaxRenderBatchInstances)
+			{
+				gl::setShaderProgramUniformArray(globShaders.vtRenderSimpleBatched.unifMvpMatrices, batchMvpMatrices, 16, batchSize);
+				drawBatch(batchSize, draw);
+				batchSize = 0;
+			}
+		}
+
+		if (batchSize != 0)
+		{
+			gl::setShaderProgramUniformArray(globShaders.vtRenderSimpleBatched.unifMvpMatrices, batchMvpMatrices, 16, batchSize);
+			drawBatch(batchSize, draw);
+		}
+	}
+}
+
+void renderDrawInstances(const RenderInstance * instances, const int numInstances, const RenderDrawElements & draw)
+{
+	assert(instances != nullptr);
+
+	if (numInstances <= 0)
+	{
+		return;
+	}
+
+	const GlobalShaders & globShaders = getGlobalShaders();
+	const bool pageIdPass   = (currentShader == globShaders.pageIdGenPassBatched.programId);
+	const bool texturedPass = (currentShader == globShaders.vtRenderSimpleBatched.programId);
+	if (!pageIdPass && !texturedPass)
+	{
+		vtFatalError("renderDrawInstances() requires a batched shader to be bound!");
+		return;
+	}
+
+	beginInstanceIndexes();
+	if (pageIdPass)
+	{
+		drawPageIdPassInstances(instances, numInstances, draw);
+	}
+	else
+	{
+		drawTexturedPassInstances(instances, numInstances, draw);
+	}
+	endInstanceIndexes();
+}
+
 void renderSetMvpMatrix(const float * const mvpMatrix)
 {
 	const GlobalShaders & globShaders = getGlobalShaders();
@@ -340,6 +950,10 @@ void renderSetMipDebugBias(const float mipDebugBias)
 	{
 		gl::setShaderProgramUniform(globShaders.vtRenderLit.unifMipSampleBias, mipSampleBias);
 	}
+	else if (currentShader == globShaders.vtRenderSimpleBatched.programId)
+	{
+		gl::setShaderProgramUniform(globShaders.vtRenderSimpleBatched.unifMipSampleBias, mipSampleBias);
+	}
 	else
 	{
 		vtFatalError("currentShader is invalid!");
@@ -349,8 +963,14 @@ void renderSetMipDebugBias(const float mipDebugBias)
 void renderSetLog2MipScaleFactor(const float log2MipScaleFactor)
 {
 	// This is a pageIdGenPass param.
-	assert(currentShader == getGlobalShaders().pageIdGenPass.programId);
-	gl::setShaderProgramUniform(getGlobalShaders().pageIdGenPass.unifLog2MipScaleFactor, log2MipScaleFactor);
+	const GlobalShaders & globShaders = getGlobalShaders();
+	if (currentShader == globShaders.pageIdGenPassBatched.programId)
+	{
+		gl::setShaderProgramUniform(globShaders.pageIdGenPassBatched.unifLog2MipScaleFactor, log2MipScaleFactor);
+		return;
+	}
+	assert(currentShader == globShaders.pageIdGenPass.programId);
+	gl::setShaderProgramUniform(globShaders.pageIdGenPass.unifLog2MipScaleFactor, log2MipScaleFactor);
 }
 
 void renderSetLightPosObjectSpace(const float pos[4])
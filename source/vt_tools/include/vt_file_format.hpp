@@ -34,6 +34,7 @@
 #define VT_TOOL_FILE_FORMAT_HPP
 
 #include <cassert>
+#include <cstring>
 #include <vector>
 #include <array>
 
@@ -49,7 +50,16 @@ struct VTFF
 {
 	// VT magic and version number:
 	static constexpr uint32_t Magic   = 'VTFF';
-	static constexpr uint32_t Version = 4;
+	static constexpr uint32_t Version = 7;
+
+	// Oldest version still readable. Files older than
+	// FirstVersionWithMipTail have no MipTailInfo. Files older than
+	// FirstVersionWithPageStorage use PageInfoV5 and have no PageStorageInfo.
+	// Files older than FirstVersionWithValidExtents use MipLevelInfoV6.
+	static constexpr uint32_t MinVersion = 4;
+	static constexpr uint32_t FirstVersionWithMipTail = 5;
+	static constexpr uint32_t FirstVersionWithPageStorage = 6;
+	static constexpr uint32_t FirstVersionWithValidExtents = 7;
 
 	struct Header
 	{
@@ -71,9 +81,27 @@ struct VTFF
 		uint16_t numPagesX; // Number of pages in the x-axis.
 		uint16_t numPagesY; // Number of pages in the y-axis.
 
+		// Size in pixels of the image data, without border. Always starts at the first
+		// page. The right/bottom pages are only partially filled if this is less than
+		// numPages * pageContentSize, with the image edges repeated into the rest, and
+		// pages past it are all padding. The UV scale that maps the image into the
+		// pages is validWidth / (numPagesX * pageContentSize), same for the height.
+		uint32_t validWidth;
+		uint32_t validHeight;
+
 		// Followed by PageInfo[numPagesX * numPagesY] instances
 	};
 
+	// MipLevelInfo of files older than FirstVersionWithValidExtents.
+	// The image data always filled all the pages.
+	struct MipLevelInfoV6
+	{
+		uint32_t width;
+		uint32_t height;
+		uint16_t numPagesX;
+		uint16_t numPagesY;
+	};
+
 	struct PageInfo
 	{
 		// Offset from the beginning of the file where this page's data starts.
@@ -82,7 +110,91 @@ struct VTFF
 		// Size in bytes of this page. This is useful if the
 		// compression algorithm generates varying sized pages.
 		uint32_t sizeInBytes;
+
+		// Page stored at (pageSize >> storageShift) pixels, to be upsampled when
+		// loaded, with PageStorageInfo::upsampleFilter. 0 = full, 1 = half, 2 = quarter resolution.
+		uint8_t  storageShift;
+		uint8_t  reserved[3];
+	};
+
+	// PageInfo of files older than FirstVersionWithPageStorage.
+	struct PageInfoV5
+	{
+		uint64_t fileOffset;
+		uint32_t sizeInBytes;
 	};
+
+	// The always-resident mip tail: the coarsest level that fills a page,
+	// padding of partially filled pages included, resampled to power-of-two, then its mipmaps down to 1x1. Stored as
+	// tightly packed RGBA8 levels, with the same orientation as the pages.
+	// Meant to be loaded once into a small regular texture, to sample where
+	// no page is resident. Level 'l' is max(width >> l, 1) x max(height >> l, 1).
+	struct MipTailInfo
+	{
+		uint32_t width;       // Size of the first tail level, in pixels. Zero if the file has no tail.
+		uint32_t height;
+		uint32_t numLevels;   // Levels down to 1x1.
+		uint32_t sizeInBytes; // All levels.
+		uint64_t fileOffset;  // Offset from the beginning of the file.
+	};
+
+	// How the pages stored at reduced resolution (PageInfo::storageShift) are restored.
+	// The counts and the error are informative only.
+	struct PageStorageInfo
+	{
+		uint32_t upsampleFilter;     // tool::FilterType used to upsample reduced pages.
+		uint32_t numHalfResPages;    // Pages stored at half resolution.
+		uint32_t numQuarterResPages; // Pages stored at quarter resolution.
+		uint32_t maxError;           // Largest difference to the full page, in 8bits steps.
+	};
+
+	// Size of a mipmap level record in a file of the given version.
+	static uint32_t getMipLevelInfoSize(const uint32_t fileVersion)
+	{
+		return (fileVersion >= FirstVersionWithValidExtents) ? sizeof(MipLevelInfo) : sizeof(MipLevelInfoV6);
+	}
+
+	// Converts a mipmap level record read from a file of the given version.
+	static void unpackMipLevelInfo(const uint8_t * record, const uint32_t fileVersion, const uint32_t pageContentSize, MipLevelInfo & levelInfo)
+	{
+		if (fileVersion >= FirstVersionWithValidExtents)
+		{
+			std::memcpy(&levelInfo, record, sizeof(MipLevelInfo));
+			return;
+		}
+		MipLevelInfoV6 oldInfo;
+		std::memcpy(&oldInfo, record, sizeof(MipLevelInfoV6));
+		levelInfo.width       = oldInfo.width;
+		levelInfo.height      = oldInfo.height;
+		levelInfo.numPagesX   = oldInfo.numPagesX;
+		levelInfo.numPagesY   = oldInfo.numPagesY;
+		levelInfo.validWidth  = oldInfo.numPagesX * pageContentSize;
+		levelInfo.validHeight = oldInfo.numPagesY * pageContentSize;
+	}
+
+	// Size of a page info record in a file of the given version.
+	static uint32_t getPageInfoSize(const uint32_t fileVersion)
+	{
+		return (fileVersion >= FirstVersionWithPageStorage) ? sizeof(PageInfo) : sizeof(PageInfoV5);
+	}
+
+	// Converts page info records read from a file of the given version.
+	static void unpackPageInfos(const uint8_t * records, const uint32_t fileVersion, PageInfo * pageInfos, const size_t count)
+	{
+		if (fileVersion >= FirstVersionWithPageStorage)
+		{
+			std::memcpy(pageInfos, records, count * sizeof(PageInfo));
+			return;
+		}
+		for (size_t i = 0; i < count; ++i)
+		{
+			PageInfoV5 oldInfo;
+			std::memcpy(&oldInfo, records + i * sizeof(PageInfoV5), sizeof(PageInfoV5));
+			std::memset(&pageInfos[i], 0, sizeof(PageInfo));
+			pageInfos[i].fileOffset  = oldInfo.fileOffset;
+			pageInfos[i].sizeInBytes = oldInfo.sizeInBytes;
+		}
+	}
 };
 #pragma pack(pop)
 
@@ -107,15 +219,228 @@ struct VTFF
 // 2nd mip-level, 2nd PageInfo
 // 2nd mip-level, 3rd PageInfo
 // 2nd mip-level, 4th PageInfo
+// -------------------------------
+// MipTailInfo (since version 5)
+// -------------------------------
+// PageStorageInfo (since version 6)
 // ------------------------------- <== pageDataStart
 // pixel data of 4 pages
 // for 1st mip-level ...
+// (pages stored at reduced resolution are smaller)
 // -------------------------------
 // pixel data of 4 pages
 // for 2nd mip-level ...
 // -------------------------------
+// mip tail pixel data, if any
+// -------------------------------
+// EOF
+//
+
+// ======================================================
+// VTFA:
+// ======================================================
+
+//
+// VT File Archive (VTFA): A single container file for many VTFF textures.
+//
+// The archive has a global directory with one TextureEntry per texture,
+// followed by the MipLevelInfo and PageInfo tables of all textures, then
+// by the page data. The PageInfo offsets are absolute archive offsets.
+// Each texture's PageInfos are stored level after level, exactly like
+// the pages of a VTFFPageTree, so the runtime can memory map the file
+// and use views into the index, with no per-texture parsing.
+// The VTFF mip tails are copied after the page data, since version 4:
+//
+// -------------------------------
+// Header
+// -------------------------------
+// TextureEntry[numTextures]
+// -------------------------------
+// MipLevelInfo[totalLevels] (MipLevelInfoV6 before version 3)
+// -------------------------------
+// PageInfo[totalPages]
+// ------------------------------- <== pageDataStart
+// page data of all textures ...
+// -------------------------------
+// mip tail data of all textures, if any (since version 4)
+// -------------------------------
+// EOF
+//
+#pragma pack(push, 1)
+struct VTFA
+{
+	// Archive magic and version number:
+	static constexpr uint32_t Magic   = 'VTFA';
+	static constexpr uint32_t Version = 4;
+
+	// Oldest version still readable. Archives older than
+	// FirstVersionWithValidExtents store VTFF::MipLevelInfoV6.
+	// Archives older than FirstVersionWithMipTail use TextureEntryV3.
+	static constexpr uint32_t MinVersion = 2;
+	static constexpr uint32_t FirstVersionWithValidExtents = 3;
+	static constexpr uint32_t FirstVersionWithMipTail = 4;
+
+	// Max length of a texture name, including the null terminator.
+	static constexpr int MaxNameLength = 64;
+
+	// Size of a mipmap level record in an archive of the given version.
+	static uint32_t getMipLevelInfoSize(const uint32_t archiveVersion)
+	{
+		return (archiveVersion >= FirstVersionWithValidExtents) ? sizeof(VTFF::MipLevelInfo) : sizeof(VTFF::MipLevelInfoV6);
+	}
+
+	struct Header
+	{
+		uint32_t magic;         // First 4 bytes of file = 'VTFA'
+		uint32_t version;       // Archive version number.
+		uint32_t numTextures;   // Number of TextureEntry instances following the header.
+		uint32_t totalLevels;   // Number of MipLevelInfo instances, all textures.
+		uint32_t totalPages;    // Number of PageInfo instances, all textures.
+		uint64_t pageDataStart; // Offset of the first byte of page data.
+	};
+
+	struct TextureEntry
+	{
+		char     name[MaxNameLength]; // Null terminated. Source file name, without path and extension.
+		uint32_t pixelFormat;         // Same as VTFF::Header.
+		uint32_t numMipMapLevels;     // Same as VTFF::Header.
+		uint32_t pageContentSize;     // Same as VTFF::Header.
+		uint32_t pageSize;            // Same as VTFF::Header.
+		uint32_t borderSize;          // Same as VTFF::Header.
+		uint32_t firstLevel;          // Index of the texture's first MipLevelInfo in the global table.
+		uint32_t firstPage;           // Index of the texture's first PageInfo in the global table.
+		uint32_t upsampleFilter;      // Same as VTFF::PageStorageInfo. Zero for files older than version 6.
+		VTFF::MipTailInfo mipTail;    // Same as the VTFF one, with an archive offset. Zero width if none.
+	};
+
+	// TextureEntry of archives older than FirstVersionWithMipTail.
+	struct TextureEntryV3
+	{
+		char     name[MaxNameLength];
+		uint32_t pixelFormat;
+		uint32_t numMipMapLevels;
+		uint32_t pageContentSize;
+		uint32_t pageSize;
+		uint32_t borderSize;
+		uint32_t firstLevel;
+		uint32_t firstPage;
+		uint32_t upsampleFilter;
+	};
+
+	// Size of a texture entry in an archive of the given version.
+	static uint32_t getTextureEntrySize(const uint32_t archiveVersion)
+	{
+		return (archiveVersion >= FirstVersionWithMipTail) ? sizeof(TextureEntry) : sizeof(TextureEntryV3);
+	}
+
+	// Converts a texture entry read from an archive of the given version.
+	static void unpackTextureEntry(const uint8_t * record, const uint32_t archiveVersion, TextureEntry & entry)
+	{
+		if (archiveVersion >= FirstVersionWithMipTail)
+		{
+			std::memcpy(&entry, record, sizeof(TextureEntry));
+			return;
+		}
+		std::memset(&entry, 0, sizeof(TextureEntry));
+		std::memcpy(&entry, record, sizeof(TextureEntryV3)); // Common prefix.
+	}
+};
+#pragma pack(pop)
+
+// ======================================================
+// VTAT:
+// ======================================================
+
+//
+// VT Atlas remap Table (VTAT): Companion of a VTFF built from many textures
+// packed into one virtual texture (vtmake --atlas). For each texture,
+// maps its own [0,1] UVs into the virtual texture:
+//
+//   vt_uv = tex_uv * vec2(scaleU, scaleV) + vec2(biasU, biasV);
+//
+// Entries are in the order of the input files. Texture id = entry index.
+// Read at runtime by vt::AtlasRemapTable. vtAtlasRemap() applies it in GLSL.
+//
+// -------------------------------
+// Header
+// -------------------------------
+// Entry[numTextures]
+// -------------------------------
 // EOF
 //
+#pragma pack(push, 1)
+struct VTAT
+{
+	// Table magic and version number:
+	static constexpr uint32_t Magic   = 'VTAT';
+	static constexpr uint32_t Version = 1;
+
+	// Max length of a texture name, including the null terminator.
+	static constexpr int MaxNameLength = 64;
+
+	struct Header
+	{
+		uint32_t magic;       // First 4 bytes of file = 'VTAT'
+		uint32_t version;     // Table version number.
+		uint32_t numTextures; // Number of Entry instances following the header.
+		uint32_t atlasWidth;  // Level 0 size of the virtual texture, in pixels.
+		uint32_t atlasHeight;
+	};
+
+	struct Entry
+	{
+		char     name[MaxNameLength]; // Null terminated. Source file name, without path and extension.
+		float    scaleU, scaleV;      // UV transform, see above.
+		float    biasU,  biasV;
+		uint32_t x, y;                // Level 0 rect in the atlas, in pixels. Top-left origin.
+		uint32_t width, height;       // Might be larger than the source if padded for page alignment.
+		uint32_t srcWidth, srcHeight; // Size of the source image.
+	};
+};
+#pragma pack(pop)
+
+// ======================================================
+// VTPO:
+// ======================================================
+
+//
+// VT Page Overlay (VTPO): Sparse set of pages written at runtime to
+// a writable VirtualTexture (see PageOverlay). Only modified pages are
+// stored, each in a fixed size slot holding a SlotHeader followed by
+// the uncompressed RGBA page. A page rewritten later reuses its slot.
+// The runtime rebuilds its index by scanning the slot headers, so an
+// incomplete slot at the end of the file is simply ignored:
+//
+// -------------------------------
+// Header
+// -------------------------------
+// Slot[0]: SlotHeader + page data
+// Slot[1]: SlotHeader + page data
+// ...
+// -------------------------------
+// EOF
+//
+#pragma pack(push, 1)
+struct VTPO
+{
+	// Overlay magic and version number:
+	static constexpr uint32_t Magic   = 'VTPO';
+	static constexpr uint32_t Version = 1;
+
+	struct Header
+	{
+		uint32_t magic;    // First 4 bytes of file = 'VTPO'
+		uint32_t version;  // Overlay version number.
+		uint32_t pageSize; // Page size in pixels, with border. Pages are always RGBA.
+	};
+
+	struct SlotHeader
+	{
+		uint32_t pageId; // Page position and level. The texture index is always zero.
+		uint32_t fileId; // Page file of the VirtualTexture the page belongs to.
+	};
+};
+#pragma pack(pop)
 
 // ======================================================
 // VTFFPageTree:
@@ -123,6 +448,9 @@ struct VTFF
 
 // Quadtree-like page set. Each texture mipmap level is represented
 // by and array of VTFF::PageInfo that allows us to index the Virtual Texture file.
+//
+// The tree either owns its page infos or is a view into an external
+// array of them (e.g. the memory mapped index of a VTFA archive).
 class VTFFPageTree final
 	: public NonCopyable
 {
@@ -130,52 +458,35 @@ public:
 
 	using PageInfo = VTFF::PageInfo;
 
-	VTFFPageTree(const int * vtPagesX, const int * vtPagesY, const unsigned int numLevels)
+	// Allocates and owns the page infos. Filled with set().
+	VTFFPageTree(const int * vtPagesX, const int * vtPagesY, const unsigned int vtNumLevels)
 	{
-		assert(numLevels > 0 && numLevels <= MaxVTMipLevels);
-
-		// Clear every slot first, as some might end up unused:
-		clearArray(numPagesX);
-		clearArray(numPagesY);
-		for (unsigned int l = 0; l < numLevels; ++l)
-		{
-			assert(vtPagesX[l] > 0);
-			assert(vtPagesY[l] > 0);
-			numPagesX[l] = vtPagesX[l];
-			numPagesY[l] = vtPagesY[l];
-		}
-
-		// Count total number of entries to allocate exact amount of memory:
-		unsigned int totalEntries = 0;
-		for (unsigned int l = 0; l < numLevels; ++l)
-		{
-			totalEntries += numPagesX[l] * numPagesY[l];
-		}
-
-		levels.resize(numLevels, nullptr);
+		const unsigned int totalEntries = initLevels(vtPagesX, vtPagesY, vtNumLevels);
 		pageInfoPool.resize(totalEntries, {});
+		pages = pageInfoPool.data();
+	}
 
-		// Set up the pointers:
-		totalEntries = 0;
-		for (unsigned int l = 0; l < numLevels; ++l)
-		{
-			levels[l] = pageInfoPool.data() + totalEntries;
-			totalEntries += numPagesX[l] * numPagesY[l]; // Move to the next level
-		}
-
-		assert(totalEntries == pageInfoPool.size());
-		assert(numLevels    == levels.size());
+	// View into 'externalPages', laid out level after level. Nothing is copied and
+	// the external memory must outlive the tree. A view is read-only, set() cannot be used.
+	VTFFPageTree(const int * vtPagesX, const int * vtPagesY, const unsigned int vtNumLevels, const PageInfo * externalPages)
+	{
+		assert(externalPages != nullptr);
+		initLevels(vtPagesX, vtPagesY, vtNumLevels);
+		pages = externalPages;
 	}
 
-	void set(const int x, const int y, const int level, const uint64_t fileOffset, const uint32_t sizeInBytes)
+	void set(const int x, const int y, const int level, const uint64_t fileOffset,
+	         const uint32_t sizeInBytes, const uint8_t storageShift = 0)
 	{
+		assert(!isView());
 		assert(level >= 0 && level < getNumLevels());
-		PageInfo * levelPages = levels[level];
 		const int pageIndex = x + y * numPagesX[level];
 
 		assert(pageIndex < (numPagesX[level] * numPagesY[level]));
-		levelPages[pageIndex].fileOffset  = fileOffset;
-		levelPages[pageIndex].sizeInBytes = sizeInBytes;
+		PageInfo & pageInfo  = pageInfoPool[levelStart[level] + pageIndex];
+		pageInfo.fileOffset  = fileOffset;
+		pageInfo.sizeInBytes = sizeInBytes;
+		pageInfo.storageShift = storageShift;
 	}
 
 	PageInfo get(const PageId id) const
@@ -185,16 +496,20 @@ public:
 		const int level = pageIdExtractMipLevel(id);
 
 		assert(level >= 0 && level < getNumLevels());
-		const PageInfo * levelPages = levels[level];
 		const int pageIndex = x + y * numPagesX[level];
 
 		assert(pageIndex < (numPagesX[level] * numPagesY[level]));
-		return levelPages[pageIndex];
+		return pages[levelStart[level] + pageIndex];
+	}
+
+	bool isView() const
+	{
+		return pageInfoPool.empty();
 	}
 
 	int getNumLevels() const
 	{
-		return static_cast<int>(levels.size());
+		return numLevels;
 	}
 
 	int getNumPagesX(const int level) const
@@ -219,7 +534,7 @@ public:
 
 	void getLevelDimensions(int * vtPagesX, int * vtPagesY) const
 	{
-		for (size_t l = 0; l < levels.size(); ++l)
+		for (int l = 0; l < numLevels; ++l)
 		{
 			vtPagesX[l] = numPagesX[l];
 			vtPagesY[l] = numPagesY[l];
@@ -228,17 +543,58 @@ public:
 
 	void clear()
 	{
+		assert(!isView());
 		std::memset(pageInfoPool.data(), 0, pageInfoPool.size() * sizeof(PageInfo));
 	}
 
+	size_t getMemoryBytes() const
+	{
+		// Views don't own any memory.
+		return pageInfoPool.capacity() * sizeof(PageInfo);
+	}
+
+private:
+
+	unsigned int initLevels(const int * vtPagesX, const int * vtPagesY, const unsigned int vtNumLevels)
+	{
+		assert(vtNumLevels > 0 && vtNumLevels <= MaxVTMipLevels);
+		numLevels = static_cast<int>(vtNumLevels);
+
+		// Clear every slot first, as some might end up unused:
+		clearArray(numPagesX);
+		clearArray(numPagesY);
+		clearArray(levelStart);
+
+		// Count total number of entries and set up the level offsets:
+		unsigned int totalEntries = 0;
+		for (unsigned int l = 0; l < vtNumLevels; ++l)
+		{
+			assert(vtPagesX[l] > 0);
+			assert(vtPagesY[l] > 0);
+			numPagesX[l]  = vtPagesX[l];
+			numPagesY[l]  = vtPagesY[l];
+			levelStart[l] = totalEntries;
+			totalEntries += numPagesX[l] * numPagesY[l]; // Move to the next level
+		}
+
+		return totalEntries;
+	}
+
 private:
 
-	std::vector<PageInfo *> levels;
-	std::vector<PageInfo>   pageInfoPool;
+	// Page infos of all levels. Points to either 'pageInfoPool' or external memory.
+	const PageInfo * pages;
+
+	// Owned page infos. Empty if this tree is a view.
+	std::vector<PageInfo> pageInfoPool;
+
+	// Index of the first page of each level in 'pages'.
+	std::array<unsigned int, MaxVTMipLevels> levelStart;
 
 	// Per-level page counts. Unused ones set to zero.
 	std::array<int, MaxVTMipLevels> numPagesX;
 	std::array<int, MaxVTMipLevels> numPagesY;
+	int numLevels;
 };
 
 } // namespace vt {}
@@ -100,6 +100,27 @@ struct TPixel4
 	T a;
 };
 
+// ======================================================
+// ResizeFilter:
+// ======================================================
+
+//
+// Filtering applied by Image::resize(). These are quick filters for
+// interleaved images; FloatImageBuffer::resize() has the high quality ones.
+//
+enum class ResizeFilter
+{
+	// Point sampling. No filtering at all.
+	Nearest,
+
+	// Average of the source area covered by each pixel.
+	// Same as Bilinear for the dimensions being enlarged.
+	Box,
+
+	// Linear interpolation of the 4 nearest source pixels.
+	Bilinear
+};
+
 // ======================================================
 // Image:
 // ======================================================
@@ -188,12 +209,12 @@ public:
 	void flipH(Image & destImage) const;
 
 	// Resizes this image, in place.
-	void resizeInPlace(uint32_t targetWidth, uint32_t targetHeight);
+	void resizeInPlace(uint32_t targetWidth, uint32_t targetHeight, ResizeFilter filter = ResizeFilter::Nearest);
 
 	// Creates a resized copy of this image.
-	void resize(Image & destImage, uint32_t targetWidth, uint32_t targetHeight) const;
+	void resize(Image & destImage, uint32_t targetWidth, uint32_t targetHeight, ResizeFilter filter = ResizeFilter::Nearest) const;
 
-	// Rounds this image down to its nearest power for 2.
+	// Rounds this image down to its nearest power for 2, with a box filter.
 	void roundDownToPowerOfTwo();
 
 	// Swizzle the fist and third color channels of the image,
@@ -242,6 +263,10 @@ private:
 	// Move 'img' to this image. 'img' is invalidated after that.
 	void moveCopy(Image & img);
 
+	// Copies row 'rectY' of a setRect() source, in this image's format.
+	void setRectRow(const uint8_t * rowPixels, uint32_t xOffset, uint32_t yOffset,
+	                uint32_t rectY, uint32_t rectWidth, bool topLeft);
+
 private:
 
 	// Pointer to in memory image data, compressed or uncompressed.
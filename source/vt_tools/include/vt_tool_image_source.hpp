@@ -0,0 +1,168 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: vt_tool_image_source.hpp
+// Author: Guilherme R. Lampert
+// Created on: 18/10/26
+// Brief: Source image readers that deliver scanline bands on demand.
+//
+// License:
+//  This source code is released under the MIT License.
+//  Copyright (c) 2014 Guilherme R. Lampert.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+// ================================================================================================
+
+#ifndef VT_TOOL_IMAGE_SOURCE_HPP
+#define VT_TOOL_IMAGE_SOURCE_HPP
+
+#include "vt_tool_float_image_buffer.hpp"
+#include "vt_tool_filters.hpp"
+
+#include <string>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+namespace vt
+{
+namespace tool
+{
+
+// ======================================================
+// ImageSource:
+// ======================================================
+
+//
+// A source image read in bands of scanlines, so that huge inputs never have to be
+// decoded into a single buffer. Rows are numbered top to bottom, as stored in the file,
+// and are always delivered as 4 component (RGBA) floats in the [0,1] range.
+//
+// Readers available:
+//  - Memory-mapped raw 8bit (.raw), PPM/PGM (.ppm/.pgm) and PFM (.pfm). No decoding at all.
+//  - Streaming PNG. Inflates and unfilters one row at a time. Interlaced files are not streamed.
+//  - TIFF, tiled or stripped, uncompressed or deflate. Decodes one row of tiles/strips at a time.
+//  - Anything else goes through stb_image, fully decoded, but kept as bytes until requested.
+//
+class ImageSource
+{
+public:
+
+	// Raw files have no header. Their layout has to be provided when opening.
+	struct RawLayout
+	{
+		uint32_t width;
+		uint32_t height;
+		uint32_t numComponents; // 1 (grey), 3 (RGB) or 4 (RGBA). 8bits each.
+
+		RawLayout(const uint32_t w = 0, const uint32_t h = 0, const uint32_t c = 0)
+			: width(w), height(h), numComponents(c) { }
+	};
+
+	// Opens a reader for the given file, based on its contents (the extension is only used for raw files).
+	// Returns null and sets 'errorMessage', if not null, on failure.
+	static std::unique_ptr<ImageSource> open(const std::string & filename,
+	                                         const RawLayout & rawLayout = RawLayout(),
+	                                         std::string * errorMessage = nullptr);
+
+	// Reads rows [firstRow, firstRow + numRows) into rows [destRow, destRow + numRows) of 'band',
+	// which must be an RGBA float buffer as wide as the image. Sequential sources can only move
+	// forward: rows can be skipped, but not read again. Returns false and sets 'errorMessage' on failure.
+	virtual bool readRows(uint32_t firstRow, uint32_t numRows, FloatImageBuffer & band,
+	                      uint32_t destRow, std::string * errorMessage = nullptr) = 0;
+
+	// True if rows can be read in any order and more than once.
+	virtual bool isRandomAccess() const = 0;
+
+	// Printable name of the reader, for the verbose output.
+	virtual const char * getReaderName() const = 0;
+
+	// Accessors:
+	uint32_t getWidth()  const { return width;  }
+	uint32_t getHeight() const { return height; }
+
+	// Default virtual for proper inheritance usage.
+	virtual ~ImageSource() = default;
+
+protected:
+
+	uint32_t width  = 0;
+	uint32_t height = 0;
+};
+
+using ImageSourcePtr = std::unique_ptr<ImageSource>;
+
+// ======================================================
+// StreamingResizer:
+// ======================================================
+
+//
+// Same filtering as FloatImageBuffer::resize() with Clamp addressing, but fed one source row
+// at a time, in order. Each destination row is handed to the callback as soon as all the source
+// rows under its filter window have arrived. Only a window of horizontally filtered rows is kept,
+// so neither the source nor the destination image is ever stored in full. Results are identical
+// to resize() on the whole image.
+//
+class StreamingResizer final
+{
+public:
+
+	// Receives a buffer and the index of the row in it, plus the destination row number.
+	using RowCallback = std::function<void(const FloatImageBuffer & rows, uint32_t rowInBuffer, uint32_t destRow)>;
+
+	StreamingResizer(const Filter & filter, uint32_t numComponents, uint32_t srcWidth,
+	                 uint32_t srcHeight, uint32_t destWidth, uint32_t destHeight);
+
+	// No copy or assignment.
+	StreamingResizer(const StreamingResizer &) = delete;
+	StreamingResizer & operator = (const StreamingResizer &) = delete;
+
+	// Feeds the next source row, which is row 'rowInBuffer' of 'rows'.
+	void pushRow(const FloatImageBuffer & rows, uint32_t rowInBuffer, const RowCallback & emitRow);
+
+	// Accessors:
+	uint32_t getDestWidth()  const { return destWidth;  }
+	uint32_t getDestHeight() const { return destHeight; }
+	bool isFinished() const { return nextDestRow == destHeight; }
+
+private:
+
+	// Source row range under the filter window of a destination row, clamped to the image.
+	void getSourceWindow(uint32_t destRow, int32_t & left, int32_t & lastNeeded) const;
+
+	PolyphaseKernel xKernel;
+	PolyphaseKernel yKernel;
+
+	const uint32_t srcHeight;
+	const uint32_t destWidth;
+	const uint32_t destHeight;
+
+	// Ring of horizontally filtered source rows. Source row 'r' lives in row (r % ringRows).
+	FloatImageBuffer ringRows;
+	FloatImageBuffer outputRow;
+
+	uint32_t numRowsReceived;
+	uint32_t nextDestRow;
+};
+
+} // namespace tool {}
+} // namespace vt {}
+
+#endif // VT_TOOL_IMAGE_SOURCE_HPP
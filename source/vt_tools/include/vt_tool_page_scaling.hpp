@@ -0,0 +1,82 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: vt_tool_page_scaling.hpp
+// Author: Guilherme R. Lampert
+// Created on: 18/10/26
+// Brief: Reduced resolution storage of individual pages.
+//
+// License:
+//  This source code is released under the MIT License.
+//  Copyright (c) 2014 Guilherme R. Lampert.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+// ================================================================================================
+
+#ifndef VT_TOOL_PAGE_SCALING_HPP
+#define VT_TOOL_PAGE_SCALING_HPP
+
+#include "vt_tool_filters.hpp"
+
+#include <vector>
+#include <cstdint>
+
+namespace vt
+{
+namespace tool
+{
+
+// ======================================================
+// Reduced resolution pages:
+// ======================================================
+
+//
+// Pages with little detail can be stored at half or quarter resolution
+// and upsampled when loaded (see VTFF::PageInfo::storageShift). The builder
+// and the runtime share these functions, so the error measured by the builder
+// is exactly the error of the page the runtime will reconstruct.
+// Pages are square, tightly packed 8bits RGBA, including the border.
+//
+
+// Stored at up to (pageSize >> MaxPageStorageShift) pixels: quarter resolution.
+constexpr uint32_t MaxPageStorageShift = 2;
+
+// Size in bytes of a page stored with the given shift.
+inline uint32_t reducedPageSizeBytes(const uint32_t pageSize, const uint32_t shift)
+{
+	return (pageSize >> shift) * (pageSize >> shift) * 4;
+}
+
+// Downsamples 'page' to (pageSize >> shift) pixels, replacing the contents of 'reduced'.
+void reducePageRgbaU8(const uint8_t * page, uint32_t pageSize, uint32_t shift,
+                      FilterType filter, std::vector<uint8_t> & reduced);
+
+// Upsamples a page stored with the given shift back to its full size.
+// 'dest' must have room for a full page. 'reduced' and 'dest' must not overlap.
+void expandPageRgbaU8(const uint8_t * reduced, uint32_t pageSize, uint32_t shift,
+                      FilterType filter, uint8_t * dest);
+
+// Largest difference between any two channels of the given pages, in 8bits steps.
+int pageMaxErrorRgbaU8(const uint8_t * pageA, const uint8_t * pageB, uint32_t pageSize);
+
+} // namespace tool {}
+} // namespace vt {}
+
+#endif // VT_TOOL_PAGE_SCALING_HPP
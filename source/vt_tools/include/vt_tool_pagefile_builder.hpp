@@ -101,6 +101,34 @@ struct PageFileBuilderOptions
 	// Print a few stats about the pagefile generation process to STDOUT.
 	bool stdoutVerbose        = true;
 
+	// Write the always-resident mip tail (VTFF::MipTailInfo):
+	// the last page level and all sub-page levels down to 1x1.
+	bool writeMipTail         = true;
+
+	// Read the source through an ImageSource (vt_tool_image_source.hpp), tiling and
+	// downsampling bands of scanlines as they arrive, instead of decoding it whole first.
+	bool streamSource         = true;
+
+	// Layout of headerless ".raw" sources: 8bits per component, 1, 3 or 4 components.
+	int rawWidth              = 0;
+	int rawHeight             = 0;
+	int rawComponents         = 0;
+
+	// Store pages with little detail at half or quarter resolution (VTFF::PageInfo::storageShift),
+	// if upsampling them back with textureFilter changes no channel by more than reducePagesMaxError.
+	bool reducePages          = false;
+	int reducePagesMaxError   = 2;
+
+	// Atlas mode only: pack textures at pixel granularity, letting neighbours share pages.
+	// By default every texture gets a rect of whole pages and never shares a page.
+	// The image is not resampled to fill it. Its edges are repeated past the image.
+	bool atlasSharePages      = false;
+
+	// Atlas mode only: number of mip-levels, past level 0, for which each texture keeps
+	// whole pages of its own. Sizes are rounded up to multiples of 2^N pages for that,
+	// so larger values trade atlas space for fewer shared pages in the coarse levels.
+	int atlasAlignedLevels    = 1;
+
 	// Prints this structure to STDOUT.
 	void printSelf() const;
 };
@@ -119,6 +147,12 @@ public:
 	                std::string outputFile,
 	                PageFileBuilderOptions options);
 
+	// Atlas mode. Packs every input image into one virtual texture and writes
+	// a VTAT remap table next to the output file (see atlasRemapFileName()).
+	PageFileBuilder(std::vector<std::string> inputFiles,
+	                std::string outputFile,
+	                PageFileBuilderOptions options);
+
 	// No copy or assignment.
 	PageFileBuilder(const PageFileBuilder &) = delete;
 	PageFileBuilder & operator = (const PageFileBuilder &) = delete;
@@ -127,15 +161,37 @@ public:
 	// Throws an exception if any step of the process fails and it cannot recover.
 	void generatePageFile();
 
+	// Name of the VTAT file written in atlas mode: output name with a ".vtatlas" extension.
+	static std::string atlasRemapFileName(const std::string & outputFile);
+
 private:
 
 	// Throws a PageFileBuilderError.
 	void error(const std::string & errorMessage) const;
+	void validateOptions();
 
 	// Internal helpers.
+	void setBasePageLayout(uint32_t width, uint32_t height);
+	void getLevelPageLayout(unsigned int level, uint32_t & tilesX, uint32_t & tilesY) const;
+	void getLevelUsedPages(unsigned int level, uint32_t & usedX, uint32_t & usedY) const;
+	unsigned int countPageLevels(uint32_t width, uint32_t height) const;
 	void processImage(const FloatImageBuffer & source, unsigned int level);
 	void writePageFile() const;
 	void writeVTFF() const;
+	int choosePageStorage(std::vector<uint8_t> & storageShifts, std::vector<std::vector<uint8_t>> & reducedPages) const;
+	void buildMipTail(const FloatImageBuffer & lastLevel, unsigned int level, const Filter & filter);
+
+	// Streaming path (opts.streamSource).
+	class LevelTiler;
+	void generateStreamedPageFile(const Filter & filter);
+
+	// Atlas mode helpers.
+	struct AtlasTexture;
+	void generateAtlasPageFile();
+	void loadAtlasTextures(std::vector<AtlasTexture> & textures) const;
+	int packAtlasTextures(std::vector<AtlasTexture> & textures) const;
+	void processAtlasTexture(const AtlasTexture & tex, const FloatImageBuffer & source, unsigned int level, uint32_t levelSize);
+	void writeAtlasRemapTable(const std::vector<AtlasTexture> & textures, int atlasSize) const;
 
 	// Little helper class for a 2D array of tiles/pages:
 	class MipMapLevel
@@ -144,13 +200,26 @@ private:
 		uint32_t tilesX = 0;
 		uint32_t tilesY = 0;
 
-		// Indexed tile/page access:
+		// Size of the image data, without borders. Less than the pages
+		// add up to if the right/bottom pages are only partially filled.
+		uint32_t validWidth  = 0;
+		uint32_t validHeight = 0;
+
+		// Pages from the top-left that the UV scale can reach. The padding pages
+		// past them are never requested, so they are not tiled and have no storage.
+		uint32_t usedTilesX = 0;
+		uint32_t usedTilesY = 0;
+
+		bool isPaddingTile(uint32_t x, uint32_t y) const { return (x >= usedTilesX) || (y >= usedTilesY); }
+
+		// Indexed tile/page access. Padding tiles are empty.
 		const FloatImageBuffer & getTileAt(uint32_t x, uint32_t y) const;
 		FloatImageBuffer & getTileAt(uint32_t x, uint32_t y);
 
 		// Memory management:
 		bool isAllocated() const;
-		void allocate(uint32_t tx, uint32_t ty, uint32_t numComponents, uint32_t pageSizePixels);
+		void allocate(uint32_t tx, uint32_t ty, uint32_t usedTx, uint32_t usedTy,
+		              uint32_t numComponents, uint32_t pageSizePixels);
 		void free();
 
 	private:
@@ -163,6 +232,7 @@ private:
 	// Input params:
 	const std::string inputFileName;
 	const std::string outputFileName;
+	const std::vector<std::string> atlasInputFiles;
 	const PageFileBuilderOptions opts;
 
 	// Pixel format of the source image.
@@ -170,8 +240,29 @@ private:
 
 	// All mip-levels in this pagefile.
 	std::vector<MipMapLevel> pageFileLevels;
+
+	// Pages of level 0, rounded up to a power-of-two. Every other
+	// level has max(basePagesX >> level, 1) by max(basePagesY >> level, 1).
+	uint32_t basePagesX;
+	uint32_t basePagesY;
+
+	// Size of the level 0 image, in pixels.
+	uint32_t baseWidth;
+	uint32_t baseHeight;
+
+	// Levels of the mip tail, largest first. Empty if not written.
+	std::vector<FloatImageBuffer> mipTailLevels;
 };
 
+// ======================================================
+// VTFF archive packing:
+// ======================================================
+
+// Packs a set of existing VTFF files into a single VTFA archive (see vt_file_format.hpp).
+// Each texture is named after its input file, without path and extension.
+// Throws a PageFileBuilderError if any input is invalid or if the output cannot be written.
+void packVTFFArchive(const std::vector<std::string> & inputFiles, const std::string & outputFile, bool verbose);
+
 } // namespace tool {}
 } // namespace vt {}
 
@@ -39,6 +39,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <string>
+#include <vector>
 
 /*
  * Usage:
@@ -46,6 +47,12 @@
  * $ vtmake <input_file> <output_file> [--flags]
  * (Currently, args have to be in this specific order!)
  *
+ * $ vtmake --pack <output_archive> <input_1.vt> [input_2.vt ...]
+ * Packs existing VTFF files into a single VTFA archive. No flags accepted.
+ *
+ * $ vtmake --atlas <output_file> <image_1> [image_2 ...] [--flags]
+ * Packs many images into one virtual texture, plus a VTAT remap table (<output>.vtatlas).
+ *
  * Flags accepted:
  *
  * --help           : prints help text with list of commands
@@ -60,6 +67,15 @@
  * --add_debug_info : PageFileBuilderOptions::addDebugInfoToPages   (bool)
  * --dump_images    : PageFileBuilderOptions::dumpPageImages        (bool)
  * --verbose        : PageFileBuilderOptions::stdoutVerbose         (bool)
+ * --mip_tail       : PageFileBuilderOptions::writeMipTail          (bool)
+ * --stream         : PageFileBuilderOptions::streamSource          (bool)
+ * --raw_width      : PageFileBuilderOptions::rawWidth              (int)
+ * --raw_height     : PageFileBuilderOptions::rawHeight             (int)
+ * --raw_channels   : PageFileBuilderOptions::rawComponents         (int)
+ * --reduce_pages   : PageFileBuilderOptions::reducePages           (bool)
+ * --reduce_error   : PageFileBuilderOptions::reducePagesMaxError   (int)
+ * --share_pages    : PageFileBuilderOptions::atlasSharePages       (bool)
+ * --align_levels   : PageFileBuilderOptions::atlasAlignedLevels    (int)
  */
 
 namespace {
@@ -73,6 +89,8 @@ void printHelpAndExit(const char * progName)
 	std::printf("\n"
 	"Usage:\n"
 	"$ %s <input_file> <output_file> [--flags=]\n"
+	"$ %s --pack <output_archive> <input_1.vt> [input_2.vt ...]\n"
+	"$ %s --atlas <output_file> <image_1> [image_2 ...] [--flags=]\n"
 	"\n"
 	"Flags accepted:\n"
 	" --help           : prints help text with list of commands.\n"
@@ -87,7 +105,25 @@ void printHelpAndExit(const char * progName)
 	" --add_debug_info : (bool) print debug text to each page.\n"
 	" --dump_images    : (bool) dump each page as an image file (TGA format).\n"
 	" --verbose        : (bool) print stuff to STDOUT while running.\n"
-	"\n", progName);
+	" --mip_tail       : (bool) write the always-resident mip tail (last page level down to 1x1).\n"
+	" --stream         : (bool) read the source in bands of scanlines instead of decoding it whole first.\n"
+	"                    Streamed: PNG, TIFF, PPM/PGM, PFM and .raw. Other formats are decoded by stb_image.\n"
+	" --raw_width      : (int)  width in pixels of a headerless .raw source.\n"
+	" --raw_height     : (int)  height in pixels of a headerless .raw source.\n"
+	" --raw_channels   : (int)  8bit channels per pixel of a .raw source: 1, 3 or 4.\n"
+	" --reduce_pages   : (bool) store low detail pages at half or quarter resolution.\n"
+	" --reduce_error   : (int)  max per channel error, in 8bit steps, allowed for a reduced page. Default 2.\n"
+	"\n"
+	"Pack mode:\n"
+	" --pack           : pack the given VTFF files into a single VTFA archive.\n"
+	"                    Textures are named after their files, without path and extension.\n"
+	"\n"
+	"Atlas mode:\n"
+	" --atlas          : pack the given images into one virtual texture. Also writes a remap table\n"
+	"                    with the UV scale and bias of each image to <output_file>.vtatlas.\n"
+	" --share_pages    : (bool) pack at pixel granularity, letting images share pages.\n"
+	" --align_levels   : (int)  levels past the first for which each image keeps whole pages.\n"
+	"\n", progName, progName, progName);
 	std::exit(0);
 }
 
@@ -193,6 +229,102 @@ bool startsWith(const char * str, const char * prefix)
 	return std::strncmp(str, prefix, prefixLen) == 0;
 }
 
+// ======================================================
+// parseFlag():
+// ======================================================
+
+void parseFlag(const char * progName, const char * arg, vt::tool::PageFileBuilderOptions & cmdLineOpts)
+{
+	if (startsWith(arg, "--help"))
+	{
+		printHelpAndExit(progName);
+	}
+	else if (startsWith(arg, "--filter"))
+	{
+		cmdLineOpts.textureFilter = parseFilterName(arg);
+	}
+	else if (startsWith(arg, "--page_size"))
+	{
+		cmdLineOpts.pageSizePixels = parseInt(arg);
+	}
+	else if (startsWith(arg, "--content_size"))
+	{
+		cmdLineOpts.pageContentSizePixels = parseInt(arg);
+	}
+	else if (startsWith(arg, "--border_size"))
+	{
+		cmdLineOpts.pageBorderSizePixels = parseInt(arg);
+	}
+	else if (startsWith(arg, "--max_levels"))
+	{
+		cmdLineOpts.maxMipLevels = parseInt(arg);
+	}
+	else if (startsWith(arg, "--flip_v_src"))
+	{
+		cmdLineOpts.flipSourceVertically = parseBool(arg);
+	}
+	else if (startsWith(arg, "--flip_v_tiles"))
+	{
+		cmdLineOpts.flipTilesVertically = parseBool(arg);
+	}
+	else if (startsWith(arg, "--stop_on_1_mip"))
+	{
+		cmdLineOpts.stopOn1PageMip = parseBool(arg);
+	}
+	else if (startsWith(arg, "--add_debug_info"))
+	{
+		cmdLineOpts.addDebugInfoToPages = parseBool(arg);
+	}
+	else if (startsWith(arg, "--dump_images"))
+	{
+		cmdLineOpts.dumpPageImages = parseBool(arg);
+	}
+	else if (startsWith(arg, "--verbose"))
+	{
+		cmdLineOpts.stdoutVerbose = parseBool(arg);
+	}
+	else if (startsWith(arg, "--mip_tail"))
+	{
+		cmdLineOpts.writeMipTail = parseBool(arg);
+	}
+	else if (startsWith(arg, "--stream"))
+	{
+		cmdLineOpts.streamSource = parseBool(arg);
+	}
+	else if (startsWith(arg, "--raw_width"))
+	{
+		cmdLineOpts.rawWidth = parseInt(arg);
+	}
+	else if (startsWith(arg, "--raw_height"))
+	{
+		cmdLineOpts.rawHeight = parseInt(arg);
+	}
+	else if (startsWith(arg, "--raw_channels"))
+	{
+		cmdLineOpts.rawComponents = parseInt(arg);
+	}
+	else if (startsWith(arg, "--reduce_pages"))
+	{
+		cmdLineOpts.reducePages = parseBool(arg);
+	}
+	else if (startsWith(arg, "--reduce_error"))
+	{
+		cmdLineOpts.reducePagesMaxError = parseInt(arg);
+	}
+	else if (startsWith(arg, "--share_pages"))
+	{
+		cmdLineOpts.atlasSharePages = parseBool(arg);
+	}
+	else if (startsWith(arg, "--align_levels"))
+	{
+		cmdLineOpts.atlasAlignedLevels = parseInt(arg);
+	}
+	else
+	{
+		std::printf("WARNING: Unknown command line argument: '%s'\n", arg);
+	}
+}
+
 // ======================================================
 // parseCmdLine():
 // ======================================================
@@ -217,58 +349,7 @@ void parseCmdLine(const int argc, const char * argv[], std::string & inputFile,
 
 	for (int i = 3; i < argc; ++i)
 	{
-		if (startsWith(argv[i], "--help"))
-		{
-			printHelpAndExit(argv[0]);
-		}
-		else if (startsWith(argv[i], "--filter"))
-		{
-			cmdLineOpts.textureFilter = parseFilterName(argv[i]);
-		}
-		else if (startsWith(argv[i], "--page_size"))
-		{
-			cmdLineOpts.pageSizePixels = parseInt(argv[i]);
-		}
-		else if (startsWith(argv[i], "--content_size"))
-		{
-			cmdLineOpts.pageContentSizePixels = parseInt(argv[i]);
-		}
-		else if (startsWith(argv[i], "--border_size"))
-		{
-			cmdLineOpts.pageBorderSizePixels = parseInt(argv[i]);
-		}
-		else if (startsWith(argv[i], "--max_levels"))
-		{
-			cmdLineOpts.maxMipLevels = parseInt(argv[i]);
-		}
-		else if (startsWith(argv[i], "--flip_v_src"))
-		{
-			cmdLineOpts.flipSourceVertically = parseBool(argv[i]);
-		}
-		else if (startsWith(argv[i], "--flip_v_tiles"))
-		{
-			cmdLineOpts.flipTilesVertically = parseBool(argv[i]);
-		}
-		else if (startsWith(argv[i], "--stop_on_1_mip"))
-		{
-			cmdLineOpts.stopOn1PageMip = parseBool(argv[i]);
-		}
-		else if (startsWith(argv[i], "--add_debug_info"))
-		{
-			cmdLineOpts.addDebugInfoToPages = parseBool(argv[i]);
-		}
-		else if (startsWith(argv[i], "--dump_images"))
-		{
-			cmdLineOpts.dumpPageImages = parseBool(argv[i]);
-		}
-		else if (startsWith(argv[i], "--verbose"))
-		{
-			cmdLineOpts.stdoutVerbose = parseBool(argv[i]);
-		}
-		else
-		{
-			std::printf("WARNING: Unknown command line argument: '%s'\n", argv[i]);
-		}
+		parseFlag(argv[0], argv[i], cmdLineOpts);
 	}
 
 	if (cmdLineOpts.stdoutVerbose)
@@ -303,6 +384,70 @@ void runPageFileBuilder(const std::string & inputFile, const std::string & outpu
 	}
 }
 
+// ======================================================
+// runArchivePacker():
+// ======================================================
+
+void runArchivePacker(const int argc, const char * argv[])
+{
+	// argv[1] is "--pack". Need at least the output and one input.
+	if (argc < 4)
+	{
+		errorExit("Not enough arguments for --pack!");
+	}
+
+	const std::string outputFile = argv[2];
+	const std::vector<std::string> inputFiles(argv + 3, argv + argc);
+
+	vt::tool::packVTFFArchive(inputFiles, outputFile, /* verbose = */ true);
+	std::printf("Done!\n");
+}
+
+// ======================================================
+// runAtlasBuilder():
+// ======================================================
+
+void runAtlasBuilder(const int argc, const char * argv[])
+{
+	// argv[1] is "--atlas". Need at least the output and one input.
+	// Anything after the output starting with "--" is a flag.
+	if (argc < 4)
+	{
+		errorExit("Not enough arguments for --atlas!");
+	}
+
+	vt::tool::PageFileBuilderOptions cmdLineOpts;
+	const std::string outputFile = argv[2];
+	std::vector<std::string> inputFiles;
+
+	for (int i = 3; i < argc; ++i)
+	{
+		if (startsWith(argv[i], "--"))
+		{
+			parseFlag(argv[0], argv[i], cmdLineOpts);
+		}
+		else
+		{
+			inputFiles.push_back(argv[i]);
+		}
+	}
+
+	if (cmdLineOpts.stdoutVerbose)
+	{
+		std::printf("Atlas inputs: %u\n", static_cast<unsigned int>(inputFiles.size()));
+		std::printf("Output file.: \"%s\"\n", outputFile.c_str());
+		cmdLineOpts.printSelf();
+	}
+
+	vt::tool::PageFileBuilder pageFileBuilder(std::move(inputFiles), outputFile, cmdLineOpts);
+	pageFileBuilder.generatePageFile();
+
+	if (cmdLineOpts.stdoutVerbose)
+	{
+		std::printf("Done!\n");
+	}
+}
+
 } // namespace {}
 
 // ======================================================
@@ -313,6 +458,17 @@ int main(const int argc, const char * argv[])
 {
 	try
 	{
+		if ((argc >= 2) && startsWith(argv[1], "--pack"))
+		{
+			runArchivePacker(argc, argv);
+			return 0;
+		}
+		if ((argc >= 2) && startsWith(argv[1], "--atlas"))
+		{
+			runAtlasBuilder(argc, argv);
+			return 0;
+		}
+
 		vt::tool::PageFileBuilderOptions cmdLineOpts;
 		std::string inputFile, outputFile;
 
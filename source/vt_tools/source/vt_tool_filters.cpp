@@ -33,6 +33,7 @@
 #include "vt_tool_filters.hpp"
 #include <cassert>
 #include <cmath>
+#include <cstring>
 
 /*
  * Most of the code in this file was based on or copied from the
@@ -34,8 +34,23 @@
 #include <cassert>
 #include <cstring>
 #include <cstdlib>
+#include <cmath>
+#include <vector>
 #include <algorithm>
 
+// SIMD paths for the RgbaU8 kernels:
+#if defined(__SSE2__)
+	#define VT_TOOL_IMAGE_SSE2 1
+	#include <emmintrin.h>
+	#if defined(__SSSE3__)
+		#define VT_TOOL_IMAGE_SSSE3 1
+		#include <tmmintrin.h>
+	#endif // __SSSE3__
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+	#define VT_TOOL_IMAGE_NEON 1
+	#include <arm_neon.h>
+#endif // SIMD
+
 namespace vt
 {
 namespace tool
@@ -128,6 +143,320 @@ T floorPowerOfTwo(const T x)
 	return p2;
 }
 
+// ======================================================
+// Format specialized pixel kernels:
+// ======================================================
+
+//
+// The Image methods dispatch on the pixel format once and then run one
+// of these over whole rows, instead of going through getPixelAt() and
+// setPixelAt() for each pixel. RgbaU8, the format of the page data, also
+// gets SSE2/NEON versions where the compiler won't vectorize on its own.
+//
+
+using PixelRgbU8   = TPixel3<uint8_t>;
+using PixelRgbF32  = TPixel3<float>;
+using PixelRgbaU8  = TPixel4<uint8_t>;
+using PixelRgbaF32 = TPixel4<float>;
+
+static_assert(sizeof(PixelRgbU8)   == 3,  "Unexpected TPixel3<uint8_t> size!");
+static_assert(sizeof(PixelRgbaU8)  == 4,  "Unexpected TPixel4<uint8_t> size!");
+static_assert(sizeof(PixelRgbF32)  == 12, "Unexpected TPixel3<float> size!");
+static_assert(sizeof(PixelRgbaF32) == 16, "Unexpected TPixel4<float> size!");
+
+// Horizontal flip of a row of pixels:
+template<class PixelType>
+void flipRow(PixelType * row, const uint32_t rowWidth)
+{
+	std::reverse(row, row + rowWidth);
+}
+
+template<>
+void flipRow(PixelRgbaU8 * row, const uint32_t rowWidth)
+{
+	// Swap 4 pixel blocks from both ends, reversing each block.
+	uint32_t * left  = reinterpret_cast<uint32_t *>(row);
+	uint32_t * right = left + rowWidth;
+
+#if defined(VT_TOOL_IMAGE_SSE2)
+	while ((right - left) >= 8)
+	{
+		right -= 4;
+		const __m128i l = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(left)),  _MM_SHUFFLE(0, 1, 2, 3));
+		const __m128i r = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(right)), _MM_SHUFFLE(0, 1, 2, 3));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(left),  r);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(right), l);
+		left += 4;
+	}
+#elif defined(VT_TOOL_IMAGE_NEON)
+	while ((right - left) >= 8)
+	{
+		right -= 4;
+		uint32x4_t l = vrev64q_u32(vld1q_u32(left));
+		uint32x4_t r = vrev64q_u32(vld1q_u32(right));
+		vst1q_u32(left,  vextq_u32(r, r, 2));
+		vst1q_u32(right, vextq_u32(l, l, 2));
+		left += 4;
+	}
+#endif // SIMD
+
+	std::reverse(left, right);
+}
+
+// Swaps the first and third components of a row of pixels:
+template<class PixelType>
+void swizzleRow(PixelType * row, const uint32_t rowWidth)
+{
+	for (uint32_t x = 0; x < rowWidth; ++x)
+	{
+		std::swap(row[x].r, row[x].b);
+	}
+}
+
+template<>
+void swizzleRow(PixelRgbaU8 * row, const uint32_t rowWidth)
+{
+	uint32_t x = 0;
+
+#if defined(VT_TOOL_IMAGE_SSE2)
+	// Keep G and A, exchange R and B with shifts within each 32bit pixel.
+	const __m128i maskGA = _mm_set1_epi32(0xFF00FF00);
+	const __m128i maskRB = _mm_set1_epi32(0x000000FF);
+	for (; (x + 4) <= rowWidth; x += 4)
+	{
+		__m128i * ptr = reinterpret_cast<__m128i *>(row + x);
+		const __m128i p = _mm_loadu_si128(ptr);
+		const __m128i r = _mm_and_si128(p, maskRB);
+		const __m128i b = _mm_and_si128(_mm_srli_epi32(p, 16), maskRB);
+		_mm_storeu_si128(ptr, _mm_or_si128(_mm_and_si128(p, maskGA), _mm_or_si128(_mm_slli_epi32(r, 16), b)));
+	}
+#elif defined(VT_TOOL_IMAGE_NEON)
+	for (; (x + 16) <= rowWidth; x += 16)
+	{
+		uint8_t * ptr = reinterpret_cast<uint8_t *>(row + x);
+		uint8x16x4_t p = vld4q_u8(ptr);
+		const uint8x16_t r = p.val[0];
+		p.val[0] = p.val[2];
+		p.val[2] = r;
+		vst4q_u8(ptr, p);
+	}
+#endif // SIMD
+
+	for (; x < rowWidth; ++x)
+	{
+		std::swap(row[x].r, row[x].b);
+	}
+}
+
+// RGBA to RGB conversion of a row of pixels:
+template<class T>
+void discardAlphaRow(const TPixel4<T> * src, TPixel3<T> * dest, const uint32_t rowWidth)
+{
+	for (uint32_t x = 0; x < rowWidth; ++x)
+	{
+		dest[x].r = src[x].r;
+		dest[x].g = src[x].g;
+		dest[x].b = src[x].b;
+	}
+}
+
+template<>
+void discardAlphaRow(const PixelRgbaU8 * src, PixelRgbU8 * dest, const uint32_t rowWidth)
+{
+	uint32_t x = 0;
+
+#if defined(VT_TOOL_IMAGE_NEON)
+	for (; (x + 16) <= rowWidth; x += 16)
+	{
+		const uint8x16x4_t p = vld4q_u8(reinterpret_cast<const uint8_t *>(src + x));
+		uint8x16x3_t rgb;
+		rgb.val[0] = p.val[0];
+		rgb.val[1] = p.val[1];
+		rgb.val[2] = p.val[2];
+		vst3q_u8(reinterpret_cast<uint8_t *>(dest + x), rgb);
+	}
+#elif defined(VT_TOOL_IMAGE_SSSE3)
+	// Packs 4 pixels into the low 12 bytes. Each store writes 4 bytes past them,
+	// which the next store overwrites, so stop while 2 more pixels are left.
+	const __m128i packRgb = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	for (; (x + 6) <= rowWidth; x += 4)
+	{
+		const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + x), _mm_shuffle_epi8(p, packRgb));
+	}
+#endif // SIMD
+
+	for (; x < rowWidth; ++x)
+	{
+		dest[x].r = src[x].r;
+		dest[x].g = src[x].g;
+		dest[x].b = src[x].b;
+	}
+}
+
+// Point sampling resize. Source coordinates are computed exactly
+// as the original per-pixel version did, so results are the same.
+template<class PixelType>
+void resizeNearest(const PixelType * src, const uint32_t srcWidth, const uint32_t srcHeight,
+                   PixelType * dest, const uint32_t destWidth, const uint32_t destHeight)
+{
+	const double scaleWidth  = static_cast<double>(destWidth)  / static_cast<double>(srcWidth);
+	const double scaleHeight = static_cast<double>(destHeight) / static_cast<double>(srcHeight);
+
+	std::vector<uint32_t> srcColumns(destWidth);
+	for (uint32_t x = 0; x < destWidth; ++x)
+	{
+		srcColumns[x] = static_cast<uint32_t>(x / scaleWidth);
+	}
+
+	for (uint32_t y = 0; y < destHeight; ++y)
+	{
+		const PixelType * srcRow = src + static_cast<size_t>(static_cast<uint32_t>(y / scaleHeight)) * srcWidth;
+		PixelType * destRow = dest + static_cast<size_t>(y) * destWidth;
+
+		for (uint32_t x = 0; x < destWidth; ++x)
+		{
+			destRow[x] = srcRow[srcColumns[x]];
+		}
+	}
+}
+
+// Source pixels and weights of each destination pixel along one axis.
+struct ResampleAxis
+{
+	std::vector<uint32_t> first;   // First source pixel.
+	std::vector<uint32_t> count;   // Number of source pixels.
+	std::vector<float>    weights; // 'maxTaps' entries per destination pixel.
+	uint32_t maxTaps;
+};
+
+void buildResampleAxis(ResampleAxis & axis, const uint32_t srcSize, const uint32_t destSize, const bool box)
+{
+	const double scale = static_cast<double>(srcSize) / static_cast<double>(destSize);
+
+	axis.first.resize(destSize);
+	axis.count.resize(destSize);
+
+	if (box && (scale > 1.0))
+	{
+		// Coverage of each source pixel by the destination pixel footprint.
+		axis.maxTaps = static_cast<uint32_t>(std::ceil(scale)) + 1;
+		axis.weights.assign(static_cast<size_t>(destSize) * axis.maxTaps, 0.0f);
+
+		for (uint32_t d = 0; d < destSize; ++d)
+		{
+			const double start = d * scale;
+			const double end   = std::min((d + 1) * scale, static_cast<double>(srcSize));
+			const uint32_t firstPixel = static_cast<uint32_t>(start);
+			const uint32_t lastPixel  = std::min(static_cast<uint32_t>(std::ceil(end)), srcSize) - 1;
+
+			axis.first[d] = firstPixel;
+			axis.count[d] = (lastPixel - firstPixel) + 1;
+			assert(axis.count[d] <= axis.maxTaps);
+
+			for (uint32_t s = firstPixel; s <= lastPixel; ++s)
+			{
+				const double overlap = std::min(end, s + 1.0) - std::max(start, static_cast<double>(s));
+				axis.weights[d * axis.maxTaps + (s - firstPixel)] = static_cast<float>(overlap / scale);
+			}
+		}
+	}
+	else
+	{
+		// Tent between the two nearest source pixel centers, clamped to the edges.
+		axis.maxTaps = 2;
+		axis.weights.assign(static_cast<size_t>(destSize) * axis.maxTaps, 0.0f);
+
+		for (uint32_t d = 0; d < destSize; ++d)
+		{
+			const double center = std::max((d + 0.5) * scale - 0.5, 0.0);
+			uint32_t s0 = static_cast<uint32_t>(center);
+			double frac = center - s0;
+			if (s0 >= (srcSize - 1))
+			{
+				s0   = srcSize - 1;
+				frac = 0.0;
+			}
+
+			axis.first[d] = s0;
+			axis.count[d] = (frac > 0.0) ? 2 : 1;
+			axis.weights[d * 2 + 0] = static_cast<float>(1.0 - frac);
+			axis.weights[d * 2 + 1] = static_cast<float>(frac);
+		}
+	}
+}
+
+inline void storeComponent(uint8_t & dest, const float value)
+{
+	dest = static_cast<uint8_t>(std::min(std::max(value + 0.5f, 0.0f), 255.0f));
+}
+
+inline void storeComponent(float & dest, const float value)
+{
+	dest = value;
+}
+
+// Separable box or bilinear resize of an interleaved image with 'N' components of type 'T'.
+template<class T, uint32_t N>
+void resizeFiltered(const T * src, const uint32_t srcWidth, const uint32_t srcHeight,
+                    T * dest, const uint32_t destWidth, const uint32_t destHeight, const bool box)
+{
+	ResampleAxis xAxis, yAxis;
+	buildResampleAxis(xAxis, srcWidth,  destWidth,  box);
+	buildResampleAxis(yAxis, srcHeight, destHeight, box);
+
+	// Horizontal pass, every source row to 'destWidth' float pixels:
+	std::vector<float> rows(static_cast<size_t>(srcHeight) * destWidth * N);
+	for (uint32_t y = 0; y < srcHeight; ++y)
+	{
+		const T * srcRow = src + static_cast<size_t>(y) * srcWidth * N;
+		float * rowOut = &rows[static_cast<size_t>(y) * destWidth * N];
+
+		for (uint32_t x = 0; x < destWidth; ++x)
+		{
+			const T * taps = srcRow + xAxis.first[x] * N;
+			const float * weights = &xAxis.weights[x * xAxis.maxTaps];
+
+			float sum[N] = { };
+			for (uint32_t t = 0; t < xAxis.count[x]; ++t)
+			{
+				for (uint32_t c = 0; c < N; ++c)
+				{
+					sum[c] += taps[t * N + c] * weights[t];
+				}
+			}
+			for (uint32_t c = 0; c < N; ++c)
+			{
+				rowOut[x * N + c] = sum[c];
+			}
+		}
+	}
+
+	// Vertical pass, into the destination image:
+	const size_t rowStride = static_cast<size_t>(destWidth) * N;
+	std::vector<float> sums(rowStride);
+	for (uint32_t y = 0; y < destHeight; ++y)
+	{
+		std::fill(sums.begin(), sums.end(), 0.0f);
+
+		const float * weights = &yAxis.weights[y * yAxis.maxTaps];
+		for (uint32_t t = 0; t < yAxis.count[y]; ++t)
+		{
+			const float * rowIn = &rows[(yAxis.first[y] + t) * rowStride];
+			for (size_t i = 0; i < rowStride; ++i)
+			{
+				sums[i] += rowIn[i] * weights[t];
+			}
+		}
+
+		T * destRow = dest + y * rowStride;
+		for (size_t i = 0; i < rowStride; ++i)
+		{
+			storeComponent(destRow[i], sums[i]);
+		}
+	}
+}
+
 } // namespace {}
 
 // ======================================================
@@ -502,12 +831,13 @@ void Image::flipVInPlace()
 {
 	assert(isValid());
 
+	// Format doesn't matter, just swap whole rows:
+	const size_t rowSizeBytes = width * PixelFormat::sizeBytes(pixelFormat);
 	for (uint32_t y = 0; y < (height / 2); ++y)
 	{
-		for (uint32_t x = 0; x < width; ++x)
-		{
-			swapPixels(x, y, x, ((height - 1) - y));
-		}
+		uint8_t * top    = data + y * rowSizeBytes;
+		uint8_t * bottom = data + ((height - 1) - y) * rowSizeBytes;
+		std::swap_ranges(top, top + rowSizeBytes, bottom);
 	}
 }
 
@@ -517,10 +847,24 @@ void Image::flipHInPlace()
 
 	for (uint32_t y = 0; y < height; ++y)
 	{
-		for (uint32_t x = 0; x < (width / 2); ++x)
+		const size_t rowStart = static_cast<size_t>(y) * width;
+		switch (pixelFormat)
 		{
-			swapPixels(x, y, ((width - 1) - x), y);
-		}
+		case PixelFormat::RgbU8 :
+			flipRow(getDataPtr<PixelRgbU8>() + rowStart, width);
+			break;
+		case PixelFormat::RgbF32 :
+			flipRow(getDataPtr<PixelRgbF32>() + rowStart, width);
+			break;
+		case PixelFormat::RgbaU8 :
+			flipRow(getDataPtr<PixelRgbaU8>() + rowStart, width);
+			break;
+		case PixelFormat::RgbaF32 :
+			flipRow(getDataPtr<PixelRgbaF32>() + rowStart, width);
+			break;
+		default:
+			assert(false && "Bad image pixel format!");
+		} // switch (pixelFormat)
 	}
 }
 
@@ -532,18 +876,11 @@ void Image::flipV(Image & destImage) const
 	destImage.freeImageStorage();
 	destImage.allocImageStorage(dataSizeBytes, width, height, pixelFormat);
 
-	// Flip it:
-	uint8_t tmpPixel[bigPixelSizeBytes];
-	const uint32_t maxWidthIndex  = (width  - 1);
-	const uint32_t maxHeightIndex = (height - 1);
-
+	// Copy the rows in reverse order:
+	const size_t rowSizeBytes = width * PixelFormat::sizeBytes(pixelFormat);
 	for (uint32_t y = 0; y < height; ++y)
 	{
-		for (uint32_t x = 0; x < width; ++x)
-		{
-			getPixelAt((maxWidthIndex - x), y, tmpPixel);
-			destImage.setPixelAt((maxWidthIndex - x), (maxHeightIndex - y), tmpPixel);
-		}
+		std::memcpy(destImage.data + ((height - 1) - y) * rowSizeBytes, data + y * rowSizeBytes, rowSizeBytes);
 	}
 }
 
@@ -551,24 +888,13 @@ void Image::flipH(Image & destImage) const
 {
 	assert(isValid());
 
-	// Allocate a new image:
+	// Copy and flip the copy:
 	destImage.freeImageStorage();
-	destImage.allocImageStorage(dataSizeBytes, width, height, pixelFormat);
-
-	// Flip it:
-	uint8_t tmpPixel[bigPixelSizeBytes];
-	for (uint32_t y = 0; y < height; ++y)
-	{
-		for (uint32_t x = 0; x < width; )
-		{
-			getPixelAt(x, y, tmpPixel);
-			x = x + 1;
-			destImage.setPixelAt((width - x), y, tmpPixel);
-		}
-	}
+	destImage.initFromCopy(*this);
+	destImage.flipHInPlace();
 }
 
-void Image::resizeInPlace(const uint32_t targetWidth, const uint32_t targetHeight)
+void Image::resizeInPlace(const uint32_t targetWidth, const uint32_t targetHeight, const ResizeFilter filter)
 {
 	if ((width == targetWidth) && (height == targetHeight))
 	{
@@ -578,12 +904,12 @@ void Image::resizeInPlace(const uint32_t targetWidth, const uint32_t targetHeigh
 	// Resulting image may be bigger or smaller.
 	// We always need a copy:
 	Image resizedImage;
-	resize(resizedImage, targetWidth, targetHeight);
+	resize(resizedImage, targetWidth, targetHeight, filter);
 	freeImageStorage();
 	moveCopy(resizedImage);
 }
 
-void Image::resize(Image & destImage, const uint32_t targetWidth, const uint32_t targetHeight) const
+void Image::resize(Image & destImage, const uint32_t targetWidth, const uint32_t targetHeight, const ResizeFilter filter) const
 {
 	assert(isValid());
 	assert(targetWidth  > 0);
@@ -591,25 +917,55 @@ void Image::resize(Image & destImage, const uint32_t targetWidth, const uint32_t
 
 	if ((width == targetWidth) && (height == targetHeight))
 	{
-		return; // Nothing to be done here...
+		destImage = *this; // Same size, plain copy.
+		return;
 	}
 
 	const size_t pixelSize = PixelFormat::sizeBytes(pixelFormat);
 	destImage.freeImageStorage();
 	destImage.allocImageStorage((targetWidth * targetHeight * pixelSize), targetWidth, targetHeight, pixelFormat);
 
-	// Quick resample with no filtering applied:
-	const double scaleWidth  = static_cast<double>(targetWidth)  / static_cast<double>(width);
-	const double scaleHeight = static_cast<double>(targetHeight) / static_cast<double>(height);
-	uint8_t tmpPixel[bigPixelSizeBytes];
-
-	for (uint32_t y = 0; y < targetHeight; ++y)
+	if (filter == ResizeFilter::Nearest)
 	{
-		for (uint32_t x = 0; x < targetWidth; ++x)
+		// Quick resample with no filtering applied:
+		switch (pixelFormat)
 		{
-			getPixelAt(static_cast<uint32_t>(x / scaleWidth), static_cast<uint32_t>(y / scaleHeight), tmpPixel);
-			destImage.setPixelAt(x, y, tmpPixel);
-		}
+		case PixelFormat::RgbU8 :
+			resizeNearest(getDataPtr<PixelRgbU8>(), width, height, destImage.getDataPtr<PixelRgbU8>(), targetWidth, targetHeight);
+			break;
+		case PixelFormat::RgbF32 :
+			resizeNearest(getDataPtr<PixelRgbF32>(), width, height, destImage.getDataPtr<PixelRgbF32>(), targetWidth, targetHeight);
+			break;
+		case PixelFormat::RgbaU8 :
+			resizeNearest(getDataPtr<PixelRgbaU8>(), width, height, destImage.getDataPtr<PixelRgbaU8>(), targetWidth, targetHeight);
+			break;
+		case PixelFormat::RgbaF32 :
+			resizeNearest(getDataPtr<PixelRgbaF32>(), width, height, destImage.getDataPtr<PixelRgbaF32>(), targetWidth, targetHeight);
+			break;
+		default:
+			assert(false && "Bad image pixel format!");
+		} // switch (pixelFormat)
+	}
+	else
+	{
+		const bool box = (filter == ResizeFilter::Box);
+		switch (pixelFormat)
+		{
+		case PixelFormat::RgbU8 :
+			resizeFiltered<uint8_t, 3>(data, width, height, destImage.data, targetWidth, targetHeight, box);
+			break;
+		case PixelFormat::RgbF32 :
+			resizeFiltered<float, 3>(getDataPtr<float>(), width, height, destImage.getDataPtr<float>(), targetWidth, targetHeight, box);
+			break;
+		case PixelFormat::RgbaU8 :
+			resizeFiltered<uint8_t, 4>(data, width, height, destImage.data, targetWidth, targetHeight, box);
+			break;
+		case PixelFormat::RgbaF32 :
+			resizeFiltered<float, 4>(getDataPtr<float>(), width, height, destImage.getDataPtr<float>(), targetWidth, targetHeight, box);
+			break;
+		default:
+			assert(false && "Bad image pixel format!");
+		} // switch (pixelFormat)
 	}
 }
 
@@ -639,23 +995,32 @@ void Image::roundDownToPowerOfTwo()
 		targetHeight = minSize;
 	}
 
-	resizeInPlace(targetWidth, targetHeight);
+	resizeInPlace(targetWidth, targetHeight, ResizeFilter::Box);
 }
 
 void Image::swizzleRGB()
 {
 	assert(isValid());
 
-	// Swizzle every pixel:
-	const size_t pixelCount         = (width * height);
-	const size_t componentsPerPixel = PixelFormat::componentCount(pixelFormat);
-	uint8_t * pixelPtr              = data;
-
-	for (size_t i = 0; i < pixelCount; ++i)
+	// Swizzle every pixel. The image is contiguous, so it is a single "row":
+	const uint32_t pixelCount = (width * height);
+	switch (pixelFormat)
 	{
-		std::swap(pixelPtr[0], pixelPtr[2]);
-		pixelPtr += componentsPerPixel;
-	}
+	case PixelFormat::RgbU8 :
+		swizzleRow(getDataPtr<PixelRgbU8>(), pixelCount);
+		break;
+	case PixelFormat::RgbF32 :
+		swizzleRow(getDataPtr<PixelRgbF32>(), pixelCount);
+		break;
+	case PixelFormat::RgbaU8 :
+		swizzleRow(getDataPtr<PixelRgbaU8>(), pixelCount);
+		break;
+	case PixelFormat::RgbaF32 :
+		swizzleRow(getDataPtr<PixelRgbaF32>(), pixelCount);
+		break;
+	default:
+		assert(false && "Bad image pixel format!");
+	} // switch (pixelFormat)
 }
 
 void Image::discardAlphaComponent()
@@ -667,18 +1032,19 @@ void Image::discardAlphaComponent()
 	}
 
 	// Resulting image will be smaller. We need a new one:
+	const PixelFormat::Enum rgbFormat = (pixelFormat == PixelFormat::RgbaU8) ? PixelFormat::RgbU8 : PixelFormat::RgbF32;
+	const uint32_t pixelCount = (width * height);
+
 	Image rgbImage;
-	rgbImage.allocImageStorage((width * height * PixelFormat::sizeBytes(pixelFormat)), width, height,
-			(pixelFormat == PixelFormat::RgbaU8) ? PixelFormat::RgbU8 : PixelFormat::RgbF32);
+	rgbImage.allocImageStorage((pixelCount * PixelFormat::sizeBytes(rgbFormat)), width, height, rgbFormat);
 
-	uint8_t tmpPixel[bigPixelSizeBytes];
-	for (uint32_t y = 0; y < height; ++y)
+	if (pixelFormat == PixelFormat::RgbaU8)
 	{
-		for (uint32_t x = 0; x < width; ++x)
-		{
-			getPixelAt(x, y, tmpPixel);
-			rgbImage.setPixelAt(x, y, tmpPixel); // Since rgbImage is RGB, the alpha will be dropped by setPixelAt.
-		}
+		discardAlphaRow(getDataPtr<PixelRgbaU8>(), rgbImage.getDataPtr<PixelRgbU8>(), pixelCount);
+	}
+	else
+	{
+		discardAlphaRow(getDataPtr<PixelRgbaF32>(), rgbImage.getDataPtr<PixelRgbF32>(), pixelCount);
 	}
 
 	freeImageStorage();
@@ -696,6 +1062,7 @@ void Image::copyRect(Image & destImage, const uint32_t xOffset, const uint32_t y
 {
 	assert(isValid());
 	assert(rectHeight != 0 && rectWidth != 0);
+	assert((xOffset + rectWidth) <= width);
 
 	if ((destImage.pixelFormat != pixelFormat) ||
 		(destImage.width  < rectWidth)         ||
@@ -706,35 +1073,19 @@ void Image::copyRect(Image & destImage, const uint32_t xOffset, const uint32_t y
 				rectWidth, rectHeight, pixelFormat);
 	}
 
-	uint8_t tmpPixel[bigPixelSizeBytes];
+	// Same format on both sides, so each row of the rect is a single copy.
+	const size_t pixelSize    = PixelFormat::sizeBytes(pixelFormat);
+	const size_t rectRowBytes = rectWidth * pixelSize;
 
-	if (topLeft)
-	{
-		// Use the top-left corner of the image as the (0,0) origin.
-		// Invert Y:
-		uint32_t maxY = (getHeight() - 1);
-		for (uint32_t y = 0; y < rectHeight; ++y)
-		{
-			for (uint32_t x = 0; x < rectWidth; ++x)
-			{
-				getPixelAt(x + xOffset, maxY - yOffset, tmpPixel);
-				destImage.setPixelAt(x, y, tmpPixel);
-			}
-			--maxY;
-		}
-	}
-	else
+	for (uint32_t y = 0; y < rectHeight; ++y)
 	{
-		// Use the bottom-left corner of the image as the (0,0) origin.
-		// Default Y:
-		for (uint32_t y = 0; y < rectHeight; ++y)
-		{
-			for (uint32_t x = 0; x < rectWidth; ++x)
-			{
-				getPixelAt(x + xOffset, y + yOffset, tmpPixel);
-				destImage.setPixelAt(x, y, tmpPixel);
-			}
-		}
+		// With topLeft, the top-left corner of the image is the (0,0) origin. Invert Y.
+		// Else, the origin point is the bottom-left corner of the image.
+		const uint32_t srcY = topLeft ? (((height - 1) - y) - yOffset) : (y + yOffset);
+		assert(srcY < height);
+
+		std::memcpy(destImage.data + (static_cast<size_t>(y) * destImage.width) * pixelSize,
+		            data + (static_cast<size_t>(srcY) * width + xOffset) * pixelSize, rectRowBytes);
 	}
 }
 
@@ -745,36 +1096,29 @@ void Image::setRect(const Image & srcImage, const uint32_t xOffset, const uint32
 	assert(isValid());
 	assert(srcImage.isValid());
 	assert(rectHeight != 0 && rectWidth != 0);
+	assert(rectWidth <= srcImage.width);
 
-	uint8_t tmpPixel[bigPixelSizeBytes];
-
-	if (topLeft)
+	if (srcImage.pixelFormat != pixelFormat)
 	{
-		// Use the top-left corner of the image as the (0,0) origin.
-		// Invert Y:
-		uint32_t maxY = (getHeight() - 1);
+		// Pixels are reinterpreted as our format, one at a time.
+		uint8_t tmpPixel[bigPixelSizeBytes];
 		for (uint32_t y = 0; y < rectHeight; ++y)
 		{
+			const uint32_t destY = topLeft ? (((height - 1) - y) - yOffset) : (y + yOffset);
 			for (uint32_t x = 0; x < rectWidth; ++x)
 			{
 				srcImage.getPixelAt(x, y, tmpPixel);
-				setPixelAt(x + xOffset, maxY - yOffset, tmpPixel);
+				setPixelAt(x + xOffset, destY, tmpPixel);
 			}
-			--maxY;
 		}
+		return;
 	}
-	else
+
+	const size_t pixelSize = PixelFormat::sizeBytes(pixelFormat);
+	for (uint32_t y = 0; y < rectHeight; ++y)
 	{
-		// Use the bottom-left corner of the image as the (0,0) origin.
-		// Default Y:
-		for (uint32_t y = 0; y < rectHeight; ++y)
-		{
-			for (uint32_t x = 0; x < rectWidth; ++x)
-			{
-				srcImage.getPixelAt(x, y, tmpPixel);
-				setPixelAt(x + xOffset, y + yOffset, tmpPixel);
-			}
-		}
+		setRectRow(srcImage.data + (static_cast<size_t>(y) * srcImage.width) * pixelSize,
+		           xOffset, yOffset, y, rectWidth, topLeft);
 	}
 }
 
@@ -786,38 +1130,26 @@ void Image::setRect(const uint8_t * __restrict image, const uint32_t xOffset, co
 	assert(image != nullptr);
 	assert(rectHeight != 0 && rectWidth != 0);
 
-	const size_t pixelSize = PixelFormat::sizeBytes(pixelFormat);
-	uint8_t tmpPixel[bigPixelSizeBytes];
-
-	if (topLeft)
-	{
-		// Use the top-left corner of the image as the (0,0) origin.
-		// Invert Y:
-		uint32_t maxY = (getHeight() - 1);
-		for (uint32_t y = 0; y < rectHeight; ++y)
-		{
-			for (uint32_t x = 0; x < rectWidth; ++x)
-			{
-				std::memcpy(tmpPixel, (image + (x + y * rectWidth) * pixelSize), pixelSize);
-				setPixelAt(x + xOffset, maxY - yOffset, tmpPixel);
-			}
-			--maxY;
-		}
-	}
-	else
+	const size_t rectRowBytes = rectWidth * PixelFormat::sizeBytes(pixelFormat);
+	for (uint32_t y = 0; y < rectHeight; ++y)
 	{
-		// Use the bottom-left corner of the image as the (0,0) origin.
-		// Default Y:
-		for (uint32_t y = 0; y < rectHeight; ++y)
-		{
-			for (uint32_t x = 0; x < rectWidth; ++x)
-			{
-				std::memcpy(tmpPixel, (image + (x + y * rectWidth) * pixelSize), pixelSize);
-				setPixelAt(x + xOffset, y + yOffset, tmpPixel);
-			}
-		}
+		setRectRow(image + y * rectRowBytes, xOffset, yOffset, y, rectWidth, topLeft);
 	}
 }
 
+void Image::setRectRow(const uint8_t * __restrict rowPixels, const uint32_t xOffset, const uint32_t yOffset,
+                       const uint32_t rectY, const uint32_t rectWidth, const bool topLeft)
+{
+	assert((xOffset + rectWidth) <= width);
+
+	// With topLeft, the top-left corner of the image is the (0,0) origin. Invert Y.
+	// Else, the origin point is the bottom-left corner of the image.
+	const uint32_t destY = topLeft ? (((height - 1) - rectY) - yOffset) : (rectY + yOffset);
+	assert(destY < height);
+
+	const size_t pixelSize = PixelFormat::sizeBytes(pixelFormat);
+	std::memcpy(data + (static_cast<size_t>(destY) * width + xOffset) * pixelSize, rowPixels, rectWidth * pixelSize);
+}
+
 } // namespace tool {}
 } // namespace vt {}
@@ -0,0 +1,1740 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: vt_tool_image_source.cpp
+// Author: Guilherme R. Lampert
+// Created on: 18/10/26
+// Brief: Source image readers that deliver scanline bands on demand.
+//
+// License:
+//  This source code is released under the MIT License.
+//  Copyright (c) 2014 Guilherme R. Lampert.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+// ================================================================================================
+
+#include "vt_tool_image_source.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// POSIX memory mapping:
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace vt
+{
+namespace tool
+{
+namespace
+{
+
+// Same conversion used by FloatImageBuffer when importing an 8bits image,
+// so that streamed and fully loaded sources produce the same pages.
+constexpr float oneOver255   = (1.0f / 255.0f);
+constexpr float oneOver65535 = (1.0f / 65535.0f);
+
+// ======================================================
+// Little helpers:
+// ======================================================
+
+inline bool setError(std::string * errorMessage, const std::string & message)
+{
+	if (errorMessage != nullptr)
+	{
+		*errorMessage = message;
+	}
+	return false;
+}
+
+inline bool isHostLittleEndian()
+{
+	const uint16_t value = 1;
+	uint8_t firstByte;
+	std::memcpy(&firstByte, &value, 1);
+	return firstByte == 1;
+}
+
+inline uint16_t readU16(const uint8_t * p, const bool littleEndian)
+{
+	return littleEndian ? static_cast<uint16_t>(p[0] | (p[1] << 8)) :
+	                      static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+inline uint32_t readU32(const uint8_t * p, const bool littleEndian)
+{
+	return littleEndian ?
+		(uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24)) :
+		((uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]));
+}
+
+inline float readF32(const uint8_t * p, const bool littleEndian)
+{
+	const uint32_t bits = readU32(p, littleEndian);
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+// Writes one pixel into row 'destRow' of an RGBA float band.
+inline void storePixel(FloatImageBuffer & band, const uint32_t destRow, const uint32_t x,
+                       const float r, const float g, const float b, const float a)
+{
+	const uint32_t index = destRow * band.getWidth() + x;
+	band.getChannel(FloatImageBuffer::ChRed)[index]   = r;
+	band.getChannel(FloatImageBuffer::ChGreen)[index] = g;
+	band.getChannel(FloatImageBuffer::ChBlue)[index]  = b;
+	band.getChannel(FloatImageBuffer::ChAlpha)[index] = a;
+}
+
+// Converts a row of interleaved samples, already normalized to [0,1]
+// by 'fetch', to RGBA. 1 = grey, 2 = grey+alpha, 3 = RGB, 4 = RGBA.
+template<class FetchFunc>
+void storeRow(FloatImageBuffer & band, const uint32_t destRow, const uint32_t width,
+              const uint32_t numComponents, const FetchFunc & fetch)
+{
+	for (uint32_t x = 0; x < width; ++x)
+	{
+		const uint32_t s = x * numComponents;
+		switch (numComponents)
+		{
+		case 1 :
+			{
+				const float grey = fetch(s);
+				storePixel(band, destRow, x, grey, grey, grey, 1.0f);
+				break;
+			}
+		case 2 :
+			{
+				const float grey = fetch(s);
+				storePixel(band, destRow, x, grey, grey, grey, fetch(s + 1));
+				break;
+			}
+		case 3 :
+			storePixel(band, destRow, x, fetch(s), fetch(s + 1), fetch(s + 2), 1.0f);
+			break;
+		default :
+			storePixel(band, destRow, x, fetch(s), fetch(s + 1), fetch(s + 2), fetch(s + 3));
+			break;
+		} // switch (numComponents)
+	}
+}
+
+bool checkBand(const ImageSource & source, const uint32_t firstRow, const uint32_t numRows,
+               const FloatImageBuffer & band, const uint32_t destRow, std::string * errorMessage)
+{
+	if ((band.getWidth() != source.getWidth()) || (band.getNumComponents() != 4) ||
+	    ((destRow + numRows) > band.getHeight()) || ((firstRow + numRows) > source.getHeight()))
+	{
+		return setError(errorMessage, "Bad row range or band buffer layout!");
+	}
+	return true;
+}
+
+// ======================================================
+// Inflater:
+// ======================================================
+
+//
+// Streaming DEFLATE (RFC 1951) decoder, optionally with a zlib (RFC 1950) wrapper.
+// Compressed data is pulled from a callback and the output is produced on demand,
+// only keeping the 32KB back-reference window. The Adler-32 checksum is not verified.
+//
+class Inflater final
+{
+public:
+
+	// Fills 'dest' with up to 'size' compressed bytes. Returns 0 at the end of the input.
+	using InputFunc = std::function<size_t(uint8_t * dest, size_t size)>;
+
+	void reset(InputFunc inputFunc, bool zlibHeader);
+
+	// Decompresses exactly 'count' bytes. False if the data is corrupt or ends early.
+	bool read(uint8_t * dest, size_t count);
+
+	const char * getError() const { return errorString; }
+
+private:
+
+	static constexpr uint32_t WindowSize = 32768;
+	static constexpr int MaxCodeBits     = 15;
+	static constexpr int FastBits        = 9;
+
+	// Canonical Huffman decoding table, plus a lookup for the short codes.
+	struct Huffman
+	{
+		uint16_t count[MaxCodeBits + 1];
+		uint16_t symbol[288];
+		uint16_t fast[1 << FastBits]; // (symbol << 4) | length. Zero if the code is longer.
+	};
+
+	enum class State
+	{
+		BlockHeader,
+		StoredBlock,
+		HuffmanBlock,
+		Done
+	};
+
+	bool fail(const char * message) { errorString = message; state = State::Done; failed = true; return false; }
+	bool refillBits(int numBits);
+	uint32_t getBits(int numBits);
+	int  decodeSymbol(const Huffman & h);
+	bool buildHuffman(Huffman & h, const uint8_t * lengths, int numSymbols);
+	bool readBlockHeader();
+	bool readDynamicTables();
+	void setupFixedTables();
+
+	void putByte(const uint8_t b, uint8_t *& dest)
+	{
+		window[windowPos++ & (WindowSize - 1)] = b;
+		*dest++ = b;
+	}
+
+private:
+
+	InputFunc input;
+	uint8_t inBuf[16384];
+	size_t inPos  = 0;
+	size_t inSize = 0;
+	bool inputEnded = false;
+
+	uint32_t bitBuf  = 0;
+	int bitCount     = 0;
+
+	State state      = State::Done;
+	bool lastBlock   = false;
+	bool failed      = false;
+	const char * errorString = "";
+
+	uint32_t storedRemaining = 0;
+	uint32_t copyLength      = 0;
+	uint32_t copyDistance    = 0;
+
+	Huffman litLenCodes;
+	Huffman distCodes;
+
+	std::unique_ptr<uint8_t[]> window;
+	uint64_t windowPos = 0;
+};
+
+void Inflater::reset(InputFunc inputFunc, const bool zlibHeader)
+{
+	input      = std::move(inputFunc);
+	inPos      = 0;
+	inSize     = 0;
+	inputEnded = false;
+	bitBuf     = 0;
+	bitCount   = 0;
+	state      = State::BlockHeader;
+	lastBlock  = false;
+	failed     = false;
+	errorString     = "";
+	storedRemaining = 0;
+	copyLength      = 0;
+	copyDistance    = 0;
+	windowPos       = 0;
+
+	if (window == nullptr)
+	{
+		window.reset(new uint8_t[WindowSize]);
+	}
+
+	if (zlibHeader)
+	{
+		const uint32_t cmf = getBits(8);
+		const uint32_t flg = getBits(8);
+		if (failed || ((cmf & 0x0F) != 8) || (((cmf << 8) | flg) % 31) != 0 || (flg & 0x20))
+		{
+			fail("Bad zlib header!");
+		}
+	}
+}
+
+bool Inflater::refillBits(const int numBits)
+{
+	while (bitCount < numBits)
+	{
+		if (inPos == inSize)
+		{
+			inSize = inputEnded ? 0 : input(inBuf, sizeof(inBuf));
+			inPos  = 0;
+			if (inSize == 0)
+			{
+				inputEnded = true;
+				return false;
+			}
+		}
+		bitBuf |= uint32_t(inBuf[inPos++]) << bitCount;
+		bitCount += 8;
+	}
+	return true;
+}
+
+uint32_t Inflater::getBits(const int numBits)
+{
+	if (numBits == 0)
+	{
+		return 0;
+	}
+	if (!refillBits(numBits))
+	{
+		fail("Compressed data ended unexpectedly!");
+		return 0;
+	}
+	const uint32_t value = bitBuf & ((1u << numBits) - 1);
+	bitBuf  >>= numBits;
+	bitCount -= numBits;
+	return value;
+}
+
+int Inflater::decodeSymbol(const Huffman & h)
+{
+	// Short codes with a single lookup. Near the end of the
+	// data fewer bits might be available, which is fine if the code fits.
+	refillBits(FastBits);
+	const uint16_t entry = h.fast[bitBuf & ((1u << FastBits) - 1)];
+	const int length = entry & 0x0F;
+	if ((length != 0) && (length <= bitCount))
+	{
+		bitBuf  >>= length;
+		bitCount -= length;
+		return entry >> 4;
+	}
+
+	// Long codes, one bit at a time (the Huffman codes are stored MSB first).
+	int code = 0, first = 0, index = 0;
+	for (int len = 1; len <= MaxCodeBits; ++len)
+	{
+		code |= static_cast<int>(getBits(1));
+		if (failed)
+		{
+			return -1;
+		}
+		const int count = h.count[len];
+		if ((code - count) < first)
+		{
+			return h.symbol[index + (code - first)];
+		}
+		index += count;
+		first += count;
+		first <<= 1;
+		code  <<= 1;
+	}
+
+	fail("Invalid Huffman code!");
+	return -1;
+}
+
+bool Inflater::buildHuffman(Huffman & h, const uint8_t * lengths, const int numSymbols)
+{
+	std::memset(&h, 0, sizeof(h));
+	for (int s = 0; s < numSymbols; ++s)
+	{
+		++h.count[lengths[s]];
+	}
+	h.count[0] = 0;
+
+	// Over-subscribed code sets are an error. Incomplete ones are allowed (single distance code).
+	int left = 1;
+	for (int len = 1; len <= MaxCodeBits; ++len)
+	{
+		left <<= 1;
+		left -= h.count[len];
+		if (left < 0)
+		{
+			return fail("Over-subscribed Huffman code!");
+		}
+	}
+
+	uint16_t offsets[MaxCodeBits + 1];
+	offsets[1] = 0;
+	for (int len = 1; len < MaxCodeBits; ++len)
+	{
+		offsets[len + 1] = offsets[len] + h.count[len];
+	}
+	for (int s = 0; s < numSymbols; ++s)
+	{
+		if (lengths[s] != 0)
+		{
+			h.symbol[offsets[lengths[s]]++] = static_cast<uint16_t>(s);
+		}
+	}
+
+	// Canonical codes for the lookup table. Stream bits come LSB first,
+	// so the codes are bit-reversed to index the table.
+	int code = 0, index = 0;
+	for (int len = 1; len <= FastBits; ++len)
+	{
+		for (int i = 0; i < h.count[len]; ++i, ++code, ++index)
+		{
+			int reversed = 0;
+			for (int b = 0; b < len; ++b)
+			{
+				reversed |= ((code >> b) & 1) << (len - 1 - b);
+			}
+			for (int fill = reversed; fill < (1 << FastBits); fill += (1 << len))
+			{
+				h.fast[fill] = static_cast<uint16_t>((h.symbol[index] << 4) | len);
+			}
+		}
+		code <<= 1;
+	}
+	return true;
+}
+
+void Inflater::setupFixedTables()
+{
+	uint8_t lengths[288 + 30];
+	int s = 0;
+	for (; s < 144; ++s) { lengths[s] = 8; }
+	for (; s < 256; ++s) { lengths[s] = 9; }
+	for (; s < 280; ++s) { lengths[s] = 7; }
+	for (; s < 288; ++s) { lengths[s] = 8; }
+	for (; s < 288 + 30; ++s) { lengths[s] = 5; }
+
+	buildHuffman(litLenCodes, lengths, 288);
+	buildHuffman(distCodes, lengths + 288, 30);
+}
+
+bool Inflater::readDynamicTables()
+{
+	static const uint8_t codeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	const int numLitLen = static_cast<int>(getBits(5)) + 257;
+	const int numDist   = static_cast<int>(getBits(5)) + 1;
+	const int numCodeLengths = static_cast<int>(getBits(4)) + 4;
+	if (failed || (numLitLen > 286) || (numDist > 30))
+	{
+		return fail("Bad dynamic block header!");
+	}
+
+	uint8_t lengths[286 + 30];
+	std::memset(lengths, 0, sizeof(lengths));
+	for (int i = 0; i < numCodeLengths; ++i)
+	{
+		lengths[codeLengthOrder[i]] = static_cast<uint8_t>(getBits(3));
+	}
+
+	Huffman codeLengthCodes;
+	if (failed || !buildHuffman(codeLengthCodes, lengths, 19))
+	{
+		return false;
+	}
+
+	std::memset(lengths, 0, sizeof(lengths));
+	int index = 0;
+	while (index < (numLitLen + numDist))
+	{
+		const int symbol = decodeSymbol(codeLengthCodes);
+		if (symbol < 0)
+		{
+			return false;
+		}
+		if (symbol < 16)
+		{
+			lengths[index++] = static_cast<uint8_t>(symbol);
+			continue;
+		}
+
+		uint8_t value = 0;
+		int repeat;
+		if (symbol == 16)
+		{
+			if (index == 0)
+			{
+				return fail("Repeat with no previous code length!");
+			}
+			value  = lengths[index - 1];
+			repeat = 3 + static_cast<int>(getBits(2));
+		}
+		else if (symbol == 17)
+		{
+			repeat = 3 + static_cast<int>(getBits(3));
+		}
+		else
+		{
+			repeat = 11 + static_cast<int>(getBits(7));
+		}
+
+		if (failed || (index + repeat) > (numLitLen + numDist))
+		{
+			return fail("Too many code lengths!");
+		}
+		while (repeat--)
+		{
+			lengths[index++] = value;
+		}
+	}
+
+	if (lengths[256] == 0)
+	{
+		return fail("Missing end-of-block code!");
+	}
+
+	return buildHuffman(litLenCodes, lengths, numLitLen) &&
+	       buildHuffman(distCodes, lengths + numLitLen, numDist);
+}
+
+bool Inflater::readBlockHeader()
+{
+	if (lastBlock)
+	{
+		return fail("Read past the end of the compressed data!");
+	}
+
+	lastBlock = (getBits(1) != 0);
+	const uint32_t type = getBits(2);
+	if (failed)
+	{
+		return false;
+	}
+
+	switch (type)
+	{
+	case 0 :
+		{
+			// Stored block. Skip to a byte boundary first.
+			getBits(bitCount & 7);
+			const uint32_t len  = getBits(16);
+			const uint32_t nlen = getBits(16);
+			if (failed || (len != (~nlen & 0xFFFF)))
+			{
+				return fail("Bad stored block length!");
+			}
+			storedRemaining = len;
+			state = State::StoredBlock;
+			return true;
+		}
+	case 1 :
+		setupFixedTables();
+		state = State::HuffmanBlock;
+		return true;
+	case 2 :
+		if (!readDynamicTables())
+		{
+			return false;
+		}
+		state = State::HuffmanBlock;
+		return true;
+	default :
+		return fail("Invalid block type!");
+	} // switch (type)
+}
+
+bool Inflater::read(uint8_t * dest, const size_t count)
+{
+	static const uint16_t lengthBase[29]  = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	static const uint8_t  lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	static const uint16_t distBase[30]    = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+	                                          1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	static const uint8_t  distExtra[30]   = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	uint8_t * const destEnd = dest + count;
+	while (dest != destEnd)
+	{
+		if (failed)
+		{
+			return false;
+		}
+
+		// Finish a pending back-reference first:
+		if (copyLength != 0)
+		{
+			const uint32_t n = static_cast<uint32_t>(std::min<size_t>(copyLength, destEnd - dest));
+			for (uint32_t i = 0; i < n; ++i)
+			{
+				putByte(window[(windowPos - copyDistance) & (WindowSize - 1)], dest);
+			}
+			copyLength -= n;
+			continue;
+		}
+
+		switch (state)
+		{
+		case State::BlockHeader :
+			readBlockHeader();
+			break;
+
+		case State::StoredBlock :
+			if (storedRemaining == 0)
+			{
+				state = lastBlock ? State::Done : State::BlockHeader;
+				break;
+			}
+			putByte(static_cast<uint8_t>(getBits(8)), dest);
+			--storedRemaining;
+			break;
+
+		case State::HuffmanBlock :
+			{
+				const int symbol = decodeSymbol(litLenCodes);
+				if (symbol < 0)
+				{
+					break;
+				}
+				if (symbol < 256)
+				{
+					putByte(static_cast<uint8_t>(symbol), dest);
+					break;
+				}
+				if (symbol == 256)
+				{
+					state = lastBlock ? State::Done : State::BlockHeader;
+					break;
+				}
+				if (symbol > 285)
+				{
+					fail("Invalid length symbol!");
+					break;
+				}
+
+				const int lengthIndex = symbol - 257;
+				const uint32_t length = lengthBase[lengthIndex] + getBits(lengthExtra[lengthIndex]);
+				const int distSymbol  = decodeSymbol(distCodes);
+				if ((distSymbol < 0) || (distSymbol > 29))
+				{
+					fail("Invalid distance symbol!");
+					break;
+				}
+
+				const uint32_t distance = distBase[distSymbol] + getBits(distExtra[distSymbol]);
+				if (distance > std::min<uint64_t>(windowPos, WindowSize))
+				{
+					fail("Back-reference distance too far!");
+					break;
+				}
+				copyLength   = length;
+				copyDistance = distance;
+				break;
+			}
+
+		case State::Done :
+			return failed ? false : fail("Compressed data ended before the image did!");
+		} // switch (state)
+	}
+	return !failed;
+}
+
+// ======================================================
+// MappedImageSource:
+// ======================================================
+
+//
+// Raw, PPM/PGM and PFM files. The file is memory-mapped and
+// rows are converted straight from the mapping, in any order.
+//
+class MappedImageSource final
+	: public ImageSource
+{
+public:
+
+	enum class Format { Raw, Pnm, Pfm };
+
+	~MappedImageSource();
+	bool open(const std::string & filename, Format fmt, const RawLayout & rawLayout, std::string * errorMessage);
+
+	bool readRows(uint32_t firstRow, uint32_t numRows, FloatImageBuffer & band,
+	              uint32_t destRow, std::string * errorMessage) override;
+
+	bool isRandomAccess() const override { return true; }
+	const char * getReaderName() const override;
+
+private:
+
+	bool parsePnmHeader(std::string * errorMessage);
+	bool parsePfmHeader(std::string * errorMessage);
+	bool readHeaderToken(size_t & pos, std::string & token) const;
+
+	Format format          = Format::Raw;
+	const uint8_t * mapped = nullptr;
+	size_t mappedSize      = 0;
+	size_t dataOffset      = 0;
+	uint32_t numComponents = 0;
+	uint32_t bytesPerSample = 1;
+	float sampleScale      = oneOver255;
+	bool littleEndian      = false;
+};
+
+MappedImageSource::~MappedImageSource()
+{
+	if (mapped != nullptr)
+	{
+		munmap(const_cast<uint8_t *>(mapped), mappedSize);
+	}
+}
+
+const char * MappedImageSource::getReaderName() const
+{
+	switch (format)
+	{
+	case Format::Raw : return "memory-mapped raw";
+	case Format::Pnm : return "memory-mapped PPM/PGM";
+	case Format::Pfm : return "memory-mapped PFM";
+	default : return "memory-mapped";
+	} // switch (format)
+}
+
+bool MappedImageSource::open(const std::string & filename, const Format fmt, const RawLayout & rawLayout, std::string * errorMessage)
+{
+	format = fmt;
+
+	const int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return setError(errorMessage, "Unable to open \"" + filename + "\": " + std::strerror(errno));
+	}
+
+	struct stat fileInfo;
+	if ((fstat(fd, &fileInfo) != 0) || (fileInfo.st_size <= 0))
+	{
+		::close(fd);
+		return setError(errorMessage, "Unable to get the size of \"" + filename + "\"!");
+	}
+
+	mappedSize = static_cast<size_t>(fileInfo.st_size);
+	void * mapping = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // The mapping stays valid.
+
+	if (mapping == MAP_FAILED)
+	{
+		mappedSize = 0;
+		return setError(errorMessage, "Failed to memory-map \"" + filename + "\": " + std::strerror(errno));
+	}
+
+	mapped = static_cast<const uint8_t *>(mapping);
+	madvise(mapping, mappedSize, MADV_SEQUENTIAL);
+
+	bool success;
+	switch (format)
+	{
+	case Format::Pnm :
+		success = parsePnmHeader(errorMessage);
+		break;
+	case Format::Pfm :
+		success = parsePfmHeader(errorMessage);
+		break;
+	default :
+		width          = rawLayout.width;
+		height         = rawLayout.height;
+		numComponents  = rawLayout.numComponents;
+		dataOffset     = 0;
+		success = (width != 0) && (height != 0) && (numComponents == 1 || numComponents == 3 || numComponents == 4);
+		if (!success)
+		{
+			setError(errorMessage, "Raw image layout must be given! (width, height and 1, 3 or 4 components)");
+		}
+		break;
+	} // switch (format)
+
+	if (!success)
+	{
+		return false;
+	}
+
+	const uint64_t dataSize = uint64_t(width) * height * numComponents * bytesPerSample;
+	if ((dataOffset + dataSize) > mappedSize)
+	{
+		return setError(errorMessage, "\"" + filename + "\" is smaller than its image data!");
+	}
+	return true;
+}
+
+bool MappedImageSource::readHeaderToken(size_t & pos, std::string & token) const
+{
+	// Skip white space and '#' comments:
+	while (pos < mappedSize)
+	{
+		if (mapped[pos] == '#')
+		{
+			while ((pos < mappedSize) && (mapped[pos] != '\n'))
+			{
+				++pos;
+			}
+		}
+		else if (std::isspace(mapped[pos]))
+		{
+			++pos;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	token.clear();
+	while ((pos < mappedSize) && !std::isspace(mapped[pos]) && (token.size() < 32))
+	{
+		token.push_back(static_cast<char>(mapped[pos++]));
+	}
+	return !token.empty();
+}
+
+bool MappedImageSource::parsePnmHeader(std::string * errorMessage)
+{
+	size_t pos = 0;
+	std::string magic, w, h, maxVal;
+	if (!readHeaderToken(pos, magic) || !readHeaderToken(pos, w) ||
+	    !readHeaderToken(pos, h) || !readHeaderToken(pos, maxVal))
+	{
+		return setError(errorMessage, "Truncated PPM/PGM header!");
+	}
+
+	numComponents = (magic == "P6") ? 3 : (magic == "P5") ? 1 : 0;
+	width  = static_cast<uint32_t>(std::strtoul(w.c_str(), nullptr, 10));
+	height = static_cast<uint32_t>(std::strtoul(h.c_str(), nullptr, 10));
+	const unsigned long maxValue = std::strtoul(maxVal.c_str(), nullptr, 10);
+
+	if ((numComponents == 0) || (width == 0) || (height == 0) || (maxValue == 0) || (maxValue > 65535))
+	{
+		return setError(errorMessage, "Only binary PPM (P6) and PGM (P5) files are supported!");
+	}
+
+	// Samples are big-endian when 16bits wide. A single white space precedes the data.
+	bytesPerSample = (maxValue > 255) ? 2 : 1;
+	sampleScale    = (maxValue == 255) ? oneOver255 : (maxValue == 65535) ? oneOver65535 : (1.0f / maxValue);
+	littleEndian   = false;
+	dataOffset     = pos + 1;
+	return true;
+}
+
+bool MappedImageSource::parsePfmHeader(std::string * errorMessage)
+{
+	size_t pos = 0;
+	std::string magic, w, h, scale;
+	if (!readHeaderToken(pos, magic) || !readHeaderToken(pos, w) ||
+	    !readHeaderToken(pos, h) || !readHeaderToken(pos, scale))
+	{
+		return setError(errorMessage, "Truncated PFM header!");
+	}
+
+	numComponents = (magic == "PF") ? 3 : (magic == "Pf") ? 1 : 0;
+	width  = static_cast<uint32_t>(std::strtoul(w.c_str(), nullptr, 10));
+	height = static_cast<uint32_t>(std::strtoul(h.c_str(), nullptr, 10));
+	if ((numComponents == 0) || (width == 0) || (height == 0))
+	{
+		return setError(errorMessage, "Bad PFM header!");
+	}
+
+	// A negative scale means little-endian floats.
+	bytesPerSample = 4;
+	littleEndian   = (std::strtod(scale.c_str(), nullptr) < 0.0);
+	dataOffset     = pos + 1;
+	return true;
+}
+
+bool MappedImageSource::readRows(const uint32_t firstRow, const uint32_t numRows, FloatImageBuffer & band,
+                                 const uint32_t destRow, std::string * errorMessage)
+{
+	if (!checkBand(*this, firstRow, numRows, band, destRow, errorMessage))
+	{
+		return false;
+	}
+
+	const size_t rowBytes = size_t(width) * numComponents * bytesPerSample;
+	for (uint32_t r = 0; r < numRows; ++r)
+	{
+		// PFM scanlines are stored bottom to top.
+		const uint32_t fileRow = (format == Format::Pfm) ? (height - 1 - (firstRow + r)) : (firstRow + r);
+		const uint8_t * row = mapped + dataOffset + fileRow * rowBytes;
+
+		if (bytesPerSample == 1)
+		{
+			const float scale = sampleScale;
+			storeRow(band, destRow + r, width, numComponents,
+				[row, scale](uint32_t s) { return static_cast<float>(row[s]) * scale; });
+		}
+		else if (bytesPerSample == 2)
+		{
+			const float scale = sampleScale;
+			storeRow(band, destRow + r, width, numComponents,
+				[row, scale](uint32_t s) { return static_cast<float>(readU16(row + s * 2, false)) * scale; });
+		}
+		else
+		{
+			const bool le = littleEndian;
+			storeRow(band, destRow + r, width, numComponents,
+				[row, le](uint32_t s) { return readF32(row + s * 4, le); });
+		}
+	}
+	return true;
+}
+
+// ======================================================
+// PngImageSource:
+// ======================================================
+
+//
+// Streaming PNG reader. The IDAT chunks are inflated as rows are
+// requested, keeping only the previous row for the unfiltering.
+// Sequential only. Interlaced files are left to stb_image.
+//
+class PngImageSource final
+	: public ImageSource
+{
+public:
+
+	~PngImageSource();
+	bool open(const std::string & filename, std::string * errorMessage);
+	bool isInterlaced() const { return interlaced; }
+
+	bool readRows(uint32_t firstRow, uint32_t numRows, FloatImageBuffer & band,
+	              uint32_t destRow, std::string * errorMessage) override;
+
+	bool isRandomAccess() const override { return false; }
+	const char * getReaderName() const override { return "streaming PNG"; }
+
+private:
+
+	bool readChunkHeader(uint32_t & length, uint32_t & type);
+	size_t readIdatData(uint8_t * dest, size_t size);
+	bool decodeNextRow(std::string * errorMessage);
+	float fetchSample(uint32_t s) const;
+
+	FILE * file = nullptr;
+	Inflater inflater;
+
+	uint32_t bitDepth  = 0;
+	uint32_t colorType = 0;
+	uint32_t numChannels = 0; // Channels in the file (palette counts as 1).
+	bool interlaced    = false;
+
+	// Palette expanded to RGBA, plus the tRNS colour key for grey/RGB images.
+	uint8_t palette[256][4];
+	bool hasColorKey = false;
+	uint16_t colorKey[3];
+
+	uint32_t idatRemaining = 0;
+	size_t rowBytes        = 0;
+	size_t filterBpp       = 0; // Bytes per complete pixel for the filters, at least 1.
+	uint32_t nextRow       = 0;
+	std::vector<uint8_t> currRow; // Both with 'filterBpp' leading zeros.
+	std::vector<uint8_t> prevRow;
+};
+
+PngImageSource::~PngImageSource()
+{
+	if (file != nullptr)
+	{
+		std::fclose(file);
+	}
+}
+
+bool PngImageSource::readChunkHeader(uint32_t & length, uint32_t & type)
+{
+	uint8_t header[8];
+	if (std::fread(header, 1, sizeof(header), file) != sizeof(header))
+	{
+		return false;
+	}
+	length = readU32(header, false);
+	type   = readU32(header + 4, false);
+	return true;
+}
+
+size_t PngImageSource::readIdatData(uint8_t * dest, size_t size)
+{
+	// The zlib stream is split across consecutive IDAT chunks.
+	while (idatRemaining == 0)
+	{
+		uint32_t length, type;
+		if ((std::fseek(file, 4, SEEK_CUR) != 0) || !readChunkHeader(length, type) || (type != 0x49444154 /* IDAT */))
+		{
+			return 0;
+		}
+		idatRemaining = length;
+	}
+
+	size = std::min<size_t>(size, idatRemaining);
+	size = std::fread(dest, 1, size, file);
+	idatRemaining -= static_cast<uint32_t>(size);
+	return size;
+}
+
+bool PngImageSource::open(const std::string & filename, std::string * errorMessage)
+{
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+	file = std::fopen(filename.c_str(), "rb");
+	if (file == nullptr)
+	{
+		return setError(errorMessage, "Unable to open \"" + filename + "\": " + std::strerror(errno));
+	}
+
+	uint8_t sig[8];
+	if ((std::fread(sig, 1, sizeof(sig), file) != sizeof(sig)) || (std::memcmp(sig, signature, sizeof(sig)) != 0))
+	{
+		return setError(errorMessage, "Not a PNG file!");
+	}
+
+	// Read everything up to the first IDAT:
+	std::memset(palette, 0, sizeof(palette));
+	for (;;)
+	{
+		uint32_t length, type;
+		if (!readChunkHeader(length, type))
+		{
+			return setError(errorMessage, "PNG file has no image data!");
+		}
+
+		if (type == 0x49444154 /* IDAT */)
+		{
+			idatRemaining = length;
+			break;
+		}
+
+		std::vector<uint8_t> data(length);
+		if ((length != 0) && (std::fread(data.data(), 1, length, file) != length))
+		{
+			return setError(errorMessage, "Truncated PNG chunk!");
+		}
+		std::fseek(file, 4, SEEK_CUR); // CRC
+
+		if (type == 0x49484452 /* IHDR */ && length >= 13)
+		{
+			width      = readU32(&data[0], false);
+			height     = readU32(&data[4], false);
+			bitDepth   = data[8];
+			colorType  = data[9];
+			interlaced = (data[12] != 0);
+		}
+		else if (type == 0x504C5445 /* PLTE */)
+		{
+			for (uint32_t i = 0; (i < 256) && ((i * 3 + 2) < length); ++i)
+			{
+				palette[i][0] = data[i * 3 + 0];
+				palette[i][1] = data[i * 3 + 1];
+				palette[i][2] = data[i * 3 + 2];
+				palette[i][3] = 0xFF;
+			}
+		}
+		else if (type == 0x74524E53 /* tRNS */)
+		{
+			if (colorType == 3)
+			{
+				for (uint32_t i = 0; (i < length) && (i < 256); ++i)
+				{
+					palette[i][3] = data[i];
+				}
+			}
+			else if ((colorType == 0) && (length >= 2))
+			{
+				hasColorKey = true;
+				colorKey[0] = colorKey[1] = colorKey[2] = readU16(&data[0], false);
+			}
+			else if ((colorType == 2) && (length >= 6))
+			{
+				hasColorKey = true;
+				colorKey[0] = readU16(&data[0], false);
+				colorKey[1] = readU16(&data[2], false);
+				colorKey[2] = readU16(&data[4], false);
+			}
+		}
+	}
+
+	switch (colorType)
+	{
+	case 0 : numChannels = 1; break; // Grey
+	case 2 : numChannels = 3; break; // RGB
+	case 3 : numChannels = 1; break; // Palette
+	case 4 : numChannels = 2; break; // Grey + alpha
+	case 6 : numChannels = 4; break; // RGBA
+	default : numChannels = 0; break;
+	} // switch (colorType)
+
+	const bool depthOk = (bitDepth == 8) || (bitDepth == 16) ||
+		(((colorType == 0) || (colorType == 3)) && ((bitDepth == 1) || (bitDepth == 2) || (bitDepth == 4)));
+	if ((width == 0) || (height == 0) || (numChannels == 0) || !depthOk || ((colorType == 3) && (bitDepth == 16)))
+	{
+		return setError(errorMessage, "Unsupported PNG layout!");
+	}
+
+	rowBytes  = (size_t(width) * numChannels * bitDepth + 7) / 8;
+	filterBpp = std::max<size_t>(1, (numChannels * bitDepth) / 8);
+	currRow.assign(rowBytes + filterBpp, 0);
+	prevRow.assign(rowBytes + filterBpp, 0);
+
+	inflater.reset([this](uint8_t * dest, size_t size) { return readIdatData(dest, size); }, /* zlibHeader = */ true);
+	return true;
+}
+
+bool PngImageSource::decodeNextRow(std::string * errorMessage)
+{
+	std::swap(currRow, prevRow);
+
+	uint8_t filterType;
+	uint8_t * row = currRow.data() + filterBpp;
+	if (!inflater.read(&filterType, 1) || !inflater.read(row, rowBytes))
+	{
+		return setError(errorMessage, std::string("PNG decompression failed: ") + inflater.getError());
+	}
+
+	const uint8_t * prior = prevRow.data() + filterBpp;
+	const size_t bpp = filterBpp;
+	switch (filterType)
+	{
+	case 0 :
+		break;
+	case 1 : // Sub
+		for (size_t i = 0; i < rowBytes; ++i) { row[i] = uint8_t(row[i] + row[i - bpp]); }
+		break;
+	case 2 : // Up
+		for (size_t i = 0; i < rowBytes; ++i) { row[i] = uint8_t(row[i] + prior[i]); }
+		break;
+	case 3 : // Average
+		for (size_t i = 0; i < rowBytes; ++i) { row[i] = uint8_t(row[i] + ((row[i - bpp] + prior[i]) >> 1)); }
+		break;
+	case 4 : // Paeth
+		for (size_t i = 0; i < rowBytes; ++i)
+		{
+			const int a = row[i - bpp], b = prior[i], c = prior[i - bpp];
+			const int p = a + b - c;
+			const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+			row[i] = uint8_t(row[i] + ((pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c));
+		}
+		break;
+	default :
+		return setError(errorMessage, "Bad PNG row filter!");
+	} // switch (filterType)
+
+	++nextRow;
+	return true;
+}
+
+float PngImageSource::fetchSample(const uint32_t s) const
+{
+	const uint8_t * row = currRow.data() + filterBpp;
+	if (bitDepth == 16)
+	{
+		return static_cast<float>(readU16(row + s * 2, false)) * oneOver65535;
+	}
+	if (bitDepth == 8)
+	{
+		return static_cast<float>(row[s]) * oneOver255;
+	}
+
+	// Packed grey. Expanded to 8bits first, like stb_image does.
+	const uint32_t perByte = 8 / bitDepth;
+	const uint32_t shift   = (perByte - 1 - (s % perByte)) * bitDepth;
+	const uint32_t value   = (row[s / perByte] >> shift) & ((1u << bitDepth) - 1);
+	return static_cast<float>(value * (255 / ((1u << bitDepth) - 1))) * oneOver255;
+}
+
+bool PngImageSource::readRows(const uint32_t firstRow, const uint32_t numRows, FloatImageBuffer & band,
+                              const uint32_t destRow, std::string * errorMessage)
+{
+	if (!checkBand(*this, firstRow, numRows, band, destRow, errorMessage))
+	{
+		return false;
+	}
+	if (firstRow < nextRow)
+	{
+		return setError(errorMessage, "Streaming PNG rows can only be read once, in order!");
+	}
+
+	while (nextRow < firstRow)
+	{
+		if (!decodeNextRow(errorMessage))
+		{
+			return false;
+		}
+	}
+
+	for (uint32_t r = 0; r < numRows; ++r)
+	{
+		if (!decodeNextRow(errorMessage))
+		{
+			return false;
+		}
+
+		const uint32_t dr = destRow + r;
+		const uint8_t * row = currRow.data() + filterBpp;
+
+		if (colorType == 3)
+		{
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				const uint32_t perByte = 8 / bitDepth;
+				const uint32_t shift   = (perByte - 1 - (x % perByte)) * bitDepth;
+				const uint8_t * rgba   = palette[(row[x / perByte] >> shift) & ((1u << bitDepth) - 1)];
+				storePixel(band, dr, x, rgba[0] * oneOver255, rgba[1] * oneOver255, rgba[2] * oneOver255, rgba[3] * oneOver255);
+			}
+			continue;
+		}
+
+		storeRow(band, dr, width, numChannels, [this](uint32_t s) { return fetchSample(s); });
+
+		// tRNS colour key for grey/RGB files:
+		if (hasColorKey && (bitDepth >= 8))
+		{
+			float * alpha = band.getChannel(FloatImageBuffer::ChAlpha) + dr * width;
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				bool match = true;
+				for (uint32_t c = 0; c < numChannels; ++c)
+				{
+					const uint32_t s = x * numChannels + c;
+					const uint16_t value = (bitDepth == 16) ? readU16(row + s * 2, false) : row[s];
+					match = match && (value == colorKey[c]);
+				}
+				if (match)
+				{
+					alpha[x] = 0.0f;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// ======================================================
+// TiffImageSource:
+// ======================================================
+
+//
+// Baseline TIFF reader for tiled or stripped images, uncompressed or deflate,
+// with chunky samples of 8/16bits unsigned or 32bits float. Strips are handled
+// as tiles as wide as the image. One row of tiles is kept decoded at a time.
+//
+class TiffImageSource final
+	: public ImageSource
+{
+public:
+
+	~TiffImageSource();
+	bool open(const std::string & filename, std::string * errorMessage);
+
+	bool readRows(uint32_t firstRow, uint32_t numRows, FloatImageBuffer & band,
+	              uint32_t destRow, std::string * errorMessage) override;
+
+	bool isRandomAccess() const override { return true; }
+	const char * getReaderName() const override { return tiled ? "tiled TIFF" : "stripped TIFF"; }
+
+private:
+
+	bool readTagValues(const uint8_t * entry, std::vector<uint32_t> & values);
+	bool decodeBlockRow(uint32_t blockRow, std::string * errorMessage);
+
+	FILE * file = nullptr;
+	bool littleEndian = true;
+	bool tiled        = false;
+
+	uint32_t samplesPerPixel = 1;
+	uint32_t bitsPerSample   = 8;
+	uint32_t sampleFormat    = 1; // 1 = unsigned int, 3 = IEEE float.
+	uint32_t compression     = 1;
+	uint32_t predictor       = 1;
+	uint32_t photometric     = 1;
+
+	uint32_t blockWidth  = 0;
+	uint32_t blockHeight = 0;
+	uint32_t blocksAcross = 0;
+	std::vector<uint32_t> blockOffsets;
+	std::vector<uint32_t> blockByteCounts;
+
+	// Currently decoded row of blocks, as full width scanlines.
+	int64_t cachedBlockRow = -1;
+	std::vector<uint8_t> blockRowPixels;
+	std::vector<uint8_t> compressed;
+	std::vector<uint8_t> blockPixels;
+	Inflater inflater;
+};
+
+TiffImageSource::~TiffImageSource()
+{
+	if (file != nullptr)
+	{
+		std::fclose(file);
+	}
+}
+
+bool TiffImageSource::readTagValues(const uint8_t * entry, std::vector<uint32_t> & values)
+{
+	const uint16_t type  = readU16(entry + 2, littleEndian);
+	const uint32_t count = readU32(entry + 4, littleEndian);
+	const uint32_t size  = (type == 3) ? 2 : (type == 4) ? 4 : (type == 1) ? 1 : 0;
+	if ((size == 0) || (count == 0) || (count > (1u << 24)))
+	{
+		return false;
+	}
+
+	// Values up to 4 bytes are stored in the entry itself.
+	std::vector<uint8_t> raw(size_t(size) * count);
+	if (raw.size() <= 4)
+	{
+		std::memcpy(raw.data(), entry + 8, raw.size());
+	}
+	else if ((std::fseek(file, readU32(entry + 8, littleEndian), SEEK_SET) != 0) ||
+	         (std::fread(raw.data(), 1, raw.size(), file) != raw.size()))
+	{
+		return false;
+	}
+
+	values.resize(count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		values[i] = (size == 1) ? raw[i] : (size == 2) ? readU16(&raw[i * 2], littleEndian) : readU32(&raw[i * 4], littleEndian);
+	}
+	return true;
+}
+
+bool TiffImageSource::open(const std::string & filename, std::string * errorMessage)
+{
+	file = std::fopen(filename.c_str(), "rb");
+	if (file == nullptr)
+	{
+		return setError(errorMessage, "Unable to open \"" + filename + "\": " + std::strerror(errno));
+	}
+
+	uint8_t header[8];
+	if (std::fread(header, 1, sizeof(header), file) != sizeof(header))
+	{
+		return setError(errorMessage, "Truncated TIFF header!");
+	}
+	littleEndian = (header[0] == 'I');
+	if (readU16(header + 2, littleEndian) != 42)
+	{
+		return setError(errorMessage, "Not a classic TIFF file! (BigTIFF is not supported)");
+	}
+
+	// Only the first IFD (the full resolution image) is used.
+	uint8_t countBytes[2];
+	if ((std::fseek(file, readU32(header + 4, littleEndian), SEEK_SET) != 0) ||
+	    (std::fread(countBytes, 1, 2, file) != 2))
+	{
+		return setError(errorMessage, "Bad TIFF directory offset!");
+	}
+
+	const uint16_t numEntries = readU16(countBytes, littleEndian);
+	std::vector<uint8_t> entries(size_t(numEntries) * 12);
+	if (std::fread(entries.data(), 1, entries.size(), file) != entries.size())
+	{
+		return setError(errorMessage, "Truncated TIFF directory!");
+	}
+
+	uint32_t planarConfig = 1;
+	std::vector<uint32_t> values;
+	std::vector<uint32_t> stripOffsets, stripByteCounts;
+	uint32_t rowsPerStrip = ~0u;
+
+	for (uint16_t e = 0; e < numEntries; ++e)
+	{
+		const uint8_t * entry = &entries[e * 12];
+		const uint16_t tag = readU16(entry, littleEndian);
+		if (!readTagValues(entry, values))
+		{
+			continue; // Types we don't care about.
+		}
+
+		switch (tag)
+		{
+		case 256 : width           = values[0]; break;
+		case 257 : height          = values[0]; break;
+		case 258 : bitsPerSample   = values[0]; break;
+		case 259 : compression     = values[0]; break;
+		case 262 : photometric     = values[0]; break;
+		case 273 : stripOffsets    = values;    break;
+		case 277 : samplesPerPixel = values[0]; break;
+		case 278 : rowsPerStrip    = values[0]; break;
+		case 279 : stripByteCounts = values;    break;
+		case 284 : planarConfig    = values[0]; break;
+		case 317 : predictor       = values[0]; break;
+		case 322 : blockWidth      = values[0]; tiled = true; break;
+		case 323 : blockHeight     = values[0]; break;
+		case 324 : blockOffsets    = values;    break;
+		case 325 : blockByteCounts = values;    break;
+		case 339 : sampleFormat    = values[0]; break;
+		default  : break;
+		} // switch (tag)
+	}
+
+	if (!tiled)
+	{
+		blockWidth      = width;
+		blockHeight     = std::min(rowsPerStrip, height);
+		blockOffsets    = std::move(stripOffsets);
+		blockByteCounts = std::move(stripByteCounts);
+	}
+
+	const bool formatOk =
+		((sampleFormat == 1) && ((bitsPerSample == 8) || (bitsPerSample == 16))) ||
+		((sampleFormat == 3) && (bitsPerSample == 32));
+
+	if ((width == 0) || (height == 0) || (blockWidth == 0) || (blockHeight == 0) || !formatOk ||
+	    (samplesPerPixel < 1) || (samplesPerPixel > 4) || (planarConfig != 1) || (photometric > 2) ||
+	    ((compression != 1) && (compression != 8) && (compression != 32946)) || (predictor > 2))
+	{
+		return setError(errorMessage, "Unsupported TIFF layout! (supported: 8/16bits unsigned or 32bits float, "
+		                              "chunky grey/RGB[A], uncompressed or deflate)");
+	}
+
+	blocksAcross = (width + blockWidth - 1) / blockWidth;
+	const uint32_t blocksDown = (height + blockHeight - 1) / blockHeight;
+	if ((blockOffsets.size() < size_t(blocksAcross) * blocksDown) || (blockByteCounts.size() < blockOffsets.size()))
+	{
+		return setError(errorMessage, "TIFF tile/strip tables are incomplete!");
+	}
+
+	blockRowPixels.resize(size_t(width) * blockHeight * samplesPerPixel * (bitsPerSample / 8));
+	return true;
+}
+
+bool TiffImageSource::decodeBlockRow(const uint32_t blockRow, std::string * errorMessage)
+{
+	const uint32_t bytesPerSample = bitsPerSample / 8;
+	const size_t pixelBytes = size_t(samplesPerPixel) * bytesPerSample;
+	const size_t blockRowBytes = size_t(blockWidth) * pixelBytes;
+	const size_t blockBytes = blockRowBytes * blockHeight;
+
+	for (uint32_t bx = 0; bx < blocksAcross; ++bx)
+	{
+		const size_t blockIndex = size_t(blockRow) * blocksAcross + bx;
+		const uint32_t byteCount = blockByteCounts[blockIndex];
+
+		compressed.resize(byteCount);
+		if ((std::fseek(file, blockOffsets[blockIndex], SEEK_SET) != 0) ||
+		    (std::fread(compressed.data(), 1, byteCount, file) != byteCount))
+		{
+			return setError(errorMessage, "Truncated TIFF tile/strip data!");
+		}
+
+		// The last strip may be shorter than the others.
+		const uint32_t rowsInBlock = std::min(blockHeight, height - blockRow * blockHeight);
+		const size_t decodedBytes = tiled ? blockBytes : (blockRowBytes * rowsInBlock);
+
+		if (compression == 1)
+		{
+			if (byteCount < decodedBytes)
+			{
+				return setError(errorMessage, "TIFF tile/strip is smaller than expected!");
+			}
+			blockPixels.swap(compressed);
+		}
+		else
+		{
+			size_t consumed = 0;
+			inflater.reset([this, &consumed](uint8_t * dest, size_t size)
+			{
+				size = std::min(size, compressed.size() - consumed);
+				std::memcpy(dest, compressed.data() + consumed, size);
+				consumed += size;
+				return size;
+			}, /* zlibHeader = */ true);
+
+			blockPixels.resize(decodedBytes);
+			if (!inflater.read(blockPixels.data(), decodedBytes))
+			{
+				return setError(errorMessage, std::string("TIFF decompression failed: ") + inflater.getError());
+			}
+		}
+
+		// Horizontal differencing predictor. Restarts at each row of the block.
+		if (predictor == 2)
+		{
+			for (uint32_t y = 0; y < rowsInBlock; ++y)
+			{
+				uint8_t * row = blockPixels.data() + y * blockRowBytes;
+				for (uint32_t x = 1; x < blockWidth; ++x)
+				{
+					for (uint32_t c = 0; c < samplesPerPixel; ++c)
+					{
+						const size_t i = (size_t(x) * samplesPerPixel + c) * bytesPerSample;
+						const size_t p = i - pixelBytes;
+						if (bytesPerSample == 1)
+						{
+							row[i] = uint8_t(row[i] + row[p]);
+						}
+						else if (bytesPerSample == 2)
+						{
+							const uint16_t value = uint16_t(readU16(row + i, littleEndian) + readU16(row + p, littleEndian));
+							row[i + (littleEndian ? 0 : 1)] = uint8_t(value & 0xFF);
+							row[i + (littleEndian ? 1 : 0)] = uint8_t(value >> 8);
+						}
+					}
+				}
+			}
+		}
+
+		// Copy the visible part of the block into the full width scanlines:
+		const uint32_t x0 = bx * blockWidth;
+		const size_t copyBytes = size_t(std::min(blockWidth, width - x0)) * pixelBytes;
+		for (uint32_t y = 0; y < rowsInBlock; ++y)
+		{
+			std::memcpy(blockRowPixels.data() + (size_t(y) * width + x0) * pixelBytes,
+			            blockPixels.data() + y * blockRowBytes, copyBytes);
+		}
+	}
+
+	cachedBlockRow = blockRow;
+	return true;
+}
+
+bool TiffImageSource::readRows(const uint32_t firstRow, const uint32_t numRows, FloatImageBuffer & band,
+                               const uint32_t destRow, std::string * errorMessage)
+{
+	if (!checkBand(*this, firstRow, numRows, band, destRow, errorMessage))
+	{
+		return false;
+	}
+
+	const size_t pixelBytes = size_t(samplesPerPixel) * (bitsPerSample / 8);
+	const bool invert = (photometric == 0); // WhiteIsZero
+
+	for (uint32_t r = 0; r < numRows; ++r)
+	{
+		const uint32_t y = firstRow + r;
+		const uint32_t blockRow = y / blockHeight;
+		if ((cachedBlockRow != blockRow) && !decodeBlockRow(blockRow, errorMessage))
+		{
+			return false;
+		}
+
+		const uint8_t * row = blockRowPixels.data() + size_t(y - blockRow * blockHeight) * width * pixelBytes;
+		const bool le = littleEndian;
+		const uint32_t bits = bitsPerSample;
+
+		storeRow(band, destRow + r, width, samplesPerPixel, [row, le, bits, invert](uint32_t s)
+		{
+			const float value = (bits == 8)  ? static_cast<float>(row[s]) * oneOver255 :
+			                    (bits == 16) ? static_cast<float>(readU16(row + s * 2, le)) * oneOver65535 :
+			                                   readF32(row + s * 4, le);
+			return invert ? (1.0f - value) : value;
+		});
+	}
+	return true;
+}
+
+// ======================================================
+// StbImageSource:
+// ======================================================
+
+//
+// Fallback for every other format. The image is fully decoded by stb_image,
+// but stays as 8bits RGBA until rows are requested.
+//
+class StbImageSource final
+	: public ImageSource
+{
+public:
+
+	bool open(const std::string & filename, std::string * errorMessage)
+	{
+		if (!image.loadFromFile(filename, errorMessage, /* forceRGBA = */ true))
+		{
+			return false;
+		}
+		width  = image.getWidth();
+		height = image.getHeight();
+		return true;
+	}
+
+	bool readRows(const uint32_t firstRow, const uint32_t numRows, FloatImageBuffer & band,
+	              const uint32_t destRow, std::string * errorMessage) override
+	{
+		if (!checkBand(*this, firstRow, numRows, band, destRow, errorMessage))
+		{
+			return false;
+		}
+		for (uint32_t r = 0; r < numRows; ++r)
+		{
+			const uint8_t * row = image.getDataPtr<uint8_t>() + size_t(firstRow + r) * width * 4;
+			storeRow(band, destRow + r, width, 4, [row](uint32_t s) { return static_cast<float>(row[s]) * oneOver255; });
+		}
+		return true;
+	}
+
+	bool isRandomAccess() const override { return true; }
+	const char * getReaderName() const override { return "stb_image (fully decoded)"; }
+
+private:
+
+	Image image;
+};
+
+// ======================================================
+
+bool hasExtension(const std::string & filename, const char * ext)
+{
+	const size_t extLen = std::strlen(ext);
+	if (filename.size() < extLen)
+	{
+		return false;
+	}
+	for (size_t i = 0; i < extLen; ++i)
+	{
+		if (std::tolower(filename[filename.size() - extLen + i]) != ext[i])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+} // namespace {}
+
+// ======================================================
+// ImageSource:
+// ======================================================
+
+std::unique_ptr<ImageSource> ImageSource::open(const std::string & filename, const RawLayout & rawLayout, std::string * errorMessage)
+{
+	// Raw files have no magic. Everything else is sniffed from the first bytes.
+	if (hasExtension(filename, ".raw"))
+	{
+		std::unique_ptr<MappedImageSource> source(new MappedImageSource());
+		return source->open(filename, MappedImageSource::Format::Raw, rawLayout, errorMessage) ? std::move(source) : nullptr;
+	}
+
+	uint8_t magic[8];
+	std::memset(magic, 0, sizeof(magic));
+	FILE * file = std::fopen(filename.c_str(), "rb");
+	if (file == nullptr)
+	{
+		setError(errorMessage, "Unable to open \"" + filename + "\": " + std::strerror(errno));
+		return nullptr;
+	}
+	const size_t magicSize = std::fread(magic, 1, sizeof(magic), file);
+	std::fclose(file);
+
+	if ((magicSize >= 2) && (magic[0] == 'P') && ((magic[1] == '5') || (magic[1] == '6')))
+	{
+		std::unique_ptr<MappedImageSource> source(new MappedImageSource());
+		return source->open(filename, MappedImageSource::Format::Pnm, rawLayout, errorMessage) ? std::move(source) : nullptr;
+	}
+
+	if ((magicSize >= 2) && (magic[0] == 'P') && ((magic[1] == 'F') || (magic[1] == 'f')))
+	{
+		std::unique_ptr<MappedImageSource> source(new MappedImageSource());
+		return source->open(filename, MappedImageSource::Format::Pfm, rawLayout, errorMessage) ? std::move(source) : nullptr;
+	}
+
+	if ((magicSize >= 8) && (magic[0] == 0x89) && (magic[1] == 'P') && (magic[2] == 'N') && (magic[3] == 'G'))
+	{
+		std::unique_ptr<PngImageSource> source(new PngImageSource());
+		if (!source->open(filename, errorMessage))
+		{
+			return nullptr;
+		}
+		if (!source->isInterlaced())
+		{
+			return ImageSourcePtr(source.release());
+		}
+		// Adam7 can't be delivered in row order. Fall through to stb_image.
+	}
+
+	if ((magicSize >= 4) && (((magic[0] == 'I') && (magic[1] == 'I')) || ((magic[0] == 'M') && (magic[1] == 'M'))))
+	{
+		std::unique_ptr<TiffImageSource> source(new TiffImageSource());
+		return source->open(filename, errorMessage) ? std::move(source) : nullptr;
+	}
+
+	std::unique_ptr<StbImageSource> source(new StbImageSource());
+	return source->open(filename, errorMessage) ? std::move(source) : nullptr;
+}
+
+// ======================================================
+// StreamingResizer:
+// ======================================================
+
+StreamingResizer::StreamingResizer(const Filter & filter, const uint32_t numComponents, const uint32_t srcW,
+                                   const uint32_t srcH, const uint32_t destW, const uint32_t destH)
+	: xKernel(filter, srcW, destW, 32)
+	, yKernel(filter, srcH, destH, 32)
+	, srcHeight(srcH)
+	, destWidth(destW)
+	, destHeight(destH)
+	, numRowsReceived(0)
+	, nextDestRow(0)
+{
+	assert(srcW  > 0 && srcH  > 0);
+	assert(destW > 0 && destH > 0);
+
+	// A window of rows is all the vertical pass ever needs at once.
+	ringRows.allocImageStorage(numComponents, destWidth, std::min<uint32_t>(yKernel.getWindowSize(), srcHeight));
+	outputRow.allocImageStorage(numComponents, destWidth, 1);
+}
+
+void StreamingResizer::getSourceWindow(const uint32_t destRow, int32_t & left, int32_t & lastNeeded) const
+{
+	// Same arithmetic as FloatImageBuffer::applyKernelVertical().
+	const float scale  = static_cast<float>(destHeight) / static_cast<float>(srcHeight);
+	const float iscale = (1.0f / scale);
+	const float center = (0.5f + destRow) * iscale;
+
+	left = static_cast<int32_t>(std::floor(center - yKernel.getWidth()));
+	lastNeeded = std::min<int32_t>(left + yKernel.getWindowSize() - 1, static_cast<int32_t>(srcHeight) - 1);
+}
+
+void StreamingResizer::pushRow(const FloatImageBuffer & rows, const uint32_t rowInBuffer, const RowCallback & emitRow)
+{
+	assert(numRowsReceived < srcHeight && "More rows than the source height!");
+
+	// Horizontal pass straight into the ring:
+	const uint32_t ringSize = ringRows.getHeight();
+	const uint32_t ringRow  = numRowsReceived % ringSize;
+	for (uint32_t c = 0; c < ringRows.getNumComponents(); ++c)
+	{
+		rows.applyKernelHorizontal(xKernel, static_cast<int32_t>(rowInBuffer), c, FloatImageBuffer::Clamp,
+		                           ringRows.getChannel(c) + ringRow * destWidth);
+	}
+	++numRowsReceived;
+
+	// Vertical pass for every destination row whose window is now complete:
+	const int32_t windowSize = yKernel.getWindowSize();
+	const int32_t maxRow = static_cast<int32_t>(srcHeight) - 1;
+	while (nextDestRow < destHeight)
+	{
+		int32_t left, lastNeeded;
+		getSourceWindow(nextDestRow, left, lastNeeded);
+		if (lastNeeded >= static_cast<int32_t>(numRowsReceived))
+		{
+			break;
+		}
+
+		for (uint32_t c = 0; c < ringRows.getNumComponents(); ++c)
+		{
+			const float * ring = ringRows.getChannel(c);
+			float * out = outputRow.getChannel(c);
+
+			for (uint32_t x = 0; x < destWidth; ++x)
+			{
+				float sum = 0;
+				for (int32_t j = 0; j < windowSize; ++j)
+				{
+					const int32_t srcRow = std::max(0, std::min(left + j, maxRow));
+					sum += yKernel.getValueAt(nextDestRow, j) * ring[(srcRow % ringSize) * destWidth + x];
+				}
+				out[x] = sum;
+			}
+		}
+
+		emitRow(outputRow, 0, nextDestRow);
+		++nextDestRow;
+	}
+}
+
+} // namespace tool {}
+} // namespace vt {}
@@ -0,0 +1,103 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: vt_tool_page_scaling.cpp
+// Author: Guilherme R. Lampert
+// Created on: 18/10/26
+// Brief: Reduced resolution storage of individual pages.
+//
+// License:
+//  This source code is released under the MIT License.
+//  Copyright (c) 2014 Guilherme R. Lampert.
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+// ================================================================================================
+
+#include "vt_tool_page_scaling.hpp"
+#include "vt_tool_float_image_buffer.hpp"
+#include "vt_tool_image.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+namespace vt
+{
+namespace tool
+{
+namespace
+{
+
+void resizePage(const uint8_t * src, const uint32_t srcSize, const uint32_t destSize,
+                const FilterType filterType, Image & destImage)
+{
+	Image srcImage;
+	std::memcpy(srcImage.allocImageStorage(srcSize * srcSize * 4, srcSize, srcSize, PixelFormat::RgbaU8),
+	            src, srcSize * srcSize * 4);
+
+	// Same filter and addressing used to build the mipmaps.
+	const std::unique_ptr<Filter> filter = Filter::createFilter(filterType);
+	FloatImageBuffer floatImage(srcImage);
+	FloatImageBuffer resizedImage;
+	floatImage.resize(resizedImage, *filter, destSize, destSize, FloatImageBuffer::Clamp);
+	resizedImage.toImageRgbaU8(destImage);
+}
+
+} // namespace {}
+
+void reducePageRgbaU8(const uint8_t * page, const uint32_t pageSize, const uint32_t shift,
+                      const FilterType filter, std::vector<uint8_t> & reduced)
+{
+	assert(page != nullptr);
+	assert(shift > 0 && shift <= MaxPageStorageShift);
+
+	Image reducedImage;
+	resizePage(page, pageSize, (pageSize >> shift), filter, reducedImage);
+
+	const uint8_t * data = reducedImage.getDataPtr<uint8_t>();
+	reduced.assign(data, data + reducedImage.getDataSizeBytes());
+}
+
+void expandPageRgbaU8(const uint8_t * reduced, const uint32_t pageSize, const uint32_t shift,
+                      const FilterType filter, uint8_t * dest)
+{
+	assert(reduced != nullptr && dest != nullptr);
+	assert(shift > 0 && shift <= MaxPageStorageShift);
+
+	Image fullImage;
+	resizePage(reduced, (pageSize >> shift), pageSize, filter, fullImage);
+	std::memcpy(dest, fullImage.getDataPtr<uint8_t>(), fullImage.getDataSizeBytes());
+}
+
+int pageMaxErrorRgbaU8(const uint8_t * pageA, const uint8_t * pageB, const uint32_t pageSize)
+{
+	int maxError = 0;
+	const uint32_t numBytes = pageSize * pageSize * 4;
+	for (uint32_t i = 0; i < numBytes; ++i)
+	{
+		maxError = std::max(maxError, std::abs(int(pageA[i]) - int(pageB[i])));
+	}
+	return maxError;
+}
+
+} // namespace tool {}
+} // namespace vt {}
@@ -36,14 +36,21 @@
 #include "vt_tool_platform_utils.hpp"
 #include "vt_tool_mipmapper.hpp"
 #include "vt_tool_image.hpp"
+#include "vt_tool_image_source.hpp"
+#include "vt_tool_page_scaling.hpp"
 #include "vt_file_format.hpp"
 
 // Standard library:
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstdio>
 #include <fstream>
 #include <cerrno>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace vt
 {
@@ -69,6 +76,15 @@ void PageFileBuilderOptions::printSelf() const
 	std::printf("addDebugInfoToPages....: %s\n", boolStr[int(addDebugInfoToPages)]);
 	std::printf("dumpPageImages.........: %s\n", boolStr[int(dumpPageImages)]);
 	std::printf("stdoutVerbose..........: %s\n", boolStr[int(stdoutVerbose)]);
+	std::printf("writeMipTail...........: %s\n", boolStr[int(writeMipTail)]);
+	std::printf("streamSource...........: %s\n", boolStr[int(streamSource)]);
+	std::printf("rawWidth...............: %d\n", rawWidth);
+	std::printf("rawHeight..............: %d\n", rawHeight);
+	std::printf("rawComponents..........: %d\n", rawComponents);
+	std::printf("reducePages............: %s\n", boolStr[int(reducePages)]);
+	std::printf("reducePagesMaxError....: %d\n", reducePagesMaxError);
+	std::printf("atlasSharePages........: %s\n", boolStr[int(atlasSharePages)]);
+	std::printf("atlasAlignedLevels.....: %d\n", atlasAlignedLevels);
 }
 
 // ======================================================
@@ -94,18 +110,25 @@ bool PageFileBuilder::MipMapLevel::isAllocated() const
 	return tiles != nullptr;
 }
 
-void PageFileBuilder::MipMapLevel::allocate(const uint32_t tx, const uint32_t ty, const uint32_t numComponents, const uint32_t pageSizePixels)
+void PageFileBuilder::MipMapLevel::allocate(const uint32_t tx, const uint32_t ty, const uint32_t usedTx, const uint32_t usedTy,
+                                            const uint32_t numComponents, const uint32_t pageSizePixels)
 {
 	assert(!isAllocated() && "Already allocated! free() first.");
 	assert(tx != 0 && ty != 0 && "Number of tiles was invalid! Must not be zero!");
+	assert(usedTx != 0 && usedTx <= tx && usedTy != 0 && usedTy <= ty);
 
 	tilesX = tx;
 	tilesY = ty;
+	usedTilesX = usedTx;
+	usedTilesY = usedTy;
 	tiles.reset(new FloatImageBuffer[tilesX * tilesY]);
 
-	for (uint32_t i = 0; i < (tilesX * tilesY); ++i)
+	for (uint32_t y = 0; y < usedTilesY; ++y)
 	{
-		tiles[i].allocImageStorage(numComponents, pageSizePixels, pageSizePixels);
+		for (uint32_t x = 0; x < usedTilesX; ++x)
+		{
+			tiles[x + y * tilesX].allocImageStorage(numComponents, pageSizePixels, pageSizePixels);
+		}
 	}
 }
 
@@ -113,6 +136,10 @@ void PageFileBuilder::MipMapLevel::free()
 {
 	tilesX = 0;
 	tilesY = 0;
+	validWidth  = 0;
+	validHeight = 0;
+	usedTilesX  = 0;
+	usedTilesY  = 0;
 	tiles  = nullptr;
 }
 
@@ -132,68 +159,144 @@ inline std::string removeExtension(const std::string & filename)
 	return filename.substr(0, lastDot);
 }
 
-inline int buildMipSizeList(int size, int mipLevels[], const int tileSize)
+inline std::string textureNameFromFile(const std::string & filename)
+{
+	// File name without path and extension.
+	const size_t lastSlash = filename.find_last_of("/\\");
+	return removeExtension((lastSlash != std::string::npos) ? filename.substr(lastSlash + 1) : filename);
+}
+
+inline uint32_t nextPowerOfTwo(uint32_t size)
 {
-	int levelNum = 0;
-	while ((size > 0) && (size >= tileSize))
+	uint32_t pot = 1;
+	while (pot < size)
 	{
-		mipLevels[levelNum++] = size;
-		size /= 2;
+		pot *= 2;
 	}
-	return levelNum;
+	return pot;
+}
+
+inline int roundUpTo(const int value, const int multiple)
+{
+	return ((value + multiple - 1) / multiple) * multiple;
 }
 
-inline bool mipsAreDivisible(const int mipLevels[], const int numLevels, const int tileSize)
+// PageIds store the page coordinates in 8 bits each.
+constexpr int MaxAtlasPagesPerAxis = 256;
+
+// Skyline bottom-left rectangle packer, working in arbitrary units.
+// Keeps the top edge of the packed area as a list of horizontal segments
+// and places each rectangle where it ends up the lowest.
+class SkylinePacker final
 {
-	for (int i = 0; i < numLevels; ++i)
+public:
+
+	explicit SkylinePacker(const int binSize)
+		: size(binSize)
+	{
+		skyline.push_back({ 0, 0, binSize });
+	}
+
+	// Position is aligned to 'align' units on both axes. False if the rect doesn't fit.
+	bool insert(const int w, const int h, const int align, int & outX, int & outY)
 	{
-		if ((mipLevels[i] % tileSize) != 0)
+		int bestX = -1, bestY = -1;
+		for (const Segment & seg : skyline)
+		{
+			const int x = roundUpTo(seg.x, align);
+			const int y = fitAt(x, w, align);
+			if ((y >= 0) && ((y + h) <= size) && ((bestY < 0) || (y < bestY) || ((y == bestY) && (x < bestX))))
+			{
+				bestX = x;
+				bestY = y;
+			}
+		}
+
+		if (bestY < 0)
 		{
 			return false;
 		}
+
+		addSegment(bestX, bestY + h, w);
+		outX = bestX;
+		outY = bestY;
+		return true;
 	}
-	return true;
-}
 
-inline int adjustSize(const int texSize, const int tileSize)
-{
-	// +1 rounds up
-	// -1 rounds down
-	//
-	// Example:
-	//   +1 with 1024 => 1920
-	//   -1 with 1024 => 960
-	//
-	constexpr int increment = 1;
+private:
 
-	int mipLevels[32] = {0};
-	int numLevels = 0, newSize = texSize;
+	struct Segment
+	{
+		int x, y, width;
+	};
 
-	if ((newSize % tileSize) != 0)
+	// Lowest aligned y where a 'w' wide rect can sit at 'x'. -1 if off the bin.
+	int fitAt(const int x, const int w, const int align) const
 	{
-		while ((newSize % tileSize) != 0)
+		if ((x + w) > size)
 		{
-			newSize += increment;
+			return -1;
 		}
 
-		numLevels = buildMipSizeList(newSize, mipLevels, tileSize);
-		while (!mipsAreDivisible(mipLevels, numLevels, tileSize))
+		int y = 0;
+		for (const Segment & seg : skyline)
+		{
+			if ((seg.x < (x + w)) && ((seg.x + seg.width) > x))
+			{
+				y = std::max(y, seg.y);
+			}
+		}
+		return roundUpTo(y, align);
+	}
+
+	void addSegment(const int x, const int top, const int w)
+	{
+		std::vector<Segment> result;
+		result.reserve(skyline.size() + 2);
+
+		bool inserted = false;
+		for (const Segment & seg : skyline)
 		{
-			newSize  += increment;
-			numLevels = buildMipSizeList(newSize, mipLevels, tileSize);
+			const int segEnd = seg.x + seg.width;
+			if (segEnd <= x)
+			{
+				result.push_back(seg);
+				continue;
+			}
+			if (seg.x < x)
+			{
+				result.push_back({ seg.x, seg.y, x - seg.x });
+			}
+			if (!inserted)
+			{
+				result.push_back({ x, top, w });
+				inserted = true;
+			}
+			if (segEnd > (x + w))
+			{
+				const int start = std::max(seg.x, x + w);
+				result.push_back({ start, seg.y, segEnd - start });
+			}
 		}
 
-		/*
-		std::printf("New size: %d\n", newSize);
-		for (int i = 0; i < numLevels; ++i)
+		// Merge neighbours of the same height:
+		skyline.clear();
+		for (const Segment & seg : result)
 		{
-			std::printf("Level %d = %d ( %d tiles )\n", i, mipLevels[i], (mipLevels[i] / tileSize));
+			if (!skyline.empty() && (skyline.back().y == seg.y))
+			{
+				skyline.back().width += seg.width;
+			}
+			else
+			{
+				skyline.push_back(seg);
+			}
 		}
-		*/
 	}
 
-	return newSize;
-}
+	const int size;
+	std::vector<Segment> skyline;
+};
 
 } // namespace {}
 
@@ -206,12 +309,43 @@ PageFileBuilder::PageFileBuilder(std::string inputFile, std::string outputFile,
 	, outputFileName(std::move(outputFile))
 	, opts(std::move(options))
 	, sourcePixelFormat(PixelFormat::RgbaU8)
+	, basePagesX(0)
+	, basePagesY(0)
+	, baseWidth(0)
+	, baseHeight(0)
 {
 	// Basic input validation:
 	if (inputFileName.empty())
 	{
 		error("No input filename provided!");
 	}
+	validateOptions();
+}
+
+PageFileBuilder::PageFileBuilder(std::vector<std::string> inputFiles, std::string outputFile, PageFileBuilderOptions options)
+	: inputFileName("atlas of " + std::to_string(inputFiles.size()) + " images")
+	, outputFileName(std::move(outputFile))
+	, atlasInputFiles(std::move(inputFiles))
+	, opts(std::move(options))
+	, sourcePixelFormat(PixelFormat::RgbaU8)
+	, basePagesX(0)
+	, basePagesY(0)
+	, baseWidth(0)
+	, baseHeight(0)
+{
+	if (atlasInputFiles.empty())
+	{
+		error("No input filenames provided!");
+	}
+	if (opts.atlasAlignedLevels < 0)
+	{
+		error("Invalid number of atlas aligned levels!");
+	}
+	validateOptions();
+}
+
+void PageFileBuilder::validateOptions()
+{
 	if (outputFileName.empty())
 	{
 		error("No output filename provided!");
@@ -234,6 +368,12 @@ PageFileBuilder::PageFileBuilder(std::string inputFile, std::string outputFile,
 
 void PageFileBuilder::generatePageFile()
 {
+	if (!atlasInputFiles.empty())
+	{
+		generateAtlasPageFile();
+		return;
+	}
+
 	// Steps:
 	// - Open file & load image;
 	// - Generate mipmap chain;
@@ -245,6 +385,14 @@ void PageFileBuilder::generatePageFile()
 		std::printf("Beginning page file processing... Loading image: %s\n", inputFileName.c_str());
 	}
 
+	if (opts.streamSource)
+	{
+		std::unique_ptr<Filter> textureFilter = Filter::createFilter(opts.textureFilter);
+		generateStreamedPageFile(*textureFilter);
+		writePageFile();
+		return;
+	}
+
 	Image srcImage;
 	std::string imageLoadError;
 
@@ -273,27 +421,10 @@ void PageFileBuilder::generatePageFile()
 	// Filter used for the mipmap downsampling and eventual upsampling:
 	std::unique_ptr<Filter> textureFilter = Filter::createFilter(opts.textureFilter);
 
-	// If the source image dimensions are not evenly divisible by the
-	// page content size, we need to upsample it to an adequate size.
-	if (((floatImage.getWidth()  % opts.pageContentSizePixels) != 0) ||
-	    ((floatImage.getHeight() % opts.pageContentSizePixels) != 0))
-	{
-		int newWidth  = static_cast<int>(floatImage.getWidth());
-		int newHeight = static_cast<int>(floatImage.getHeight());
-
-		newWidth  = adjustSize(newWidth,  opts.pageContentSizePixels);
-		newHeight = adjustSize(newHeight, opts.pageContentSizePixels);
-
-		if (opts.stdoutVerbose)
-		{
-			std::printf("Upsampling source image to size evenly divisible by %d: (%u, %u)...\n",
-					opts.pageContentSizePixels, newWidth, newHeight);
-		}
-
-		FloatImageBuffer upsampledImage;
-		floatImage.resize(upsampledImage, *textureFilter, newWidth, newHeight, FloatImageBuffer::Clamp);
-		floatImage = std::move(upsampledImage);
-	}
+	// Sizes that are not a power-of-two number of pages are not resampled.
+	// The right/bottom pages are only partially filled instead, see processImage().
+	setBasePageLayout(floatImage.getWidth(), floatImage.getHeight());
+	const unsigned int numPageLevels = countPageLevels(floatImage.getWidth(), floatImage.getHeight());
 
 	// Generate mip-chain.
 	// The only error that can happen here is an out-of-memory situation,
@@ -301,12 +432,10 @@ void PageFileBuilder::generatePageFile()
 	MipMapper mipMapper(std::move(floatImage));
 	mipMapper.buildMipMapChain(*textureFilter, FloatImageBuffer::Clamp);
 
-	unsigned int numMipMapLevels = static_cast<unsigned int>(mipMapper.getNumMipMapLevels());
-	if (numMipMapLevels > static_cast<unsigned int>(opts.maxMipLevels))
-	{
-		numMipMapLevels = static_cast<unsigned int>(opts.maxMipLevels);
-	}
+	const unsigned int numMipMapLevels = std::min(numPageLevels, static_cast<unsigned int>(mipMapper.getNumMipMapLevels()));
 
+	const FloatImageBuffer * lastLevel = nullptr;
+	unsigned int lastLevelIndex = 0;
 	for (unsigned int l = 0; l < numMipMapLevels; ++l)
 	{
 		const FloatImageBuffer * source = mipMapper.getMipMapLevel(l);
@@ -316,16 +445,14 @@ void PageFileBuilder::generatePageFile()
 			error("Null image for mip-level " + std::to_string(l));
 		}
 
-		if (opts.stopOn1PageMip)
-		{
-			if ((source->getWidth()  < static_cast<unsigned int>(opts.pageContentSizePixels)) ||
-			    (source->getHeight() < static_cast<unsigned int>(opts.pageContentSizePixels)))
-			{
-				break;
-			}
-		}
-
 		processImage(*source, l);
+		lastLevel = source;
+		lastLevelIndex = l;
+	}
+
+	if (opts.writeMipTail && (lastLevel != nullptr))
+	{
+		buildMipTail(*lastLevel, lastLevelIndex, *textureFilter);
 	}
 
 	writePageFile();
@@ -336,27 +463,96 @@ void PageFileBuilder::error(const std::string & errorMessage) const
 	throw PageFileBuilderError("PageFileBuilder error (" + inputFileName + "): " + errorMessage);
 }
 
+void PageFileBuilder::setBasePageLayout(const uint32_t width, const uint32_t height)
+{
+	// The runtime expects a power-of-two number of pages in both axes.
+	// Pages past the image are filled by clamping to its edges.
+	const uint32_t contentSize = opts.pageContentSizePixels;
+	basePagesX = nextPowerOfTwo((width  + contentSize - 1) / contentSize);
+	basePagesY = nextPowerOfTwo((height + contentSize - 1) / contentSize);
+	baseWidth  = width;
+	baseHeight = height;
+
+	if (opts.stdoutVerbose && (((basePagesX * contentSize) != width) || ((basePagesY * contentSize) != height)))
+	{
+		std::printf("Image (%u, %u) partially fills its %ux%u pages. UV scale: (%f, %f)\n",
+				width, height, basePagesX, basePagesY,
+				static_cast<double>(width)  / (basePagesX * contentSize),
+				static_cast<double>(height) / (basePagesY * contentSize));
+	}
+}
+
+void PageFileBuilder::getLevelPageLayout(const unsigned int level, uint32_t & tilesX, uint32_t & tilesY) const
+{
+	assert(basePagesX != 0 && basePagesY != 0);
+	tilesX = std::max(basePagesX >> level, 1u);
+	tilesY = std::max(basePagesY >> level, 1u);
+}
+
+void PageFileBuilder::getLevelUsedPages(const unsigned int level, uint32_t & usedX, uint32_t & usedY) const
+{
+	// Texture coordinates in [0,1] reach (baseWidth / 2^level) pixels into the level,
+	// that is page floor(baseWidth / (contentSize * 2^level)), inclusive, since a
+	// coordinate of exactly one lands on the first pixel past the image.
+	uint32_t tilesX, tilesY;
+	getLevelPageLayout(level, tilesX, tilesY);
+
+	const uint64_t levelContentSize = uint64_t(opts.pageContentSizePixels) << level;
+	usedX = static_cast<uint32_t>(std::min<uint64_t>(baseWidth  / levelContentSize + 1, tilesX));
+	usedY = static_cast<uint32_t>(std::min<uint64_t>(baseHeight / levelContentSize + 1, tilesY));
+}
+
+unsigned int PageFileBuilder::countPageLevels(uint32_t width, uint32_t height) const
+{
+	// Same level sizes as MipMapper::buildMipMapChain(). With stopOn1PageMip the
+	// chain ends at the first level with a single page in either axis, which keeps
+	// the fraction of the pages covered by the image the same for every level.
+	unsigned int numLevels = 0;
+	while (numLevels < static_cast<unsigned int>(opts.maxMipLevels))
+	{
+		if (opts.stopOn1PageMip && (((basePagesX >> numLevels) == 0) || ((basePagesY >> numLevels) == 0)))
+		{
+			break;
+		}
+
+		++numLevels;
+		if ((width == 1) || (height == 1))
+		{
+			break;
+		}
+		width  = std::max(width  / 2, 1u);
+		height = std::max(height / 2, 1u);
+	}
+	return numLevels;
+}
+
 void PageFileBuilder::processImage(const FloatImageBuffer & source, const unsigned int level)
 {
 	const uint32_t w = source.getWidth();
 	const uint32_t h = source.getHeight();
-	const uint32_t contentSize = opts.pageContentSizePixels;
-	const uint32_t tilesX = static_cast<uint32_t>(std::ceil(static_cast<float>(w) / contentSize));
-	const uint32_t tilesY = static_cast<uint32_t>(std::ceil(static_cast<float>(h) / contentSize));
+
+	uint32_t tilesX, tilesY, usedX, usedY;
+	getLevelPageLayout(level, tilesX, tilesY);
+	getLevelUsedPages(level, usedX, usedY);
 
 	if (opts.stdoutVerbose)
 	{
-		std::printf("Processing level %u (tilesX:%u, tilesY:%u), (w:%u, h:%u)\n",
-				level, tilesX, tilesY, w, h);
+		std::printf("Processing level %u (tilesX:%u, tilesY:%u, used:%ux%u), (w:%u, h:%u)\n",
+				level, tilesX, tilesY, usedX, usedY, w, h);
 	}
 
 	// Allocate a mipmap level:
 	MipMapLevel & vtLevel = pageFileLevels[level];
-	vtLevel.allocate(tilesX, tilesY, source.getNumComponents(), opts.pageSizePixels);
-
-	for (uint32_t y = 0; y < tilesY; ++y)
+	vtLevel.allocate(tilesX, tilesY, usedX, usedY, source.getNumComponents(), opts.pageSizePixels);
+	vtLevel.validWidth  = w;
+	vtLevel.validHeight = h;
+
+	// Pages overlapping the right/bottom edges of the image get the edge pixels
+	// repeated by the Clamp mode, so filtering across the edge of the valid area
+	// never picks up anything else. Padding pages past them are skipped.
+	for (uint32_t y = 0; y < usedY; ++y)
 	{
-		for (uint32_t x = 0; x < tilesX; ++x)
+		for (uint32_t x = 0; x < usedX; ++x)
 		{
 			FloatImageBuffer & dest = vtLevel.getTileAt(x, y);
 
@@ -377,6 +573,317 @@ void PageFileBuilder::processImage(const FloatImageBuffer & source, const unsign
 	}
 }
 
+void PageFileBuilder::buildMipTail(const FloatImageBuffer & lastLevel, const unsigned int level, const Filter & filter)
+{
+	// The tail is sampled with the same coordinates as the pages, so it
+	// has to cover the whole page area of the level, padding included.
+	const MipMapLevel & vtLevel = pageFileLevels[level];
+	const uint32_t pagesWidth  = vtLevel.tilesX * opts.pageContentSizePixels;
+	const uint32_t pagesHeight = vtLevel.tilesY * opts.pageContentSizePixels;
+
+	const FloatImageBuffer * tailSource = &lastLevel;
+	FloatImageBuffer paddedLevel;
+	bool flipTail = opts.flipSourceVertically;
+
+	if ((lastLevel.getWidth() != pagesWidth) || (lastLevel.getHeight() != pagesHeight))
+	{
+		// Same flip and Clamp as processImage(), so the padding ends up where the pages have it.
+		paddedLevel.allocImageStorage(lastLevel.getNumComponents(), pagesWidth, pagesHeight);
+		lastLevel.copyRect(paddedLevel, 0, 0, 0, 0, pagesWidth, pagesHeight, opts.flipSourceVertically, FloatImageBuffer::Clamp);
+		tailSource = &paddedLevel;
+		flipTail = false;
+	}
+
+	// Power-of-two sizes, so the runtime can keep the tail in a mipmapped
+	// GLES2 texture. Never larger than one page of content.
+	const uint32_t maxSize = nextPowerOfTwo(opts.pageContentSizePixels);
+	uint32_t w = std::min(nextPowerOfTwo(tailSource->getWidth()),  maxSize);
+	uint32_t h = std::min(nextPowerOfTwo(tailSource->getHeight()), maxSize);
+
+	mipTailLevels.clear();
+	mipTailLevels.emplace_back();
+	tailSource->resize(mipTailLevels.back(), filter, w, h, FloatImageBuffer::Clamp);
+
+	// Same row order as the pages. Per-tile flipping doesn't apply to the tail.
+	if (flipTail)
+	{
+		mipTailLevels.back().flipVInPlace();
+	}
+
+	while ((w > 1) || (h > 1))
+	{
+		w = std::max(w / 2, 1u);
+		h = std::max(h / 2, 1u);
+
+		FloatImageBuffer nextLevel;
+		mipTailLevels.back().resize(nextLevel, filter, w, h, FloatImageBuffer::Clamp);
+		mipTailLevels.push_back(std::move(nextLevel));
+	}
+
+	if (opts.stdoutVerbose)
+	{
+		std::printf("Built mip tail with %u levels, starting at (%u, %u).\n",
+				static_cast<unsigned int>(mipTailLevels.size()),
+				mipTailLevels.front().getWidth(), mipTailLevels.front().getHeight());
+	}
+}
+
+// ======================================================
+// PageFileBuilder::LevelTiler:
+// ======================================================
+
+//
+// Cuts one mip-level into pages as its rows arrive, in stored order (top to bottom).
+// A row of pages is written as soon as the last row under it is in, so only a page's
+// height of rows is ever kept. Produces exactly the same pages as processImage().
+//
+class PageFileBuilder::LevelTiler final
+{
+public:
+
+	LevelTiler(const PageFileBuilderOptions & options, MipMapLevel & level, const uint32_t w, const uint32_t h,
+	           const uint32_t tilesX, const uint32_t tilesY, const uint32_t usedX, const uint32_t usedY,
+	           const uint32_t numComponents, const bool keepWholeImage)
+		: opts(options)
+		, vtLevel(level)
+		, width(w)
+		, height(h)
+		, ringSize(opts.pageSizePixels + opts.pageBorderSizePixels)
+	{
+		vtLevel.allocate(tilesX, tilesY, usedX, usedY, numComponents, opts.pageSizePixels);
+		vtLevel.validWidth  = w;
+		vtLevel.validHeight = h;
+
+		// With a flipped source the bottom row of pages is the first one completed.
+		nextTileY = opts.flipSourceVertically ? static_cast<int32_t>(vtLevel.tilesY) - 1 : 0;
+
+		ringRows.allocImageStorage(numComponents, w, ringSize);
+		if (keepWholeImage)
+		{
+			wholeImage.allocImageStorage(numComponents, w, h);
+		}
+	}
+
+	// No copy or assignment.
+	LevelTiler(const LevelTiler &) = delete;
+	LevelTiler & operator = (const LevelTiler &) = delete;
+
+	void pushRow(const FloatImageBuffer & rows, const uint32_t rowInBuffer, const uint32_t storedRow)
+	{
+		for (uint32_t c = 0; c < rows.getNumComponents(); ++c)
+		{
+			const float * src = rows.getChannel(c) + rowInBuffer * width;
+			std::copy(src, src + width, ringRows.getChannel(c) + (storedRow % ringSize) * width);
+			if (wholeImage.getWidth() != 0)
+			{
+				std::copy(src, src + width, wholeImage.getChannel(c) + storedRow * width);
+			}
+		}
+
+		while (!isFinished() && (getLastStoredRow(nextTileY) <= storedRow))
+		{
+			emitTileRow(static_cast<uint32_t>(nextTileY));
+			nextTileY += opts.flipSourceVertically ? -1 : +1;
+		}
+	}
+
+	bool isFinished() const
+	{
+		return (nextTileY < 0) || (nextTileY >= static_cast<int32_t>(vtLevel.tilesY));
+	}
+
+	// Full image of the level, if requested when constructed.
+	const FloatImageBuffer & getWholeImage() const { return wholeImage; }
+
+private:
+
+	// Stored row read for output row 'y' of the level, as copyRect() does with Clamp.
+	uint32_t getStoredRow(const int32_t y) const
+	{
+		const uint32_t row = static_cast<uint32_t>(std::max(0, std::min(y, static_cast<int32_t>(height) - 1)));
+		return opts.flipSourceVertically ? (height - 1 - row) : row;
+	}
+
+	uint32_t getLastStoredRow(const int32_t tileY) const
+	{
+		const int32_t firstRow = tileY * opts.pageContentSizePixels - opts.pageBorderSizePixels;
+		return std::max(getStoredRow(firstRow), getStoredRow(firstRow + static_cast<int32_t>(ringSize) - 1));
+	}
+
+	void emitTileRow(const uint32_t tileY)
+	{
+		// Mirrors the copyRect() in processImage(), including the clamping of the
+		// destination coordinates, which lets the trailing border rows/columns overwrite
+		// the last row/column of the page.
+		const int32_t pageSize = opts.pageSizePixels;
+		const int32_t rectSize = static_cast<int32_t>(ringSize);
+		const int32_t firstRow = static_cast<int32_t>(tileY) * opts.pageContentSizePixels - opts.pageBorderSizePixels;
+		const int32_t maxX     = static_cast<int32_t>(width) - 1;
+
+		if (tileY >= vtLevel.usedTilesY)
+		{
+			return; // Padding row.
+		}
+
+		for (uint32_t x = 0; x < vtLevel.usedTilesX; ++x)
+		{
+			FloatImageBuffer & dest = vtLevel.getTileAt(x, tileY);
+			const int32_t firstCol = static_cast<int32_t>(x) * opts.pageContentSizePixels - opts.pageBorderSizePixels;
+
+			for (uint32_t c = 0; c < dest.getNumComponents(); ++c)
+			{
+				const float * ring = ringRows.getChannel(c);
+				float * destChannel = dest.getChannel(c);
+
+				for (int32_t y = 0; y < rectSize; ++y)
+				{
+					const float * srcRow = ring + (getStoredRow(firstRow + y) % ringSize) * width;
+					float * destRow = destChannel + std::min(y, pageSize - 1) * pageSize;
+
+					for (int32_t i = 0; i < rectSize; ++i)
+					{
+						destRow[std::min(i, pageSize - 1)] = srcRow[std::max(0, std::min(firstCol + i, maxX))];
+					}
+				}
+			}
+
+			if (opts.flipTilesVertically)
+			{
+				dest.flipVInPlace();
+			}
+		}
+	}
+
+	const PageFileBuilderOptions & opts;
+	MipMapLevel & vtLevel;
+
+	const uint32_t width;
+	const uint32_t height;
+	const uint32_t ringSize;
+	int32_t nextTileY;
+
+	// The last page-height of rows received. Stored row 'r' lives in row (r % ringSize).
+	FloatImageBuffer ringRows;
+	FloatImageBuffer wholeImage;
+};
+
+// ======================================================
+
+void PageFileBuilder::generateStreamedPageFile(const Filter & filter)
+{
+	// Rows read from the source at a time:
+	constexpr uint32_t bandRows = 32;
+
+	ImageSource::RawLayout rawLayout(opts.rawWidth, opts.rawHeight, opts.rawComponents);
+	std::string openError;
+
+	ImageSourcePtr source = ImageSource::open(inputFileName, rawLayout, &openError);
+	if (source == nullptr)
+	{
+		error("Can't open input image file! " + openError);
+	}
+
+	// Sources are always delivered as RGBA. Pages are written as 8bit RGBA.
+	sourcePixelFormat = PixelFormat::RgbaU8;
+	const uint32_t numComponents = 4;
+
+	const uint32_t srcWidth  = source->getWidth();
+	const uint32_t srcHeight = source->getHeight();
+
+	if (opts.stdoutVerbose)
+	{
+		std::printf("Streaming source image (%u, %u) with the %s reader...\n",
+				srcWidth, srcHeight, source->getReaderName());
+	}
+
+	// Same page layout and level sizes as the in-memory path, following
+	// MipMapper::buildMipMapChain(). No upsampling for partially filled pages.
+	setBasePageLayout(srcWidth, srcHeight);
+	const unsigned int numLevels = countPageLevels(srcWidth, srcHeight);
+	if (numLevels == 0)
+	{
+		return;
+	}
+
+	// One tiler per level. Every level past the first is resized straight
+	// from level 0, like MipMapper does, fed with the level 0 rows as they come.
+	std::vector<std::unique_ptr<LevelTiler>> tilers;
+	std::vector<std::unique_ptr<StreamingResizer>> downsamplers;
+	uint32_t w = srcWidth;
+	uint32_t h = srcHeight;
+	for (unsigned int l = 0; l < numLevels; ++l)
+	{
+		const bool isLastLevel = (l == numLevels - 1);
+
+		uint32_t tilesX, tilesY, usedX, usedY;
+		getLevelPageLayout(l, tilesX, tilesY);
+		getLevelUsedPages(l, usedX, usedY);
+
+		if (opts.stdoutVerbose)
+		{
+			std::printf("Processing level %u (tilesX:%u, tilesY:%u, used:%ux%u), (w:%u, h:%u)\n",
+					l, tilesX, tilesY, usedX, usedY, w, h);
+		}
+
+		tilers.emplace_back(new LevelTiler(opts, pageFileLevels[l], w, h, tilesX, tilesY, usedX, usedY,
+		                                   numComponents, isLastLevel && opts.writeMipTail));
+		if (l != 0)
+		{
+			downsamplers.emplace_back(new StreamingResizer(filter, numComponents, srcWidth, srcHeight, w, h));
+		}
+
+		w = std::max(w / 2, 1u);
+		h = std::max(h / 2, 1u);
+	}
+
+	const StreamingResizer::RowCallback pushBaseRow =
+		[&tilers, &downsamplers](const FloatImageBuffer & rows, const uint32_t rowInBuffer, const uint32_t row)
+	{
+		tilers[0]->pushRow(rows, rowInBuffer, row);
+		for (size_t d = 0; d < downsamplers.size(); ++d)
+		{
+			LevelTiler * tiler = tilers[d + 1].get();
+			downsamplers[d]->pushRow(rows, rowInBuffer,
+				[tiler](const FloatImageBuffer & levelRows, const uint32_t levelRowInBuffer, const uint32_t levelRow)
+				{
+					tiler->pushRow(levelRows, levelRowInBuffer, levelRow);
+				});
+		}
+	};
+
+	FloatImageBuffer band;
+	band.allocImageStorage(numComponents, srcWidth, std::min(bandRows, srcHeight));
+
+	std::string readError;
+	for (uint32_t firstRow = 0; firstRow < srcHeight; firstRow += bandRows)
+	{
+		const uint32_t numRows = std::min(bandRows, srcHeight - firstRow);
+		if (!source->readRows(firstRow, numRows, band, 0, &readError))
+		{
+			error("Failed to read source image rows! " + readError);
+		}
+
+		for (uint32_t r = 0; r < numRows; ++r)
+		{
+			pushBaseRow(band, r, firstRow + r);
+		}
+	}
+
+	for (const auto & tiler : tilers)
+	{
+		if (!tiler->isFinished())
+		{
+			error("Source image ended before all pages were built!");
+		}
+	}
+
+	source.reset();
+	if (opts.writeMipTail)
+	{
+		buildMipTail(tilers.back()->getWholeImage(), numLevels - 1, filter);
+	}
+}
+
 void PageFileBuilder::writePageFile() const
 {
 	writeVTFF();
@@ -410,10 +917,10 @@ void PageFileBuilder::writePageFile() const
 			std::snprintf(dirname, sizeof(dirname), "img_dump/level_%u", static_cast<unsigned int>(l));
 			createDirectory(baseDir.c_str(), dirname);
 
-			// Write every page for every level:
-			for (uint32_t y = 0; y < vtLevel.tilesY; ++y)
+			// Write every page for every level. Padding pages are never loaded.
+			for (uint32_t y = 0; y < vtLevel.usedTilesY; ++y)
 			{
-				for (uint32_t x = 0; x < vtLevel.tilesX; ++x)
+				for (uint32_t x = 0; x < vtLevel.usedTilesX; ++x)
 				{
 					const FloatImageBuffer & rawImage = vtLevel.getTileAt(x, y);
 					rawImage.toImageRgbaU8(rgbaImage);
@@ -452,24 +959,111 @@ void PageFileBuilder::writePageFile() const
 	}
 }
 
-void PageFileBuilder::writeVTFF() const
+int PageFileBuilder::choosePageStorage(std::vector<uint8_t> & storageShifts, std::vector<std::vector<uint8_t>> & reducedPages) const
 {
-	std::ofstream file;
-
-	errno = 0;
-	file.exceptions(0); // Don't throw and exception if we have an error.
-	file.open(outputFileName, std::ofstream::out | std::ofstream::binary);
+	storageShifts.clear();
+	reducedPages.clear();
 
-	if (!file.is_open())
+	size_t totalPages = 0;
+	for (const MipMapLevel & vtLevel : pageFileLevels)
 	{
-		error("Failed to create VTFF output file! Reason: " + std::string(std::strerror(errno)));
+		if (vtLevel.isAllocated())
+		{
+			totalPages += vtLevel.tilesX * vtLevel.tilesY;
+		}
 	}
-	if (!file.good())
+
+	// Everything at full resolution unless asked otherwise.
+	storageShifts.resize(totalPages, 0);
+	reducedPages.resize(totalPages);
+	if (!opts.reducePages)
 	{
-		error("File stream is in a bad state for IO!");
+		return 0;
 	}
 
-	// The vector has all the 16 possible levels,
+	// Each page is reduced, then upsampled back exactly like the runtime will,
+	// trying the coarsest resolution first. The error is against the full page
+	// as it would have been stored, in 8bits steps.
+	const uint32_t pageSize = opts.pageSizePixels;
+	const uint32_t pageSizeBytes = pageSize * pageSize * 4;
+	std::vector<uint8_t> reduced;
+	std::vector<uint8_t> restored(pageSizeBytes);
+	uint64_t storedBytes = 0;
+	int maxError = 0;
+
+	Image rgbaImage;
+	size_t pageIndex = 0;
+	for (const MipMapLevel & vtLevel : pageFileLevels)
+	{
+		if (!vtLevel.isAllocated())
+		{
+			continue;
+		}
+		for (uint32_t y = 0; y < vtLevel.tilesY; ++y)
+		{
+			for (uint32_t x = 0; x < vtLevel.tilesX; ++x, ++pageIndex)
+			{
+				if (vtLevel.isPaddingTile(x, y))
+				{
+					continue; // Shared full size page, see writeVTFF().
+				}
+
+				vtLevel.getTileAt(x, y).toImageRgbaU8(rgbaImage);
+				const uint8_t * page = rgbaImage.getDataPtr<uint8_t>();
+
+				for (uint32_t shift = MaxPageStorageShift; shift > 0; --shift)
+				{
+					reducePageRgbaU8(page, pageSize, shift, opts.textureFilter, reduced);
+					expandPageRgbaU8(reduced.data(), pageSize, shift, opts.textureFilter, restored.data());
+
+					const int error = pageMaxErrorRgbaU8(page, restored.data(), pageSize);
+					if (error <= opts.reducePagesMaxError)
+					{
+						storageShifts[pageIndex] = static_cast<uint8_t>(shift);
+						reducedPages[pageIndex].swap(reduced);
+						maxError = std::max(maxError, error);
+						break;
+					}
+				}
+				storedBytes += reducedPageSizeBytes(pageSize, storageShifts[pageIndex]);
+			}
+		}
+	}
+
+	if (opts.stdoutVerbose)
+	{
+		const uint64_t fullBytes = uint64_t(totalPages) * pageSizeBytes;
+		const size_t numHalf    = std::count(storageShifts.begin(), storageShifts.end(), 1);
+		const size_t numQuarter = std::count(storageShifts.begin(), storageShifts.end(), 2);
+
+		std::printf("Reduced pages: %zu at half and %zu at quarter resolution, out of %zu.\n",
+				numHalf, numQuarter, totalPages);
+		std::printf("Page data: %.2f MB instead of %.2f MB (%.1f%% smaller). Max error: %d.\n",
+				storedBytes / (1024.0 * 1024.0), fullBytes / (1024.0 * 1024.0),
+				(fullBytes != 0) ? (100.0 * (fullBytes - storedBytes) / fullBytes) : 0.0, maxError);
+	}
+
+	return maxError;
+}
+
+void PageFileBuilder::writeVTFF() const
+{
+	std::ofstream file;
+
+	errno = 0;
+	file.exceptions(std::ofstream::goodbit); // Don't throw and exception if we have an error.
+	file.open(outputFileName, std::ofstream::out | std::ofstream::binary);
+
+	if (!file.is_open())
+	{
+		error("Failed to create VTFF output file! Reason: " + std::string(std::strerror(errno)));
+	}
+	if (!file.good())
+	{
+		error("File stream is in a bad state for IO!");
+	}
+
+	// The vector has all the 16 possible levels,
 	// but only the first N are allocated if in use.
 	uint32_t numLevels = 0;
 	for (size_t l = 0; l < pageFileLevels.size(); ++l)
@@ -499,8 +1093,13 @@ void PageFileBuilder::writeVTFF() const
 	header.borderSize      = opts.pageBorderSizePixels;
 
 	uint64_t pageDataStart = 0;
-	uint64_t pagesSoFar    = 0;
-	const uint32_t pageSizeBytes = header.pageSize * header.pageSize * 4; // Fixed to RGBA for now!
+	uint64_t pageDataSize  = 0;
+	size_t   pagesSoFar    = 0;
+
+	// Resolution each page is stored at, in the order they are written:
+	std::vector<uint8_t> storageShifts;
+	std::vector<std::vector<uint8_t>> reducedPages;
+	const int maxError = choosePageStorage(storageShifts, reducedPages);
 
 	// Write the file header:
 	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
@@ -516,12 +1115,19 @@ void PageFileBuilder::writeVTFF() const
 		pageDataStart += sizeof(VTFF::MipLevelInfo);
 		pageDataStart += sizeof(VTFF::PageInfo) * (vtLevel.tilesX * vtLevel.tilesY);
 	}
+	pageDataStart += sizeof(VTFF::MipTailInfo);
+	pageDataStart += sizeof(VTFF::PageStorageInfo);
 
 	if (opts.stdoutVerbose)
 	{
 		std::printf("VTFF headers use the first %llu bytes of the file.\n", pageDataStart);
 	}
 
+	// Padding pages are never requested, so they all point to a
+	// single page of zeros, stored in place of the first one.
+	uint64_t paddingPageOffset = 0;
+	size_t   numPaddingPages   = 0;
+
 	// Now write each mipmap level header:
 	for (uint32_t l = 0; l < numLevels; ++l)
 	{
@@ -533,6 +1139,8 @@ void PageFileBuilder::writeVTFF() const
 		levelInfo.height    = vtLevel.tilesY * header.pageSize;
 		levelInfo.numPagesX = static_cast<uint16_t>(vtLevel.tilesX);
 		levelInfo.numPagesY = static_cast<uint16_t>(vtLevel.tilesY);
+		levelInfo.validWidth  = vtLevel.validWidth;
+		levelInfo.validHeight = vtLevel.validHeight;
 		file.write(reinterpret_cast<const char *>(&levelInfo), sizeof(levelInfo));
 
 		// Write the individual page headers:
@@ -541,15 +1149,62 @@ void PageFileBuilder::writeVTFF() const
 			for (uint16_t x = 0; x < levelInfo.numPagesX; ++x)
 			{
 				VTFF::PageInfo pageInfo;
-				pageInfo.sizeInBytes = pageSizeBytes;
-				pageInfo.fileOffset  = pageDataStart + (pagesSoFar * pageSizeBytes);
+				std::memset(&pageInfo, 0, sizeof(pageInfo));
+				pageInfo.storageShift = storageShifts[pagesSoFar];
+				pageInfo.sizeInBytes  = reducedPageSizeBytes(header.pageSize, pageInfo.storageShift);
+
+				const bool isPadding = vtLevel.isPaddingTile(x, y);
+				const bool reused    = isPadding && (numPaddingPages != 0);
+				pageInfo.fileOffset  = reused ? paddingPageOffset : (pageDataStart + pageDataSize);
 				file.write(reinterpret_cast<const char *>(&pageInfo), sizeof(pageInfo));
+
+				if (isPadding)
+				{
+					paddingPageOffset = pageInfo.fileOffset;
+					++numPaddingPages;
+				}
+				if (!reused)
+				{
+					pageDataSize += pageInfo.sizeInBytes;
+				}
 				++pagesSoFar;
 			}
 		}
 	}
 
+	// Mip tail info. The data goes after the pages:
+	VTFF::MipTailInfo mipTailInfo;
+	std::memset(&mipTailInfo, 0, sizeof(mipTailInfo));
+	if (!mipTailLevels.empty())
+	{
+		mipTailInfo.width      = mipTailLevels.front().getWidth();
+		mipTailInfo.height     = mipTailLevels.front().getHeight();
+		mipTailInfo.numLevels  = static_cast<uint32_t>(mipTailLevels.size());
+		mipTailInfo.fileOffset = pageDataStart + pageDataSize;
+		for (const FloatImageBuffer & tailLevel : mipTailLevels)
+		{
+			mipTailInfo.sizeInBytes += tailLevel.getWidth() * tailLevel.getHeight() * 4; // Fixed to RGBA!
+		}
+	}
+	file.write(reinterpret_cast<const char *>(&mipTailInfo), sizeof(mipTailInfo));
+
+	// Reduced resolution page info:
+	VTFF::PageStorageInfo storageInfo;
+	std::memset(&storageInfo, 0, sizeof(storageInfo));
+	storageInfo.upsampleFilter     = static_cast<uint32_t>(opts.textureFilter);
+	storageInfo.numHalfResPages    = static_cast<uint32_t>(std::count(storageShifts.begin(), storageShifts.end(), 1));
+	storageInfo.numQuarterResPages = static_cast<uint32_t>(std::count(storageShifts.begin(), storageShifts.end(), 2));
+	storageInfo.maxError           = static_cast<uint32_t>(maxError);
+	file.write(reinterpret_cast<const char *>(&storageInfo), sizeof(storageInfo));
+
+	if (opts.stdoutVerbose && (numPaddingPages != 0))
+	{
+		std::printf("%zu padding pages past the image share a single stored page.\n", numPaddingPages);
+	}
+
 	// Now the actual page pixels are written:
+	pagesSoFar = 0;
+	bool paddingPageWritten = false;
 	for (uint32_t l = 0; l < numLevels; ++l)
 	{
 		const MipMapLevel & vtLevel = pageFileLevels[l];
@@ -559,8 +1214,26 @@ void PageFileBuilder::writeVTFF() const
 		Image rgbaImage;
 		for (uint32_t y = 0; y < vtLevel.tilesY; ++y)
 		{
-			for (uint32_t x = 0; x < vtLevel.tilesX; ++x)
+			for (uint32_t x = 0; x < vtLevel.tilesX; ++x, ++pagesSoFar)
 			{
+				if (vtLevel.isPaddingTile(x, y))
+				{
+					if (!paddingPageWritten)
+					{
+						const std::vector<char> zeros(reducedPageSizeBytes(header.pageSize, 0), 0);
+						file.write(zeros.data(), zeros.size());
+						paddingPageWritten = true;
+					}
+					continue;
+				}
+
+				if (storageShifts[pagesSoFar] != 0)
+				{
+					const std::vector<uint8_t> & reduced = reducedPages[pagesSoFar];
+					file.write(reinterpret_cast<const char *>(reduced.data()), reduced.size());
+					continue;
+				}
+
 				const FloatImageBuffer & rawImage = vtLevel.getTileAt(x, y);
 				rawImage.toImageRgbaU8(rgbaImage); // Fixed to RGBA!
 
@@ -569,11 +1242,717 @@ void PageFileBuilder::writeVTFF() const
 		}
 	}
 
+	// And the mip tail levels, largest first:
+	Image rgbaImage;
+	for (const FloatImageBuffer & tailLevel : mipTailLevels)
+	{
+		tailLevel.toImageRgbaU8(rgbaImage);
+		file.write(rgbaImage.getDataPtr<char>(), rgbaImage.getDataSizeBytes());
+	}
+
 	if (opts.stdoutVerbose)
 	{
 		std::printf("Finished writing VTFF output.\n");
 	}
 }
 
+// ======================================================
+// PageFileBuilder atlas mode:
+// ======================================================
+
+struct PageFileBuilder::AtlasTexture
+{
+	std::string name;                   // Source file name, without path and extension.
+	std::unique_ptr<MipMapper> mipMaps; // Independent mip chain of this texture.
+	int srcWidth  = 0;                  // Size of the source image.
+	int srcHeight = 0;
+	int width     = 0;                  // Packed rect size at level 0, in pixels. Never less than the source.
+	int height    = 0;
+	int x         = 0;                  // Level 0 position in the atlas, in pixels. Top-left origin.
+	int y         = 0;
+	int alignment = 1;                  // Packing alignment, in packer units.
+
+	// Rect covered at a given level. Never less than a pixel, so tiny
+	// textures still contribute their average color to the coarse levels.
+	void getLevelRect(const unsigned int level, int & x0, int & y0, int & w, int & h) const
+	{
+		x0 = (x >> level);
+		y0 = (y >> level);
+		w  = std::max(((x + width)  >> level) - x0, 1);
+		h  = std::max(((y + height) >> level) - y0, 1);
+	}
+
+	// True if the texture covers whole pages of its own at a given level.
+	bool ownsPagesAt(const unsigned int level, const int contentSize) const
+	{
+		int x0, y0, w, h;
+		getLevelRect(level, x0, y0, w, h);
+		return ((x0 % contentSize) == 0) && ((y0 % contentSize) == 0) &&
+		       ((w  % contentSize) == 0) && ((h  % contentSize) == 0);
+	}
+
+	// Image of a given level, placed at the top-left of the level rect (w, h).
+	// It is the texture's own mipmap, unless the chain stopped short of this level
+	// or the mip is larger than the rect. Then it is reduced, never enlarged.
+	// Copies of it into the rect clamp to its edges to fill the rest.
+	const FloatImageBuffer & getLevelImage(const unsigned int level, const int w, const int h,
+	                                       const Filter & filter, FloatImageBuffer & scratch) const
+	{
+		const uint32_t levelW = static_cast<uint32_t>(std::min(std::max(srcWidth  >> level, 1), w));
+		const uint32_t levelH = static_cast<uint32_t>(std::min(std::max(srcHeight >> level, 1), h));
+
+		const size_t mip = std::min(static_cast<size_t>(level), mipMaps->getNumMipMapLevels() - 1);
+		const FloatImageBuffer * image = mipMaps->getMipMapLevel(mip);
+		assert(image != nullptr);
+
+		if ((image->getWidth() == levelW) && (image->getHeight() == levelH))
+		{
+			return *image;
+		}
+
+		image->resize(scratch, filter, levelW, levelH, FloatImageBuffer::Clamp);
+		return scratch;
+	}
+};
+
+std::string PageFileBuilder::atlasRemapFileName(const std::string & outputFile)
+{
+	return removeExtension(outputFile) + ".vtatlas";
+}
+
+void PageFileBuilder::generateAtlasPageFile()
+{
+	// Steps:
+	// - Load every image and size its rect, in whole pages unless pages can be shared;
+	// - Pack the rects into the smallest square virtual texture that holds them;
+	// - Build the mip chain of each texture independently;
+	// - Compose each atlas level from the texture mipmaps and break it into pages;
+	// - Write output file(s) and the remap table.
+
+	if (opts.stdoutVerbose)
+	{
+		std::printf("Beginning atlas page file processing with %u images...\n",
+				static_cast<unsigned int>(atlasInputFiles.size()));
+	}
+
+	std::unique_ptr<Filter> textureFilter = Filter::createFilter(opts.textureFilter);
+
+	std::vector<AtlasTexture> textures(atlasInputFiles.size());
+	loadAtlasTextures(textures);
+	sourcePixelFormat = PixelFormat::RgbaU8; // All inputs are forced to RGBA.
+
+	const int atlasSize   = packAtlasTextures(textures);
+	const int contentSize = opts.pageContentSizePixels;
+	setBasePageLayout(atlasSize, atlasSize);
+
+	// Each texture gets its own chain, so the coarse levels of the
+	// atlas never blend the colors of neighbouring textures.
+	for (AtlasTexture & tex : textures)
+	{
+		tex.mipMaps->buildMipMapChain(*textureFilter, FloatImageBuffer::Clamp);
+	}
+
+	unsigned int numMipMapLevels = 0;
+	for (int size = atlasSize; (size > 0) && (numMipMapLevels < static_cast<unsigned int>(opts.maxMipLevels)); size /= 2)
+	{
+		if (opts.stopOn1PageMip && (size < contentSize))
+		{
+			break;
+		}
+		++numMipMapLevels;
+	}
+
+	const uint32_t numComponents = textures[0].mipMaps->getMipMapLevel(0)->getNumComponents();
+	const TPixel4<float> clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+	FloatImageBuffer atlasLevel;
+	FloatImageBuffer scratch;
+
+	for (unsigned int l = 0; l < numMipMapLevels; ++l)
+	{
+		const uint32_t levelSize = static_cast<uint32_t>(atlasSize) >> l;
+
+		atlasLevel.freeImageStorage();
+		atlasLevel.allocImageStorage(numComponents, levelSize, levelSize);
+		atlasLevel.colorFill(clearColor);
+
+		int x0, y0, w, h;
+		for (const AtlasTexture & tex : textures)
+		{
+			tex.getLevelRect(l, x0, y0, w, h);
+			const FloatImageBuffer & source = tex.getLevelImage(l, w, h, *textureFilter, scratch);
+			source.copyRect(atlasLevel, 0, 0, x0, y0, w, h, false, FloatImageBuffer::Clamp);
+		}
+
+		processImage(atlasLevel, l);
+
+		// Pages owned by a single texture are cut again from its own image,
+		// so the page borders clamp to the texture's edges instead of
+		// picking up pixels from the neighbours.
+		if (!opts.atlasSharePages)
+		{
+			for (const AtlasTexture & tex : textures)
+			{
+				if (!tex.ownsPagesAt(l, contentSize))
+				{
+					continue;
+				}
+
+				tex.getLevelRect(l, x0, y0, w, h);
+				processAtlasTexture(tex, tex.getLevelImage(l, w, h, *textureFilter, scratch), l, levelSize);
+			}
+		}
+	}
+
+	// The last composed level is still in the buffer.
+	if (opts.writeMipTail && (numMipMapLevels != 0))
+	{
+		buildMipTail(atlasLevel, numMipMapLevels - 1, *textureFilter);
+	}
+
+	writePageFile();
+	writeAtlasRemapTable(textures, atlasSize);
+}
+
+void PageFileBuilder::loadAtlasTextures(std::vector<AtlasTexture> & textures) const
+{
+	const int contentSize = opts.pageContentSizePixels;
+
+	for (size_t i = 0; i < atlasInputFiles.size(); ++i)
+	{
+		AtlasTexture & tex = textures[i];
+		const std::string & fileName = atlasInputFiles[i];
+
+		tex.name = textureNameFromFile(fileName);
+		if (tex.name.empty() || tex.name.length() >= VTAT::MaxNameLength)
+		{
+			error("Bad texture name for \"" + fileName + "\"! Max length is " + std::to_string(VTAT::MaxNameLength - 1) + ".");
+		}
+
+		Image srcImage;
+		std::string imageLoadError;
+
+		// Forced to RGBA, same as the single image path.
+		if (!srcImage.loadFromFile(fileName, &imageLoadError, /* forceRGBA = */ true))
+		{
+			error("Can't load input image file \"" + fileName + "\"! " + imageLoadError);
+		}
+		if (!FloatImageBuffer::isImageFormatCompatible(srcImage.getFormat()))
+		{
+			error(fileName + ": " + std::string(PixelFormat::toString(srcImage.getFormat())) + " => image format currently not supported!");
+		}
+
+		FloatImageBuffer floatImage(srcImage);
+		srcImage.freeImageStorage();
+
+		tex.srcWidth  = static_cast<int>(floatImage.getWidth());
+		tex.srcHeight = static_cast<int>(floatImage.getHeight());
+
+		if (opts.atlasSharePages)
+		{
+			tex.width     = tex.srcWidth;
+			tex.height    = tex.srcHeight;
+			tex.alignment = 1;
+		}
+		else
+		{
+			// Round the rect up to whole pages, then to a multiple of 2^N pages, so
+			// the texture keeps pages of its own for N levels past the first one.
+			// The image isn't resampled to fill it. The UV scale only covers the
+			// image, and the rest of the rect repeats its edges, for filtering.
+			int pagesX = (tex.srcWidth  + contentSize - 1) / contentSize;
+			int pagesY = (tex.srcHeight + contentSize - 1) / contentSize;
+
+			int alignedLevels = 0;
+			while ((alignedLevels < opts.atlasAlignedLevels) && ((2 << alignedLevels) <= std::min(pagesX, pagesY)))
+			{
+				++alignedLevels;
+			}
+
+			tex.alignment = (1 << alignedLevels);
+			pagesX = roundUpTo(pagesX, tex.alignment);
+			pagesY = roundUpTo(pagesY, tex.alignment);
+
+			tex.width  = pagesX * contentSize;
+			tex.height = pagesY * contentSize;
+		}
+
+		if (opts.stdoutVerbose && ((tex.width != tex.srcWidth) || (tex.height != tex.srcHeight)))
+		{
+			std::printf("Padding \"%s\" (%d, %d) to a page aligned rect of (%d, %d)...\n",
+					tex.name.c_str(), tex.srcWidth, tex.srcHeight, tex.width, tex.height);
+		}
+
+		tex.mipMaps.reset(new MipMapper(std::move(floatImage)));
+	}
+}
+
+int PageFileBuilder::packAtlasTextures(std::vector<AtlasTexture> & textures) const
+{
+	// Whole pages are the packing unit, unless pages can be shared.
+	const int contentSize = opts.pageContentSizePixels;
+	const int unit = opts.atlasSharePages ? 1 : contentSize;
+
+	// Tallest first, then widest.
+	std::vector<size_t> order(textures.size());
+	std::iota(std::begin(order), std::end(order), 0);
+	std::sort(std::begin(order), std::end(order),
+		[&textures](size_t a, size_t b) -> bool
+		{
+			if (textures[a].height != textures[b].height)
+			{
+				return textures[a].height > textures[b].height;
+			}
+			return textures[a].width > textures[b].width;
+		}
+	);
+
+	// Start at the smallest power-of-two number of pages with enough
+	// area for all textures, then double it until everything fits.
+	uint64_t totalArea = 0;
+	for (const AtlasTexture & tex : textures)
+	{
+		totalArea += static_cast<uint64_t>(tex.width) * static_cast<uint64_t>(tex.height);
+	}
+
+	int sizeInPages = 1;
+	while ((static_cast<uint64_t>(sizeInPages * contentSize) * static_cast<uint64_t>(sizeInPages * contentSize)) < totalArea)
+	{
+		sizeInPages *= 2;
+	}
+
+	for (;;)
+	{
+		if (sizeInPages > MaxAtlasPagesPerAxis)
+		{
+			error("Textures don't fit in a virtual texture of " + std::to_string(MaxAtlasPagesPerAxis) + " pages per axis!");
+		}
+
+		SkylinePacker packer((sizeInPages * contentSize) / unit);
+		bool allFit = true;
+
+		for (size_t i : order)
+		{
+			AtlasTexture & tex = textures[i];
+			int px, py;
+			if (!packer.insert(tex.width / unit, tex.height / unit, tex.alignment, px, py))
+			{
+				allFit = false;
+				break;
+			}
+			tex.x = px * unit;
+			tex.y = py * unit;
+		}
+
+		if (allFit)
+		{
+			break;
+		}
+		sizeInPages *= 2;
+	}
+
+	const int atlasSize = sizeInPages * contentSize;
+	if (opts.stdoutVerbose)
+	{
+		std::printf("Packed %u textures into a %dx%d atlas (%d pages per axis), %.1f%% used.\n",
+				static_cast<unsigned int>(textures.size()), atlasSize, atlasSize, sizeInPages,
+				(static_cast<double>(totalArea) / (static_cast<double>(atlasSize) * atlasSize)) * 100.0);
+	}
+
+	return atlasSize;
+}
+
+void PageFileBuilder::processAtlasTexture(const AtlasTexture & tex, const FloatImageBuffer & source,
+                                          const unsigned int level, const uint32_t levelSize)
+{
+	const int contentSize = opts.pageContentSizePixels;
+	const int borderSize  = opts.pageBorderSizePixels;
+
+	int x0, y0, w, h;
+	tex.getLevelRect(level, x0, y0, w, h);
+
+	// Rows are counted from the bottom of the atlas when the source is flipped (see processImage()).
+	// The image sits at the top of the rect, so a flipped copy skips the padding rows below it.
+	const int rectY = opts.flipSourceVertically ? (static_cast<int>(levelSize) - y0 - h) : y0;
+	const int padY  = opts.flipSourceVertically ? (h - static_cast<int>(source.getHeight())) : 0;
+
+	MipMapLevel & vtLevel = pageFileLevels[level];
+	for (int ty = rectY / contentSize; ty < (rectY + h) / contentSize; ++ty)
+	{
+		for (int tx = x0 / contentSize; tx < (x0 + w) / contentSize; ++tx)
+		{
+			FloatImageBuffer & dest = vtLevel.getTileAt(tx, ty);
+
+			source.copyRect(dest,
+				(tx * contentSize - borderSize - x0),
+				(ty * contentSize - borderSize - rectY - padY),
+				0, 0,
+				(opts.pageSizePixels + borderSize),
+				(opts.pageSizePixels + borderSize),
+				opts.flipSourceVertically,
+				FloatImageBuffer::Clamp);
+
+			if (opts.flipTilesVertically)
+			{
+				dest.flipVInPlace();
+			}
+		}
+	}
+}
+
+void PageFileBuilder::writeAtlasRemapTable(const std::vector<AtlasTexture> & textures, const int atlasSize) const
+{
+	const std::string fileName = atlasRemapFileName(outputFileName);
+
+	std::ofstream file;
+	errno = 0;
+	file.open(fileName, std::ofstream::out | std::ofstream::binary);
+	if (!file.is_open())
+	{
+		error("Failed to create atlas remap table! Reason: " + std::string(std::strerror(errno)));
+	}
+
+	VTAT::Header header;
+	header.magic       = VTAT::Magic;
+	header.version     = VTAT::Version;
+	header.numTextures = static_cast<uint32_t>(textures.size());
+	header.atlasWidth  = static_cast<uint32_t>(atlasSize);
+	header.atlasHeight = static_cast<uint32_t>(atlasSize);
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+	const float invSize = 1.0f / static_cast<float>(atlasSize);
+	for (const AtlasTexture & tex : textures)
+	{
+		VTAT::Entry entry;
+		std::memset(&entry, 0, sizeof(entry));
+		std::strncpy(entry.name, tex.name.c_str(), VTAT::MaxNameLength - 1);
+
+		// Only the image is mapped, not the padding of its rect. It sits at the
+		// top-left of the rect, and V is measured from the bottom of the atlas
+		// when the source is flipped.
+		const int v = opts.flipSourceVertically ? (atlasSize - tex.y - tex.srcHeight) : tex.y;
+		entry.scaleU    = tex.srcWidth  * invSize;
+		entry.scaleV    = tex.srcHeight * invSize;
+		entry.biasU     = tex.x * invSize;
+		entry.biasV     = v * invSize;
+		entry.x         = static_cast<uint32_t>(tex.x);
+		entry.y         = static_cast<uint32_t>(tex.y);
+		entry.width     = static_cast<uint32_t>(tex.width);
+		entry.height    = static_cast<uint32_t>(tex.height);
+		entry.srcWidth  = static_cast<uint32_t>(tex.srcWidth);
+		entry.srcHeight = static_cast<uint32_t>(tex.srcHeight);
+		file.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+	}
+
+	if (!file.good())
+	{
+		error("Failed to write atlas remap table \"" + fileName + "\"!");
+	}
+
+	if (opts.stdoutVerbose)
+	{
+		std::printf("Atlas remap table written to \"%s\".\n", fileName.c_str());
+	}
+}
+
+// ======================================================
+// VTFF archive packing:
+// ======================================================
+
+namespace {
+
+struct PackInput
+{
+	std::string fileName;
+	std::string textureName;
+	VTFF::Header header;
+	std::vector<VTFF::MipLevelInfo> levels;
+	std::vector<VTFF::PageInfo> pages;
+	std::vector<VTFF::PageInfo> archivePages; // Same pages, with archive offsets.
+	VTFF::MipTailInfo mipTail;                // With the input file offset. Zero levels if none.
+	uint32_t upsampleFilter = 0;
+};
+
+void packError(const std::string & errorMessage)
+{
+	throw PageFileBuilderError("VTFA packing error: " + errorMessage);
+}
+
+void readPackInput(std::ifstream & file, PackInput & input)
+{
+	file.read(reinterpret_cast<char *>(&input.header), sizeof(input.header));
+	if (!file.good())
+	{
+		packError("Unable to read the header of \"" + input.fileName + "\"!");
+	}
+
+	if (input.header.magic != VTFF::Magic || input.header.version < VTFF::MinVersion || input.header.version > VTFF::Version)
+	{
+		packError("\"" + input.fileName + "\" is not a valid VTFF file!");
+	}
+	if (input.header.numMipMapLevels == 0 || input.header.numMipMapLevels > MaxVTMipLevels)
+	{
+		packError("\"" + input.fileName + "\" has a bad number of mipmap levels!");
+	}
+
+	// Level and page records are converted to the current layout as they are read.
+	const uint32_t levelInfoSize = VTFF::getMipLevelInfoSize(input.header.version);
+	const uint32_t pageInfoSize  = VTFF::getPageInfoSize(input.header.version);
+	uint8_t levelRecord[sizeof(VTFF::MipLevelInfo)];
+	std::vector<uint8_t> records;
+
+	input.levels.resize(input.header.numMipMapLevels);
+	for (uint32_t l = 0; l < input.header.numMipMapLevels; ++l)
+	{
+		VTFF::MipLevelInfo & levelInfo = input.levels[l];
+		file.read(reinterpret_cast<char *>(levelRecord), levelInfoSize);
+		VTFF::unpackMipLevelInfo(levelRecord, input.header.version, input.header.pageContentSize, levelInfo);
+
+		const size_t firstPage = input.pages.size();
+		const size_t numPages  = levelInfo.numPagesX * levelInfo.numPagesY;
+		input.pages.resize(firstPage + numPages);
+		records.resize(numPages * pageInfoSize);
+		file.read(reinterpret_cast<char *>(records.data()), records.size());
+
+		if (!file.good())
+		{
+			packError("Unable to read the page index of \"" + input.fileName + "\"!");
+		}
+		VTFF::unpackPageInfos(records.data(), input.header.version, &input.pages[firstPage], numPages);
+	}
+
+	// Mip tail, copied after the page data of the archive. Older files have none.
+	std::memset(&input.mipTail, 0, sizeof(input.mipTail));
+	if (input.header.version >= VTFF::FirstVersionWithMipTail)
+	{
+		file.read(reinterpret_cast<char *>(&input.mipTail), sizeof(input.mipTail));
+		if (!file.good())
+		{
+			packError("Unable to read the mip tail info of \"" + input.fileName + "\"!");
+		}
+
+		uint64_t expectedBytes = 0;
+		for (uint32_t l = 0; l < std::min(input.mipTail.numLevels, 32u); ++l)
+		{
+			expectedBytes += uint64_t(std::max(input.mipTail.width >> l, 1u)) * std::max(input.mipTail.height >> l, 1u) * 4;
+		}
+		if (input.mipTail.numLevels > 32 || input.mipTail.sizeInBytes != expectedBytes)
+		{
+			packError("\"" + input.fileName + "\" has a bad mip tail!");
+		}
+	}
+
+	// Filter to upsample the reduced resolution pages with, if any.
+	if (input.header.version >= VTFF::FirstVersionWithPageStorage)
+	{
+		VTFF::PageStorageInfo storageInfo;
+		file.read(reinterpret_cast<char *>(&storageInfo), sizeof(storageInfo));
+		if (!file.good())
+		{
+			packError("Unable to read the page storage info of \"" + input.fileName + "\"!");
+		}
+		input.upsampleFilter = storageInfo.upsampleFilter;
+	}
+}
+
+} // namespace {}
+
+void packVTFFArchive(const std::vector<std::string> & inputFiles, const std::string & outputFile, const bool verbose)
+{
+	if (inputFiles.empty())
+	{
+		packError("No input files!");
+	}
+
+	// Load the index of every input. The page data is only copied at the end.
+	std::vector<PackInput> inputs(inputFiles.size());
+	uint64_t totalLevels = 0;
+	uint64_t totalPages  = 0;
+
+	for (size_t i = 0; i < inputFiles.size(); ++i)
+	{
+		PackInput & input = inputs[i];
+		input.fileName = inputFiles[i];
+
+		// Name is the file name without path and extension. Must be unique.
+		input.textureName = textureNameFromFile(input.fileName);
+		if (input.textureName.empty() || input.textureName.length() >= VTFA::MaxNameLength)
+		{
+			packError("Bad texture name for \"" + input.fileName + "\"! Max length is " + std::to_string(VTFA::MaxNameLength - 1) + ".");
+		}
+		for (size_t j = 0; j < i; ++j)
+		{
+			if (inputs[j].textureName == input.textureName)
+			{
+				packError("Duplicate texture name \"" + input.textureName + "\"!");
+			}
+		}
+
+		std::ifstream file(input.fileName, std::ifstream::in | std::ifstream::binary);
+		if (!file.is_open())
+		{
+			packError("Failed to open \"" + input.fileName + "\"!");
+		}
+		readPackInput(file, input);
+
+		totalLevels += input.levels.size();
+		totalPages  += input.pages.size();
+	}
+
+	if (totalLevels > UINT32_MAX || totalPages > UINT32_MAX)
+	{
+		packError("Too many pages for a single archive!");
+	}
+
+	VTFA::Header header;
+	header.magic         = VTFA::Magic;
+	header.version       = VTFA::Version;
+	header.numTextures   = static_cast<uint32_t>(inputs.size());
+	header.totalLevels   = static_cast<uint32_t>(totalLevels);
+	header.totalPages    = static_cast<uint32_t>(totalPages);
+	header.pageDataStart = sizeof(VTFA::Header) +
+	                       (inputs.size() * sizeof(VTFA::TextureEntry)) +
+	                       (totalLevels   * sizeof(VTFF::MipLevelInfo)) +
+	                       (totalPages    * sizeof(VTFF::PageInfo));
+
+	// Page infos rebased to the archive. Pages sharing their data in
+	// the input (padding pages) keep sharing it in the archive.
+	uint64_t pageDataOffset = header.pageDataStart;
+	for (PackInput & input : inputs)
+	{
+		std::unordered_map<uint64_t, uint64_t> rebasedOffsets;
+		input.archivePages = input.pages;
+		for (VTFF::PageInfo & pageInfo : input.archivePages)
+		{
+			const auto rebased = rebasedOffsets.emplace(pageInfo.fileOffset, pageDataOffset);
+			if (rebased.second)
+			{
+				pageDataOffset += pageInfo.sizeInBytes;
+			}
+			pageInfo.fileOffset = rebased.first->second;
+		}
+	}
+
+	// The mip tails follow the page data, in the same order.
+	uint64_t mipTailOffset = pageDataOffset;
+	std::vector<uint64_t> mipTailOffsets(inputs.size());
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		mipTailOffsets[i] = mipTailOffset;
+		mipTailOffset += inputs[i].mipTail.sizeInBytes;
+	}
+
+	if (verbose)
+	{
+		std::printf("Packing %u VTFF files into archive \"%s\"...\n", header.numTextures, outputFile.c_str());
+		std::printf("Archive has %u mipmap levels and %u pages.\n", header.totalLevels, header.totalPages);
+	}
+
+	std::ofstream file;
+	errno = 0;
+	file.open(outputFile, std::ofstream::out | std::ofstream::binary);
+	if (!file.is_open())
+	{
+		packError("Failed to create output file! Reason: " + std::string(std::strerror(errno)));
+	}
+
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+	// Directory:
+	uint32_t firstLevel = 0;
+	uint32_t firstPage  = 0;
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		const PackInput & input = inputs[i];
+		VTFA::TextureEntry entry;
+		std::memset(&entry, 0, sizeof(entry));
+		std::strncpy(entry.name, input.textureName.c_str(), VTFA::MaxNameLength - 1);
+		entry.pixelFormat     = input.header.pixelFormat;
+		entry.numMipMapLevels = input.header.numMipMapLevels;
+		entry.pageContentSize = input.header.pageContentSize;
+		entry.pageSize        = input.header.pageSize;
+		entry.borderSize      = input.header.borderSize;
+		entry.firstLevel      = firstLevel;
+		entry.firstPage       = firstPage;
+		entry.upsampleFilter  = input.upsampleFilter;
+		entry.mipTail         = input.mipTail;
+		entry.mipTail.fileOffset = (input.mipTail.numLevels != 0) ? mipTailOffsets[i] : 0;
+		file.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+
+		firstLevel += static_cast<uint32_t>(input.levels.size());
+		firstPage  += static_cast<uint32_t>(input.pages.size());
+	}
+
+	// Global level table:
+	for (const PackInput & input : inputs)
+	{
+		file.write(reinterpret_cast<const char *>(input.levels.data()), input.levels.size() * sizeof(VTFF::MipLevelInfo));
+	}
+
+	// Global page table:
+	for (const PackInput & input : inputs)
+	{
+		file.write(reinterpret_cast<const char *>(input.archivePages.data()), input.archivePages.size() * sizeof(VTFF::PageInfo));
+	}
+
+	// Page data, copied one page at a time, in the same order:
+	std::vector<char> pageBuffer;
+	for (const PackInput & input : inputs)
+	{
+		std::ifstream inFile(input.fileName, std::ifstream::in | std::ifstream::binary);
+		if (!inFile.is_open())
+		{
+			packError("Failed to reopen \"" + input.fileName + "\"!");
+		}
+
+		std::unordered_set<uint64_t> copiedOffsets;
+		for (const VTFF::PageInfo & pageInfo : input.pages)
+		{
+			if (!copiedOffsets.insert(pageInfo.fileOffset).second)
+			{
+				continue;
+			}
+
+			pageBuffer.resize(pageInfo.sizeInBytes);
+			inFile.seekg(static_cast<std::streamoff>(pageInfo.fileOffset));
+			inFile.read(pageBuffer.data(), pageBuffer.size());
+			if (!inFile.good())
+			{
+				packError("Failed to read page data from \"" + input.fileName + "\"!");
+			}
+			file.write(pageBuffer.data(), pageBuffer.size());
+		}
+	}
+
+	// Mip tails, each copied as a single chunk:
+	for (const PackInput & input : inputs)
+	{
+		if (input.mipTail.numLevels == 0)
+		{
+			continue;
+		}
+
+		std::ifstream inFile(input.fileName, std::ifstream::in | std::ifstream::binary);
+		pageBuffer.resize(input.mipTail.sizeInBytes);
+		inFile.seekg(static_cast<std::streamoff>(input.mipTail.fileOffset));
+		inFile.read(pageBuffer.data(), pageBuffer.size());
+		if (!inFile.good())
+		{
+			packError("Failed to read the mip tail of \"" + input.fileName + "\"!");
+		}
+		file.write(pageBuffer.data(), pageBuffer.size());
+	}
+
+	if (!file.good())
+	{
+		packError("Failed to write output file \"" + outputFile + "\"!");
+	}
+
+	if (verbose)
+	{
+		std::printf("Finished writing VTFA archive (%llu bytes).\n", static_cast<unsigned long long>(mipTailOffset));
+	}
+}
+
 } // namespace tool {}
 } // namespace vt {}